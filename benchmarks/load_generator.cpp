@@ -0,0 +1,328 @@
+/* load_generator.cpp
+ *
+ * End-to-end load test for an InferenceEngine. Loads a .minn model, makes
+ * synthetic inputs of its input shape and drives it from N client threads,
+ * either closed loop (each client sends its next request as soon as the last
+ * one returns) or open loop at a fixed total rate. Reports throughput,
+ * latency percentiles, CPU utilization and resident memory.
+ *
+ * Usage: load_generator model.minn [--clients N] [--qps R] [--batch B]
+ *                       [--batcher] [--engine-threads T] [--duration s]
+ *                       [--warmup s] [--mmap] [--json results.json]
+ *   --qps R       open loop: R requests per second over all clients, each
+ *                 latency is measured from when its request was due, so a
+ *                 server falling behind shows up as queueing delay
+ *   --batch B     every request is a predictBatch of B samples
+ *   --batcher     clients submit single samples to a DynamicBatcher instead
+ *                 of calling predict themselves
+ */
+
+#include "dynamic_batcher.h"
+#include "inference_engine.h"
+#include "latency_histogram.h"
+#include "thread_pool.h"
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace mininn;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr size_t INPUTS_PER_CLIENT = 16;
+
+    enum Phase { WARMUP, MEASURE, STOP };
+
+    struct Options
+    {
+        std::string model_path;
+        size_t clients = 1;
+        double qps = 0.0;                 // 0 -> closed loop
+        size_t batch = 0;                 // 0 -> predict, otherwise predictBatch of this many
+        bool batcher = false;
+        size_t engine_threads = 1;
+        double duration = 10.0;           // seconds
+        double warmup = 2.0;
+        bool mmap = false;
+        std::string json_path;
+    };
+
+    void printUsage(const char* program)
+    {
+        std::cerr << "Usage: " << program << " model.minn [--clients N] [--qps R] [--batch B] [--batcher]"
+                  << " [--engine-threads T] [--duration s] [--warmup s] [--mmap] [--json results.json]\n";
+    }
+
+    double cpuSeconds()
+    {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+               (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    }
+
+    size_t residentBytes()
+    {
+        std::ifstream statm("/proc/self/statm");
+        size_t pages = 0, resident = 0;
+        statm >> pages >> resident;
+        return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+
+    size_t peakResidentBytes()
+    {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;   // kilobytes on linux
+    }
+
+    std::vector<Tensor> makeInputs(const std::vector<size_t>& shape, size_t count, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+        std::vector<Tensor> inputs;
+        for (size_t i = 0; i < count; ++i)
+        {
+            Tensor input(shape);
+            for (size_t j = 0; j < input.size(); ++j)
+            {
+                input.data()[j] = uniform(rng);
+            }
+            inputs.push_back(std::move(input));
+        }
+        return inputs;
+    }
+
+    // one client: sends requests until told to stop, records the ones that start while measuring
+    void runClient(const Options& options, const InferenceEngine& engine, DynamicBatcher* batcher, size_t client,
+                   const std::atomic<int>& phase, LatencyHistogram& latency, std::atomic<size_t>& completed)
+    {
+        ExecutionContext context = engine.createContext();
+        const std::vector<Tensor> inputs = makeInputs(engine.getInputShape(),
+                                                      std::max<size_t>(INPUTS_PER_CLIENT, options.batch), client + 1);
+        const std::vector<Tensor> batch_inputs(inputs.begin(), inputs.begin() + options.batch);
+        Tensor output(engine.getOutputShape());
+
+        // open loop: this client's share of the rate, starting at a staggered offset
+        const bool open_loop = options.qps > 0.0;
+        const auto interval = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(open_loop ? options.clients / options.qps : 0.0));
+        Clock::time_point due = Clock::now() + interval * client / options.clients;
+
+        for (size_t n = 0; phase.load(std::memory_order_relaxed) != STOP; ++n)
+        {
+            if (open_loop)
+            {
+                std::this_thread::sleep_until(due);
+            }
+            const Clock::time_point start = open_loop ? due : Clock::now();
+            const bool measured = phase.load(std::memory_order_relaxed) == MEASURE;
+
+            if (batcher)
+            {
+                batcher->submit(inputs[n % inputs.size()]).get();
+            }
+            else if (options.batch > 0)
+            {
+                engine.predictBatch(batch_inputs, context);
+            }
+            else
+            {
+                engine.predict(inputs[n % inputs.size()], output, context);
+            }
+
+            if (measured)
+            {
+                latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start));
+                completed.fetch_add(1, std::memory_order_relaxed);
+            }
+            due += interval;
+        }
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const bool has_value = i + 1 < argc;
+            if (std::strcmp(argv[i], "--clients") == 0 && has_value)
+            {
+                options.clients = std::strtoul(argv[++i], nullptr, 10);
+            }
+            else if (std::strcmp(argv[i], "--qps") == 0 && has_value)
+            {
+                options.qps = std::strtod(argv[++i], nullptr);
+            }
+            else if (std::strcmp(argv[i], "--batch") == 0 && has_value)
+            {
+                options.batch = std::strtoul(argv[++i], nullptr, 10);
+            }
+            else if (std::strcmp(argv[i], "--batcher") == 0)
+            {
+                options.batcher = true;
+            }
+            else if (std::strcmp(argv[i], "--engine-threads") == 0 && has_value)
+            {
+                options.engine_threads = std::strtoul(argv[++i], nullptr, 10);
+            }
+            else if (std::strcmp(argv[i], "--duration") == 0 && has_value)
+            {
+                options.duration = std::strtod(argv[++i], nullptr);
+            }
+            else if (std::strcmp(argv[i], "--warmup") == 0 && has_value)
+            {
+                options.warmup = std::strtod(argv[++i], nullptr);
+            }
+            else if (std::strcmp(argv[i], "--mmap") == 0)
+            {
+                options.mmap = true;
+            }
+            else if (std::strcmp(argv[i], "--json") == 0 && has_value)
+            {
+                options.json_path = argv[++i];
+            }
+            else if (argv[i][0] != '-' && options.model_path.empty())
+            {
+                options.model_path = argv[i];
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        return !options.model_path.empty() && options.clients > 0 && options.duration > 0.0 &&
+               options.warmup >= 0.0 && options.qps >= 0.0 && !(options.batcher && options.batch > 0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        auto engine = createInferenceEngine(options.model_path, options.mmap ? LoadMode::MMAP : LoadMode::COPY);
+        engine->setNumThreads(options.engine_threads);
+        const size_t resident_after_load = residentBytes();
+
+        std::unique_ptr<DynamicBatcher> batcher;
+        if (options.batcher)
+        {
+            batcher = std::make_unique<DynamicBatcher>(*engine);
+        }
+
+        const char* mode = options.batcher ? "batcher" : options.batch > 0 ? "predictBatch" : "predict";
+        std::cout << "Load test: " << options.model_path << ", " << options.clients << " clients, " << mode;
+        if (options.batch > 0)
+        {
+            std::cout << " of " << options.batch;
+        }
+        if (options.qps > 0.0)
+        {
+            std::cout << ", open loop at " << options.qps << " requests/s";
+        }
+        else
+        {
+            std::cout << ", closed loop";
+        }
+        std::cout << ", " << engine->getNumThreads() << " engine threads, " << options.warmup << "s warmup + "
+                  << options.duration << "s\n";
+
+        std::atomic<int> phase(WARMUP);
+        std::atomic<size_t> completed(0);
+        std::vector<LatencyHistogram> latencies(options.clients);
+        std::vector<std::thread> clients;
+        for (size_t c = 0; c < options.clients; ++c)
+        {
+            clients.emplace_back(runClient, std::cref(options), std::cref(*engine), batcher.get(), c,
+                                 std::cref(phase), std::ref(latencies[c]), std::ref(completed));
+        }
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(options.warmup));
+        const double cpu_start = cpuSeconds();
+        const Clock::time_point start = Clock::now();
+        phase.store(MEASURE);
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(options.duration));
+        phase.store(STOP);
+        const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        const double cpu_used = cpuSeconds() - cpu_start;
+        const size_t resident = residentBytes();
+        // ru_maxrss lags behind statm for some mappings
+        const size_t peak_resident = std::max(peakResidentBytes(), resident);
+        for (auto& client : clients)
+        {
+            client.join();
+        }
+
+        LatencyHistogram latency;
+        for (const auto& histogram : latencies)
+        {
+            latency.merge(histogram);
+        }
+
+        const size_t requests = completed.load();
+        const size_t samples_per_request = options.batch > 0 ? options.batch : 1;
+        const double throughput = requests / elapsed;
+        const double cores_used = cpu_used / elapsed;
+        const size_t cores = ThreadPool::hardwareThreads();
+
+        std::printf("\nthroughput:   %.1f requests/s (%.1f samples/s), %zu requests in %.2fs\n", throughput,
+                    throughput * samples_per_request, requests, elapsed);
+        std::printf("latency (ms): mean %.3f  p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n",
+                    latency.mean().count(), latency.percentile(50).count(), latency.percentile(90).count(),
+                    latency.percentile(99).count(), latency.percentile(99.9).count(), latency.max().count());
+        std::printf("cpu:          %.2f cores busy (%.1f%% of %zu)\n", cores_used, 100.0 * cores_used / cores, cores);
+        std::printf("memory:       %.1f MB resident (%.1f MB after load, %.1f MB peak)\n", resident / 1048576.0,
+                    resident_after_load / 1048576.0, peak_resident / 1048576.0);
+        if (batcher)
+        {
+            std::printf("batcher:      %.2f requests per batch\n",
+                        batcher->getNumBatches() ? double(batcher->getNumRequests()) / batcher->getNumBatches() : 0.0);
+        }
+
+        if (!options.json_path.empty())
+        {
+            std::ofstream json(options.json_path);
+            if (!json.is_open())
+            {
+                throw std::runtime_error("Failed to open file for writing: " + options.json_path);
+            }
+            json << "{\"model\": \"" << options.model_path << "\", \"mode\": \"" << mode << "\", \"clients\": "
+                 << options.clients << ", \"qps_target\": " << options.qps << ", \"batch\": " << samples_per_request
+                 << ", \"engine_threads\": " << engine->getNumThreads() << ",\n \"duration_s\": " << elapsed
+                 << ", \"requests\": " << requests << ", \"requests_per_second\": " << throughput
+                 << ", \"samples_per_second\": " << throughput * samples_per_request
+                 << ",\n \"latency_ms\": {\"mean\": " << latency.mean().count()
+                 << ", \"p50\": " << latency.percentile(50).count() << ", \"p90\": " << latency.percentile(90).count()
+                 << ", \"p99\": " << latency.percentile(99).count() << ", \"p999\": " << latency.percentile(99.9).count()
+                 << ", \"max\": " << latency.max().count() << "},\n \"cpu_cores_busy\": " << cores_used
+                 << ", \"rss_bytes\": " << resident << ", \"peak_rss_bytes\": " << peak_resident << "}\n";
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
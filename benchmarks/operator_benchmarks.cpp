@@ -0,0 +1,369 @@
+/* operator_benchmarks.cpp
+ *
+ * Micro-benchmarks for the operators everything else is built from: matmul
+ * (square, tall-skinny and gemv shapes), the activations across sizes,
+ * Tensor copies, moves and elementwise ops, and LinearLayer::forward, plus
+ * end-to-end engine scenarios. Reports ns/op, GFLOP/s and GB/s (median over
+ * the repetitions) and can write the full statistics as JSON.
+ *
+ * Usage: operator_benchmarks [--filter a,b] [--repetitions N] [--min-time ms]
+ *                            [--quick] [--json results.json]
+ *                            [--baseline baseline.json [--threshold 0.1]]
+ *   --quick runs 3 short repetitions per benchmark (smoke test, noisy numbers).
+ *   --baseline compares against a stored --json run: benchmarks that look
+ *   slower by more than the threshold with non-overlapping 95% confidence
+ *   intervals are run again with twice the repetitions, and the ones still
+ *   slower fail the run (exit code 2).
+ *   MININN_CPU_TIER picks the kernel tier as usual.
+ */
+
+#include "benchmark.h"
+#include "inference_engine.h"
+#include "kernels.h"
+#include "model_loader.h"
+#include "tensor.h"
+#include "tensor_ops.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace mininn;
+
+namespace
+{
+    void printUsage(const char* program)
+    {
+        std::cerr << "Usage: " << program << " [--filter a,b] [--repetitions N] [--min-time ms] [--quick]"
+                  << " [--json results.json] [--baseline baseline.json [--threshold 0.1]]\n";
+    }
+
+    Tensor makeTensor(const std::vector<size_t>& shape, unsigned seed)
+    {
+        Tensor tensor(shape);
+        float* data = tensor.data();
+        for (size_t i = 0; i < tensor.size(); ++i)
+        {
+            data[i] = static_cast<float>((i * 2654435761u + seed) % 1000) / 500.0f - 1.0f;
+        }
+        return tensor;
+    }
+
+    std::string sizeName(size_t n)
+    {
+        return n >= (1 << 20) && n % (1 << 20) == 0 ? std::to_string(n >> 20) + "M"
+             : n >= 1024 && n % 1024 == 0 ? std::to_string(n >> 10) + "K"
+             : std::to_string(n);
+    }
+
+    // [m, k] x [k, n]
+    void benchMatmul(BenchmarkSuite& suite, size_t m, size_t k, size_t n, bool naive)
+    {
+        const std::string name = std::string(naive ? "matmul_naive/" : "matmul/") + std::to_string(m) + "x" +
+                                 std::to_string(k) + "x" + std::to_string(n);
+        Tensor a = makeTensor({m, k}, 1);
+        Tensor b = makeTensor({k, n}, 2);
+        Tensor c({m, n});
+        const uint64_t flops = 2ull * m * k * n;
+        const uint64_t bytes = (m * k + k * n + m * n) * sizeof(float);
+
+        if (naive)
+        {
+            suite.run(name, flops, bytes, [&] { TensorOps::matmul_reference(a, b, c); });
+        }
+        else
+        {
+            suite.run(name, flops, bytes, [&] { TensorOps::matmul(a, b, c); });
+        }
+    }
+
+    void benchActivations(BenchmarkSuite& suite, size_t n)
+    {
+        // in place, so repeated calls see the previous call's output (same cost, values stay finite)
+        Tensor tensor = makeTensor({n}, 3);
+        const uint64_t bytes = 2 * n * sizeof(float);
+        const std::vector<size_t> shape = {n};
+
+        suite.run("relu/" + sizeName(n), ReLULayer().flops(shape), bytes, [&] { TensorOps::relu(tensor); });
+        suite.run("sigmoid/" + sizeName(n), SigmoidLayer().flops(shape), bytes, [&] { TensorOps::sigmoid(tensor); });
+        suite.run("softmax/" + sizeName(n), SoftmaxLayer().flops(shape), bytes, [&] { TensorOps::softmax(tensor); });
+    }
+
+    void benchTensor(BenchmarkSuite& suite, size_t n)
+    {
+        const Tensor a = makeTensor({n}, 4);
+        const Tensor b = makeTensor({n}, 5);
+        Tensor c({n});
+        const uint64_t bytes = n * sizeof(float);
+        const std::string size = sizeName(n);
+
+        // assignment reuses c's buffer, construction allocates
+        suite.run("tensor_copy_assign/" + size, 0, 2 * bytes, [&] { c = a; });
+        suite.run("tensor_copy_construct/" + size, 0, 2 * bytes, [&] { Tensor copy(a); c = std::move(copy); });
+        suite.run("tensor_move/" + size, 0, 0, [&] { Tensor moved(std::move(c)); c = std::move(moved); });
+        c = a;
+        suite.run("tensor_add_inplace/" + size, n, 3 * bytes, [&] { c += b; });
+        suite.run("tensor_mul/" + size, n, 3 * bytes, [&] { c = a * b; });
+    }
+
+    void benchLinear(BenchmarkSuite& suite, size_t batch, size_t in, size_t out)
+    {
+        LinearLayer layer(makeTensor({in, out}, 6), makeTensor({out}, 7));
+        const std::vector<size_t> input_shape = batch == 1 ? std::vector<size_t>{in} : std::vector<size_t>{batch, in};
+        Tensor input = makeTensor(input_shape, 8);
+        Tensor output(layer.outputShape(input_shape));
+        const uint64_t bytes = (input.size() + in * out + out + output.size()) * sizeof(float);
+
+        suite.run("linear_forward/" + std::to_string(batch) + "x" + std::to_string(in) + "x" + std::to_string(out),
+                  layer.flops(input_shape), bytes, [&] { layer.forward(input, output); });
+    }
+
+    // end to end: an mnist sized mlp through the engine, single samples and a batch
+    void benchEngine(BenchmarkSuite& suite)
+    {
+        const size_t sizes[] = {784, 512, 256, 10};
+        auto model = std::make_unique<Model>();
+        for (size_t i = 0; i < 3; ++i)
+        {
+            model->addLayer(std::make_unique<LinearLayer>(makeTensor({sizes[i], sizes[i + 1]}, 9 + i),
+                                                          makeTensor({sizes[i + 1]}, 12 + i)));
+            if (i < 2)
+            {
+                model->addLayer(std::make_unique<ReLULayer>());
+            }
+        }
+        model->addLayer(std::make_unique<SoftmaxLayer>());
+        model->setInputShape({sizes[0]});
+        model->setOutputShape({sizes[3]});
+
+        // the weights have to be read once per forward pass, whatever the batch
+        const uint64_t weight_bytes = model->parameterBytes().total();
+        auto flopsFor = [&](const std::vector<size_t>& input_shape)
+        {
+            uint64_t flops = 0;
+            std::vector<size_t> shape = input_shape;
+            for (const auto& layer : model->getLayers())
+            {
+                flops += layer->flops(shape);
+                shape = layer->outputShape(shape);
+            }
+            return flops;
+        };
+        const uint64_t sample_flops = flopsFor({sizes[0]});
+        const uint64_t batch_flops = flopsFor({32, sizes[0]});
+
+        InferenceEngine engine(std::move(model));
+        ExecutionContext context = engine.createContext();
+        const Tensor input = makeTensor({sizes[0]}, 15);
+        Tensor output(engine.getOutputShape());
+        const std::vector<Tensor> batch(32, input);
+
+        suite.run("engine_predict/mlp784-512-256-10", sample_flops, weight_bytes,
+                  [&] { engine.predict(input, output, context); });
+        suite.run("engine_predict_batch/32/mlp784-512-256-10", batch_flops, weight_bytes,
+                  [&] { engine.predictBatch(batch, context); });
+    }
+
+    // every benchmark the options' filter lets through, printing each group as it finishes
+    void runAll(BenchmarkSuite& suite, const std::function<void()>& flush)
+    {
+        for (size_t n : {64, 128, 256, 512})
+        {
+            benchMatmul(suite, n, n, n, false);
+            flush();
+        }
+        benchMatmul(suite, 128, 128, 128, true);
+        benchMatmul(suite, 4096, 64, 64, false);      // tall-skinny
+        benchMatmul(suite, 64, 4096, 64, false);      // long inner dimension
+        benchMatmul(suite, 1, 1024, 1024, false);     // gemv
+        benchMatmul(suite, 1, 4096, 1024, false);
+        flush();
+
+        for (size_t n : {1024, 65536, 1 << 20})
+        {
+            benchActivations(suite, n);
+            flush();
+        }
+
+        for (size_t n : {1024, 1 << 20})
+        {
+            benchTensor(suite, n);
+            flush();
+        }
+
+        benchLinear(suite, 1, 784, 128);
+        benchLinear(suite, 32, 784, 128);
+        benchLinear(suite, 1, 1024, 1024);
+        benchLinear(suite, 64, 1024, 1024);
+        flush();
+
+        benchEngine(suite);
+        flush();
+    }
+
+    // runs the suite quietly and returns its results
+    std::vector<BenchmarkResult> runQuietly(const BenchmarkOptions& options)
+    {
+        BenchmarkSuite suite(options);
+        runAll(suite, [] {});
+        return suite.results();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    std::string json_path;
+    std::string baseline_path;
+    double threshold = 0.1;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            options.filter = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc)
+        {
+            options.repetitions = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+        {
+            options.min_time = std::chrono::milliseconds(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "--quick") == 0)
+        {
+            options.repetitions = 3;
+            options.warmup_runs = 1;
+            options.min_time = std::chrono::milliseconds(2);
+        }
+        else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            json_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+        {
+            baseline_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+        {
+            threshold = std::strtod(argv[++i], nullptr);
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    try
+    {
+        // read first, so a bad baseline fails before the long run
+        std::vector<BenchmarkResult> baseline;
+        if (!baseline_path.empty())
+        {
+            baseline = BenchmarkSuite::loadJson(baseline_path);
+        }
+
+        BenchmarkSuite suite(options);
+        std::cout << "miniNN operator benchmarks (" << Kernels::active().name << " kernels, median of "
+                  << options.repetitions << " repetitions)\n\n";
+        BenchmarkSuite::printHeader(std::cout);
+
+        // print each result as it comes in, the whole suite takes a while
+        size_t printed = 0;
+        runAll(suite, [&]
+        {
+            for (; printed < suite.results().size(); ++printed)
+            {
+                BenchmarkSuite::printRow(std::cout, suite.results()[printed]);
+            }
+            std::cout.flush();
+        });
+
+        if (!json_path.empty())
+        {
+            suite.saveJson(json_path);
+            std::cout << "\nwrote " << suite.results().size() << " results to " << json_path << "\n";
+        }
+
+        if (baseline_path.empty())
+        {
+            return 0;
+        }
+
+        std::vector<BenchmarkComparison> comparisons = compareBenchmarks(baseline, suite.results(), threshold);
+
+        // one slow repetition window (another process, thermal throttling) can push a whole run off;
+        // whatever looks regressed gets a second, longer run and only counts if that agrees
+        std::string suspects;
+        for (const auto& comparison : comparisons)
+        {
+            if (comparison.verdict == BenchmarkComparison::Verdict::REGRESSED)
+            {
+                suspects += (suspects.empty() ? "" : ",") + comparison.name;
+            }
+        }
+        if (!suspects.empty())
+        {
+            BenchmarkOptions confirm = options;
+            confirm.filter = suspects;
+            confirm.repetitions *= 2;
+            std::cout << "\nre-running suspected regressions with " << confirm.repetitions << " repetitions...\n";
+
+            const std::vector<BenchmarkComparison> rerun =
+                compareBenchmarks(baseline, runQuietly(confirm), threshold);
+            for (auto& comparison : comparisons)
+            {
+                for (const auto& confirmed : rerun)
+                {
+                    if (confirmed.name == comparison.name)
+                    {
+                        comparison = confirmed;
+                    }
+                }
+            }
+        }
+
+        std::cout << "\ncompared with " << baseline_path << " (threshold " << 100.0 * threshold << "%)\n";
+        printComparison(std::cout, comparisons);
+
+        // everything moving together points at the machine (clock, load) or a global change like compiler flags
+        double log_sum = 0.0;
+        size_t compared = 0;
+        for (const auto& comparison : comparisons)
+        {
+            if (comparison.verdict != BenchmarkComparison::Verdict::NEW)
+            {
+                log_sum += std::log1p(comparison.change);
+                ++compared;
+            }
+        }
+        if (compared > 0)
+        {
+            std::printf("\ngeometric mean change over %zu benchmarks: %+.1f%%\n", compared,
+                        100.0 * std::expm1(log_sum / compared));
+        }
+
+        const size_t regressions = static_cast<size_t>(std::count_if(comparisons.begin(), comparisons.end(),
+            [](const BenchmarkComparison& c) { return c.verdict == BenchmarkComparison::Verdict::REGRESSED; }));
+        if (regressions > 0)
+        {
+            std::cout << regressions << " benchmark(s) regressed\n";
+            return 2;
+        }
+        std::cout << "no regressions\n";
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
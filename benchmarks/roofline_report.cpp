@@ -0,0 +1,114 @@
+/* roofline_report.cpp
+ *
+ * Roofline report for a .minn model: measures this machine's peak fp32
+ * GFLOP/s and memory bandwidth, profiles the model on random inputs and
+ * prints every layer's flops, bytes, arithmetic intensity, achieved GFLOP/s
+ * and how close it gets to the peak and to the roof at its intensity.
+ *
+ * Usage: roofline_report model.minn [--batch B] [--runs N] [--threads T]
+ *                        [--mmap] [--json report.json]
+ *   --batch B     profile predictBatch of B samples instead of predict
+ *   --threads T   engine threads, the peak is measured on as many
+ */
+
+#include "kernels.h"
+#include "roofline.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace mininn;
+
+namespace
+{
+    void printUsage(const char* program)
+    {
+        std::cerr << "Usage: " << program
+                  << " model.minn [--batch B] [--runs N] [--threads T] [--mmap] [--json report.json]\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string model_path;
+    std::string json_path;
+    size_t batch_size = 1;
+    size_t runs = 100;
+    size_t threads = 1;
+    bool mmap = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--batch") == 0 && has_value)
+        {
+            batch_size = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--runs") == 0 && has_value)
+        {
+            runs = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--threads") == 0 && has_value)
+        {
+            threads = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--mmap") == 0)
+        {
+            mmap = true;
+        }
+        else if (std::strcmp(argv[i], "--json") == 0 && has_value)
+        {
+            json_path = argv[++i];
+        }
+        else if (argv[i][0] != '-' && model_path.empty())
+        {
+            model_path = argv[i];
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (model_path.empty() || batch_size == 0 || runs == 0)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        auto engine = createInferenceEngine(model_path, mmap ? LoadMode::MMAP : LoadMode::COPY);
+        threads = threads == 0 ? ThreadPool::hardwareThreads() : threads;
+        std::shared_ptr<ThreadPool> pool = threads > 1 ? std::make_shared<ThreadPool>(threads) : nullptr;
+        engine->setThreadPool(pool);
+
+        std::cout << "Measuring machine peak (" << Kernels::active().name << " kernels)...\n";
+        const MachinePeak peak = MachinePeak::measure(pool.get());
+
+        std::cout << "Profiling " << model_path << "...\n\n";
+        const RooflineReport report = measureRoofline(*engine, peak, batch_size, runs);
+        report.print(std::cout);
+
+        if (!json_path.empty())
+        {
+            std::ofstream json(json_path);
+            if (!json.is_open())
+            {
+                throw std::runtime_error("Failed to open file for writing: " + json_path);
+            }
+            report.writeJson(json);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -52,6 +52,7 @@ int main()
         // create inference engine
         InferenceEngine engine(std::move(model));
         engine.enableProfiling(true);
+        engine.enableHardwareCounters(true);
         
         std::cout << "Model loaded successfully!\n";
         std::cout << "Number of layers: " << engine.getNumLayers() << "\n\n";
@@ -122,6 +123,21 @@ int main()
         {
             std::cout << "    Layer " << i << ": " << stats.layer_times[i].count() << " ms\n";
         }
+        std::cout << "  Latency over all runs: " << stats.latency.summary() << "\n";
+        if (stats.counters_available)
+        {
+            std::cout << "  Hardware counters:\n";
+            for (size_t i = 0; i < stats.layer_counters.size(); ++i)
+            {
+                const auto& layer = stats.layer_counters[i];
+                std::cout << "    Layer " << i << ": " << layer.counts.get(PerfEvent::CYCLES) << " cycles, IPC "
+                          << layer.ipc() << ", " << layer.bytesPerFlop() << " bytes/FLOP\n";
+            }
+        }
+        else
+        {
+            std::cout << "  Hardware counters unavailable: " << PerfCounters::forThisThread().error() << "\n";
+        }
         
         // demo utility functions
         std::cout << "\nUtility Functions Demo:\n";
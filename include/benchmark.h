@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace mininn
+{
+    struct BenchmarkOptions
+    {
+        size_t warmup_runs = 2;                        // untimed repetitions first (caches, page faults, clocks)
+        size_t repetitions = 10;                       // timed repetitions, the statistics are over these
+        std::chrono::milliseconds min_time{20};        // each repetition runs the op at least this long
+        std::string filter;                            // only benchmarks whose name contains one of these (comma separated)
+    };
+
+    // one benchmark's timings: ns per op of every repetition, plus the work one op does
+    struct BenchmarkResult
+    {
+        std::string name;
+        uint64_t flops_per_op = 0;
+        uint64_t bytes_per_op = 0;    // memory the op has to read and write at least once
+        size_t iterations = 0;        // ops per repetition
+        std::vector<double> samples;  // ns per op
+
+        double median() const;
+        double mean() const;
+        double min() const;
+        double max() const;
+        double stddev() const;
+        // distribution-free 95% confidence interval of the median (order statistics of the samples)
+        double medianLow() const;
+        double medianHigh() const;
+
+        // at the median time, 0 when the op does no such work
+        double gflops() const;
+        double gbytesPerSecond() const;
+    };
+
+    // runs and collects micro-benchmarks: each op is timed in repetitions of as many back to back calls as
+    // fill min_time, so sub-microsecond ops aren't lost in clock resolution
+    class BenchmarkSuite
+    {
+    public:
+        explicit BenchmarkSuite(BenchmarkOptions options = BenchmarkOptions());
+
+        // false when the filter skips name (op is not run)
+        bool run(const std::string& name, uint64_t flops_per_op, uint64_t bytes_per_op, const std::function<void()>& op);
+
+        const std::vector<BenchmarkResult>& results() const { return results_; }
+        const BenchmarkOptions& options() const { return options_; }
+
+        // aligned columns: name, median ns/op, +-stddev, GFLOP/s, GB/s
+        void printTable(std::ostream& out) const;
+        static void printHeader(std::ostream& out);
+        static void printRow(std::ostream& out, const BenchmarkResult& result);
+
+        // {"context":{...},"benchmarks":[{"name":...,"ns_per_op":{"median":...},...}]}
+        void writeJson(std::ostream& out) const;
+        // throws std::runtime_error if the file can't be written
+        void saveJson(const std::string& filepath) const;
+
+        // results written by writeJson (e.g. a stored baseline), throws std::runtime_error if malformed
+        static std::vector<BenchmarkResult> readJson(std::istream& in);
+        static std::vector<BenchmarkResult> loadJson(const std::string& filepath);
+
+    private:
+        BenchmarkOptions options_;
+        std::vector<BenchmarkResult> results_;
+    };
+
+    // one benchmark of a run against the same one in a baseline run
+    struct BenchmarkComparison
+    {
+        enum class Verdict
+        {
+            UNCHANGED,   // within the threshold
+            NOISY,       // median moved past the threshold but the confidence intervals overlap
+            REGRESSED,   // slower by more than the threshold and the intervals are apart
+            IMPROVED,    // same, faster
+            NEW          // not in the baseline
+        };
+
+        std::string name;
+        double baseline_ns = 0.0;   // medians
+        double current_ns = 0.0;
+        double change = 0.0;        // current / baseline - 1, e.g. 0.15 -> 15% slower
+        Verdict verdict = Verdict::NEW;
+    };
+
+    const char* verdictName(BenchmarkComparison::Verdict verdict);
+
+    // every benchmark of current, in order (baseline only ones are left out, e.g. a filtered run)
+    // a change only counts when it exceeds threshold (0.1 -> 10%) and the two medians' confidence intervals
+    // don't overlap, so one noisy run can't fail the gate
+    std::vector<BenchmarkComparison> compareBenchmarks(const std::vector<BenchmarkResult>& baseline,
+                                                       const std::vector<BenchmarkResult>& current, double threshold);
+
+    // aligned columns: name, baseline and current ns/op, change, verdict
+    void printComparison(std::ostream& out, const std::vector<BenchmarkComparison>& comparisons);
+
+} // namespace mininn
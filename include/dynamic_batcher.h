@@ -0,0 +1,86 @@
+#pragma once
+
+#include "inference_engine.h"
+#include "mpmc_queue.h"
+#include "tensor.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+namespace mininn
+{
+    struct BatchingOptions
+    {
+        size_t max_batch_size = 32;                       // a batch runs as soon as it has this many requests
+        std::chrono::microseconds max_wait{500};          // ... or once its oldest request has waited this long
+        size_t queue_capacity = 1024;                     // pending requests before submit starts to wait
+    };
+
+    // asynchronous front end for serving: single requests go into a lock-free queue and a dispatcher
+    // thread runs whatever has arrived as one predictBatch, so concurrent requests share a gemm
+    // instead of each running its own gemv, then hands every request its own row of the result
+    // with a tracer on the engine, every batch and every request's time in the queue are traced too
+    class DynamicBatcher
+    {
+    public:
+        // on error output is empty and error holds the exception predictBatch threw
+        using Callback = std::function<void(Tensor output, std::exception_ptr error)>;
+
+        // runs on a clone of engine (shares its weights and settings, not its buffers)
+        explicit DynamicBatcher(const InferenceEngine& engine, BatchingOptions options = BatchingOptions());
+        // finishes every request submitted so far, then stops the dispatcher
+        ~DynamicBatcher();
+
+        DynamicBatcher(const DynamicBatcher&) = delete;
+        DynamicBatcher& operator=(const DynamicBatcher&) = delete;
+
+        // thread-safe; both throw std::invalid_argument right away for an input the model can't take
+        // and wait (without blocking the dispatcher) while the queue is full
+        std::future<Tensor> submit(Tensor input);
+        // callback runs on the dispatcher thread, so it should be quick
+        void submit(Tensor input, Callback callback);
+
+        const BatchingOptions& getOptions() const { return options_; }
+        // totals so far: requests answered and the batches they ran in
+        size_t getNumRequests() const { return num_requests_.load(std::memory_order_relaxed); }
+        size_t getNumBatches() const { return num_batches_.load(std::memory_order_relaxed); }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Request
+        {
+            Tensor input;
+            std::promise<Tensor> promise;   // used when callback is empty
+            Callback callback;
+            Clock::time_point enqueued;
+            uint32_t thread_id = 0;         // submitter's trace track, its queue wait is drawn there
+        };
+
+        InferenceEngine engine_;
+        ExecutionContext context_;
+        BatchingOptions options_;
+        MpmcQueue<Request> queue_;
+
+        // the dispatcher sleeps on wake_ only while the queue is empty, submitters notify only when it does
+        std::mutex sleep_mutex_;
+        std::condition_variable wake_;
+        std::atomic<bool> sleeping_;
+        std::atomic<bool> stopping_;
+
+        std::atomic<size_t> num_requests_;
+        std::atomic<size_t> num_batches_;
+        std::thread dispatcher_;
+
+        void enqueue(Request request);
+        void dispatchLoop();
+        bool waitForWork();
+        void runBatch(std::vector<Request>& batch);
+    };
+
+} // namespace mininn
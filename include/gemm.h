@@ -0,0 +1,77 @@
+#pragma once
+
+#include "kernels.h"
+#include <cstddef>
+
+namespace mininn
+{
+    class ThreadPool;
+
+    // raw-pointer matrix multiplication kernels used by TensorOps and the layers
+    // all matrices are row-major, ld* is the distance (in elements) between rows
+    namespace Gemm
+    {
+        // cache blocking parameters (in elements)
+        // KC x NR panels of B stay in L1, MC x KC blocks of A stay in L2
+        // the MR x NR register tile comes from the active KernelTable (see kernels.h)
+        constexpr size_t KC = 256;
+        constexpr size_t MC = 96;
+        constexpr size_t NC = 1024;
+
+        // below this many multiply-adds a gemm isn't worth handing to other threads
+        constexpr size_t PARALLEL_MIN_FLOPS = 1 << 18;
+
+        // c[m x n] = a[m x k] * b[k x n], dispatched to the active cpu tier
+        // with a pool, large products are split over row blocks (or column blocks for short m)
+        // the epilogue (bias + activation, see kernels.h) is applied to each tile as it's finished
+        void sgemm(size_t m, size_t n, size_t k,
+                   const float* a, size_t lda,
+                   const float* b, size_t ldb,
+                   float* c, size_t ldc,
+                   ThreadPool* pool = nullptr,
+                   const GemmEpilogue& epilogue = GemmEpilogue());
+
+        // 16-bit float formats sgemmHalf reads b in
+        enum class HalfFormat
+        {
+            FP16,
+            BF16
+        };
+
+        // sgemm with b stored as fp16 / bf16 bits: widened to fp32 while packing (or inside the axpy
+        // for short m) and accumulated in fp32, so only the memory traffic for b is halved
+        void sgemmHalf(size_t m, size_t n, size_t k,
+                       const float* a, size_t lda,
+                       const uint16_t* b, HalfFormat format, size_t ldb,
+                       float* c, size_t ldc,
+                       ThreadPool* pool = nullptr,
+                       const GemmEpilogue& epilogue = GemmEpilogue());
+
+        // int8 and int4 weights are walked in column blocks of about this many bytes, so a block stays
+        // in L2 while every row of a goes past it
+        constexpr size_t S8_BLOCK_BYTES = 256 * 1024;
+
+        // c[m x n] = epilogue(a_scales[i] * b_scales[j] * (a[m x k] * b[n x k]^T)) in int8 -> int32
+        // b is stored one row per output column, b_sums are its row sums, k is padded to
+        // Kernels::INT8_K_ALIGNMENT (see KernelTable::gemm_s8); with a pool, columns are split
+        void gemmS8(size_t m, size_t n, size_t k,
+                    const int8_t* a, size_t lda,
+                    const int8_t* b, size_t ldb, const int32_t* b_sums,
+                    const float* a_scales, const float* b_scales,
+                    float* c, size_t ldc,
+                    ThreadPool* pool = nullptr,
+                    const GemmEpilogue& epilogue = GemmEpilogue());
+
+        // c[m x n] = epilogue(a[m x k] * dequantize(b)^T) with packed int4 weights and fp32 activations
+        // b is stored one packed row per output column (ldb bytes apart), b_scales one row of
+        // k / group_size scales per column (see KernelTable::gemm_q4); with a pool, columns are split
+        void gemmQ4(size_t m, size_t n, size_t k,
+                    const float* a, size_t lda,
+                    const uint8_t* b, size_t ldb,
+                    const float* b_scales, size_t group_size,
+                    float* c, size_t ldc,
+                    ThreadPool* pool = nullptr,
+                    const GemmEpilogue& epilogue = GemmEpilogue());
+    }
+
+} // namespace mininn
@@ -1,30 +1,119 @@
 #pragma once
 
+#include "latency_histogram.h"
 #include "model_loader.h"
+#include "memory_plan.h"
+#include "perf_counters.h"
 #include "tensor.h"
+#include "thread_pool.h"
+#include "tracer.h"
 #include <memory>
+#include <string>
 #include <vector>
 #include <chrono>
 
 namespace mininn
 {
+    // where an engine's memory goes, in bytes
+    struct MemoryReport
+    {
+        ParameterBytes parameters;          // weights, scales and biases by dtype (one copy, shared with clones)
+        size_t mapped_file_bytes = 0;       // the mmapped model file (page cache, shareable across processes)
+        size_t activation_bytes = 0;        // planned intermediate arenas, single sample and batch
+        size_t transient_peak_bytes = 0;    // most a single predictBatch allocated for staging and slice arenas
+        size_t scratch_bytes = 0;           // per-thread gemm / quantization scratch, all threads of the process
+        size_t scratch_peak_bytes = 0;
+        
+        // heap this engine accounts for: parameters not read from the mapping, activations, the transient
+        // peak and the current scratch
+        size_t totalBytes() const;
+        // one line per item, for logs
+        std::string toString() const;
+    };
+
+    // hardware counters of one layer in the last call, a fused layer counts under its predecessor
+    struct LayerCounters
+    {
+        PerfCounts counts;
+        uint64_t flops = 0;      // Layer::flops for the shapes it ran on (plus the layer it fused)
+        
+        double ipc() const { return counts.ipc(); }
+        // bytes it pulled from memory (LLC misses) per flop: well below the machine's bytes per flop of peak
+        // means compute bound, near or above it memory bound; 0 when there are no flops or no LLC count
+        double bytesPerFlop() const;
+    };
+
     // profiling info
     struct InferenceStats
     {
+        // the last call
         std::chrono::duration<double, std::milli> total_time{0};
         std::vector<std::chrono::duration<double, std::milli>> layer_times;
-        size_t memory_usage_bytes{0};
+        size_t memory_usage_bytes{0};   // memory.totalBytes()
+        MemoryReport memory;
+        
+        // every profiled call since the context was made or its latency was reset (a batch is one sample)
+        LatencyHistogram latency;
+        std::vector<LatencyHistogram> layer_latency;
+        
+        // the last call's hardware counters (see enableHardwareCounters), counters is the sum of the layers'
+        // false when none could be opened on the calling thread, PerfCounters::error() says why
+        bool counters_available{false};
+        PerfCounts counters;
+        std::vector<LayerCounters> layer_counters;
+        
+        // adds other's histograms to these, e.g. to report over all threads' contexts
+        void mergeLatency(const InferenceStats& other);
+    };
+
+    // everything a forward pass writes: the planned intermediate buffers and the stats of the last call
+    // an engine only reads its model and settings while predicting, so threads that each bring their own
+    // context can run predict on one engine (one copy of the weights) at the same time
+    class ExecutionContext
+    {
+    public:
+        ExecutionContext() = default;
+        
+        // owns the arenas the plans' views point into, so it moves but doesn't copy
+        ExecutionContext(const ExecutionContext&) = delete;
+        ExecutionContext& operator=(const ExecutionContext&) = delete;
+        ExecutionContext(ExecutionContext&&) = default;
+        ExecutionContext& operator=(ExecutionContext&&) = default;
+        
+        // profiling results of the last predict / predictBatch made with this context
+        const InferenceStats& stats() const { return stats_; }
+        
+        // free the planned buffers, the next call re-plans them
+        void clearBuffers();
+        
+        // start the latency histograms over
+        void resetLatency();
+        
+    private:
+        friend class InferenceEngine;
+        
+        const Model* model_ = nullptr;     // the plans below are for this model's layers
+        InferenceStats stats_;
+        size_t transient_peak_bytes_ = 0;
+        
+        // pre-planned intermediate buffers for single samples and for the last batch size seen
+        MemoryPlan plan_;
+        MemoryPlan batch_plan_;
     };
 
     // main inference engine class
+    // the plain predict calls use a context owned by the engine and are not thread-safe; the ones taking
+    // an ExecutionContext are, as long as each thread uses its own context and the engine isn't
+    // reconfigured (fusion, threads, profiling) meanwhile
     class InferenceEngine
     {
     public:
         // constructor loads model and prepares for inference
-        explicit InferenceEngine(std::unique_ptr<Model> model);
+        // the model is only read from here on, so engines made from the same shared_ptr share its weights
+        explicit InferenceEngine(std::shared_ptr<const Model> model);
         ~InferenceEngine() = default;
         
-        // move semantics only (engines can hold large models)
+        // move semantics only (engines can hold large models), use clone() for a second engine
         InferenceEngine(const InferenceEngine&) = delete;
         InferenceEngine& operator=(const InferenceEngine&) = delete;
         InferenceEngine(InferenceEngine&&) = default;
@@ -33,39 +122,107 @@ namespace mininn
         // main inference method -> executes forward pass
         Tensor predict(const Tensor& input);
         
+        // same, writing into output -> once output has the model's output shape, and the buffers are
+        // planned, a call does no heap allocation at all
+        void predict(const Tensor& input, Tensor& output);
+        
         // batch inference for multiple inputs
+        // flat inputs are stacked into one [batch, features] tensor so every linear layer runs as a single gemm
+        // with a thread pool, large batches are cut into row slices that run the whole network in parallel
         std::vector<Tensor> predictBatch(const std::vector<Tensor>& inputs);
         
+        // reentrant versions: all scratch buffers and stats live in context
+        Tensor predict(const Tensor& input, ExecutionContext& context) const;
+        void predict(const Tensor& input, Tensor& output, ExecutionContext& context) const;
+        std::vector<Tensor> predictBatch(const std::vector<Tensor>& inputs, ExecutionContext& context) const;
+        
+        // context with its single sample buffers already planned, so its first predict doesn't allocate
+        ExecutionContext createContext() const;
+        
+        // engine on the same model (weights are shared, not copied) with this one's fusion, profiling and
+        // thread pool settings but its own buffers and stats; the model lives until its last engine is gone
+        InferenceEngine clone() const;
+        
+        // multi-threading (single threaded by default)
+        // setNumThreads gives this engine its own pool: 0 -> one thread per core, 1 -> no pool
+        void setNumThreads(size_t num_threads, bool pin_threads = false);
+        // share one pool between several engines instead of each starting its own threads
+        void setThreadPool(std::shared_ptr<ThreadPool> pool) { thread_pool_ = std::move(pool); }
+        size_t getNumThreads() const { return thread_pool_ ? thread_pool_->size() : 1; }
+        
         // model introspection
         const std::vector<size_t>& getInputShape() const { return model_->getInputShape(); }
         const std::vector<size_t>& getOutputShape() const { return model_->getOutputShape(); }
         size_t getNumLayers() const { return model_->getLayers().size(); }
+        const std::shared_ptr<const Model>& getModel() const { return model_; }
+        
+        // operator fusion (on by default): a linear layer followed by an activation runs as one gemm
+        // whose epilogue adds the bias and applies the activation (its time is counted under the linear layer)
+        void enableFusion(bool enable);
+        size_t getNumFusedLayers() const;
+        // layer index is applied by the layer before it (and has no time or counts of its own)
+        bool isFused(size_t index) const { return fused_.at(index); }
         
         // performance monitoring
         void enableProfiling(bool enable) { profiling_enabled_ = enable; }
-        const InferenceStats& getLastInferenceStats() const { return last_stats_; }
+        // profiled calls also count cycles, instructions, cache and branch misses per layer (linux
+        // perf_event_open, two counter reads per layer); each thread counts only its own work, so layers
+        // splitting a gemm over the pool are undercounted, while predictBatch's row slices add up
+        // where counters aren't permitted the stats just say they're unavailable
+        void enableHardwareCounters(bool enable) { counters_enabled_ = enable; }
+        // timeline of predict calls, planning and every layer's forward (type, shapes, flops) into tracer,
+        // null (the default) turns it off; clones share the tracer
+        void setTracer(std::shared_ptr<Tracer> tracer) { tracer_ = std::move(tracer); }
+        const std::shared_ptr<Tracer>& getTracer() const { return tracer_; }
+        // stats of the last call through the engine's own context, and its latency histograms
+        const InferenceStats& getLastInferenceStats() const { return context_.stats(); }
+        void resetLatencyStats() { context_.resetLatency(); }
+        
+        // memory accounting, with the buffers of the engine's own context or of context
+        MemoryReport memoryReport() const { return memoryReport(context_); }
+        MemoryReport memoryReport(const ExecutionContext& context) const;
         
-        // mem management
+        // mem management (of the engine's own context)
+        // intermediates live in an arena planned from the model's shapes (see memory_plan.h)
+        // the constructor plans it, predict re-plans lazily after clearBuffers
         void preallocateBuffers();  // pre-allocate intermediate tensors for performance
         void clearBuffers();        // free intermediate tensors to save memory
         
     private:
-        std::unique_ptr<Model> model_;
+        std::shared_ptr<const Model> model_;
         bool profiling_enabled_;
-        InferenceStats last_stats_;
+        bool counters_enabled_ = false;
+        std::shared_ptr<ThreadPool> thread_pool_;
+        std::shared_ptr<Tracer> tracer_;
+        ParameterBytes parameter_bytes_;   // the model never changes, so counted once
+        
+        // fused_[i] -> layer i is applied by layer i - 1 (see enableFusion)
+        std::vector<bool> fused_;
         
-        // pre-allocated intermediate tensors for performance
-        std::vector<Tensor> intermediate_tensors_;
-        bool buffers_allocated_;
+        // used by the calls that don't take a context
+        ExecutionContext context_;
         
         // helpers
         void validateInput(const Tensor& input) const;
-        void executeForwardPass(const Tensor& input, Tensor& output);
-        void updateMemoryUsage();
+        void prepareContext(ExecutionContext& context) const;
+        MemoryPlan makePlan(const std::vector<size_t>& input_shape) const;
+        void executeForwardPass(const Tensor& input, Tensor& output, MemoryPlan& plan,
+                                ThreadPool* pool, std::vector<std::chrono::duration<double, std::milli>>* layer_times,
+                                std::vector<LayerCounters>* layer_counters) const;
+        void runBatchSlice(const std::vector<Tensor>& inputs, size_t begin, size_t end,
+                           std::vector<Tensor>& outputs, MemoryPlan& plan, ThreadPool* pool,
+                           std::vector<std::chrono::duration<double, std::milli>>* layer_times,
+                           std::vector<LayerCounters>* layer_counters) const;
+        void resetStats(InferenceStats& stats) const;
+        void recordLatency(InferenceStats& stats) const;
+        bool countersOn() const { return profiling_enabled_ && counters_enabled_; }
+        void updateMemoryUsage(ExecutionContext& context) const;
     };
 
     // factory function for creating inference engines
-    std::unique_ptr<InferenceEngine> createInferenceEngine(const std::string& model_path);
+    // a tracer gets the load and is set on the engine
+    std::unique_ptr<InferenceEngine> createInferenceEngine(const std::string& model_path, LoadMode mode = LoadMode::COPY,
+                                                           std::shared_ptr<Tracer> tracer = nullptr);
 
     // utility functions for common inference tasks
     namespace InferenceUtils
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mininn
+{
+    // instruction set tiers we ship kernels for, ordered from least to most capable
+    enum class CpuTier
+    {
+        SCALAR = 0,
+        SSE42 = 1,
+        AVX2 = 2,     // avx2 + fma + f16c
+        AVX512 = 3    // avx512f
+    };
+
+    // elementwise activations a gemm can apply to its output tile before storing it
+    enum class Activation
+    {
+        NONE = 0,
+        RELU = 1,
+        SIGMOID = 2
+    };
+
+    // work folded into the end of a gemm while the output tile is still in registers:
+    // c = activation(c + bias), with bias indexed by column (may be null)
+    struct GemmEpilogue
+    {
+        const float* bias = nullptr;
+        Activation activation = Activation::NONE;
+    };
+
+    // one implementation of every hot kernel, all built for the same tier
+    // every pointer works on contiguous float arrays
+    struct KernelTable
+    {
+        CpuTier tier;
+        const char* name;
+
+        // in-place activations over n elements
+        void (*relu)(float* data, size_t n);
+        void (*sigmoid)(float* data, size_t n);
+        void (*softmax)(float* data, size_t n);
+
+        // y[0..n) += alpha * x[0..n)
+        void (*axpy)(size_t n, float alpha, const float* x, float* y);
+
+        // the same with x stored as fp16 / bf16 bits, widened to fp32 in registers
+        void (*axpy_fp16)(size_t n, float alpha, const uint16_t* x, float* y);
+        void (*axpy_bf16)(size_t n, float alpha, const uint16_t* x, float* y);
+
+        // gemm micro-kernel: computes a gemm_mr x gemm_nr tile of c from panels packed by Gemm
+        // only the top-left mr x nr corner is written, accumulate adds into c instead of overwriting
+        // a non-null epilogue (bias already offset to the tile's first column) is applied last
+        size_t gemm_mr;
+        size_t gemm_nr;
+        void (*gemm_micro)(size_t kc, const float* a, const float* b,
+                           float* c, size_t ldc, size_t mr, size_t nr, bool accumulate,
+                           const GemmEpilogue* epilogue);
+
+        // int8 gemm with requantization fused into the epilogue:
+        // c[i][j] = epilogue(a_scales[i] * b_scales[j] * sum_p a[i][p] * b[j][p])
+        // a is m x k int8 activations, b holds one row of k int8 weights per output column (both are
+        // read along k), b_sums[j] = sum_p b[j][p] lets u8 x s8 instructions take signed activations
+        // k must be a multiple of Kernels::INT8_K_ALIGNMENT, with a and b zero padded up to it
+        void (*gemm_s8)(size_t m, size_t n, size_t k,
+                        const int8_t* a, size_t lda, const int8_t* b, size_t ldb, const int32_t* b_sums,
+                        const float* a_scales, const float* b_scales,
+                        float* c, size_t ldc, const GemmEpilogue* epilogue);
+
+        // int4 weight-only gemm, weights dequantized on the fly, activations and sums stay fp32:
+        // c[i][j] = epilogue(sum_p a[i][p] * b_scales[j][p / group_size] * q(b[j], p))
+        // b holds one row of k packed int4 weights per output column (ldb bytes apart, packed as described
+        // at Kernels::INT4_BLOCK), b_scales one row of k / group_size scales per column
+        // k and group_size must be multiples of Kernels::INT4_BLOCK
+        void (*gemm_q4)(size_t m, size_t n, size_t k,
+                        const float* a, size_t lda, const uint8_t* b, size_t ldb,
+                        const float* b_scales, size_t group_size,
+                        float* c, size_t ldc, const GemmEpilogue* epilogue);
+
+        // 16-bit float <-> fp32 over n elements, as raw bits: fp16 is ieee binary16, bf16 the top half
+        // of an fp32; narrowing rounds to nearest even and keeps nan a (quiet) nan
+        void (*fp16_to_fp32)(const uint16_t* src, float* dst, size_t n);
+        void (*fp32_to_fp16)(const float* src, uint16_t* dst, size_t n);
+        void (*bf16_to_fp32)(const uint16_t* src, float* dst, size_t n);
+        void (*fp32_to_bf16)(const float* src, uint16_t* dst, size_t n);
+    };
+
+    // runtime cpu feature dispatch
+    // the active table is picked once, on first use, from the best tier the cpu and os support
+    // set MININN_CPU_TIER=scalar|sse4.2|avx2|avx512 to cap it (useful for testing slower paths)
+    namespace Kernels
+    {
+        // largest register tile any tier uses (lets Gemm size stack buffers)
+        constexpr size_t MAX_MR = 8;
+        constexpr size_t MAX_NR = 32;
+
+        // int8 gemm operands are padded along k to a multiple of this (one zmm of bytes)
+        constexpr size_t INT8_K_ALIGNMENT = 64;
+
+        // int4 weights are packed in blocks of this many values along k, 16 bytes each: byte i holds
+        // element i in its low nibble and element i + 16 in its high nibble, both stored as q + 8
+        // (so unpacking is a mask, a shift and one subtract, no interleaving)
+        constexpr size_t INT4_BLOCK = 32;
+
+        // best tier supported by this cpu (cpuid + xgetbv), ignores the environment
+        CpuTier detectCpuTier();
+
+        // avx512 vnni (+bw): the avx512 tier's int8 gemm uses vpdpbusd, otherwise the avx2 one
+        // the one cpuid check for it; like detectCpuTier it ignores the environment, a MININN_CPU_TIER
+        // cap below avx512 just never uses the table that asks
+        bool hasAvx512Vnni();
+
+        // kernels for a given tier, or nullptr if this build/cpu can't run them
+        const KernelTable* forTier(CpuTier tier);
+
+        // kernels used by TensorOps, Gemm and the layers
+        const KernelTable& active();
+
+        // override the active tier at runtime (throws if the cpu doesn't support it)
+        void setActiveTier(CpuTier tier);
+
+        const char* tierName(CpuTier tier);
+        bool parseTier(const std::string& name, CpuTier& tier);
+    }
+
+} // namespace mininn
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mininn
+{
+    // latency distribution in HDR-style log-linear buckets: every power of two of nanoseconds is split
+    // into SUB_BUCKETS equal buckets, so a reported percentile is within ~1.6% of the true value from
+    // 1 ns up to centuries, in a fixed 15 KB of counters
+    // record() is a handful of relaxed atomic adds, so any number of threads can record into one
+    // histogram (or each into its own, merged later) while another thread reads it
+    class LatencyHistogram
+    {
+    public:
+        using Duration = std::chrono::duration<double, std::milli>;
+
+        static constexpr unsigned SUB_BUCKET_BITS = 5;
+        static constexpr uint64_t SUB_BUCKETS = uint64_t(1) << SUB_BUCKET_BITS;
+        // values below 2 * SUB_BUCKETS ns get a bucket each, every octave above that SUB_BUCKETS
+        static constexpr size_t NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+        LatencyHistogram();
+
+        // copies are snapshots (counts recorded meanwhile may or may not be in them)
+        LatencyHistogram(const LatencyHistogram& other);
+        LatencyHistogram& operator=(const LatencyHistogram& other);
+
+        void record(std::chrono::nanoseconds latency);
+        void record(Duration latency) { record(std::chrono::duration_cast<std::chrono::nanoseconds>(latency)); }
+
+        // adds other's samples to this one (e.g. the histograms of several threads)
+        void merge(const LatencyHistogram& other);
+        void reset();
+
+        uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+        Duration mean() const;
+        Duration min() const;
+        Duration max() const;
+
+        // smallest recorded latency that p percent of the samples don't exceed (p in [0, 100]), 0 when empty
+        Duration percentile(double p) const;
+
+        // "n=1000 mean=0.12 p50=0.11 p90=0.15 p99=0.21 p999=0.40 max=0.52 ms"
+        std::string summary() const;
+
+        static size_t bucketIndex(uint64_t nanoseconds);
+        // smallest value in bucket index and the number of values it covers
+        static uint64_t bucketLowest(size_t index);
+        static uint64_t bucketWidth(size_t index);
+
+    private:
+        std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets_;
+        std::atomic<uint64_t> count_;
+        std::atomic<uint64_t> sum_;   // nanoseconds
+        std::atomic<uint64_t> min_;
+        std::atomic<uint64_t> max_;
+    };
+
+} // namespace mininn
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mininn
+{
+    // read-only memory mapping of a whole file, unmapped on destruction
+    // pages are faulted in lazily on first touch and come straight from the page cache, so every
+    // process mapping the same file shares one copy of it
+    class MappedFile
+    {
+    public:
+        // throws std::runtime_error if the file can't be opened or mapped (or is empty)
+        explicit MappedFile(const std::string& filepath);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const uint8_t* data() const { return data_; }
+        size_t size() const { return size_; }
+
+        // false on platforms without mmap, where the constructor always throws
+        static bool supported();
+
+    private:
+        const uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+} // namespace mininn
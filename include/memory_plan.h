@@ -0,0 +1,59 @@
+#pragma once
+
+#include "model_loader.h"
+#include "tensor.h"
+#include <memory>
+#include <vector>
+
+namespace mininn
+{
+    // static buffer plan for running a layer stack on one fixed input shape
+    // every layer's output shape is inferred up front, and intermediates whose lifetimes don't
+    // overlap share a slot of one arena (a plain chain just ping-pongs between two slots)
+    // layers that support it run in place on their input's buffer, so they need no slot of their own
+    class MemoryPlan
+    {
+    public:
+        MemoryPlan() = default;
+        MemoryPlan(const std::vector<std::unique_ptr<Layer>>& layers, const std::vector<size_t>& input_shape);
+
+        // the views point into arena_, which moves along with them
+        MemoryPlan(const MemoryPlan&) = delete;
+        MemoryPlan& operator=(const MemoryPlan&) = delete;
+        MemoryPlan(MemoryPlan&&) = default;
+        MemoryPlan& operator=(MemoryPlan&&) = default;
+
+        bool empty() const { return shapes_.empty(); }
+        const std::vector<size_t>& inputShape() const { return input_shape_; }
+        const std::vector<size_t>& outputShape() const { return shapes_.back(); }
+        const std::vector<size_t>& layerOutputShape(size_t layer) const { return shapes_[layer]; }
+
+        // layer i overwrites its input instead of writing a new tensor
+        bool inPlace(size_t layer) const { return in_place_[layer]; }
+        // layer i writes the caller's output tensor: the last layer that doesn't run in place,
+        // plus any in-place layers after it
+        bool writesOutput(size_t layer) const { return layer >= output_start_; }
+
+        // output tensor for layer i when it doesn't write the caller's output: a view into the arena
+        Tensor& intermediate(size_t layer) { return intermediates_[layer]; }
+
+        size_t numBuffers() const { return slot_sizes_.size(); }
+        size_t arenaBytes() const { return arena_size_ * sizeof(float); }
+
+    private:
+        struct ArenaDelete
+        {
+            void operator()(float* arena) const;
+        };
+
+        std::vector<size_t> input_shape_;
+        std::vector<std::vector<size_t>> shapes_;   // output shape of every layer
+        std::vector<bool> in_place_;
+        size_t output_start_ = 0;
+        std::vector<size_t> slot_sizes_;            // floats per arena slot
+        size_t arena_size_ = 0;                     // floats
+        std::unique_ptr<float[], ArenaDelete> arena_;   // Tensor::ALIGNMENT aligned, like owned tensors
+        std::vector<Tensor> intermediates_;         // one per layer before output_start_
+    };
+
+} // namespace mininn
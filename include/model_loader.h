@@ -1,6 +1,8 @@
 #pragma once
 
 #include "tensor.h"
+#include "kernels.h"
+#include <array>
 #include <vector>
 #include <string>
 #include <memory>
@@ -8,13 +10,37 @@
 
 namespace mininn
 {
+    class ThreadPool;
+    class MappedFile;
+    class ModelReader;
+    class Tracer;
+
     // layer types supported by our inference engine
     enum class LayerType : uint8_t 
     {
         LINEAR = 0,
         RELU = 1,
         SIGMOID = 2,
-        SOFTMAX = 3
+        SOFTMAX = 3,
+        LINEAR_INT8 = 4,
+        LINEAR_INT4 = 5
+    };
+
+    const char* layerTypeName(LayerType type);
+
+    // parameter memory (weights, scales, biases) of a layer or model
+    struct ParameterBytes
+    {
+        std::array<size_t, NUM_DATA_TYPES> by_type{};  // indexed by DataType
+        size_t other = 0;    // precomputed data that isn't a tensor (int8 weight sums)
+        size_t mapped = 0;   // part of the above read in place from a mapped model file
+        
+        void add(const Tensor& tensor) { add(tensor.dtype(), tensor.byteSize(), tensor.isView()); }
+        void add(DataType dtype, size_t bytes, bool in_place);
+        ParameterBytes& operator+=(const ParameterBytes& other);
+        
+        size_t total() const;
+        size_t heap() const { return total() - mapped; }
     };
 
     // base class for neural network layers
@@ -28,6 +54,39 @@ namespace mininn
         
         // pure virtual function -> each layer must implement forward pass
         virtual void forward(const Tensor& input, Tensor& output) = 0;
+
+        // same, but free to split the work over pool's threads (pool may be null)
+        // layers with nothing worth parallelizing keep this default
+        virtual void forward(const Tensor& input, Tensor& output, ThreadPool* pool)
+        {
+            (void)pool;
+            forward(input, output);
+        }
+        
+        // shape inference: the output shape forward() produces for this input shape
+        // throws std::invalid_argument when the layer can't take that input (activations keep the shape)
+        virtual std::vector<size_t> outputShape(const std::vector<size_t>& input_shape) const { return input_shape; }
+        
+        // arithmetic operations forward() does on an input of this shape (multiply-adds count as two);
+        // elementwise layers default to one per element
+        virtual uint64_t flops(const std::vector<size_t>& input_shape) const;
+        
+        // memory forward() has to read and write at least once on an input of this shape: the fp32 input
+        // and output and every parameter byte (the compulsory traffic a roofline divides the flops by)
+        virtual uint64_t bytesMoved(const std::vector<size_t>& input_shape) const;
+        
+        // in-place execution: layers whose output can overwrite their input (elementwise activations)
+        // report it here so the engine can run them on the previous layer's buffer without a copy
+        virtual bool supportsInPlace() const { return false; }
+        virtual void forwardInPlace(Tensor& tensor);
+        
+        // operator fusion: a layer that can apply the following layer itself (e.g. in its gemm epilogue)
+        // says so here, and the engine then runs forwardFused instead of the two layers one by one
+        virtual bool canFuse(const Layer& next) const { (void)next; return false; }
+        virtual void forwardFused(const Tensor& input, Tensor& output, Layer& next, ThreadPool* pool);
+        
+        // memory accounting: layers with parameters add their bytes (activations have none)
+        virtual void addParameterBytes(ParameterBytes& bytes) const { (void)bytes; }
         
     protected:
         LayerType type_;
@@ -37,37 +96,165 @@ namespace mininn
     class LinearLayer : public Layer
     {
     public:
-        LinearLayer(const Tensor& weights, const Tensor& bias);
+        // takes the tensors by value so views (e.g. into a mapped model file) stay views when moved in
+        // weights may be FLOAT16 or BFLOAT16 (widened to fp32 inside the gemm, which accumulates in fp32)
+        LinearLayer(Tensor weights, Tensor bias);
         void forward(const Tensor& input, Tensor& output) override;
+        void forward(const Tensor& input, Tensor& output, ThreadPool* pool) override;
+        std::vector<size_t> outputShape(const std::vector<size_t>& input_shape) const override;
+        uint64_t flops(const std::vector<size_t>& input_shape) const override;
+        
+        // relu and sigmoid run in the gemm epilogue, softmax right after it
+        bool canFuse(const Layer& next) const override;
+        void forwardFused(const Tensor& input, Tensor& output, Layer& next, ThreadPool* pool) override;
+        void addParameterBytes(ParameterBytes& bytes) const override;
+        
+        const Tensor& weights() const { return weights_; }
+        const Tensor& bias() const { return bias_; }
         
         // Make ModelLoader a friend so it can access weights/bias for saving
         friend class ModelLoader;
         
     private:
-        Tensor weights_;  // weight matrix [input_size, output_size]
+        Tensor weights_;  // weight matrix [input_size, output_size], FLOAT32, FLOAT16 or BFLOAT16
         Tensor bias_;     // bias vector [output_size]
+        
+        void forwardWithEpilogue(const Tensor& input, Tensor& output, ThreadPool* pool, Activation activation);
+    };
+
+    // linear layer with int8 weights (symmetric, one scale per output channel)
+    // activations are quantized to int8 on the way in: with the calibrated input_scale when it's
+    // positive, per row at run time otherwise; products accumulate in int32 and are scaled back to
+    // float together with the bias (and a fused activation) in the gemm epilogue
+    class QuantizedLinearLayer : public Layer
+    {
+    public:
+        // weights: [out_features, in_features] row-major, weight_scales and bias: [out_features]
+        QuantizedLinearLayer(size_t in_features, size_t out_features, const int8_t* weights,
+                             Tensor weight_scales, Tensor bias, float input_scale);
+        
+        // per output channel quantization of a float layer
+        static std::unique_ptr<QuantizedLinearLayer> quantize(const LinearLayer& layer, float input_scale);
+        
+        void forward(const Tensor& input, Tensor& output) override;
+        void forward(const Tensor& input, Tensor& output, ThreadPool* pool) override;
+        std::vector<size_t> outputShape(const std::vector<size_t>& input_shape) const override;
+        uint64_t flops(const std::vector<size_t>& input_shape) const override;
+        bool canFuse(const Layer& next) const override;
+        void forwardFused(const Tensor& input, Tensor& output, Layer& next, ThreadPool* pool) override;
+        void addParameterBytes(ParameterBytes& bytes) const override;
+        
+        size_t inFeatures() const { return in_features_; }
+        size_t outFeatures() const { return out_features_; }
+        float inputScale() const { return input_scale_; }
+        const int8_t* weightRow(size_t out) const { return weights_.data() + out * padded_in_; }
+        const Tensor& weightScales() const { return weight_scales_; }
+        const Tensor& bias() const { return bias_; }
+        
+        friend class ModelLoader;
+        
+    private:
+        size_t in_features_;
+        size_t out_features_;
+        size_t padded_in_;                  // in_features rounded up to Kernels::INT8_K_ALIGNMENT
+        std::vector<int8_t> weights_;       // [out_features, padded_in], zero padded
+        std::vector<int32_t> weight_sums_;  // per output channel
+        Tensor weight_scales_;
+        Tensor bias_;
+        float input_scale_;
+        
+        void forwardWithEpilogue(const Tensor& input, Tensor& output, ThreadPool* pool, Activation activation);
     };
 
-    // activation layers (stateless)
+    // linear layer with int4 weights (symmetric, one scale per group of group_size inputs in every
+    // output channel), dequantized on the fly inside the gemm; activations and sums stay fp32
+    // weight-only: single sample inference is bound by streaming the weights, which are 8x smaller than fp32
+    class Int4LinearLayer : public Layer
+    {
+    public:
+        // packed: [out_features, padded_in / 2] bytes in the layout of Kernels::INT4_BLOCK, where padded_in is
+        // in_features rounded up to a whole group (zero weights past in_features); .minn files store these
+        // bytes as is under DataType::INT4, but they aren't that dtype's nibble order (see DataType::INT4)
+        // scales: [out_features, padded_in / group_size] FLOAT32, FLOAT16 or BFLOAT16 (16-bit scales are widened
+        // to fp32 once here and saved in their own dtype again), bias: [out_features] FLOAT32
+        // copy_weights = false uses packed in place (e.g. a mapped model file), it must outlive the layer
+        Int4LinearLayer(size_t in_features, size_t out_features, size_t group_size, const uint8_t* packed,
+                        Tensor scales, Tensor bias, bool copy_weights = true);
+        
+        // weights_ may point into owned_weights_
+        Int4LinearLayer(const Int4LinearLayer&) = delete;
+        Int4LinearLayer& operator=(const Int4LinearLayer&) = delete;
+        
+        // group-wise quantization of a float layer, group_size a multiple of Kernels::INT4_BLOCK
+        // scale_dtype FLOAT16 / BFLOAT16 rounds every scale to it before the group is quantized with it;
+        // throws std::invalid_argument for other dtypes or a scale the 16-bit type can't hold
+        static std::unique_ptr<Int4LinearLayer> quantize(const LinearLayer& layer, size_t group_size,
+                                                         DataType scale_dtype = DataType::FLOAT32);
+        
+        void forward(const Tensor& input, Tensor& output) override;
+        void forward(const Tensor& input, Tensor& output, ThreadPool* pool) override;
+        std::vector<size_t> outputShape(const std::vector<size_t>& input_shape) const override;
+        uint64_t flops(const std::vector<size_t>& input_shape) const override;
+        bool canFuse(const Layer& next) const override;
+        void forwardFused(const Tensor& input, Tensor& output, Layer& next, ThreadPool* pool) override;
+        void addParameterBytes(ParameterBytes& bytes) const override;
+        
+        size_t inFeatures() const { return in_features_; }
+        size_t outFeatures() const { return out_features_; }
+        size_t groupSize() const { return group_size_; }
+        size_t paddedInFeatures() const { return padded_in_; }
+        const uint8_t* weightRow(size_t out) const { return weights_ + out * (padded_in_ / 2); }
+        const Tensor& scales() const { return scales_; }             // always FLOAT32
+        DataType scaleType() const { return scale_dtype_; }           // what the scales are stored as
+        const Tensor& bias() const { return bias_; }
+        
+        friend class ModelLoader;
+        
+    private:
+        size_t in_features_;
+        size_t out_features_;
+        size_t group_size_;
+        size_t padded_in_;                    // in_features rounded up to group_size
+        std::vector<uint8_t> owned_weights_;  // empty when the weights are used in place
+        const uint8_t* weights_;              // [out_features, padded_in / 2]
+        DataType scale_dtype_;
+        Tensor scales_;
+        Tensor bias_;
+        
+        void forwardWithEpilogue(const Tensor& input, Tensor& output, ThreadPool* pool, Activation activation);
+    };
+
+    // activation layers (stateless, elementwise -> all run in place)
     class ReLULayer : public Layer
     {
     public:
         ReLULayer() : Layer(LayerType::RELU) {}
+        using Layer::forward;
         void forward(const Tensor& input, Tensor& output) override;
+        bool supportsInPlace() const override { return true; }
+        void forwardInPlace(Tensor& tensor) override;
     };
 
     class SigmoidLayer : public Layer  
     {
     public:
         SigmoidLayer() : Layer(LayerType::SIGMOID) {}
+        using Layer::forward;
         void forward(const Tensor& input, Tensor& output) override;
+        uint64_t flops(const std::vector<size_t>& input_shape) const override;
+        bool supportsInPlace() const override { return true; }
+        void forwardInPlace(Tensor& tensor) override;
     };
 
     class SoftmaxLayer : public Layer
     {
     public:
         SoftmaxLayer() : Layer(LayerType::SOFTMAX) {}
+        using Layer::forward;
         void forward(const Tensor& input, Tensor& output) override;
+        uint64_t flops(const std::vector<size_t>& input_shape) const override;
+        bool supportsInPlace() const override { return true; }
+        void forwardInPlace(Tensor& tensor) override;
     };
 
     // nn model container -> this is the main class that holds the layers and metadata
@@ -92,7 +279,17 @@ namespace mininn
         const std::vector<size_t>& getInputShape() const { return input_shape_; }
         const std::vector<size_t>& getOutputShape() const { return output_shape_; }
         
+        // file the layers' weight tensors point into when loaded with LoadMode::MMAP
+        // the model keeps it mapped for as long as it lives
+        void setMappedFile(std::shared_ptr<const MappedFile> file) { mapped_file_ = std::move(file); }
+        bool isMapped() const { return mapped_file_ != nullptr; }
+        size_t mappedBytes() const;
+        
+        // all layers' parameter bytes
+        ParameterBytes parameterBytes() const;
+        
     private:
+        std::shared_ptr<const MappedFile> mapped_file_;  // declared first so it outlives the layers
         std::vector<std::unique_ptr<Layer>> layers_;
         std::vector<size_t> input_shape_;
         std::vector<size_t> output_shape_;
@@ -101,10 +298,11 @@ namespace mininn
     namespace ModelFormat 
     {
         constexpr uint32_t MAGIC_NUMBER = 0x4E4E494D;  // "MINN" in hex
-        constexpr uint16_t VERSION_MAJOR = 1;
+        constexpr uint16_t VERSION_MAJOR = 2;          // written by saveToFile
         constexpr uint16_t VERSION_MINOR = 0;
+        constexpr uint16_t VERSION_MAJOR_V1 = 1;       // still loaded: layers and tensors inline, in order
         
-        // file header structure (total: 16 bytes)
+        // file header structure, shared by every version (total: 16 bytes)
         struct Header 
         {
             uint32_t magic;           // magic number for format validation
@@ -113,31 +311,91 @@ namespace mininn
             uint32_t num_layers;      // number of layers in the model
             uint32_t reserved;        // reserved for future use
         };
+        
+        // v2 layout: Header, ModelInfo, LayerEntry[num_layers], TensorEntry[num_tensors], then the
+        // tensor payloads, each starting at a multiple of TENSOR_ALIGNMENT from the start of the file
+        // (so mapped tensors are ready for aligned simd loads, and any layer can be read on its own)
+        constexpr size_t TENSOR_ALIGNMENT = 64;
+        constexpr uint32_t MAX_RANK = 8;
+        
+        // model metadata and table size (total: 80 bytes)
+        struct ModelInfo
+        {
+            uint32_t num_tensors;
+            uint32_t input_rank;
+            uint32_t output_rank;
+            uint32_t reserved;
+            uint32_t input_shape[MAX_RANK];
+            uint32_t output_shape[MAX_RANK];
+        };
+        
+        // one per layer (total: 12 bytes)
+        struct LayerEntry
+        {
+            uint8_t type;             // LayerType
+            uint8_t reserved[3];
+            uint32_t first_tensor;    // index of the layer's first tensor in the tensor table
+            uint32_t num_tensors;     // linear: weights then bias, activations: none
+                                      // linear_int8: int8 weights [out, in], weight scales, bias, input scale [1]
+                                      // linear_int4: int4 weights [out, in] (packed rows padded to whole
+                                      // groups), group scales [out, groups], bias
+        };
+        
+        // one per tensor (total: 56 bytes)
+        struct TensorEntry
+        {
+            uint64_t offset;          // payload position from the start of the file
+            uint64_t byte_length;     // payload size
+            uint8_t dtype;            // DataType
+            uint8_t rank;
+            uint16_t reserved;
+            uint32_t shape[MAX_RANK]; // unused dimensions are 0
+            uint32_t reserved2;
+        };
     }
 
+    // how loadFromFile gets tensor data into memory
+    enum class LoadMode
+    {
+        COPY = 0,   // read the file once and copy each tensor into its own buffer
+        MMAP = 1    // map the file and point weight tensors straight into it (read-only, shared page cache)
+    };
+
     // model loader with comprehensive error handling
     class ModelLoader
     {
     public:
-        static std::unique_ptr<Model> loadFromFile(const std::string& filepath);
+        // reads v2 and v1 files; with LoadMode::MMAP, a tensor whose data sits at an offset aligned to its
+        // element type in the file is used in place and any other is copied (v2 aligns every payload, v1
+        // doesn't, so its wider tensors copy unless they happen to land aligned); int8 weights are always
+        // copied, padded on load
+        // saveToFile always writes v2 and rejects models without layers
+        // with a tracer the load is recorded as one span
+        static std::unique_ptr<Model> loadFromFile(const std::string& filepath, LoadMode mode = LoadMode::COPY,
+                                                   Tracer* tracer = nullptr);
         static void saveToFile(const Model& model, const std::string& filepath);
         
     private:
-        // loading helpers
+        // loading helpers, parsing from the file's bytes in memory
+        static std::unique_ptr<Model> parseModel(ModelReader& reader);
         static void validateHeader(const ModelFormat::Header& header);
-        static std::unique_ptr<Layer> loadLayer(std::ifstream& file);
-        static Tensor loadTensor(std::ifstream& file);
+        static std::unique_ptr<Layer> createLayer(uint8_t layer_type_raw, std::vector<Tensor>& tensors);
+        
+        // v1: everything in file order
+        static void parseV1(ModelReader& reader, const ModelFormat::Header& header, Model& model);
+        static Tensor loadTensor(ModelReader& reader);
         
-        // file I/O helpers with error checking
-        template<typename T>
-        static void readBinary(std::ifstream& file, T& value);
+        // v2: through the layer and tensor tables
+        static void parseV2(ModelReader& reader, const ModelFormat::Header& header, Model& model);
+        static Tensor loadTensor(ModelReader& reader, const ModelFormat::TensorEntry& entry);
+        static std::unique_ptr<Layer> loadQuantizedLinear(ModelReader& reader,
+                                                          const ModelFormat::TensorEntry* entries, uint32_t count);
+        static std::unique_ptr<Layer> loadInt4Linear(ModelReader& reader,
+                                                     const ModelFormat::TensorEntry* entries, uint32_t count);
         
         // write binary data to file
         template<typename T>  
         static void writeBinary(std::ofstream& file, const T& value);
-        
-        // helper function to save tensors
-        static void saveTensor(std::ofstream& file, const Tensor& tensor);
     };
 
 } // namespace mininn
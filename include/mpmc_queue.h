@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace mininn
+{
+    // bounded lock-free multi-producer multi-consumer queue (Vyukov's ring buffer)
+    // every cell carries a sequence number saying whose turn it is: a producer may fill cell i when
+    // its sequence equals the enqueue position, a consumer may empty it when it's one past that
+    // so neither side ever takes a lock and each push / pop costs one CAS on its position
+    template <typename T>
+    class MpmcQueue
+    {
+    public:
+        // capacity is rounded up to a power of two
+        explicit MpmcQueue(size_t capacity)
+            : enqueue_pos_(0), dequeue_pos_(0)
+        {
+            size_t size = 2;
+            while (size < capacity)
+            {
+                size *= 2;
+            }
+            mask_ = size - 1;
+
+            cells_.reset(new Cell[size]);
+            for (size_t i = 0; i < size; ++i)
+            {
+                cells_[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        MpmcQueue(const MpmcQueue&) = delete;
+        MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+        // false when full (value is left untouched then)
+        bool tryPush(T&& value)
+        {
+            size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Cell& cell = cells_[pos & mask_];
+                const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+
+                if (diff == 0)
+                {
+                    if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        cell.value = std::move(value);
+                        cell.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false;   // the consumer of the previous lap hasn't emptied this cell yet
+                }
+                else
+                {
+                    pos = enqueue_pos_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // false when empty
+        bool tryPop(T& value)
+        {
+            size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Cell& cell = cells_[pos & mask_];
+                const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+
+                if (diff == 0)
+                {
+                    if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        value = std::move(cell.value);
+                        cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false;   // no producer has filled this cell yet
+                }
+                else
+                {
+                    pos = dequeue_pos_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // a snapshot: true while a push has claimed a cell but not yet filled it
+        bool empty() const
+        {
+            return enqueue_pos_.load(std::memory_order_acquire) == dequeue_pos_.load(std::memory_order_acquire);
+        }
+
+        size_t capacity() const { return mask_ + 1; }
+
+    private:
+        // a cell per cache line, and the two positions on their own lines, so producers and
+        // consumers don't invalidate each other's lines
+        struct alignas(64) Cell
+        {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        std::unique_ptr<Cell[]> cells_;
+        size_t mask_;
+        alignas(64) std::atomic<size_t> enqueue_pos_;
+        alignas(64) std::atomic<size_t> dequeue_pos_;
+    };
+
+} // namespace mininn
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mininn
+{
+    // hardware events counted per layer (see InferenceEngine::enableHardwareCounters)
+    enum class PerfEvent
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        L1D_MISSES,      // L1 data cache read misses
+        LLC_MISSES,      // last level cache misses, i.e. lines that came from memory
+        BRANCH_MISSES
+    };
+    constexpr size_t NUM_PERF_EVENTS = 5;
+
+    const char* perfEventName(PerfEvent event);
+
+    // counts of the events that could be opened, the others are marked unavailable rather than 0
+    struct PerfCounts
+    {
+        static constexpr uint64_t CACHE_LINE_BYTES = 64;
+
+        std::array<uint64_t, NUM_PERF_EVENTS> values{};
+        uint32_t available = 0;      // bit per PerfEvent
+
+        bool has(PerfEvent event) const { return available & (1u << static_cast<size_t>(event)); }
+        uint64_t get(PerfEvent event) const { return values[static_cast<size_t>(event)]; }
+        bool empty() const { return available == 0; }
+
+        // instructions per cycle, 0 when either isn't counted
+        double ipc() const;
+        // memory traffic the LLC misses stand for (a line each)
+        uint64_t memoryBytes() const { return get(PerfEvent::LLC_MISSES) * CACHE_LINE_BYTES; }
+
+        // events available in both stay available (an empty one takes the other's)
+        PerfCounts& operator+=(const PerfCounts& other);
+        // counts between two reads of the same counters
+        PerfCounts operator-(const PerfCounts& earlier) const;
+    };
+
+    // the calling thread's hardware counters through linux perf_event_open, user space only
+    // opening never throws: in a container or VM without a PMU, or with perf_event_paranoid / seccomp
+    // forbidding it, the events just come out unavailable and error() says why
+    // the events are one group, so they are scheduled (and multiplexed) together; multiplexed counts
+    // are scaled up to the whole time the group was enabled
+    class PerfCounters
+    {
+    public:
+        PerfCounters();
+        ~PerfCounters();
+
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        // at least one event could be opened
+        bool available() const { return counts_available_ != 0; }
+        // why the first event that failed to open did, empty if none did
+        const std::string& error() const { return error_; }
+
+        // running totals since the counters were opened; only meaningful on the thread that opened them
+        PerfCounts read() const;
+
+        // one set per thread, opened on first use (a handful of syscalls)
+        static PerfCounters& forThisThread();
+        // false on platforms without perf_event_open, where every event is unavailable
+        static bool supported();
+
+    private:
+        std::array<int, NUM_PERF_EVENTS> fds_;
+        int leader_ = -1;
+        uint32_t counts_available_ = 0;
+        std::string error_;
+    };
+
+} // namespace mininn
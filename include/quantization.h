@@ -0,0 +1,63 @@
+#pragma once
+
+#include "model_loader.h"
+#include "tensor.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mininn
+{
+    // post-training quantization: calibration and conversion of float models
+    namespace Quantization
+    {
+        // symmetric int8: x ~= scale * q with q in [-127, 127] (-128 is never produced)
+        constexpr int INT8_LIMIT = 127;
+
+        // scale that maps [-max_abs, max_abs] onto the int8 range (1 for all-zero data)
+        float int8Scale(float max_abs);
+
+        // q[i] = round(x[i] / scale), clamped to the int8 range
+        void quantizeInt8(const float* x, size_t n, float scale, int8_t* q);
+
+        float maxAbs(const float* x, size_t n);
+
+        // symmetric int4: x ~= scale * q with q in [-7, 7], one scale per group of weights
+        constexpr int INT4_LIMIT = 7;
+        constexpr size_t DEFAULT_INT4_GROUP_SIZE = 32;
+
+        float int4Scale(float max_abs);
+
+        // q[i] = round(x[i] / scale), clamped to the int4 range (one value per byte, unpacked)
+        void quantizeInt4(const float* x, size_t n, float scale, int8_t* q);
+
+        // n int4 values into n / 2 bytes, in the block layout described at Kernels::INT4_BLOCK
+        // n must be a multiple of Kernels::INT4_BLOCK
+        void packInt4(const int8_t* q, size_t n, uint8_t* packed);
+
+        // element i of a packed int4 array
+        int8_t unpackInt4(const uint8_t* packed, size_t i);
+
+        // largest |x| reaching each layer's input over the calibration samples (one entry per layer)
+        std::vector<float> calibrate(const Model& model, const std::vector<Tensor>& samples);
+
+        // copy of model with every LinearLayer replaced by a QuantizedLinearLayer
+        // with samples, activations get static scales from calibrate(); without, each row is scaled at run time
+        std::unique_ptr<Model> quantizeInt8(const Model& model, const std::vector<Tensor>& calibration_samples);
+
+        // copy of model with every LinearLayer replaced by an Int4LinearLayer (weight-only, activations stay fp32)
+        // group_size must be a multiple of Kernels::INT4_BLOCK, e.g. 32 or 128; scale_dtype FLOAT16 or BFLOAT16
+        // stores the group scales in half the bytes (see Int4LinearLayer::quantize)
+        std::unique_ptr<Model> quantizeInt4(const Model& model, size_t group_size = DEFAULT_INT4_GROUP_SIZE,
+                                            DataType scale_dtype = DataType::FLOAT32);
+
+        // copy of model with every LinearLayer's weights stored as dtype (FLOAT32, FLOAT16 or BFLOAT16,
+        // rounded to nearest even); biases stay fp32 and the layers still accumulate in fp32
+        std::unique_ptr<Model> convertWeights(const Model& model, DataType dtype);
+
+        // calibration samples from a raw float32 file (native byte order) of back to back inputs
+        std::vector<Tensor> loadSamples(const std::string& filepath, const std::vector<size_t>& input_shape);
+    }
+
+} // namespace mininn
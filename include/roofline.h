@@ -0,0 +1,76 @@
+#pragma once
+
+#include "inference_engine.h"
+#include "thread_pool.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace mininn
+{
+    // the most this machine does with the active kernel tier: the two roofs of a roofline
+    struct MachinePeak
+    {
+        double gflops = 0.0;              // fp32 gemm micro-kernel on panels that stay in L1
+        double gbytes_per_second = 0.0;   // streaming axpy over buffers far bigger than the caches
+        size_t threads = 1;
+
+        // flops per byte where the roofline turns from memory bound to compute bound
+        double ridgePoint() const;
+        // the roof at this arithmetic intensity: min(gflops, intensity * bandwidth)
+        double attainableGflops(double intensity) const;
+
+        // runs each microbenchmark as one copy per pool thread (one thread without), all copies on distinct
+        // threads and started together, each repeated for at least min_time; the defaults take about a second
+        static MachinePeak measure(ThreadPool* pool = nullptr,
+                                   std::chrono::milliseconds min_time = std::chrono::milliseconds(50));
+    };
+
+    // one pass of the engine: a layer, or a layer with the one fused into it
+    struct LayerRoofline
+    {
+        size_t index = 0;           // of the (first) layer
+        std::string name;           // "Linear", "Linear+ReLU" when fused
+        uint64_t flops = 0;         // Layer::flops for the shapes it ran on
+        uint64_t bytes = 0;         // Layer::bytesMoved, a fused layer works in registers and adds none
+        double time_ms = 0.0;       // median over the runs
+
+        double gflops() const;
+        // flops per byte, 0 without bytes
+        double intensity() const;
+    };
+
+    // measured layer times against the machine's roofs: which layers take the time, and how far each
+    // is from what its arithmetic intensity allows
+    struct RooflineReport
+    {
+        MachinePeak peak;
+        std::vector<size_t> input_shape;    // what every run fed the model ([batch, features] for batches)
+        size_t runs = 0;
+        double total_ms = 0.0;              // median whole call, layers plus the engine's own overhead
+        std::vector<LayerRoofline> layers;
+
+        uint64_t totalFlops() const;
+        uint64_t totalBytes() const;
+
+        // achieved against the compute peak, and against the roof at the layer's intensity
+        // the bandwidth roof is memory's, so a layer whose weights stay in cache between runs can pass 100%
+        double percentOfPeak(const LayerRoofline& layer) const;
+        double percentOfRoof(const LayerRoofline& layer) const;
+        bool memoryBound(const LayerRoofline& layer) const { return layer.intensity() < peak.ridgePoint(); }
+
+        // aligned columns per layer plus a total, slowest layers are the ones worth optimizing
+        void print(std::ostream& out) const;
+        void writeJson(std::ostream& out) const;
+    };
+
+    // profiles runs calls on random inputs through a clone of engine (so its settings and stats stay
+    // as they are), after a few warmup calls; batch_size > 1 stacks that many samples per predictBatch
+    // throws std::invalid_argument for runs == 0, batch_size == 0, or batches of a model without flat inputs
+    RooflineReport measureRoofline(const InferenceEngine& engine, const MachinePeak& peak, size_t batch_size = 1,
+                                   size_t runs = 100);
+
+} // namespace mininn
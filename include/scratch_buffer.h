@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace mininn
+{
+    // process wide totals of the per-thread scratch below (gemm packing panels, quantized activations)
+    namespace ScratchMemory
+    {
+        size_t bytes();        // held right now, over all threads
+        size_t peakBytes();    // most ever held at once
+
+        void add(size_t bytes);
+        void release(size_t bytes);
+    }
+
+    // grow-only buffer meant to be thread_local: kernels reuse it call after call, and its
+    // capacity is counted in ScratchMemory until the owning thread exits
+    template <typename T>
+    class ScratchBuffer
+    {
+    public:
+        ScratchBuffer() = default;
+        ~ScratchBuffer() { ScratchMemory::release(buffer_.capacity() * sizeof(T)); }
+
+        ScratchBuffer(const ScratchBuffer&) = delete;
+        ScratchBuffer& operator=(const ScratchBuffer&) = delete;
+
+        // at least n elements (new ones zeroed, earlier contents kept)
+        T* reserve(size_t n)
+        {
+            if (buffer_.size() < n)
+            {
+                const size_t before = buffer_.capacity();
+                buffer_.resize(n);
+                ScratchMemory::add((buffer_.capacity() - before) * sizeof(T));
+            }
+            return buffer_.data();
+        }
+
+        T* data() { return buffer_.data(); }
+
+    private:
+        std::vector<T> buffer_;
+    };
+
+} // namespace mininn
@@ -4,17 +4,46 @@
 #include <memory>
 #include <cstdint>
 #include <stdexcept>
+#include <string>
+#include <type_traits>
 
 namespace mininn 
 {
-    // TODO later: add more data type support
+    // element types a tensor can hold (values are stored in .minn files, append new ones at the end)
     enum class DataType 
     {
         FLOAT32,
         INT8,
-        INT4
+        INT4,       // two per byte, element 2i in the low nibble, two's complement; LINEAR_INT4 weights are
+                    // the exception, stored under this dtype in the Kernels::INT4_BLOCK layout (q + 8,
+                    // element i paired with i + 16), only Int4LinearLayer reads them
+        FLOAT16,    // ieee binary16
+        BFLOAT16    // top half of an fp32
     };
 
+    constexpr size_t NUM_DATA_TYPES = 5;
+
+    // 16-bit float element types, raw bits (convert through Tensor::to or the kernel table)
+    struct Float16
+    {
+        uint16_t bits;
+    };
+
+    struct BFloat16
+    {
+        uint16_t bits;
+    };
+
+    // c++ element type behind data<T>() for each dtype (INT4 tensors are accessed as packed bytes)
+    template<typename T> struct DataTypeOf;
+    template<> struct DataTypeOf<float> { static constexpr DataType value = DataType::FLOAT32; };
+    template<> struct DataTypeOf<int8_t> { static constexpr DataType value = DataType::INT8; };
+    template<> struct DataTypeOf<uint8_t> { static constexpr DataType value = DataType::INT4; };
+    template<> struct DataTypeOf<Float16> { static constexpr DataType value = DataType::FLOAT16; };
+    template<> struct DataTypeOf<BFloat16> { static constexpr DataType value = DataType::BFLOAT16; };
+
+    const char* dataTypeName(DataType dtype);
+
     class Tensor 
     {
     public:
@@ -24,7 +53,19 @@ namespace mininn
         Tensor(const std::vector<size_t>& shape, const std::vector<float>& data, 
                DataType dtype = DataType::FLOAT32);
         
+        // owned buffers are aligned to this many bytes (a cache line, one zmm)
+        static constexpr size_t ALIGNMENT = 64;
+        
+        // bytes needed for count elements of dtype (INT4 rounds up to whole bytes)
+        static size_t byteSize(DataType dtype, size_t count);
+        
+        // non-owning tensor over memory kept alive by someone else (e.g. an engine's buffer arena)
+        // writes go straight to that memory, copies of a view are ordinary owning tensors
+        static Tensor view(float* data, const std::vector<size_t>& shape);
+        static Tensor view(void* data, const std::vector<size_t>& shape, DataType dtype);
+        
         // deep copy constructor and assignment operator
+        // assignment reuses the existing buffer (or view) when the dtype and element count match
         Tensor(const Tensor& other);
         Tensor& operator=(const Tensor& other);
         
@@ -34,21 +75,54 @@ namespace mininn
         
         // destructor
         ~Tensor() = default;
+        
+        // converted copy, e.g. t.to(DataType::FLOAT16)
+        // float <-> fp16/bf16 round to nearest even, float -> INT8/INT4 rounds and saturates (no scaling,
+        // see Quantization for that), other pairs go through float
+        Tensor to(DataType dtype) const;
 
         // accessors
         const std::vector<size_t>& shape() const { return shape_; }
         size_t rank() const { return shape_.size(); }
         size_t size() const { return total_size_; }
         DataType dtype() const { return dtype_; }
+        size_t byteSize() const { return byteSize(dtype_, total_size_); }
+        bool isView() const { return data_ != nullptr && !storage_; }
+        
+        // data access, float for FLOAT32 tensors (checked in debug builds)
+        float* data() { return static_cast<float*>(fastData(DataType::FLOAT32)); }
+        const float* data() const { return static_cast<const float*>(fastData(DataType::FLOAT32)); }
+        
+        // typed access, throws unless T is the tensor's element type (see DataTypeOf)
+        template<typename T>
+        T* data() { return static_cast<T*>(checkedData(DataTypeOf<T>::value)); }
+        template<typename T>
+        const T* data() const { return static_cast<const T*>(checkedData(DataTypeOf<T>::value)); }
         
-        // data access
-        float* data() { return data_.get(); }
-        const float* data() const { return data_.get(); }
+        // untyped bytes, byteSize() of them
+        void* raw() { return data_; }
+        const void* raw() const { return data_; }
+        
+        const std::vector<size_t>& strides() const { return strides_; }
         
         // element access with bounds checking
         float& at(const std::vector<size_t>& indices);
         const float& at(const std::vector<size_t>& indices) const;
         
+        // allocation free element access with bounds checking, e.g. t.at(i, j)
+        // (element access is for FLOAT32 tensors, others go through data<T>() or to())
+        template<typename... Indices>
+        float& at(Indices... indices) { return data<float>()[checkedOffset(indices...)]; }
+        template<typename... Indices>
+        const float& at(Indices... indices) const { return data<float>()[checkedOffset(indices...)]; }
+        
+        // fast path for hot loops, e.g. t(i, j)
+        // checks bounds in debug builds, compiles down to a stride dot product with NDEBUG
+        template<typename... Indices>
+        float& operator()(Indices... indices) { return data()[fastOffset(indices...)]; }
+        template<typename... Indices>
+        const float& operator()(Indices... indices) const { return data()[fastOffset(indices...)]; }
+        
         void reshape(const std::vector<size_t>& new_shape);
         
         Tensor& operator+=(const Tensor& other);
@@ -57,15 +131,87 @@ namespace mininn
         Tensor& operator/=(const Tensor& other);
 
     private:
+        struct AlignedDelete
+        {
+            void operator()(uint8_t* bytes) const;
+        };
+        
         std::vector<size_t> shape_;        // shape of the tensor (e.g. [2,3,4] for 2x3x4 tensor)
+        std::vector<size_t> strides_;      // elements to skip per step in each dimension (row-major)
         size_t total_size_;                // total number of elements
         DataType dtype_;
-        std::unique_ptr<float[]> data_;    // actual data storage using smart pointer
+        std::unique_ptr<uint8_t[], AlignedDelete> storage_; // owned ALIGNMENT aligned bytes, null for views
+        void* data_;                       // storage_ or the viewed memory
+        
+        // zeroed, aligned buffer for this tensor's dtype and size (or none when empty)
+        void allocate();
+        
+        void* checkedData(DataType expected) const
+        {
+            if (dtype_ != expected)
+            {
+                throw std::invalid_argument(std::string("Tensor holds ") + dataTypeName(dtype_) +
+                                            ", not " + dataTypeName(expected));
+            }
+            return data_;
+        }
+        
+        void* fastData(DataType expected) const
+        {
+#ifdef NDEBUG
+            (void)expected;
+            return data_;
+#else
+            return checkedData(expected);
+#endif
+        }
         
         // helper methods
         void validateShape(const std::vector<size_t>& shape) const;
         size_t calculateIndex(const std::vector<size_t>& indices) const;
         size_t calculateTotalSize() const;
+        void calculateStrides();
+        
+        template<typename... Indices>
+        size_t checkedOffset(Indices... indices) const
+        {
+            static_assert((std::is_integral_v<Indices> && ...), "Tensor indices must be integral");
+            
+            if (sizeof...(Indices) != shape_.size())
+            {
+                throw std::invalid_argument("Number of indices must match tensor rank");
+            }
+            
+            const size_t idx[] = {static_cast<size_t>(indices)...};
+            size_t offset = 0;
+            for (size_t i = 0; i < sizeof...(Indices); ++i)
+            {
+                if (idx[i] >= shape_[i])
+                {
+                    throw std::out_of_range("Index out of bounds");
+                }
+                offset += idx[i] * strides_[i];
+            }
+            return offset;
+        }
+        
+        template<typename... Indices>
+        size_t fastOffset(Indices... indices) const
+        {
+#ifdef NDEBUG
+            static_assert((std::is_integral_v<Indices> && ...), "Tensor indices must be integral");
+            
+            const size_t idx[] = {static_cast<size_t>(indices)...};
+            size_t offset = 0;
+            for (size_t i = 0; i < sizeof...(Indices); ++i)
+            {
+                offset += idx[i] * strides_[i];
+            }
+            return offset;
+#else
+            return checkedOffset(indices...);
+#endif
+        }
     };
 
     // binary operators
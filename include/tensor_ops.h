@@ -3,18 +3,27 @@
 
 namespace mininn
 {
+    class ThreadPool;
+
     class TensorOps
     {
     public:
 
         // static methods since no class instance is required -> idiomatic in c++
-        static void matmul(const Tensor& tensor1, const Tensor& tensor2, Tensor& result);
+        // blocked gemm over packed panels (see gemm.h)
+        // result is reused without reallocating when it already has the right shape
+        // pass a pool to split large products across its threads
+        static void matmul(const Tensor& tensor1, const Tensor& tensor2, Tensor& result,
+                           ThreadPool* pool = nullptr);
 
-        // cache friendly version
-        // static void matmul_optimized(const Tensor& tensor1, const Tensor& tensor2, Tensor& result);
+        // plain triple loop, the ground truth the blocked gemm is tested and benchmarked against
+        static void matmul_reference(const Tensor& tensor1, const Tensor& tensor2, Tensor& result);
 
         static void relu(Tensor& tensor);
         static void sigmoid(Tensor& tensor);
         static void softmax(Tensor& tensor);
+        
+        // softmax over the last dimension -> each row of a [batch, features] tensor sums to 1
+        static void softmax_rows(Tensor& tensor);
     };
 }; // namespace mininn
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mininn
+{
+    // persistent pool of worker threads with one work-stealing deque per worker
+    // workers pop their own deque from the back (hot in cache) and steal from the front of others
+    class ThreadPool
+    {
+    public:
+        // num_threads counts the calling thread too, so ThreadPool(4) starts 3 workers
+        // 0 -> one thread per hardware core, pin_threads binds worker i to core i (linux only)
+        explicit ThreadPool(size_t num_threads = 0, bool pin_threads = false);
+        ~ThreadPool();
+
+        // threads are tied to this object
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // threads taking part in parallelFor (workers + caller)
+        size_t size() const { return workers_.size() + 1; }
+
+        // calls fn(begin, end) over [0, count) in chunks of at least grain elements and blocks until done
+        // the caller runs chunks too, so nesting parallelFor inside a task can't deadlock
+        // the first exception thrown by fn is rethrown here after all chunks finish
+        void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+        static size_t hardwareThreads();
+
+    private:
+        using Task = std::function<void()>;
+
+        struct WorkQueue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<WorkQueue>> queues_;  // one per worker
+        std::vector<std::thread> workers_;
+
+        std::mutex sleep_mutex_;
+        std::condition_variable wake_;
+        std::atomic<size_t> pending_;     // queued but not yet started
+        std::atomic<size_t> next_queue_;  // round robin target for submissions from outside the pool
+        bool stopping_;
+
+        void submit(Task task);
+        void workerLoop(size_t index);
+        bool tryPop(size_t index, Task& task);
+        bool trySteal(size_t thief, Task& task);
+        bool runPendingTask();            // lets a waiting thread help out
+        size_t currentQueue() const;      // own queue for workers, SIZE_MAX for outside threads
+    };
+
+} // namespace mininn
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace mininn
+{
+    // opt-in timeline recorder: complete events ("this ran from t0 to t1 on thread n") go into a fixed
+    // ring buffer, the newest capacity of them are kept, and the lot is written out as Chrome
+    // trace-event JSON (open in chrome://tracing or ui.perfetto.dev)
+    // recording claims a slot with one atomic add, so any number of threads can record at once;
+    // write the JSON once the traced work is done, events recorded meanwhile may come out torn
+    class Tracer
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        static constexpr size_t DEFAULT_CAPACITY = 16384;
+        static constexpr size_t ARGS_SIZE = 256;   // bytes of an event's args (JSON members, dropped if longer)
+
+        explicit Tracer(size_t capacity = DEFAULT_CAPACITY);
+
+        Tracer(const Tracer&) = delete;
+        Tracer& operator=(const Tracer&) = delete;
+
+        // name and category must outlive the tracer (string literals); args are the members of the event's
+        // args object without braces, e.g. "\"layer\":3" (copied, or left out whole if they don't fit in
+        // ARGS_SIZE: cut short they could end inside a string and break the JSON)
+        void record(const char* name, const char* category, Clock::time_point start, Clock::time_point end,
+                    const char* args = nullptr);
+        // same, on another thread's track (e.g. a request's wait, recorded when it's taken off the queue)
+        void record(const char* name, const char* category, Clock::time_point start, Clock::time_point end,
+                    const char* args, uint32_t thread_id);
+
+        size_t size() const;        // events held
+        size_t dropped() const;     // overwritten by newer ones
+        size_t capacity() const { return capacity_; }
+        void clear();
+
+        // {"traceEvents":[...]} with the events in the order they were recorded
+        void writeJson(std::ostream& out) const;
+        // throws std::runtime_error if the file can't be written
+        void saveJson(const std::string& filepath) const;
+
+        // small sequential id of the calling thread, the tid of its events
+        static uint32_t currentThreadId();
+
+    private:
+        struct Event
+        {
+            std::atomic<uint64_t> sequence{0};   // 1 + index of the event in this slot, 0 while empty
+            const char* name = nullptr;
+            const char* category = nullptr;
+            int64_t start_ns = 0;                // since epoch_
+            int64_t duration_ns = 0;
+            uint32_t thread_id = 0;
+            char args[ARGS_SIZE] = {};
+        };
+
+        size_t capacity_;
+        std::unique_ptr<Event[]> events_;
+        std::atomic<uint64_t> next_;
+        Clock::time_point epoch_;
+    };
+
+    // times the enclosing scope into tracer, or does nothing when tracer is null
+    // e.g. TraceSpan span(tracer, "plan", "engine"); span.setArgs("\"rows\":%zu", rows);
+    class TraceSpan
+    {
+    public:
+        TraceSpan(Tracer* tracer, const char* name, const char* category)
+            : tracer_(tracer), name_(name), category_(category)
+        {
+            if (tracer_)
+            {
+                args_[0] = '\0';
+                start_ = Tracer::Clock::now();
+            }
+        }
+
+        ~TraceSpan()
+        {
+            if (tracer_)
+            {
+                tracer_->record(name_, category_, start_, Tracer::Clock::now(), args_);
+            }
+        }
+
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+
+        bool active() const { return tracer_ != nullptr; }
+
+        // printf style members of the args object (only formatted when tracing), none if they don't fit
+        void setArgs(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+    private:
+        Tracer* tracer_;
+        const char* name_;
+        const char* category_;
+        Tracer::Clock::time_point start_;
+        char args_[Tracer::ARGS_SIZE];
+    };
+
+} // namespace mininn
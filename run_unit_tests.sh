@@ -13,6 +13,8 @@
 #   --sigmoid    : Run only sigmoid tests
 #   --softmax    : Run only softmax tests
 #   --valgrind   : Run with valgrind memory check
+#   --bench      : Compare benchmarks against the stored baseline (records it first if missing)
+#   --bench-update : Re-record the benchmark baseline
 #   --all        : Run all test configurations (default)
 #   --help       : Show this help message
 
@@ -99,8 +101,8 @@ run_test_config() {
 # Function to run individual test suites
 run_individual_tests() {
     local failed=0
-    local test_filters=("TensorTest*" "MatmulTest*" "ReluTest*" "SigmoidTest*" "SoftmaxTest*")
-    local test_names=("Tensor" "MatMul" "ReLU" "Sigmoid" "Softmax")
+    local test_filters=("TensorTest*" "MatmulTest*" "ReluTest*" "SigmoidTest*" "SoftmaxTest*" "KernelsTest*" "ThreadPoolTest*" "MemoryPlanTest*" "QuantizationTest*")
+    local test_names=("Tensor" "MatMul" "ReLU" "Sigmoid" "Softmax" "Kernels" "ThreadPool" "MemoryPlan" "Quantization")
     local exe="./build/all_tests"
     
     if [ ! -f "$exe" ]; then
@@ -143,6 +145,36 @@ run_valgrind() {
     fi
 }
 
+# Function to run the benchmark regression gate
+# BENCH_BASELINE (default benchmarks/baseline.json, machine specific so not checked in) and BENCH_THRESHOLD (default 0.1 = 10%)
+run_benchmarks() {
+    local update=$1
+    local baseline="${BENCH_BASELINE:-benchmarks/baseline.json}"
+    local threshold="${BENCH_THRESHOLD:-0.1}"
+
+    print_header "Running Benchmark Regression Gate"
+
+    # benchmarks need optimized objects
+    make clean > /dev/null 2>&1
+
+    if $update || [ ! -f "$baseline" ]; then
+        if make bench BENCH_ARGS="--json $baseline"; then
+            print_success "Recorded benchmark baseline: $baseline"
+        else
+            print_error "Benchmark run failed"
+            return 1
+        fi
+        return 0
+    fi
+
+    if make bench BENCH_ARGS="--baseline $baseline --threshold $threshold"; then
+        print_success "No benchmark regressions against $baseline"
+    else
+        print_error "Benchmarks regressed against $baseline (or failed to run)"
+        return 1
+    fi
+}
+
 # Function to show help
 show_help() {
     echo "miniNN Test Runner"
@@ -160,6 +192,9 @@ show_help() {
     echo "  --sigmoid     Run only sigmoid tests"
     echo "  --softmax     Run only softmax tests"
     echo "  --valgrind    Run with valgrind memory check"
+    echo "  --bench       Fail on benchmark regressions against benchmarks/baseline.json"
+    echo "                (records the baseline if missing; BENCH_BASELINE, BENCH_THRESHOLD override)"
+    echo "  --bench-update  Re-record the benchmark baseline"
     echo "  --all         Run all test configurations (default)"
     echo "  --help        Show this help message"
     echo ""
@@ -170,6 +205,7 @@ show_help() {
     echo "  $0 --individual      # Run individual test suites"
     echo "  $0 --sanitize --relu # ReLU tests with memory sanitizers"
     echo "  $0 --release --valgrind  # Release build + valgrind"
+    echo "  BENCH_THRESHOLD=0.05 $0 --bench  # Fail on >5% slowdowns"
 }
 
 # Parse command line arguments
@@ -179,6 +215,8 @@ RELEASE=false
 INDIVIDUAL=false
 SINGLE_SUITE=""
 VALGRIND=false
+BENCH=false
+BENCH_UPDATE=false
 ALL=true
 
 while [[ $# -gt 0 ]]; do
@@ -231,6 +269,17 @@ while [[ $# -gt 0 ]]; do
             VALGRIND=true
             shift
             ;;
+        --bench)
+            BENCH=true
+            ALL=false
+            shift
+            ;;
+        --bench-update)
+            BENCH=true
+            BENCH_UPDATE=true
+            ALL=false
+            shift
+            ;;
         --all)
             ALL=true
             shift
@@ -293,6 +342,14 @@ if $VALGRIND; then
     fi
 fi
 
+if $BENCH; then
+    if run_benchmarks $BENCH_UPDATE; then
+        ((TOTAL_PASSED++))
+    else
+        ((TOTAL_FAILED++))
+    fi
+fi
+
 # Summary
 print_header "Test Summary"
 echo -e "Configurations passed: ${GREEN}$TOTAL_PASSED${NC}"
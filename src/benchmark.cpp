@@ -0,0 +1,640 @@
+/* benchmark.cpp
+ *
+ * Micro-benchmark runner. An op's iteration count is calibrated once (doubled
+ * until a batch of calls takes min_time), then every repetition times that
+ * many calls, so all samples measure the same amount of work. Results round
+ * trip through JSON (with a small reader for just that) so a run can be
+ * compared against a stored baseline.
+ */
+
+#include "benchmark.h"
+#include "kernels.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+namespace mininn
+{
+    namespace
+    {
+        using Clock = std::chrono::steady_clock;
+
+        // two-sided 95% normal quantile, for the median's confidence interval
+        constexpr double Z_95 = 1.959964;
+
+        double timeIterations(const std::function<void()>& op, size_t iterations)
+        {
+            const auto start = Clock::now();
+            for (size_t i = 0; i < iterations; ++i)
+            {
+                op();
+            }
+            return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        }
+
+        // 0-based index of the lower 95% confidence bound of the median of n sorted samples
+        // the median's rank is binomial(n, 1/2): n/2 +- z sqrt(n)/2, widened to whole samples
+        size_t medianLowIndex(size_t n)
+        {
+            const double rank = std::floor(n / 2.0 - Z_95 * std::sqrt(static_cast<double>(n)) / 2.0);
+            return static_cast<size_t>(std::max(rank, 0.0));
+        }
+
+        void writeNumber(std::ostream& out, double value)
+        {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.6g", std::isfinite(value) ? value : 0.0);
+            out << buffer;
+        }
+
+        // names are ours (letters, digits, punctuation), but keep the json valid whatever they hold
+        void writeString(std::ostream& out, const std::string& text)
+        {
+            out << '"';
+            for (char c : text)
+            {
+                if (c == '"' || c == '\\')
+                {
+                    out << '\\' << c;
+                }
+                else if (static_cast<unsigned char>(c) >= 0x20)
+                {
+                    out << c;
+                }
+            }
+            out << '"';
+        }
+
+        bool matchesFilter(const std::string& name, const std::string& filter)
+        {
+            if (filter.empty())
+            {
+                return true;
+            }
+
+            std::istringstream patterns(filter);
+            std::string pattern;
+            while (std::getline(patterns, pattern, ','))
+            {
+                if (!pattern.empty() && name.find(pattern) != std::string::npos)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // just enough json to read back what writeJson wrote
+        struct JsonValue
+        {
+            enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+            Type type = NUL;
+            double number = 0.0;
+            std::string string;
+            std::vector<JsonValue> items;
+            std::vector<std::pair<std::string, JsonValue>> members;
+
+            const JsonValue* find(const std::string& key) const
+            {
+                for (const auto& member : members)
+                {
+                    if (member.first == key)
+                    {
+                        return &member.second;
+                    }
+                }
+                return nullptr;
+            }
+        };
+
+        class JsonReader
+        {
+        public:
+            explicit JsonReader(const std::string& text) : text_(text), pos_(0) {}
+
+            JsonValue parseDocument()
+            {
+                JsonValue value = parseValue();
+                skipSpace();
+                if (pos_ != text_.size())
+                {
+                    fail("trailing characters");
+                }
+                return value;
+            }
+
+        private:
+            const std::string& text_;
+            size_t pos_;
+
+            [[noreturn]] void fail(const char* what) const
+            {
+                throw std::runtime_error("Malformed benchmark json at offset " + std::to_string(pos_) + ": " + what);
+            }
+
+            void skipSpace()
+            {
+                while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_])))
+                {
+                    ++pos_;
+                }
+            }
+
+            bool consume(char c)
+            {
+                skipSpace();
+                if (pos_ < text_.size() && text_[pos_] == c)
+                {
+                    ++pos_;
+                    return true;
+                }
+                return false;
+            }
+
+            void expect(char c)
+            {
+                if (!consume(c))
+                {
+                    fail("unexpected character");
+                }
+            }
+
+            bool consumeWord(const char* word)
+            {
+                const size_t length = std::strlen(word);
+                if (text_.compare(pos_, length, word) == 0)
+                {
+                    pos_ += length;
+                    return true;
+                }
+                return false;
+            }
+
+            JsonValue parseValue()
+            {
+                skipSpace();
+                if (pos_ >= text_.size())
+                {
+                    fail("unexpected end");
+                }
+
+                JsonValue value;
+                const char c = text_[pos_];
+                if (c == '{')
+                {
+                    value.type = JsonValue::OBJECT;
+                    ++pos_;
+                    if (consume('}'))
+                    {
+                        return value;
+                    }
+                    do
+                    {
+                        skipSpace();
+                        std::string key = parseString();
+                        expect(':');
+                        value.members.emplace_back(std::move(key), parseValue());
+                    } while (consume(','));
+                    expect('}');
+                }
+                else if (c == '[')
+                {
+                    value.type = JsonValue::ARRAY;
+                    ++pos_;
+                    if (consume(']'))
+                    {
+                        return value;
+                    }
+                    do
+                    {
+                        value.items.push_back(parseValue());
+                    } while (consume(','));
+                    expect(']');
+                }
+                else if (c == '"')
+                {
+                    value.type = JsonValue::STRING;
+                    value.string = parseString();
+                }
+                else if (consumeWord("true"))
+                {
+                    value.type = JsonValue::BOOLEAN;
+                    value.number = 1.0;
+                }
+                else if (consumeWord("false"))
+                {
+                    value.type = JsonValue::BOOLEAN;
+                }
+                else if (consumeWord("null"))
+                {
+                    value.type = JsonValue::NUL;
+                }
+                else
+                {
+                    const char* begin = text_.c_str() + pos_;
+                    char* end = nullptr;
+                    value.type = JsonValue::NUMBER;
+                    value.number = std::strtod(begin, &end);
+                    if (end == begin)
+                    {
+                        fail("expected a value");
+                    }
+                    pos_ += static_cast<size_t>(end - begin);
+                }
+                return value;
+            }
+
+            std::string parseString()
+            {
+                if (pos_ >= text_.size() || text_[pos_] != '"')
+                {
+                    fail("expected a string");
+                }
+                ++pos_;
+
+                std::string result;
+                while (pos_ < text_.size() && text_[pos_] != '"')
+                {
+                    if (text_[pos_] == '\\' && pos_ + 1 < text_.size())
+                    {
+                        ++pos_;   // writeString only escapes quotes and backslashes
+                    }
+                    result += text_[pos_++];
+                }
+                if (pos_ >= text_.size())
+                {
+                    fail("unterminated string");
+                }
+                ++pos_;
+                return result;
+            }
+        };
+
+        double numberOr(const JsonValue& object, const char* key, double fallback)
+        {
+            const JsonValue* value = object.find(key);
+            return value && value->type == JsonValue::NUMBER ? value->number : fallback;
+        }
+    }
+
+    double BenchmarkResult::median() const
+    {
+        if (samples.empty())
+        {
+            return 0.0;
+        }
+        std::vector<double> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        const size_t mid = sorted.size() / 2;
+        return sorted.size() % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2.0;
+    }
+
+    double BenchmarkResult::mean() const
+    {
+        return samples.empty() ? 0.0 : std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    }
+
+    double BenchmarkResult::min() const
+    {
+        return samples.empty() ? 0.0 : *std::min_element(samples.begin(), samples.end());
+    }
+
+    double BenchmarkResult::max() const
+    {
+        return samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end());
+    }
+
+    double BenchmarkResult::stddev() const
+    {
+        if (samples.size() < 2)
+        {
+            return 0.0;
+        }
+        const double average = mean();
+        double sum = 0.0;
+        for (double sample : samples)
+        {
+            sum += (sample - average) * (sample - average);
+        }
+        return std::sqrt(sum / (samples.size() - 1));
+    }
+
+    double BenchmarkResult::medianLow() const
+    {
+        if (samples.empty())
+        {
+            return 0.0;
+        }
+        std::vector<double> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[medianLowIndex(sorted.size())];
+    }
+
+    double BenchmarkResult::medianHigh() const
+    {
+        if (samples.empty())
+        {
+            return 0.0;
+        }
+        std::vector<double> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+
+        // the same distance from the top as medianLow is from the bottom
+        return sorted[sorted.size() - 1 - medianLowIndex(sorted.size())];
+    }
+
+    double BenchmarkResult::gflops() const
+    {
+        const double ns = median();
+        return ns > 0.0 ? static_cast<double>(flops_per_op) / ns : 0.0;
+    }
+
+    double BenchmarkResult::gbytesPerSecond() const
+    {
+        const double ns = median();
+        return ns > 0.0 ? static_cast<double>(bytes_per_op) / ns : 0.0;
+    }
+
+    BenchmarkSuite::BenchmarkSuite(BenchmarkOptions options)
+        : options_(std::move(options))
+    {
+        if (options_.repetitions == 0)
+        {
+            throw std::invalid_argument("Benchmark repetitions must be positive");
+        }
+    }
+
+    bool BenchmarkSuite::run(const std::string& name, uint64_t flops_per_op, uint64_t bytes_per_op,
+                             const std::function<void()>& op)
+    {
+        if (!matchesFilter(name, options_.filter))
+        {
+            return false;
+        }
+
+        BenchmarkResult result;
+        result.name = name;
+        result.flops_per_op = flops_per_op;
+        result.bytes_per_op = bytes_per_op;
+
+        // calibrate: double the batch until it fills min_time (this doubles as the first warmup)
+        const double min_ns = std::chrono::duration<double, std::nano>(options_.min_time).count();
+        size_t iterations = 1;
+        for (double elapsed = timeIterations(op, iterations); elapsed < min_ns; )
+        {
+            // jump most of the way once the batch is long enough to time
+            const double per_op = elapsed / iterations;
+            iterations = elapsed > min_ns / 16 && per_op > 0.0
+                ? std::max(iterations + 1, static_cast<size_t>(std::ceil(min_ns / per_op)))
+                : iterations * 2;
+            elapsed = timeIterations(op, iterations);
+        }
+        result.iterations = iterations;
+
+        for (size_t i = 0; i < options_.warmup_runs; ++i)
+        {
+            timeIterations(op, iterations);
+        }
+
+        result.samples.reserve(options_.repetitions);
+        for (size_t i = 0; i < options_.repetitions; ++i)
+        {
+            result.samples.push_back(timeIterations(op, iterations) / iterations);
+        }
+
+        results_.push_back(std::move(result));
+        return true;
+    }
+
+    void BenchmarkSuite::printHeader(std::ostream& out)
+    {
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-42s %14s %9s %10s %10s\n", "benchmark", "ns/op", "+-%", "GFLOP/s", "GB/s");
+        out << line;
+    }
+
+    void BenchmarkSuite::printRow(std::ostream& out, const BenchmarkResult& result)
+    {
+        const double median = result.median();
+        const double spread = median > 0.0 ? 100.0 * result.stddev() / median : 0.0;
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-42s %14.1f %8.1f%% %10.2f %10.2f\n", result.name.c_str(), median, spread,
+                      result.gflops(), result.gbytesPerSecond());
+        out << line;
+    }
+
+    void BenchmarkSuite::printTable(std::ostream& out) const
+    {
+        printHeader(out);
+        for (const auto& result : results_)
+        {
+            printRow(out, result);
+        }
+    }
+
+    void BenchmarkSuite::writeJson(std::ostream& out) const
+    {
+        out << "{\n  \"context\": {\"cpu_tier\": ";
+        writeString(out, Kernels::active().name);
+        out << ", \"repetitions\": " << options_.repetitions << ", \"warmup_runs\": " << options_.warmup_runs
+            << ", \"min_time_ms\": " << options_.min_time.count() << "},\n  \"benchmarks\": [";
+
+        for (size_t i = 0; i < results_.size(); ++i)
+        {
+            const BenchmarkResult& result = results_[i];
+            out << (i == 0 ? "\n" : ",\n") << "    {\"name\": ";
+            writeString(out, result.name);
+            out << ", \"iterations\": " << result.iterations << ", \"flops_per_op\": " << result.flops_per_op
+                << ", \"bytes_per_op\": " << result.bytes_per_op << ",\n     \"ns_per_op\": {\"median\": ";
+            writeNumber(out, result.median());
+            out << ", \"mean\": ";
+            writeNumber(out, result.mean());
+            out << ", \"min\": ";
+            writeNumber(out, result.min());
+            out << ", \"max\": ";
+            writeNumber(out, result.max());
+            out << ", \"stddev\": ";
+            writeNumber(out, result.stddev());
+            out << ", \"ci_low\": ";
+            writeNumber(out, result.medianLow());
+            out << ", \"ci_high\": ";
+            writeNumber(out, result.medianHigh());
+            out << "},\n     \"gflops\": ";
+            writeNumber(out, result.gflops());
+            out << ", \"gbytes_per_second\": ";
+            writeNumber(out, result.gbytesPerSecond());
+            out << ",\n     \"samples\": [";
+            for (size_t j = 0; j < result.samples.size(); ++j)
+            {
+                out << (j == 0 ? "" : ", ");
+                writeNumber(out, result.samples[j]);
+            }
+            out << "]}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    void BenchmarkSuite::saveJson(const std::string& filepath) const
+    {
+        std::ofstream file(filepath);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Failed to open file for writing: " + filepath);
+        }
+
+        writeJson(file);
+        if (!file.good())
+        {
+            throw std::runtime_error("Failed to write benchmark results to: " + filepath);
+        }
+    }
+
+    std::vector<BenchmarkResult> BenchmarkSuite::readJson(std::istream& in)
+    {
+        const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        const JsonValue document = JsonReader(text).parseDocument();
+
+        const JsonValue* benchmarks = document.find("benchmarks");
+        if (!benchmarks || benchmarks->type != JsonValue::ARRAY)
+        {
+            throw std::runtime_error("Benchmark json has no benchmarks array");
+        }
+
+        std::vector<BenchmarkResult> results;
+        for (const JsonValue& entry : benchmarks->items)
+        {
+            const JsonValue* name = entry.find("name");
+            if (!name || name->type != JsonValue::STRING)
+            {
+                throw std::runtime_error("Benchmark json entry without a name");
+            }
+
+            BenchmarkResult result;
+            result.name = name->string;
+            result.iterations = static_cast<size_t>(numberOr(entry, "iterations", 0.0));
+            result.flops_per_op = static_cast<uint64_t>(numberOr(entry, "flops_per_op", 0.0));
+            result.bytes_per_op = static_cast<uint64_t>(numberOr(entry, "bytes_per_op", 0.0));
+
+            const JsonValue* samples = entry.find("samples");
+            if (samples && samples->type == JsonValue::ARRAY)
+            {
+                for (const JsonValue& sample : samples->items)
+                {
+                    result.samples.push_back(sample.number);
+                }
+            }
+            else if (const JsonValue* ns = entry.find("ns_per_op"))
+            {
+                // hand written baseline: a median and nothing to say how noisy it is
+                result.samples.push_back(numberOr(*ns, "median", 0.0));
+            }
+            if (result.samples.empty())
+            {
+                throw std::runtime_error("Benchmark json entry without timings: " + result.name);
+            }
+            results.push_back(std::move(result));
+        }
+        return results;
+    }
+
+    std::vector<BenchmarkResult> BenchmarkSuite::loadJson(const std::string& filepath)
+    {
+        std::ifstream file(filepath);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Failed to open benchmark results: " + filepath);
+        }
+        return readJson(file);
+    }
+
+    const char* verdictName(BenchmarkComparison::Verdict verdict)
+    {
+        switch (verdict)
+        {
+            case BenchmarkComparison::Verdict::UNCHANGED: return "ok";
+            case BenchmarkComparison::Verdict::NOISY: return "noisy";
+            case BenchmarkComparison::Verdict::REGRESSED: return "REGRESSED";
+            case BenchmarkComparison::Verdict::IMPROVED: return "improved";
+            case BenchmarkComparison::Verdict::NEW: return "new";
+        }
+        return "unknown";
+    }
+
+    std::vector<BenchmarkComparison> compareBenchmarks(const std::vector<BenchmarkResult>& baseline,
+                                                       const std::vector<BenchmarkResult>& current, double threshold)
+    {
+        if (threshold < 0.0)
+        {
+            throw std::invalid_argument("Regression threshold must not be negative");
+        }
+
+        std::vector<BenchmarkComparison> comparisons;
+        comparisons.reserve(current.size());
+        for (const BenchmarkResult& result : current)
+        {
+            BenchmarkComparison comparison;
+            comparison.name = result.name;
+            comparison.current_ns = result.median();
+
+            auto before = std::find_if(baseline.begin(), baseline.end(),
+                                       [&](const BenchmarkResult& b) { return b.name == result.name; });
+            if (before != baseline.end() && before->median() > 0.0)
+            {
+                comparison.baseline_ns = before->median();
+                comparison.change = comparison.current_ns / comparison.baseline_ns - 1.0;
+
+                if (std::abs(comparison.change) <= threshold)
+                {
+                    comparison.verdict = BenchmarkComparison::Verdict::UNCHANGED;
+                }
+                else if (comparison.change > 0.0 && result.medianLow() > before->medianHigh())
+                {
+                    comparison.verdict = BenchmarkComparison::Verdict::REGRESSED;
+                }
+                else if (comparison.change < 0.0 && result.medianHigh() < before->medianLow())
+                {
+                    comparison.verdict = BenchmarkComparison::Verdict::IMPROVED;
+                }
+                else
+                {
+                    comparison.verdict = BenchmarkComparison::Verdict::NOISY;
+                }
+            }
+            comparisons.push_back(std::move(comparison));
+        }
+        return comparisons;
+    }
+
+    void printComparison(std::ostream& out, const std::vector<BenchmarkComparison>& comparisons)
+    {
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-42s %14s %14s %9s  %s\n", "benchmark", "baseline ns", "current ns",
+                      "change", "verdict");
+        out << line;
+        for (const auto& comparison : comparisons)
+        {
+            if (comparison.verdict == BenchmarkComparison::Verdict::NEW)
+            {
+                std::snprintf(line, sizeof(line), "%-42s %14s %14.1f %9s  %s\n", comparison.name.c_str(), "-",
+                              comparison.current_ns, "-", verdictName(comparison.verdict));
+            }
+            else
+            {
+                std::snprintf(line, sizeof(line), "%-42s %14.1f %14.1f %+8.1f%%  %s\n", comparison.name.c_str(),
+                              comparison.baseline_ns, comparison.current_ns, 100.0 * comparison.change,
+                              verdictName(comparison.verdict));
+            }
+            out << line;
+        }
+    }
+
+} // namespace mininn
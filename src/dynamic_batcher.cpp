@@ -0,0 +1,203 @@
+/* dynamic_batcher.cpp
+ *
+ * Request coalescing for serving. Submitters push into a lock-free queue; a
+ * single dispatcher thread takes the oldest request, keeps collecting until
+ * the batch is full or that request's wait budget is spent, runs the batch
+ * through the engine's batched forward pass and scatters the rows back.
+ */
+
+#include "dynamic_batcher.h"
+#include <stdexcept>
+#include <string>
+
+namespace mininn
+{
+    DynamicBatcher::DynamicBatcher(const InferenceEngine& engine, BatchingOptions options)
+        : engine_(engine.clone()), options_(options), queue_(options.queue_capacity),
+          sleeping_(false), stopping_(false), num_requests_(0), num_batches_(0)
+    {
+        if (options_.max_batch_size == 0 || options_.queue_capacity == 0)
+        {
+            throw std::invalid_argument("Batch size and queue capacity must be positive");
+        }
+
+        context_ = engine_.createContext();
+        dispatcher_ = std::thread([this] { dispatchLoop(); });
+    }
+
+    DynamicBatcher::~DynamicBatcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stopping_.store(true);
+        }
+        wake_.notify_one();
+        dispatcher_.join();
+    }
+
+    std::future<Tensor> DynamicBatcher::submit(Tensor input)
+    {
+        Request request;
+        request.input = std::move(input);
+        std::future<Tensor> result = request.promise.get_future();
+        enqueue(std::move(request));
+        return result;
+    }
+
+    void DynamicBatcher::submit(Tensor input, Callback callback)
+    {
+        if (!callback)
+        {
+            throw std::invalid_argument("Batcher callback must not be empty");
+        }
+
+        Request request;
+        request.input = std::move(input);
+        request.callback = std::move(callback);
+        enqueue(std::move(request));
+    }
+
+    void DynamicBatcher::enqueue(Request request)
+    {
+        // checked here so one bad request can't fail the whole batch it would land in
+        if (request.input.shape() != engine_.getInputShape() || request.input.dtype() != DataType::FLOAT32)
+        {
+            throw std::invalid_argument("Batcher input must be a FLOAT32 tensor of the model's input shape");
+        }
+
+        request.enqueued = Clock::now();
+        request.thread_id = Tracer::currentThreadId();
+        while (!queue_.tryPush(std::move(request)))
+        {
+            std::this_thread::yield();
+        }
+
+        // pairs with the fence in waitForWork: either the dispatcher sees this request before it
+        // sleeps, or this thread sees it sleeping and wakes it
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            wake_.notify_one();
+        }
+    }
+
+    bool DynamicBatcher::waitForWork()
+    {
+        if (!queue_.empty())
+        {
+            return true;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleeping_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wake_.wait(lock, [this] { return !queue_.empty() || stopping_.load(); });
+        sleeping_.store(false, std::memory_order_relaxed);
+
+        // when stopping, whatever is still queued runs first
+        return !queue_.empty();
+    }
+
+    void DynamicBatcher::dispatchLoop()
+    {
+        std::vector<Request> batch;
+        batch.reserve(options_.max_batch_size);
+        Request request;
+
+        while (waitForWork())
+        {
+            if (!queue_.tryPop(request))
+            {
+                // a submitter has claimed a cell but not filled it yet
+                std::this_thread::yield();
+                continue;
+            }
+
+            // the oldest request sets the deadline, so no request waits longer than max_wait for company
+            const Clock::time_point deadline = request.enqueued + options_.max_wait;
+            batch.push_back(std::move(request));
+
+            while (batch.size() < options_.max_batch_size)
+            {
+                if (queue_.tryPop(request))
+                {
+                    batch.push_back(std::move(request));
+                }
+                else if (stopping_.load() || Clock::now() >= deadline)
+                {
+                    break;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+
+            runBatch(batch);
+            batch.clear();
+        }
+    }
+
+    void DynamicBatcher::runBatch(std::vector<Request>& batch)
+    {
+        Tracer* tracer = engine_.getTracer().get();
+        TraceSpan span(tracer, "batch", "batcher");
+        if (tracer)
+        {
+            span.setArgs("\"size\":%zu", batch.size());
+            const Clock::time_point start = Clock::now();
+            for (const auto& request : batch)
+            {
+                tracer->record("queue_wait", "batcher", request.enqueued, start, nullptr, request.thread_id);
+            }
+        }
+
+        std::vector<Tensor> inputs;
+        inputs.reserve(batch.size());
+        for (auto& request : batch)
+        {
+            inputs.push_back(std::move(request.input));
+        }
+
+        std::vector<Tensor> outputs;
+        std::exception_ptr error;
+        try
+        {
+            outputs = engine_.predictBatch(inputs, context_);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        // counted before anyone is answered, so a caller that got its result sees it counted
+        num_batches_.fetch_add(1, std::memory_order_relaxed);
+        num_requests_.fetch_add(batch.size(), std::memory_order_relaxed);
+
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            Request& request = batch[i];
+            if (request.callback)
+            {
+                // a throwing callback mustn't take the dispatcher (and every later request) down with it
+                try
+                {
+                    request.callback(error ? Tensor() : std::move(outputs[i]), error);
+                }
+                catch (...)
+                {
+                }
+            }
+            else if (error)
+            {
+                request.promise.set_exception(error);
+            }
+            else
+            {
+                request.promise.set_value(std::move(outputs[i]));
+            }
+        }
+    }
+
+} // namespace mininn
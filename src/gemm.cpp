@@ -0,0 +1,429 @@
+/* gemm.cpp
+ *
+ * Cache-blocked single precision matrix multiplication. B is packed into
+ * KC x NR panels and A into MC x KC blocks of MR-row panels so the micro-kernel
+ * only ever walks contiguous memory, and the MR x NR output tile is accumulated
+ * in registers across the whole KC slice before being written back. The register
+ * tile shape and the micro-kernel itself come from the active KernelTable.
+ * Given a ThreadPool, each thread runs the same blocked loop on its own slice
+ * of rows (or columns when m is short), packing into its own buffers. Bias and
+ * activation epilogues run inside the micro-kernel on the last KC slice, so
+ * fused layers never re-read their output. A half precision B takes the same
+ * path and is widened to fp32 as it's packed.
+ */
+
+#include "gemm.h"
+#include "kernels.h"
+#include "scratch_buffer.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <vector>
+
+namespace mininn
+{
+    namespace Gemm
+    {
+        namespace
+        {
+            // packed panel buffers are reused across calls on the same thread
+            thread_local ScratchBuffer<float> packed_a;
+            thread_local ScratchBuffer<float> packed_b;
+
+            // b as the loops below read it: fp32, or 16-bit floats widened to fp32 on the way in
+            struct BOperand
+            {
+                const float* f32;
+                const uint16_t* half;       // used instead of f32 when set
+                HalfFormat format;
+                size_t ld;
+
+                BOperand at(size_t row, size_t col) const
+                {
+                    BOperand b = *this;
+                    const size_t offset = row * ld + col;
+                    if (half)
+                    {
+                        b.half += offset;
+                    }
+                    else
+                    {
+                        b.f32 += offset;
+                    }
+                    return b;
+                }
+
+                // row p, columns [0, n) as fp32 into out
+                void widenRow(const KernelTable& kernels, size_t p, size_t n, float* out) const
+                {
+                    if (!half)
+                    {
+                        std::copy(f32 + p * ld, f32 + p * ld + n, out);
+                    }
+                    else if (format == HalfFormat::FP16)
+                    {
+                        kernels.fp16_to_fp32(half + p * ld, out, n);
+                    }
+                    else
+                    {
+                        kernels.bf16_to_fp32(half + p * ld, out, n);
+                    }
+                }
+
+                // y[0..n) += alpha * row p
+                void axpyRow(const KernelTable& kernels, size_t p, size_t n, float alpha, float* y) const
+                {
+                    if (!half)
+                    {
+                        kernels.axpy(n, alpha, f32 + p * ld, y);
+                    }
+                    else if (format == HalfFormat::FP16)
+                    {
+                        kernels.axpy_fp16(n, alpha, half + p * ld, y);
+                    }
+                    else
+                    {
+                        kernels.axpy_bf16(n, alpha, half + p * ld, y);
+                    }
+                }
+            };
+
+            // copy an mc x kc block of a into MR-row panels, each stored column by column
+            // rows past mc are zero padded so the micro-kernel never needs edge handling
+            void packA(size_t mc, size_t kc, const float* a, size_t lda, size_t tile_m, float* out)
+            {
+                for (size_t ir = 0; ir < mc; ir += tile_m)
+                {
+                    const size_t rows = std::min(tile_m, mc - ir);
+                    float* panel = out + ir * kc;
+                    for (size_t p = 0; p < kc; ++p)
+                    {
+                        for (size_t i = 0; i < rows; ++i)
+                        {
+                            panel[p * tile_m + i] = a[(ir + i) * lda + p];
+                        }
+                        for (size_t i = rows; i < tile_m; ++i)
+                        {
+                            panel[p * tile_m + i] = 0.0f;
+                        }
+                    }
+                }
+            }
+
+            // copy a kc x nc block of b into NR-column panels, each stored row by row
+            void packB(const KernelTable& kernels, size_t kc, size_t nc, const BOperand& b, size_t tile_n, float* out)
+            {
+                for (size_t jr = 0; jr < nc; jr += tile_n)
+                {
+                    const size_t cols = std::min(tile_n, nc - jr);
+                    const BOperand src = b.at(0, jr);
+                    float* panel = out + jr * kc;
+                    for (size_t p = 0; p < kc; ++p)
+                    {
+                        src.widenRow(kernels, p, cols, panel + p * tile_n);
+                        for (size_t j = cols; j < tile_n; ++j)
+                        {
+                            panel[p * tile_n + j] = 0.0f;
+                        }
+                    }
+                }
+            }
+
+            bool hasEpilogue(const GemmEpilogue& epilogue)
+            {
+                return epilogue.bias || epilogue.activation != Activation::NONE;
+            }
+
+            // epilogue for rows that didn't go through the micro-kernel (still hot in l1)
+            void applyEpilogueRows(const KernelTable& kernels, size_t m, size_t n,
+                                   float* c, size_t ldc, const GemmEpilogue& epilogue)
+            {
+                for (size_t i = 0; i < m; ++i)
+                {
+                    float* c_row = c + i * ldc;
+                    if (epilogue.bias)
+                    {
+                        kernels.axpy(n, 1.0f, epilogue.bias, c_row);
+                    }
+                    if (epilogue.activation == Activation::RELU)
+                    {
+                        kernels.relu(c_row, n);
+                    }
+                    else if (epilogue.activation == Activation::SIGMOID)
+                    {
+                        kernels.sigmoid(c_row, n);
+                    }
+                }
+            }
+
+            // fewer rows than a register tile (gemv and tiny batches): every element of b
+            // is used at most m times, so packing would cost more than it saves
+            void smallM(const KernelTable& kernels, size_t m, size_t n, size_t k,
+                        const float* a, size_t lda, const BOperand& b,
+                        float* c, size_t ldc, const GemmEpilogue& epilogue)
+            {
+                for (size_t i = 0; i < m; ++i)
+                {
+                    std::fill(c + i * ldc, c + i * ldc + n, 0.0f);
+                }
+
+                for (size_t p = 0; p < k; ++p)
+                {
+                    for (size_t i = 0; i < m; ++i)
+                    {
+                        b.axpyRow(kernels, p, n, a[i * lda + p], c + i * ldc);
+                    }
+                }
+
+                if (hasEpilogue(epilogue))
+                {
+                    applyEpilogueRows(kernels, m, n, c, ldc, epilogue);
+                }
+            }
+
+            // the serial cache-blocked loop nest, m >= tile_m
+            void blocked(const KernelTable& kernels, size_t m, size_t n, size_t k,
+                         const float* a, size_t lda, const BOperand& b,
+                         float* c, size_t ldc, const GemmEpilogue& epilogue)
+            {
+                const bool fused = hasEpilogue(epilogue);
+                const size_t tile_m = kernels.gemm_mr;
+                const size_t tile_n = kernels.gemm_nr;
+
+                // panels are padded up to full MR / NR multiples
+                const size_t max_mc = (std::min(MC, m) + tile_m - 1) / tile_m * tile_m;
+                const size_t max_nc = (std::min(NC, n) + tile_n - 1) / tile_n * tile_n;
+                const size_t max_kc = std::min(KC, k);
+                packed_a.reserve(max_mc * max_kc);
+                packed_b.reserve(max_nc * max_kc);
+
+                for (size_t jc = 0; jc < n; jc += NC)
+                {
+                    const size_t nc = std::min(NC, n - jc);
+
+                    for (size_t pc = 0; pc < k; pc += KC)
+                    {
+                        const size_t kc = std::min(KC, k - pc);
+                        const bool last_slice = pc + kc == k;
+                        packB(kernels, kc, nc, b.at(pc, jc), tile_n, packed_b.data());
+
+                        for (size_t ic = 0; ic < m; ic += MC)
+                        {
+                            const size_t mc = std::min(MC, m - ic);
+                            packA(mc, kc, a + ic * lda + pc, lda, tile_m, packed_a.data());
+
+                            for (size_t jr = 0; jr < nc; jr += tile_n)
+                            {
+                                // the epilogue only runs once the tile has seen all of k
+                                GemmEpilogue tile_epilogue = epilogue;
+                                if (tile_epilogue.bias)
+                                {
+                                    tile_epilogue.bias += jc + jr;
+                                }
+                                const GemmEpilogue* tile_ep = fused && last_slice ? &tile_epilogue : nullptr;
+
+                                for (size_t ir = 0; ir < mc; ir += tile_m)
+                                {
+                                    kernels.gemm_micro(kc, packed_a.data() + ir * kc, packed_b.data() + jr * kc,
+                                                       c + (ic + ir) * ldc + jc + jr, ldc,
+                                                       std::min(tile_m, mc - ir), std::min(tile_n, nc - jr), pc > 0,
+                                                       tile_ep);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+
+            void serial(const KernelTable& kernels, size_t m, size_t n, size_t k,
+                        const float* a, size_t lda, const BOperand& b,
+                        float* c, size_t ldc, const GemmEpilogue& epilogue)
+            {
+                if (m < kernels.gemm_mr)
+                {
+                    smallM(kernels, m, n, k, a, lda, b, c, ldc, epilogue);
+                }
+                else
+                {
+                    blocked(kernels, m, n, k, a, lda, b, c, ldc, epilogue);
+                }
+            }
+
+            void run(size_t m, size_t n, size_t k,
+                     const float* a, size_t lda, const BOperand& b,
+                     float* c, size_t ldc,
+                     ThreadPool* pool,
+                     const GemmEpilogue& epilogue)
+            {
+                if (m == 0 || n == 0)
+                {
+                    return;
+                }
+
+                const KernelTable& kernels = Kernels::active();
+
+                if (k == 0)
+                {
+                    for (size_t i = 0; i < m; ++i)
+                    {
+                        std::fill(c + i * ldc, c + i * ldc + n, 0.0f);
+                    }
+                    applyEpilogueRows(kernels, m, n, c, ldc, epilogue);
+                    return;
+                }
+                const size_t threads = pool ? pool->size() : 1;
+
+                if (threads == 1 || m * n * k < PARALLEL_MIN_FLOPS)
+                {
+                    serial(kernels, m, n, k, a, lda, b, c, ldc, epilogue);
+                    return;
+                }
+
+                // split rows when every thread gets a few register tiles, otherwise split columns;
+                // slices stay multiples of the tile so only the last one has a partial edge
+                const size_t tile_m = kernels.gemm_mr;
+                const size_t tile_n = kernels.gemm_nr;
+
+                if (m >= tile_m * 4 * threads)
+                {
+                    const size_t row_tiles = (m + tile_m - 1) / tile_m;
+                    pool->parallelFor(row_tiles, 4, [&](size_t begin, size_t end)
+                    {
+                        const size_t row = begin * tile_m;
+                        const size_t rows = std::min(end * tile_m, m) - row;
+                        serial(kernels, rows, n, k, a + row * lda, lda, b, c + row * ldc, ldc, epilogue);
+                    });
+                }
+                else
+                {
+                    const size_t col_tiles = (n + tile_n - 1) / tile_n;
+                    pool->parallelFor(col_tiles, 2, [&](size_t begin, size_t end)
+                    {
+                        const size_t col = begin * tile_n;
+                        const size_t cols = std::min(end * tile_n, n) - col;
+                        GemmEpilogue slice_epilogue = epilogue;
+                        if (slice_epilogue.bias)
+                        {
+                            slice_epilogue.bias += col;
+                        }
+                        serial(kernels, m, cols, k, a, lda, b.at(0, col), c + col, ldc, slice_epilogue);
+                    });
+                }
+            }
+        } // namespace
+
+        void sgemm(size_t m, size_t n, size_t k,
+                   const float* a, size_t lda,
+                   const float* b, size_t ldb,
+                   float* c, size_t ldc,
+                   ThreadPool* pool,
+                   const GemmEpilogue& epilogue)
+        {
+            run(m, n, k, a, lda, BOperand{b, nullptr, HalfFormat::FP16, ldb}, c, ldc, pool, epilogue);
+        }
+
+        void sgemmHalf(size_t m, size_t n, size_t k,
+                       const float* a, size_t lda,
+                       const uint16_t* b, HalfFormat format, size_t ldb,
+                       float* c, size_t ldc,
+                       ThreadPool* pool,
+                       const GemmEpilogue& epilogue)
+        {
+            run(m, n, k, a, lda, BOperand{nullptr, b, format, ldb}, c, ldc, pool, epilogue);
+        }
+
+        void gemmS8(size_t m, size_t n, size_t k,
+                    const int8_t* a, size_t lda,
+                    const int8_t* b, size_t ldb, const int32_t* b_sums,
+                    const float* a_scales, const float* b_scales,
+                    float* c, size_t ldc,
+                    ThreadPool* pool,
+                    const GemmEpilogue& epilogue)
+        {
+            if (m == 0 || n == 0)
+            {
+                return;
+            }
+
+            const KernelTable& kernels = Kernels::active();
+            const size_t block_cols = std::max<size_t>(16, S8_BLOCK_BYTES / std::max<size_t>(k, 1));
+
+            // columns [begin, end), in L2 sized blocks (the activation runs per row of each block)
+            auto columns = [&](size_t begin, size_t end)
+            {
+                for (size_t col = begin; col < end; col += block_cols)
+                {
+                    const size_t cols = std::min(block_cols, end - col);
+                    GemmEpilogue block_epilogue = epilogue;
+                    if (block_epilogue.bias)
+                    {
+                        block_epilogue.bias += col;
+                    }
+                    kernels.gemm_s8(m, cols, k, a, lda, b + col * ldb, ldb, b_sums + col,
+                                    a_scales, b_scales + col, c + col, ldc, &block_epilogue);
+                }
+            };
+
+            const size_t threads = pool ? pool->size() : 1;
+            if (threads == 1 || m * n * k < PARALLEL_MIN_FLOPS)
+            {
+                columns(0, n);
+                return;
+            }
+
+            // slices of whole 16 column grains (four int8 register tiles)
+            const size_t grains = (n + 15) / 16;
+            pool->parallelFor(grains, 1, [&](size_t begin, size_t end)
+            {
+                columns(begin * 16, std::min(end * 16, n));
+            });
+        }
+
+        void gemmQ4(size_t m, size_t n, size_t k,
+                    const float* a, size_t lda,
+                    const uint8_t* b, size_t ldb,
+                    const float* b_scales, size_t group_size,
+                    float* c, size_t ldc,
+                    ThreadPool* pool,
+                    const GemmEpilogue& epilogue)
+        {
+            if (m == 0 || n == 0)
+            {
+                return;
+            }
+
+            const KernelTable& kernels = Kernels::active();
+            const size_t groups = k / group_size;
+            const size_t block_cols = std::max<size_t>(16, S8_BLOCK_BYTES / std::max<size_t>(ldb, 1));
+
+            // same blocking as gemmS8, each column block also takes its rows of scales along
+            auto columns = [&](size_t begin, size_t end)
+            {
+                for (size_t col = begin; col < end; col += block_cols)
+                {
+                    const size_t cols = std::min(block_cols, end - col);
+                    GemmEpilogue block_epilogue = epilogue;
+                    if (block_epilogue.bias)
+                    {
+                        block_epilogue.bias += col;
+                    }
+                    kernels.gemm_q4(m, cols, k, a, lda, b + col * ldb, ldb, b_scales + col * groups, group_size,
+                                    c + col, ldc, &block_epilogue);
+                }
+            };
+
+            const size_t threads = pool ? pool->size() : 1;
+            if (threads == 1 || m * n * k < PARALLEL_MIN_FLOPS)
+            {
+                columns(0, n);
+                return;
+            }
+
+            const size_t grains = (n + 15) / 16;
+            pool->parallelFor(grains, 1, [&](size_t begin, size_t end)
+            {
+                columns(begin * 16, std::min(end * 16, n));
+            });
+        }
+    } // namespace Gemm
+
+} // namespace mininn
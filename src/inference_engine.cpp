@@ -5,15 +5,85 @@
  */
 
 #include "inference_engine.h"
+#include "scratch_buffer.h"
 #include <stdexcept>
 #include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <sstream>
 
 namespace mininn
 {
-    InferenceEngine::InferenceEngine(std::unique_ptr<Model> model)
-        : model_(std::move(model)), profiling_enabled_(false), buffers_allocated_(false)
+    namespace
+    {
+        // smallest row slice worth giving its own thread in predictBatch
+        constexpr size_t MIN_ROWS_PER_SLICE = 16;
+
+        // "[32,784]", cut short if it doesn't fit
+        void formatShape(char* buffer, size_t size, const std::vector<size_t>& shape)
+        {
+            size_t used = std::snprintf(buffer, size, "[");
+            for (size_t i = 0; i < shape.size() && used < size; ++i)
+            {
+                used += std::snprintf(buffer + used, size - used, i == 0 ? "%zu" : ",%zu", shape[i]);
+            }
+            if (used < size)
+            {
+                std::snprintf(buffer + used, size - used, "]");
+            }
+        }
+
+        // a layer's work, plus that of the layer it applies in the same pass
+        uint64_t passFlops(const Layer& layer, const Layer* fused, const std::vector<size_t>& input_shape,
+                           const std::vector<size_t>& output_shape)
+        {
+            return layer.flops(input_shape) + (fused ? fused->flops(output_shape) : 0);
+        }
+
+        void setLayerArgs(TraceSpan& span, size_t index, uint64_t flops, const Layer* fused,
+                          const std::vector<size_t>& input_shape, const std::vector<size_t>& output_shape)
+        {
+            char input[40];
+            char output[40];
+            formatShape(input, sizeof(input), input_shape);
+            formatShape(output, sizeof(output), output_shape);
+            if (fused)
+            {
+                span.setArgs("\"layer\":%zu,\"in\":\"%s\",\"out\":\"%s\",\"flops\":%llu,\"fused\":\"%s\"",
+                             index, input, output, static_cast<unsigned long long>(flops),
+                             layerTypeName(fused->getType()));
+            }
+            else
+            {
+                span.setArgs("\"layer\":%zu,\"in\":\"%s\",\"out\":\"%s\",\"flops\":%llu",
+                             index, input, output, static_cast<unsigned long long>(flops));
+            }
+        }
+
+        void sumLayerCounters(InferenceStats& stats)
+        {
+            stats.counters = PerfCounts();
+            for (const auto& layer : stats.layer_counters)
+            {
+                stats.counters += layer.counts;
+            }
+        }
+    }
+
+    double LayerCounters::bytesPerFlop() const
+    {
+        if (flops == 0 || !counts.has(PerfEvent::LLC_MISSES))
+        {
+            return 0.0;
+        }
+        return static_cast<double>(counts.memoryBytes()) / flops;
+    }
+
+    InferenceEngine::InferenceEngine(std::shared_ptr<const Model> model)
+        : model_(std::move(model)), profiling_enabled_(false)
     {
         if (!model_)
         {
@@ -31,89 +101,379 @@ namespace mininn
             throw std::invalid_argument("Model must have defined input and output shapes");
         }
         
-        // initialize stats
-        last_stats_ = InferenceStats{};
+        parameter_bytes_ = model_->parameterBytes();
+        
+        // infer every layer's shape now so a bad model fails here rather than mid inference
+        preallocateBuffers();
+        if (context_.plan_.outputShape() != model_->getOutputShape())
+        {
+            throw std::invalid_argument("Model output shape doesn't match the shape its layers produce");
+        }
+        
+        enableFusion(true);
+    }
+
+    void InferenceEngine::enableFusion(bool enable)
+    {
+        // graph rewrite: mark every layer its predecessor can apply in the same pass
+        // the fused layer must work in place, so the buffer plan stays exactly the same
+        const auto& layers = model_->getLayers();
+        fused_.assign(layers.size(), false);
+        if (!enable)
+        {
+            return;
+        }
+        
+        for (size_t i = 1; i < layers.size(); ++i)
+        {
+            if (!fused_[i - 1] && layers[i]->supportsInPlace() && layers[i - 1]->canFuse(*layers[i]))
+            {
+                fused_[i] = true;
+            }
+        }
+    }
+
+    InferenceEngine InferenceEngine::clone() const
+    {
+        // only the per-engine state is new: the buffer plan for the clone's own context
+        InferenceEngine copy(model_);
+        copy.profiling_enabled_ = profiling_enabled_;
+        copy.counters_enabled_ = counters_enabled_;
+        copy.thread_pool_ = thread_pool_;
+        copy.tracer_ = tracer_;
+        copy.fused_ = fused_;
+        return copy;
+    }
+
+    size_t InferenceEngine::getNumFusedLayers() const
+    {
+        return static_cast<size_t>(std::count(fused_.begin(), fused_.end(), true));
     }
 
     Tensor InferenceEngine::predict(const Tensor& input)
     {
+        return predict(input, context_);
+    }
+
+    void InferenceEngine::predict(const Tensor& input, Tensor& output)
+    {
+        predict(input, output, context_);
+    }
+
+    std::vector<Tensor> InferenceEngine::predictBatch(const std::vector<Tensor>& inputs)
+    {
+        return predictBatch(inputs, context_);
+    }
+
+    Tensor InferenceEngine::predict(const Tensor& input, ExecutionContext& context) const
+    {
+        Tensor output(model_->getOutputShape());
+        predict(input, output, context);
+        return output;
+    }
+
+    void InferenceEngine::predict(const Tensor& input, Tensor& output, ExecutionContext& context) const
+    {
+        TraceSpan span(tracer_.get(), "predict", "engine");
         auto start_time = std::chrono::high_resolution_clock::now();
         
+        prepareContext(context);
+        
         // reset profiling stats
         if (profiling_enabled_)
         {
-            last_stats_ = InferenceStats{};
-            last_stats_.layer_times.resize(model_->getLayers().size());
+            resetStats(context.stats_);
         }
         
         // validate input
         validateInput(input);
         
+        if (context.plan_.empty())
+        {
+            context.plan_ = makePlan(model_->getInputShape());
+        }
+        
         // execute forward pass
-        Tensor output;
-        executeForwardPass(input, output);
+        executeForwardPass(input, output, context.plan_, thread_pool_.get(),
+                           profiling_enabled_ ? &context.stats_.layer_times : nullptr,
+                           countersOn() ? &context.stats_.layer_counters : nullptr);
         
         // update profiling information
         if (profiling_enabled_)
         {
             auto end_time = std::chrono::high_resolution_clock::now();
-            last_stats_.total_time = end_time - start_time;
-            updateMemoryUsage();
+            context.stats_.total_time = end_time - start_time;
+            sumLayerCounters(context.stats_);
+            updateMemoryUsage(context);
+            recordLatency(context.stats_);
         }
-        
-        return output;
     }
 
-    std::vector<Tensor> InferenceEngine::predictBatch(const std::vector<Tensor>& inputs)
+    std::vector<Tensor> InferenceEngine::predictBatch(const std::vector<Tensor>& inputs,
+                                                      ExecutionContext& context) const
     {
         if (inputs.empty())
         {
             throw std::invalid_argument("Cannot process empty batch");
         }
         
-        std::vector<Tensor> outputs;
-        outputs.reserve(inputs.size());
+        const auto& input_shape = model_->getInputShape();
+        const auto& output_shape = model_->getOutputShape();
+        
+        // layers read a 2d tensor as [batch_size, features], so only flat samples can be stacked
+        if (input_shape.size() != 1 || output_shape.size() != 1)
+        {
+            std::vector<Tensor> outputs;
+            outputs.reserve(inputs.size());
+            for (const auto& input : inputs)
+            {
+                outputs.push_back(predict(input, context));
+            }
+            return outputs;
+        }
+        
+        TraceSpan span(tracer_.get(), "predict_batch", "engine");
+        span.setArgs("\"batch_size\":%zu", inputs.size());
+        auto start_time = std::chrono::high_resolution_clock::now();
+        
+        prepareContext(context);
+        
+        if (profiling_enabled_)
+        {
+            resetStats(context.stats_);
+        }
         
-        // process each input individually
-        // TODO: future optimization -> batch processing through layers
         for (const auto& input : inputs)
         {
-            outputs.push_back(predict(input));
+            validateInput(input);
+        }
+        
+        const size_t batch_size = inputs.size();
+        std::vector<Tensor> outputs(batch_size);
+        const size_t threads = getNumThreads();
+        
+        // the stacked input and output rows, plus any slice arenas below
+        size_t transient_bytes = batch_size * (input_shape[0] + output_shape[0]) * sizeof(float);
+        
+        if (threads > 1 && batch_size >= 2 * MIN_ROWS_PER_SLICE)
+        {
+            // each thread runs every layer on its own rows, so nobody waits between layers
+            // per-layer times are the slowest slice's, i.e. what the caller actually waited for
+            std::mutex stats_mutex;
+            std::atomic<size_t> slice_bytes(0);
+            const size_t rows_per_slice = std::max(MIN_ROWS_PER_SLICE, (batch_size + threads - 1) / threads);
+            
+            thread_pool_->parallelFor(batch_size, rows_per_slice, [&](size_t begin, size_t end)
+            {
+                TraceSpan slice_span(tracer_.get(), "batch_slice", "engine");
+                slice_span.setArgs("\"begin\":%zu,\"rows\":%zu", begin, end - begin);
+                std::vector<std::chrono::duration<double, std::milli>> slice_times(model_->getLayers().size());
+                std::vector<LayerCounters> slice_counters(countersOn() ? slice_times.size() : 0);
+                MemoryPlan slice_plan = makePlan({end - begin, input_shape[0]});
+                slice_bytes.fetch_add(slice_plan.arenaBytes(), std::memory_order_relaxed);
+                runBatchSlice(inputs, begin, end, outputs, slice_plan, nullptr,
+                              profiling_enabled_ ? &slice_times : nullptr, countersOn() ? &slice_counters : nullptr);
+                
+                if (profiling_enabled_)
+                {
+                    // counts are work done, so unlike the times they add up over the slices
+                    std::lock_guard<std::mutex> lock(stats_mutex);
+                    for (size_t i = 0; i < slice_times.size(); ++i)
+                    {
+                        context.stats_.layer_times[i] = std::max(context.stats_.layer_times[i], slice_times[i]);
+                    }
+                    for (size_t i = 0; i < slice_counters.size(); ++i)
+                    {
+                        context.stats_.layer_counters[i].counts += slice_counters[i].counts;
+                        context.stats_.layer_counters[i].flops += slice_counters[i].flops;
+                    }
+                }
+            });
+            transient_bytes += slice_bytes.load();
+        }
+        else
+        {
+            // small batch: one pass, any pool goes to the gemms inside the layers instead
+            const std::vector<size_t> batch_shape = {batch_size, input_shape[0]};
+            if (context.batch_plan_.empty() || context.batch_plan_.inputShape() != batch_shape)
+            {
+                context.batch_plan_ = makePlan(batch_shape);
+            }
+            runBatchSlice(inputs, 0, batch_size, outputs, context.batch_plan_, thread_pool_.get(),
+                          profiling_enabled_ ? &context.stats_.layer_times : nullptr,
+                          countersOn() ? &context.stats_.layer_counters : nullptr);
+        }
+        context.transient_peak_bytes_ = std::max(context.transient_peak_bytes_, transient_bytes);
+        
+        if (profiling_enabled_)
+        {
+            auto end_time = std::chrono::high_resolution_clock::now();
+            context.stats_.total_time = end_time - start_time;
+            sumLayerCounters(context.stats_);
+            updateMemoryUsage(context);
+            recordLatency(context.stats_);
         }
         
         return outputs;
     }
 
+    void InferenceEngine::runBatchSlice(const std::vector<Tensor>& inputs, size_t begin, size_t end,
+                                        std::vector<Tensor>& outputs, MemoryPlan& plan, ThreadPool* pool,
+                                        std::vector<std::chrono::duration<double, std::milli>>* layer_times,
+                                        std::vector<LayerCounters>* layer_counters) const
+    {
+        const auto& output_shape = model_->getOutputShape();
+        const size_t rows = end - begin;
+        const size_t in_features = model_->getInputShape()[0];
+        const size_t out_features = output_shape[0];
+        
+        // stack samples into one contiguous [rows, in_features] tensor
+        Tensor batch_input({rows, in_features});
+        for (size_t i = 0; i < rows; ++i)
+        {
+            std::copy(inputs[begin + i].data(), inputs[begin + i].data() + in_features,
+                      batch_input.data() + i * in_features);
+        }
+        
+        // one forward pass for the whole slice
+        Tensor batch_output({rows, out_features});
+        executeForwardPass(batch_input, batch_output, plan, pool, layer_times, layer_counters);
+        
+        // split rows straight into the per-sample results
+        for (size_t i = 0; i < rows; ++i)
+        {
+            outputs[begin + i] = Tensor(output_shape);
+            const float* row = batch_output.data() + i * out_features;
+            std::copy(row, row + out_features, outputs[begin + i].data());
+        }
+    }
+
+    void InferenceEngine::setNumThreads(size_t num_threads, bool pin_threads)
+    {
+        if (num_threads == 0)
+        {
+            num_threads = ThreadPool::hardwareThreads();
+        }
+        
+        thread_pool_ = num_threads > 1 ? std::make_shared<ThreadPool>(num_threads, pin_threads) : nullptr;
+    }
+
+    ExecutionContext InferenceEngine::createContext() const
+    {
+        ExecutionContext context;
+        prepareContext(context);
+        context.plan_ = makePlan(model_->getInputShape());
+        return context;
+    }
+
+    MemoryPlan InferenceEngine::makePlan(const std::vector<size_t>& input_shape) const
+    {
+        TraceSpan span(tracer_.get(), "plan", "engine");
+        MemoryPlan plan(model_->getLayers(), input_shape);
+        if (span.active())
+        {
+            char shape[40];
+            formatShape(shape, sizeof(shape), input_shape);
+            span.setArgs("\"in\":\"%s\",\"arena_bytes\":%zu", shape, plan.arenaBytes());
+        }
+        return plan;
+    }
+
     void InferenceEngine::preallocateBuffers()
     {
-        if (buffers_allocated_)
+        prepareContext(context_);
+        if (!context_.plan_.empty())
         {
             return;
         }
         
-        // pre-allocate intermediate tensors for each layer
-        // this avoids memory allocation during inference for better performance
-        const auto& layers = model_->getLayers();
-        intermediate_tensors_.clear();
-        intermediate_tensors_.reserve(layers.size() + 1);  // +1 for final output
+        // shape inference for a single sample, then one arena for all intermediates
+        context_.plan_ = makePlan(model_->getInputShape());
+    }
+
+    void InferenceEngine::clearBuffers()
+    {
+        context_.clearBuffers();
+    }
+
+    void ExecutionContext::clearBuffers()
+    {
+        plan_ = MemoryPlan();
+        batch_plan_ = MemoryPlan();
+    }
+
+    void ExecutionContext::resetLatency()
+    {
+        stats_.latency.reset();
+        for (auto& histogram : stats_.layer_latency)
+        {
+            histogram.reset();
+        }
+    }
+
+    void InferenceStats::mergeLatency(const InferenceStats& other)
+    {
+        if (layer_latency.empty())
+        {
+            layer_latency.resize(other.layer_latency.size());
+        }
+        else if (!other.layer_latency.empty() && other.layer_latency.size() != layer_latency.size())
+        {
+            throw std::invalid_argument("Cannot merge latency stats of models with different layer counts");
+        }
         
-        // start with input shape
-        std::vector<size_t> current_shape = model_->getInputShape();
+        latency.merge(other.latency);
+        for (size_t i = 0; i < other.layer_latency.size(); ++i)
+        {
+            layer_latency[i].merge(other.layer_latency[i]);
+        }
+    }
+
+    void InferenceEngine::prepareContext(ExecutionContext& context) const
+    {
+        // plans made for another engine's model have the wrong shapes here
+        if (context.model_ != model_.get())
+        {
+            context.clearBuffers();
+            context.stats_ = InferenceStats{};
+            context.transient_peak_bytes_ = 0;
+            context.model_ = model_.get();
+        }
+    }
+
+    void InferenceEngine::resetStats(InferenceStats& stats) const
+    {
+        // reuse the layer_times storage so profiled runs don't allocate either
+        stats.total_time = std::chrono::duration<double, std::milli>(0);
+        stats.layer_times.assign(model_->getLayers().size(), std::chrono::duration<double, std::milli>(0));
+        stats.memory_usage_bytes = 0;
         
-        for (size_t i = 0; i < layers.size(); ++i)
+        // the histograms are sized once, after that recording is just atomic adds
+        if (stats.layer_latency.size() != stats.layer_times.size())
         {
-            // for now well determine shapes dynamically during first inference
-            // more sophisticated engine would infer shapes ahead of time
-            intermediate_tensors_.emplace_back();
+            stats.layer_latency.resize(stats.layer_times.size());
         }
         
-        buffers_allocated_ = true;
+        // opens this thread's counters on its first profiled call
+        stats.counters = PerfCounts();
+        stats.counters_available = countersOn() && PerfCounters::forThisThread().available();
+        if (countersOn())
+        {
+            stats.layer_counters.assign(stats.layer_times.size(), LayerCounters());
+        }
+        else
+        {
+            stats.layer_counters.clear();
+        }
     }
 
-    void InferenceEngine::clearBuffers()
+    void InferenceEngine::recordLatency(InferenceStats& stats) const
     {
-        intermediate_tensors_.clear();
-        buffers_allocated_ = false;
+        stats.latency.record(stats.total_time);
+        for (size_t i = 0; i < stats.layer_times.size(); ++i)
+        {
+            stats.layer_latency[i].record(stats.layer_times[i]);
+        }
     }
 
     void InferenceEngine::validateInput(const Tensor& input) const
@@ -147,33 +507,85 @@ namespace mininn
         }
     }
 
-    void InferenceEngine::executeForwardPass(const Tensor& input, Tensor& output)
+    void InferenceEngine::executeForwardPass(const Tensor& input, Tensor& output, MemoryPlan& plan,
+                                             ThreadPool* pool,
+                                             std::vector<std::chrono::duration<double, std::milli>>* layer_times,
+                                             std::vector<LayerCounters>* layer_counters) const
     {
         const auto& layers = model_->getLayers();
+        const auto& expected_output_shape = plan.outputShape();
+        
+        if (output.shape() != expected_output_shape)
+        {
+            output = Tensor(expected_output_shape);
+        }
         
-        // start with input tensor
-        Tensor current_input = input;  // copy input
-        Tensor layer_output;
+        // read the caller's input in place, write intermediates into the planned arena and the
+        // last layers straight into output; in-place layers overwrite whatever the previous one wrote
+        const Tensor* current_input = &input;
+        Tensor* current_output = nullptr;
+        Tracer* tracer = tracer_.get();
+        PerfCounters* counters = layer_counters ? &PerfCounters::forThisThread() : nullptr;
         
         for (size_t i = 0; i < layers.size(); ++i)
         {
+            // a fused layer shows up in its predecessor's span and counts
+            TraceSpan span(fused_[i] ? nullptr : tracer, layerTypeName(layers[i]->getType()), "layer");
+            const bool counted = counters && !fused_[i];
+            if (span.active() || counted)
+            {
+                const Layer* fused = i + 1 < layers.size() && fused_[i + 1] ? layers[i + 1].get() : nullptr;
+                const auto& layer_input_shape = i == 0 ? plan.inputShape() : plan.layerOutputShape(i - 1);
+                const uint64_t flops = passFlops(*layers[i], fused, layer_input_shape, plan.layerOutputShape(i));
+                if (span.active())
+                {
+                    setLayerArgs(span, i, flops, fused, layer_input_shape, plan.layerOutputShape(i));
+                }
+                if (counted)
+                {
+                    (*layer_counters)[i].flops = flops;
+                }
+            }
+            // read outside the timed part, so the times don't pay for the syscalls
+            const PerfCounts counts_before = counted ? counters->read() : PerfCounts();
             auto layer_start = std::chrono::high_resolution_clock::now();
             
             try 
             {
                 // execute layer forward pass
-                layers[i]->forward(current_input, layer_output);
+                if (fused_[i])
+                {
+                    // already applied by the previous layer
+                }
+                else if (plan.inPlace(i))
+                {
+                    layers[i]->forwardInPlace(*current_output);
+                }
+                else
+                {
+                    current_output = plan.writesOutput(i) ? &output : &plan.intermediate(i);
+                    if (i + 1 < layers.size() && fused_[i + 1])
+                    {
+                        layers[i]->forwardFused(*current_input, *current_output, *layers[i + 1], pool);
+                    }
+                    else
+                    {
+                        layers[i]->forward(*current_input, *current_output, pool);
+                    }
+                }
                 
                 // update profiling
-                if (profiling_enabled_)
+                if (layer_times)
                 {
                     auto layer_end = std::chrono::high_resolution_clock::now();
-                    last_stats_.layer_times[i] = layer_end - layer_start;
+                    (*layer_times)[i] = layer_end - layer_start;
+                }
+                if (counted)
+                {
+                    (*layer_counters)[i].counts = counters->read() - counts_before;
                 }
                 
-                // prepare for next layer (move output to input for next iteration)
-                current_input = std::move(layer_output);
-                layer_output = Tensor();  // clear for next iteration
+                current_input = current_output;
             }
             catch (const std::exception& e)
             {
@@ -184,11 +596,7 @@ namespace mininn
             }
         }
         
-        // final output
-        output = std::move(current_input);
-        
         // validate output shape
-        const auto& expected_output_shape = model_->getOutputShape();
         if (output.shape() != expected_output_shape)
         {
             std::string expected_str = "[";
@@ -212,38 +620,71 @@ namespace mininn
         }
     }
 
-    void InferenceEngine::updateMemoryUsage()
+    void InferenceEngine::updateMemoryUsage(ExecutionContext& context) const
+    {
+        context.stats_.memory = memoryReport(context);
+        context.stats_.memory_usage_bytes = context.stats_.memory.totalBytes();
+    }
+
+    MemoryReport InferenceEngine::memoryReport(const ExecutionContext& context) const
     {
-        // estimate memory usage (simplified calculation)
-        size_t total_bytes = 0;
+        MemoryReport report;
+        report.parameters = parameter_bytes_;
+        report.mapped_file_bytes = model_->mappedBytes();
         
-        // count model parameters
-        for (const auto& layer : model_->getLayers())
+        // a context last used with another engine holds nothing for this one
+        if (context.model_ == model_.get())
         {
-            if (layer->getType() == LayerType::LINEAR)
+            report.activation_bytes = context.plan_.arenaBytes() + context.batch_plan_.arenaBytes();
+            report.transient_peak_bytes = context.transient_peak_bytes_;
+        }
+        
+        report.scratch_bytes = ScratchMemory::bytes();
+        report.scratch_peak_bytes = ScratchMemory::peakBytes();
+        return report;
+    }
+
+    size_t MemoryReport::totalBytes() const
+    {
+        return parameters.heap() + activation_bytes + transient_peak_bytes + scratch_bytes;
+    }
+
+    std::string MemoryReport::toString() const
+    {
+        std::ostringstream out;
+        out << "parameters: " << parameters.total() << " bytes";
+        for (size_t i = 0; i < NUM_DATA_TYPES; ++i)
+        {
+            if (parameters.by_type[i] != 0)
             {
-                // rough estimate for linear layers (weights + bias)
-                // this is a simplification - real implementation would track actual sizes
-                total_bytes += 1000000;  // placeholder
+                out << ", " << dataTypeName(static_cast<DataType>(i)) << " " << parameters.by_type[i];
             }
         }
-        
-        // add intermediate tensors
-        for (const auto& tensor : intermediate_tensors_)
+        if (parameters.other != 0)
         {
-            total_bytes += tensor.size() * sizeof(float);
+            out << ", other " << parameters.other;
         }
-        
-        last_stats_.memory_usage_bytes = total_bytes;
+        if (parameters.mapped != 0)
+        {
+            out << " (" << parameters.mapped << " read in place from a " << mapped_file_bytes << " byte mapping)";
+        }
+        out << "\nactivations: " << activation_bytes << " bytes"
+            << "\ntransient peak: " << transient_peak_bytes << " bytes"
+            << "\nscratch: " << scratch_bytes << " bytes (peak " << scratch_peak_bytes << ")"
+            << "\ntotal heap: " << totalBytes() << " bytes";
+        return out.str();
     }
 
     // factory function
-    std::unique_ptr<InferenceEngine> createInferenceEngine(const std::string& model_path)
+    std::unique_ptr<InferenceEngine> createInferenceEngine(const std::string& model_path, LoadMode mode,
+                                                           std::shared_ptr<Tracer> tracer)
     {
         try
         {
-            auto model = ModelLoader::loadFromFile(model_path);
-            return std::make_unique<InferenceEngine>(std::move(model));
+            auto model = ModelLoader::loadFromFile(model_path, mode, tracer.get());
+            auto engine = std::make_unique<InferenceEngine>(std::move(model));
+            engine->setTracer(std::move(tracer));
+            return engine;
         }
         catch (const std::exception& e)
         {
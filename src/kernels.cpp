@@ -0,0 +1,453 @@
+/* kernels.cpp
+ *
+ * Scalar reference kernels, cpu feature detection and the kernel registry.
+ * The SIMD tiers live in kernels_sse42.cpp, kernels_avx2.cpp and kernels_avx512.cpp;
+ * each is compiled with per-function target attributes so a single build runs
+ * on any x86-64 host and only picks a tier after checking cpuid.
+ */
+
+#include "kernels.h"
+#include "kernels_internal.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace mininn
+{
+    namespace
+    {
+        void reluScalar(float* data, size_t n)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (data[i] < 0.0f)
+                {
+                    data[i] = 0.0f;
+                }
+            }
+        }
+
+        void sigmoidScalar(float* data, size_t n)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                data[i] = 1.0f / (1.0f + std::exp(-data[i]));
+            }
+        }
+
+        void softmaxScalar(float* data, size_t n)
+        {
+            // find max val to prevent overflow
+            float max_val = data[0];
+            for (size_t i = 1; i < n; ++i)
+            {
+                max_val = std::max(max_val, data[i]);
+            }
+
+            // exp(x - max_val) for each element then sum
+            float sum = 0.0f;
+            for (size_t i = 0; i < n; ++i)
+            {
+                data[i] = std::exp(data[i] - max_val);
+                sum += data[i];
+            }
+
+            const float inverse_sum = 1.0f / sum;
+            for (size_t i = 0; i < n; ++i)
+            {
+                data[i] *= inverse_sum;
+            }
+        }
+
+        void axpyScalar(size_t n, float alpha, const float* x, float* y)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                y[i] += alpha * x[i];
+            }
+        }
+
+        void axpyFp16Scalar(size_t n, float alpha, const uint16_t* x, float* y)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                y[i] += alpha * HalfFloat::fp16ToFp32(x[i]);
+            }
+        }
+
+        void axpyBf16Scalar(size_t n, float alpha, const uint16_t* x, float* y)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                y[i] += alpha * HalfFloat::bf16ToFp32(x[i]);
+            }
+        }
+
+        constexpr size_t SCALAR_MR = 4;
+        constexpr size_t SCALAR_NR = 8;
+        constexpr size_t S8_MR = 2;
+        constexpr size_t Q4_MR = 4;
+
+        // fixed trip counts let the compiler keep acc in (baseline sse2) vector registers
+        void gemmMicroScalar(size_t kc, const float* a, const float* b,
+                             float* c, size_t ldc, size_t mr, size_t nr, bool accumulate,
+                             const GemmEpilogue* epilogue)
+        {
+            float acc[SCALAR_MR][SCALAR_NR] = {};
+
+            for (size_t p = 0; p < kc; ++p)
+            {
+                const float* a_col = a + p * SCALAR_MR;
+                const float* b_row = b + p * SCALAR_NR;
+                for (size_t i = 0; i < SCALAR_MR; ++i)
+                {
+                    const float a_val = a_col[i];
+                    for (size_t j = 0; j < SCALAR_NR; ++j)
+                    {
+                        acc[i][j] += a_val * b_row[j];
+                    }
+                }
+            }
+
+            for (size_t i = 0; i < mr; ++i)
+            {
+                float* c_row = c + i * ldc;
+                for (size_t j = 0; j < nr; ++j)
+                {
+                    c_row[j] = accumulate ? c_row[j] + acc[i][j] : acc[i][j];
+                }
+
+                if (epilogue)
+                {
+                    if (epilogue->bias)
+                    {
+                        for (size_t j = 0; j < nr; ++j)
+                        {
+                            c_row[j] += epilogue->bias[j];
+                        }
+                    }
+                    if (epilogue->activation == Activation::RELU)
+                    {
+                        reluScalar(c_row, nr);
+                    }
+                    else if (epilogue->activation == Activation::SIGMOID)
+                    {
+                        sigmoidScalar(c_row, nr);
+                    }
+                }
+            }
+        }
+
+        void dotTileS8Scalar(const int8_t* const* a_rows, const int8_t* const* b_rows, size_t k,
+                             int32_t sums[S8_MR][Int8Gemm::NR])
+        {
+            for (size_t r = 0; r < S8_MR; ++r)
+            {
+                for (size_t q = 0; q < Int8Gemm::NR; ++q)
+                {
+                    int32_t sum = 0;
+                    for (size_t p = 0; p < k; ++p)
+                    {
+                        sum += static_cast<int32_t>(a_rows[r][p]) * static_cast<int32_t>(b_rows[q][p]);
+                    }
+                    sums[r][q] = sum;
+                }
+            }
+        }
+
+        void gemmS8Scalar(size_t m, size_t n, size_t k,
+                          const int8_t* a, size_t lda, const int8_t* b, size_t ldb, const int32_t* b_sums,
+                          const float* a_scales, const float* b_scales,
+                          float* c, size_t ldc, const GemmEpilogue* epilogue)
+        {
+            Int8Gemm::run<S8_MR>(dotTileS8Scalar, 0, reluScalar, sigmoidScalar, m, n, k, a, lda, b, ldb, b_sums,
+                          a_scales, b_scales, c, ldc, epilogue);
+        }
+
+        void dotTileQ4Scalar(const float* const* a_rows, size_t rows, const uint8_t* const* b_rows,
+                             const float* const* scale_rows, size_t k, size_t group_size,
+                             float sums[Q4_MR][Int4Gemm::NR])
+        {
+            constexpr size_t HALF = Kernels::INT4_BLOCK / 2;
+            float weights[Kernels::INT4_BLOCK];
+
+            for (size_t q = 0; q < Int4Gemm::NR; ++q)
+            {
+                for (size_t r = 0; r < rows; ++r)
+                {
+                    sums[r][q] = 0.0f;
+                }
+
+                for (size_t p = 0; p < k; p += Kernels::INT4_BLOCK)
+                {
+                    const float scale = scale_rows[q][p / group_size];
+                    const uint8_t* block = b_rows[q] + p / 2;
+                    for (size_t i = 0; i < HALF; ++i)
+                    {
+                        weights[i] = static_cast<float>((block[i] & 0x0f) - 8) * scale;
+                        weights[i + HALF] = static_cast<float>((block[i] >> 4) - 8) * scale;
+                    }
+                    for (size_t r = 0; r < rows; ++r)
+                    {
+                        for (size_t i = 0; i < Kernels::INT4_BLOCK; ++i)
+                        {
+                            sums[r][q] += a_rows[r][p + i] * weights[i];
+                        }
+                    }
+                }
+            }
+        }
+
+        void gemmQ4Scalar(size_t m, size_t n, size_t k,
+                          const float* a, size_t lda, const uint8_t* b, size_t ldb,
+                          const float* b_scales, size_t group_size,
+                          float* c, size_t ldc, const GemmEpilogue* epilogue)
+        {
+            Int4Gemm::run<Q4_MR>(dotTileQ4Scalar, reluScalar, sigmoidScalar, m, n, k, a, lda, b, ldb,
+                          b_scales, group_size, c, ldc, epilogue);
+        }
+
+        void fp16ToFp32Scalar(const uint16_t* src, float* dst, size_t n)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                dst[i] = HalfFloat::fp16ToFp32(src[i]);
+            }
+        }
+
+        void fp32ToFp16Scalar(const float* src, uint16_t* dst, size_t n)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                dst[i] = HalfFloat::fp32ToFp16(src[i]);
+            }
+        }
+
+        void bf16ToFp32Scalar(const uint16_t* src, float* dst, size_t n)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                dst[i] = HalfFloat::bf16ToFp32(src[i]);
+            }
+        }
+
+        void fp32ToBf16Scalar(const float* src, uint16_t* dst, size_t n)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                dst[i] = HalfFloat::fp32ToBf16(src[i]);
+            }
+        }
+
+        const KernelTable scalar_table = {
+            CpuTier::SCALAR, "scalar",
+            reluScalar, sigmoidScalar, softmaxScalar, axpyScalar, axpyFp16Scalar, axpyBf16Scalar,
+            SCALAR_MR, SCALAR_NR, gemmMicroScalar,
+            gemmS8Scalar,
+            gemmQ4Scalar,
+            fp16ToFp32Scalar, fp32ToFp16Scalar, bf16ToFp32Scalar, fp32ToBf16Scalar
+        };
+
+#if defined(__x86_64__) || defined(__i386__)
+        // xcr0 tells us which register files the os saves on context switch
+        uint64_t readXcr0()
+        {
+            uint32_t eax = 0;
+            uint32_t edx = 0;
+            __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            return (static_cast<uint64_t>(edx) << 32) | eax;
+        }
+#endif
+
+        CpuTier detect()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+            if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+            {
+                return CpuTier::SCALAR;
+            }
+
+            const bool sse42 = (ecx & bit_SSE4_2) != 0;
+            const bool fma = (ecx & bit_FMA) != 0;
+            const bool f16c = (ecx & bit_F16C) != 0;
+            const bool osxsave = (ecx & bit_OSXSAVE) != 0;
+            const bool avx = (ecx & bit_AVX) != 0;
+
+            if (!sse42)
+            {
+                return CpuTier::SCALAR;
+            }
+            if (!osxsave || !avx)
+            {
+                return CpuTier::SSE42;
+            }
+
+            const uint64_t xcr0 = readXcr0();
+            const bool os_ymm = (xcr0 & 0x6) == 0x6;      // xmm + ymm state
+            const bool os_zmm = (xcr0 & 0xe6) == 0xe6;    // + opmask and zmm state
+            if (!os_ymm)
+            {
+                return CpuTier::SSE42;
+            }
+
+            if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+            {
+                return CpuTier::SSE42;
+            }
+            const bool avx2 = (ebx & bit_AVX2) != 0;
+            const bool avx512f = (ebx & bit_AVX512F) != 0;
+
+            if (avx512f && avx2 && fma && f16c && os_zmm)
+            {
+                return CpuTier::AVX512;
+            }
+            if (avx2 && fma && f16c)
+            {
+                return CpuTier::AVX2;
+            }
+            return CpuTier::SSE42;
+#else
+            return CpuTier::SCALAR;
+#endif
+        }
+
+        // best tier at or below the requested one that this build + cpu can run
+        const KernelTable* bestAtOrBelow(CpuTier tier)
+        {
+            for (int t = static_cast<int>(tier); t > 0; --t)
+            {
+                if (const KernelTable* table = Kernels::forTier(static_cast<CpuTier>(t)))
+                {
+                    return table;
+                }
+            }
+            return &scalar_table;
+        }
+
+        const KernelTable* selectInitial()
+        {
+            CpuTier tier = Kernels::detectCpuTier();
+
+            if (const char* env = std::getenv("MININN_CPU_TIER"))
+            {
+                CpuTier requested;
+                if (Kernels::parseTier(env, requested) && requested < tier)
+                {
+                    tier = requested;
+                }
+            }
+            return bestAtOrBelow(tier);
+        }
+
+        std::atomic<const KernelTable*>& activeTable()
+        {
+            static std::atomic<const KernelTable*> table{selectInitial()};
+            return table;
+        }
+
+        bool detectAvx512Vnni()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+            if (Kernels::detectCpuTier() < CpuTier::AVX512 || !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+            {
+                return false;
+            }
+            return (ebx & bit_AVX512BW) != 0 && (ecx & bit_AVX512VNNI) != 0;
+#else
+            return false;
+#endif
+        }
+    } // namespace
+
+    namespace Kernels
+    {
+        CpuTier detectCpuTier()
+        {
+            static const CpuTier tier = detect();
+            return tier;
+        }
+
+        bool hasAvx512Vnni()
+        {
+            static const bool vnni = detectAvx512Vnni();
+            return vnni;
+        }
+
+        const KernelTable* forTier(CpuTier tier)
+        {
+            if (tier > detectCpuTier())
+            {
+                return nullptr;
+            }
+
+            switch (tier)
+            {
+                case CpuTier::SCALAR:
+                    return &scalar_table;
+                case CpuTier::SSE42:
+                    return sse42KernelTable();
+                case CpuTier::AVX2:
+                    return avx2KernelTable();
+                case CpuTier::AVX512:
+                    return avx512KernelTable();
+            }
+            return nullptr;
+        }
+
+        const KernelTable& active()
+        {
+            return *activeTable().load(std::memory_order_acquire);
+        }
+
+        void setActiveTier(CpuTier tier)
+        {
+            const KernelTable* table = forTier(tier);
+            if (!table)
+            {
+                throw std::invalid_argument(
+                    std::string("CPU tier not supported on this machine: ") + tierName(tier)
+                );
+            }
+            activeTable().store(table, std::memory_order_release);
+        }
+
+        const char* tierName(CpuTier tier)
+        {
+            switch (tier)
+            {
+                case CpuTier::SCALAR:
+                    return "scalar";
+                case CpuTier::SSE42:
+                    return "sse4.2";
+                case CpuTier::AVX2:
+                    return "avx2";
+                case CpuTier::AVX512:
+                    return "avx512";
+            }
+            return "unknown";
+        }
+
+        bool parseTier(const std::string& name, CpuTier& tier)
+        {
+            for (CpuTier candidate : {CpuTier::SCALAR, CpuTier::SSE42, CpuTier::AVX2, CpuTier::AVX512})
+            {
+                if (name == tierName(candidate))
+                {
+                    tier = candidate;
+                    return true;
+                }
+            }
+            return false;
+        }
+    } // namespace Kernels
+
+} // namespace mininn
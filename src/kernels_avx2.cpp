@@ -0,0 +1,511 @@
+/* kernels_avx2.cpp
+ *
+ * AVX2 + FMA kernels (8-wide). The gemm micro-kernel uses a 6x16 register tile:
+ * 12 ymm accumulators, two for the packed B row and one for the A broadcast.
+ * fp16 conversions use f16c, which every avx2 cpu we dispatch to also has.
+ */
+
+#include "kernels_internal.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define MININN_TARGET __attribute__((target("avx2,fma,f16c")))
+
+namespace mininn
+{
+    namespace
+    {
+        constexpr size_t MR = 6;
+        constexpr size_t NR = 16;
+        constexpr size_t S8_MR = 2;    // 8 accumulators + 4 weight rows + 1 activation row
+        constexpr size_t Q4_MR = 2;    // 8 accumulators + 4 weights + 1 activation row
+
+        MININN_TARGET inline __m256 exp8(__m256 x)
+        {
+            using namespace ExpConstants;
+            x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(LO)), _mm256_set1_ps(HI));
+
+            __m256 fx = _mm256_fmadd_ps(x, _mm256_set1_ps(LOG2E), _mm256_set1_ps(0.5f));
+            fx = _mm256_floor_ps(fx);
+
+            x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(LN2_HI), x);
+            x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(LN2_LO), x);
+
+            __m256 y = _mm256_set1_ps(P0);
+            y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(P1));
+            y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(P2));
+            y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(P3));
+            y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(P4));
+            y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(P5));
+            y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), _mm256_add_ps(x, _mm256_set1_ps(1.0f)));
+
+            // build 2^n directly in the exponent bits
+            __m256i n = _mm256_add_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(127));
+            return _mm256_mul_ps(y, _mm256_castsi256_ps(_mm256_slli_epi32(n, 23)));
+        }
+
+        MININN_TARGET inline float horizontalSum(__m256 v)
+        {
+            __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+            lo = _mm_add_ss(lo, _mm_movehdup_ps(lo));
+            return _mm_cvtss_f32(lo);
+        }
+
+        MININN_TARGET inline float horizontalMax(__m256 v)
+        {
+            __m128 lo = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            lo = _mm_max_ps(lo, _mm_movehl_ps(lo, lo));
+            lo = _mm_max_ss(lo, _mm_movehdup_ps(lo));
+            return _mm_cvtss_f32(lo);
+        }
+
+        MININN_TARGET void relu(float* data, size_t n)
+        {
+            const __m256 zero = _mm256_setzero_ps();
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                _mm256_storeu_ps(data + i, _mm256_max_ps(_mm256_loadu_ps(data + i), zero));
+            }
+            for (; i < n; ++i)
+            {
+                data[i] = data[i] < 0.0f ? 0.0f : data[i];
+            }
+        }
+
+        MININN_TARGET inline __m256 sigmoid8(__m256 x)
+        {
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256 neg_x = _mm256_xor_ps(x, _mm256_set1_ps(-0.0f));
+            return _mm256_div_ps(one, _mm256_add_ps(one, exp8(neg_x)));
+        }
+
+        MININN_TARGET void sigmoid(float* data, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                _mm256_storeu_ps(data + i, sigmoid8(_mm256_loadu_ps(data + i)));
+            }
+            for (; i < n; ++i)
+            {
+                data[i] = 1.0f / (1.0f + std::exp(-data[i]));
+            }
+        }
+
+        MININN_TARGET void softmax(float* data, size_t n)
+        {
+            size_t i = 0;
+
+            // max
+            __m256 max_vec = _mm256_set1_ps(data[0]);
+            for (; i + 8 <= n; i += 8)
+            {
+                max_vec = _mm256_max_ps(max_vec, _mm256_loadu_ps(data + i));
+            }
+            float max_val = horizontalMax(max_vec);
+            for (; i < n; ++i)
+            {
+                max_val = std::max(max_val, data[i]);
+            }
+
+            // exp(x - max) and sum
+            const __m256 max_bcast = _mm256_set1_ps(max_val);
+            __m256 sum_vec = _mm256_setzero_ps();
+            for (i = 0; i + 8 <= n; i += 8)
+            {
+                const __m256 e = exp8(_mm256_sub_ps(_mm256_loadu_ps(data + i), max_bcast));
+                _mm256_storeu_ps(data + i, e);
+                sum_vec = _mm256_add_ps(sum_vec, e);
+            }
+            float sum = horizontalSum(sum_vec);
+            for (; i < n; ++i)
+            {
+                data[i] = std::exp(data[i] - max_val);
+                sum += data[i];
+            }
+
+            // normalize
+            const float inverse_sum = 1.0f / sum;
+            const __m256 inverse_vec = _mm256_set1_ps(inverse_sum);
+            for (i = 0; i + 8 <= n; i += 8)
+            {
+                _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), inverse_vec));
+            }
+            for (; i < n; ++i)
+            {
+                data[i] *= inverse_sum;
+            }
+        }
+
+        MININN_TARGET void axpy(size_t n, float alpha, const float* x, float* y)
+        {
+            const __m256 a = _mm256_set1_ps(alpha);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                _mm256_storeu_ps(y + i, _mm256_fmadd_ps(a, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+            }
+            for (; i < n; ++i)
+            {
+                y[i] += alpha * x[i];
+            }
+        }
+
+        MININN_TARGET void axpyFp16(size_t n, float alpha, const uint16_t* x, float* y)
+        {
+            const __m256 a = _mm256_set1_ps(alpha);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                const __m256 xv = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+                _mm256_storeu_ps(y + i, _mm256_fmadd_ps(a, xv, _mm256_loadu_ps(y + i)));
+            }
+            for (; i < n; ++i)
+            {
+                y[i] += alpha * HalfFloat::fp16ToFp32(x[i]);
+            }
+        }
+
+        MININN_TARGET void axpyBf16(size_t n, float alpha, const uint16_t* x, float* y)
+        {
+            const __m256 a = _mm256_set1_ps(alpha);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                const __m256i b = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+                const __m256 xv = _mm256_castsi256_ps(_mm256_slli_epi32(b, 16));
+                _mm256_storeu_ps(y + i, _mm256_fmadd_ps(a, xv, _mm256_loadu_ps(y + i)));
+            }
+            for (; i < n; ++i)
+            {
+                y[i] += alpha * HalfFloat::bf16ToFp32(x[i]);
+            }
+        }
+
+        MININN_TARGET inline __m256 epilogue8(__m256 x, __m256 bias, Activation activation)
+        {
+            x = _mm256_add_ps(x, bias);
+            if (activation == Activation::RELU)
+            {
+                return _mm256_max_ps(x, _mm256_setzero_ps());
+            }
+            if (activation == Activation::SIGMOID)
+            {
+                return sigmoid8(x);
+            }
+            return x;
+        }
+
+        MININN_TARGET void gemmMicro(size_t kc, const float* a, const float* b,
+                                     float* c, size_t ldc, size_t mr, size_t nr, bool accumulate,
+                                     const GemmEpilogue* epilogue)
+        {
+            __m256 acc[MR][2];
+            for (size_t i = 0; i < MR; ++i)
+            {
+                acc[i][0] = _mm256_setzero_ps();
+                acc[i][1] = _mm256_setzero_ps();
+            }
+
+            for (size_t p = 0; p < kc; ++p)
+            {
+                const __m256 b0 = _mm256_loadu_ps(b + p * NR);
+                const __m256 b1 = _mm256_loadu_ps(b + p * NR + 8);
+                for (size_t i = 0; i < MR; ++i)
+                {
+                    const __m256 a_val = _mm256_broadcast_ss(a + p * MR + i);
+                    acc[i][0] = _mm256_fmadd_ps(a_val, b0, acc[i][0]);
+                    acc[i][1] = _mm256_fmadd_ps(a_val, b1, acc[i][1]);
+                }
+            }
+
+            // edge tiles go through a zero padded copy so every row is two full vectors
+            const bool full = mr == MR && nr == NR;
+            alignas(32) float tile[MR * NR];
+            alignas(32) float bias_tile[NR];
+            float* out = full ? c : tile;
+            const size_t ld_out = full ? ldc : NR;
+            if (!full)
+            {
+                std::fill(tile, tile + MR * NR, 0.0f);
+                if (accumulate)
+                {
+                    for (size_t i = 0; i < mr; ++i)
+                    {
+                        std::copy(c + i * ldc, c + i * ldc + nr, tile + i * NR);
+                    }
+                }
+            }
+
+            __m256 bias0 = _mm256_setzero_ps();
+            __m256 bias1 = _mm256_setzero_ps();
+            if (epilogue && epilogue->bias)
+            {
+                const float* bias = epilogue->bias;
+                if (!full)
+                {
+                    std::fill(bias_tile, bias_tile + NR, 0.0f);
+                    std::copy(bias, bias + nr, bias_tile);
+                    bias = bias_tile;
+                }
+                bias0 = _mm256_loadu_ps(bias);
+                bias1 = _mm256_loadu_ps(bias + 8);
+            }
+
+            for (size_t i = 0; i < mr; ++i)
+            {
+                float* out_row = out + i * ld_out;
+                if (accumulate)
+                {
+                    acc[i][0] = _mm256_add_ps(acc[i][0], _mm256_loadu_ps(out_row));
+                    acc[i][1] = _mm256_add_ps(acc[i][1], _mm256_loadu_ps(out_row + 8));
+                }
+                if (epilogue)
+                {
+                    acc[i][0] = epilogue8(acc[i][0], bias0, epilogue->activation);
+                    acc[i][1] = epilogue8(acc[i][1], bias1, epilogue->activation);
+                }
+                _mm256_storeu_ps(out_row, acc[i][0]);
+                _mm256_storeu_ps(out_row + 8, acc[i][1]);
+            }
+
+            if (!full)
+            {
+                for (size_t i = 0; i < mr; ++i)
+                {
+                    std::copy(tile + i * NR, tile + i * NR + nr, c + i * ldc);
+                }
+            }
+        }
+
+        // 16 bytes of k per step: widen to int16, vpmaddwd multiplies and adds neighbouring pairs into
+        // int32 (exact for the full int8 range, unlike vpmaddubsw whose int16 pair sums can saturate)
+        MININN_TARGET void dotTileS8(const int8_t* const* a_rows, const int8_t* const* b_rows, size_t k,
+                                     int32_t sums[S8_MR][Int8Gemm::NR])
+        {
+            __m256i acc[S8_MR][Int8Gemm::NR];
+            for (size_t r = 0; r < S8_MR; ++r)
+            {
+                for (size_t q = 0; q < Int8Gemm::NR; ++q)
+                {
+                    acc[r][q] = _mm256_setzero_si256();
+                }
+            }
+
+            for (size_t p = 0; p < k; p += 16)
+            {
+                __m256i b16[Int8Gemm::NR];
+                for (size_t q = 0; q < Int8Gemm::NR; ++q)
+                {
+                    b16[q] = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b_rows[q] + p)));
+                }
+                for (size_t r = 0; r < S8_MR; ++r)
+                {
+                    const __m256i a16 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a_rows[r] + p)));
+                    for (size_t q = 0; q < Int8Gemm::NR; ++q)
+                    {
+                        acc[r][q] = _mm256_add_epi32(acc[r][q], _mm256_madd_epi16(a16, b16[q]));
+                    }
+                }
+            }
+
+            for (size_t r = 0; r < S8_MR; ++r)
+            {
+                // per 128 bit lane: [sum0 sum1 sum2 sum3] partials, then fold the lanes
+                const __m256i sum = _mm256_hadd_epi32(_mm256_hadd_epi32(acc[r][0], acc[r][1]),
+                                                      _mm256_hadd_epi32(acc[r][2], acc[r][3]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(sums[r]),
+                                 _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+            }
+        }
+
+        void gemmS8(size_t m, size_t n, size_t k,
+                    const int8_t* a, size_t lda, const int8_t* b, size_t ldb, const int32_t* b_sums,
+                    const float* a_scales, const float* b_scales,
+                    float* c, size_t ldc, const GemmEpilogue* epilogue)
+        {
+            Int8Gemm::run<S8_MR>(dotTileS8, 0, relu, sigmoid, m, n, k, a, lda, b, ldb, b_sums,
+                          a_scales, b_scales, c, ldc, epilogue);
+        }
+
+        // one int4 block (16 bytes, 32 weights) of each column per step, unpacked to four ymm of fp32
+        // weights that every row then reuses; two accumulators per row and column keep the chains short
+        template<size_t ROWS>
+        MININN_TARGET void dotTileQ4Rows(const float* const* a_rows, const uint8_t* const* b_rows,
+                                         const float* const* scale_rows, size_t k, size_t group_size,
+                                         float sums[Q4_MR][Int4Gemm::NR])
+        {
+            __m256 acc[ROWS][Int4Gemm::NR][2];
+            for (size_t r = 0; r < ROWS; ++r)
+            {
+                for (size_t q = 0; q < Int4Gemm::NR; ++q)
+                {
+                    acc[r][q][0] = _mm256_setzero_ps();
+                    acc[r][q][1] = _mm256_setzero_ps();
+                }
+            }
+
+            const __m128i low_mask = _mm_set1_epi8(0x0f);
+            const __m128i offset = _mm_set1_epi8(8);
+            for (size_t g = 0, group = 0; g < k; g += group_size, ++group)
+            {
+                for (size_t q = 0; q < Int4Gemm::NR; ++q)
+                {
+                    const __m256 scale = _mm256_set1_ps(scale_rows[q][group]);
+                    for (size_t p = g; p < g + group_size; p += Kernels::INT4_BLOCK)
+                    {
+                        const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b_rows[q] + p / 2));
+                        const __m128i lo = _mm_sub_epi8(_mm_and_si128(packed, low_mask), offset);
+                        const __m128i hi = _mm_sub_epi8(_mm_and_si128(_mm_srli_epi16(packed, 4), low_mask), offset);
+
+                        __m256 w[4];
+                        w[0] = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(lo)), scale);
+                        w[1] = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(lo, 8))), scale);
+                        w[2] = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(hi)), scale);
+                        w[3] = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(hi, 8))), scale);
+
+                        for (size_t r = 0; r < ROWS; ++r)
+                        {
+                            const float* x = a_rows[r] + p;
+                            acc[r][q][0] = _mm256_fmadd_ps(_mm256_loadu_ps(x), w[0], acc[r][q][0]);
+                            acc[r][q][1] = _mm256_fmadd_ps(_mm256_loadu_ps(x + 8), w[1], acc[r][q][1]);
+                            acc[r][q][0] = _mm256_fmadd_ps(_mm256_loadu_ps(x + 16), w[2], acc[r][q][0]);
+                            acc[r][q][1] = _mm256_fmadd_ps(_mm256_loadu_ps(x + 24), w[3], acc[r][q][1]);
+                        }
+                    }
+                }
+            }
+
+            for (size_t r = 0; r < ROWS; ++r)
+            {
+                for (size_t q = 0; q < Int4Gemm::NR; ++q)
+                {
+                    sums[r][q] = horizontalSum(_mm256_add_ps(acc[r][q][0], acc[r][q][1]));
+                }
+            }
+        }
+
+        void dotTileQ4(const float* const* a_rows, size_t rows, const uint8_t* const* b_rows,
+                       const float* const* scale_rows, size_t k, size_t group_size, float sums[Q4_MR][Int4Gemm::NR])
+        {
+            switch (rows)
+            {
+                case 1: dotTileQ4Rows<1>(a_rows, b_rows, scale_rows, k, group_size, sums); break;
+                default: dotTileQ4Rows<2>(a_rows, b_rows, scale_rows, k, group_size, sums); break;
+            }
+        }
+
+        void gemmQ4(size_t m, size_t n, size_t k,
+                    const float* a, size_t lda, const uint8_t* b, size_t ldb,
+                    const float* b_scales, size_t group_size,
+                    float* c, size_t ldc, const GemmEpilogue* epilogue)
+        {
+            Int4Gemm::run<Q4_MR>(dotTileQ4, relu, sigmoid, m, n, k, a, lda, b, ldb, b_scales, group_size,
+                                 c, ldc, epilogue);
+        }
+
+        MININN_TARGET void fp16ToFp32(const uint16_t* src, float* dst, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+            }
+            for (; i < n; ++i)
+            {
+                dst[i] = HalfFloat::fp16ToFp32(src[i]);
+            }
+        }
+
+        MININN_TARGET void fp32ToFp16(const float* src, uint16_t* dst, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+            }
+            for (; i < n; ++i)
+            {
+                dst[i] = HalfFloat::fp32ToFp16(src[i]);
+            }
+        }
+
+        MININN_TARGET void bf16ToFp32(const uint16_t* src, float* dst, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                const __m256i b = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_slli_epi32(b, 16));
+            }
+            for (; i < n; ++i)
+            {
+                dst[i] = HalfFloat::bf16ToFp32(src[i]);
+            }
+        }
+
+        // fp32 bits -> bf16 in the low half of each lane, rounded to nearest even (nan stays nan)
+        MININN_TARGET inline __m256i roundToBf16(__m256 x)
+        {
+            const __m256i bits = _mm256_castps_si256(x);
+            const __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1));
+            const __m256i rounded = _mm256_add_epi32(bits, _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7fff)));
+            const __m256i abs = _mm256_and_si256(bits, _mm256_set1_epi32(0x7fffffff));
+            const __m256i nan = _mm256_cmpgt_epi32(abs, _mm256_set1_epi32(0x7f800000));
+            const __m256i quiet = _mm256_or_si256(bits, _mm256_set1_epi32(0x00400000));
+            return _mm256_srli_epi32(_mm256_blendv_epi8(rounded, quiet, nan), 16);
+        }
+
+        MININN_TARGET void fp32ToBf16(const float* src, uint16_t* dst, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                const __m256i lo = roundToBf16(_mm256_loadu_ps(src + i));
+                const __m256i hi = roundToBf16(_mm256_loadu_ps(src + i + 8));
+                // packus works per 128-bit lane, the permute puts the four quarters back in order
+                const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+            }
+            for (; i < n; ++i)
+            {
+                dst[i] = HalfFloat::fp32ToBf16(src[i]);
+            }
+        }
+
+        const KernelTable table = {
+            CpuTier::AVX2, "avx2",
+            relu, sigmoid, softmax, axpy, axpyFp16, axpyBf16,
+            MR, NR, gemmMicro,
+            gemmS8,
+            gemmQ4,
+            fp16ToFp32, fp32ToFp16, bf16ToFp32, fp32ToBf16
+        };
+    } // namespace
+
+    const KernelTable* avx2KernelTable()
+    {
+        return &table;
+    }
+
+} // namespace mininn
+
+#else
+
+namespace mininn
+{
+    const KernelTable* avx2KernelTable()
+    {
+        return nullptr;
+    }
+
+} // namespace mininn
+
+#endif
@@ -0,0 +1,507 @@
+/* kernels_avx512.cpp
+ *
+ * AVX-512F kernels (16-wide). Tails are handled with masked loads/stores instead
+ * of scalar loops, and the gemm micro-kernel uses a 6x32 register tile.
+ */
+
+#include "kernels_internal.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+// gcc's avx512 headers use `__m512 __Y = __Y;` to get undefined registers, which trips
+// -Wuninitialized once those intrinsics are inlined at -O2 and above
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#define MININN_TARGET __attribute__((target("avx512f")))
+
+namespace mininn
+{
+    namespace
+    {
+        constexpr size_t MR = 6;
+        constexpr size_t NR = 32;
+        constexpr size_t S8_MR = 4;    // 16 accumulators + 4 weight rows + 1 activation row
+        constexpr size_t Q4_MR = 4;    // 16 accumulators + 2 weights + 1 activation row
+
+        MININN_TARGET inline __mmask16 tailMask(size_t remaining)
+        {
+            return static_cast<__mmask16>((1u << remaining) - 1u);
+        }
+
+        MININN_TARGET inline __m512 exp16(__m512 x)
+        {
+            using namespace ExpConstants;
+            x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(LO)), _mm512_set1_ps(HI));
+
+            __m512 fx = _mm512_fmadd_ps(x, _mm512_set1_ps(LOG2E), _mm512_set1_ps(0.5f));
+            fx = _mm512_roundscale_ps(fx, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+
+            x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(LN2_HI), x);
+            x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(LN2_LO), x);
+
+            __m512 y = _mm512_set1_ps(P0);
+            y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(P1));
+            y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(P2));
+            y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(P3));
+            y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(P4));
+            y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(P5));
+            y = _mm512_fmadd_ps(y, _mm512_mul_ps(x, x), _mm512_add_ps(x, _mm512_set1_ps(1.0f)));
+
+            // build 2^n directly in the exponent bits
+            __m512i n = _mm512_add_epi32(_mm512_cvttps_epi32(fx), _mm512_set1_epi32(127));
+            return _mm512_mul_ps(y, _mm512_castsi512_ps(_mm512_slli_epi32(n, 23)));
+        }
+
+        MININN_TARGET void relu(float* data, size_t n)
+        {
+            const __m512 zero = _mm512_setzero_ps();
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                _mm512_storeu_ps(data + i, _mm512_max_ps(_mm512_loadu_ps(data + i), zero));
+            }
+            if (i < n)
+            {
+                const __mmask16 mask = tailMask(n - i);
+                const __m512 x = _mm512_maskz_loadu_ps(mask, data + i);
+                _mm512_mask_storeu_ps(data + i, mask, _mm512_max_ps(x, zero));
+            }
+        }
+
+        MININN_TARGET inline __m512 sigmoid16(__m512 x)
+        {
+            const __m512 one = _mm512_set1_ps(1.0f);
+            const __m512 neg_x = _mm512_sub_ps(_mm512_setzero_ps(), x);
+            return _mm512_div_ps(one, _mm512_add_ps(one, exp16(neg_x)));
+        }
+
+        MININN_TARGET void sigmoid(float* data, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                _mm512_storeu_ps(data + i, sigmoid16(_mm512_loadu_ps(data + i)));
+            }
+            if (i < n)
+            {
+                const __mmask16 mask = tailMask(n - i);
+                const __m512 x = _mm512_maskz_loadu_ps(mask, data + i);
+                _mm512_mask_storeu_ps(data + i, mask, sigmoid16(x));
+            }
+        }
+
+        MININN_TARGET void softmax(float* data, size_t n)
+        {
+            const size_t tail = n % 16;
+            const size_t body = n - tail;
+            const __mmask16 mask = tailMask(tail);
+
+            // max (masked-off lanes read as -inf so they never win)
+            __m512 max_vec = _mm512_set1_ps(-INFINITY);
+            for (size_t i = 0; i < body; i += 16)
+            {
+                max_vec = _mm512_max_ps(max_vec, _mm512_loadu_ps(data + i));
+            }
+            if (tail)
+            {
+                max_vec = _mm512_max_ps(max_vec, _mm512_mask_loadu_ps(max_vec, mask, data + body));
+            }
+            const __m512 max_bcast = _mm512_set1_ps(_mm512_reduce_max_ps(max_vec));
+
+            // exp(x - max) and sum
+            __m512 sum_vec = _mm512_setzero_ps();
+            for (size_t i = 0; i < body; i += 16)
+            {
+                const __m512 e = exp16(_mm512_sub_ps(_mm512_loadu_ps(data + i), max_bcast));
+                _mm512_storeu_ps(data + i, e);
+                sum_vec = _mm512_add_ps(sum_vec, e);
+            }
+            if (tail)
+            {
+                const __m512 x = _mm512_maskz_loadu_ps(mask, data + body);
+                const __m512 e = _mm512_maskz_mov_ps(mask, exp16(_mm512_sub_ps(x, max_bcast)));
+                _mm512_mask_storeu_ps(data + body, mask, e);
+                sum_vec = _mm512_add_ps(sum_vec, e);
+            }
+
+            // normalize
+            const __m512 inverse_vec = _mm512_set1_ps(1.0f / _mm512_reduce_add_ps(sum_vec));
+            for (size_t i = 0; i < body; i += 16)
+            {
+                _mm512_storeu_ps(data + i, _mm512_mul_ps(_mm512_loadu_ps(data + i), inverse_vec));
+            }
+            if (tail)
+            {
+                const __m512 x = _mm512_maskz_loadu_ps(mask, data + body);
+                _mm512_mask_storeu_ps(data + body, mask, _mm512_mul_ps(x, inverse_vec));
+            }
+        }
+
+        MININN_TARGET void axpy(size_t n, float alpha, const float* x, float* y)
+        {
+            const __m512 a = _mm512_set1_ps(alpha);
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                _mm512_storeu_ps(y + i, _mm512_fmadd_ps(a, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+            }
+            if (i < n)
+            {
+                const __mmask16 mask = tailMask(n - i);
+                const __m512 xv = _mm512_maskz_loadu_ps(mask, x + i);
+                const __m512 yv = _mm512_maskz_loadu_ps(mask, y + i);
+                _mm512_mask_storeu_ps(y + i, mask, _mm512_fmadd_ps(a, xv, yv));
+            }
+        }
+
+        // the 16-bit loads below can't be masked without avx512bw, so their tails are scalar
+        MININN_TARGET void axpyFp16(size_t n, float alpha, const uint16_t* x, float* y)
+        {
+            const __m512 a = _mm512_set1_ps(alpha);
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                const __m512 xv = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i)));
+                _mm512_storeu_ps(y + i, _mm512_fmadd_ps(a, xv, _mm512_loadu_ps(y + i)));
+            }
+            for (; i < n; ++i)
+            {
+                y[i] += alpha * HalfFloat::fp16ToFp32(x[i]);
+            }
+        }
+
+        MININN_TARGET void axpyBf16(size_t n, float alpha, const uint16_t* x, float* y)
+        {
+            const __m512 a = _mm512_set1_ps(alpha);
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                const __m512i b = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i)));
+                const __m512 xv = _mm512_castsi512_ps(_mm512_slli_epi32(b, 16));
+                _mm512_storeu_ps(y + i, _mm512_fmadd_ps(a, xv, _mm512_loadu_ps(y + i)));
+            }
+            for (; i < n; ++i)
+            {
+                y[i] += alpha * HalfFloat::bf16ToFp32(x[i]);
+            }
+        }
+
+        MININN_TARGET inline __m512 epilogue16(__m512 x, __m512 bias, Activation activation)
+        {
+            x = _mm512_add_ps(x, bias);
+            if (activation == Activation::RELU)
+            {
+                return _mm512_max_ps(x, _mm512_setzero_ps());
+            }
+            if (activation == Activation::SIGMOID)
+            {
+                return sigmoid16(x);
+            }
+            return x;
+        }
+
+        MININN_TARGET void gemmMicro(size_t kc, const float* a, const float* b,
+                                     float* c, size_t ldc, size_t mr, size_t nr, bool accumulate,
+                                     const GemmEpilogue* epilogue)
+        {
+            __m512 acc[MR][2];
+            for (size_t i = 0; i < MR; ++i)
+            {
+                acc[i][0] = _mm512_setzero_ps();
+                acc[i][1] = _mm512_setzero_ps();
+            }
+
+            for (size_t p = 0; p < kc; ++p)
+            {
+                const __m512 b0 = _mm512_loadu_ps(b + p * NR);
+                const __m512 b1 = _mm512_loadu_ps(b + p * NR + 16);
+                for (size_t i = 0; i < MR; ++i)
+                {
+                    const __m512 a_val = _mm512_set1_ps(a[p * MR + i]);
+                    acc[i][0] = _mm512_fmadd_ps(a_val, b0, acc[i][0]);
+                    acc[i][1] = _mm512_fmadd_ps(a_val, b1, acc[i][1]);
+                }
+            }
+
+            // column masks cover partial tiles without a spill buffer
+            const __mmask16 mask0 = nr >= 16 ? static_cast<__mmask16>(0xffff) : tailMask(nr);
+            const __mmask16 mask1 = nr >= 32 ? static_cast<__mmask16>(0xffff)
+                                             : (nr > 16 ? tailMask(nr - 16) : static_cast<__mmask16>(0));
+
+            __m512 bias0 = _mm512_setzero_ps();
+            __m512 bias1 = _mm512_setzero_ps();
+            if (epilogue && epilogue->bias)
+            {
+                bias0 = _mm512_maskz_loadu_ps(mask0, epilogue->bias);
+                bias1 = _mm512_maskz_loadu_ps(mask1, epilogue->bias + 16);
+            }
+
+            for (size_t i = 0; i < mr; ++i)
+            {
+                float* c_row = c + i * ldc;
+                if (accumulate)
+                {
+                    acc[i][0] = _mm512_add_ps(acc[i][0], _mm512_maskz_loadu_ps(mask0, c_row));
+                    acc[i][1] = _mm512_add_ps(acc[i][1], _mm512_maskz_loadu_ps(mask1, c_row + 16));
+                }
+                if (epilogue)
+                {
+                    acc[i][0] = epilogue16(acc[i][0], bias0, epilogue->activation);
+                    acc[i][1] = epilogue16(acc[i][1], bias1, epilogue->activation);
+                }
+                _mm512_mask_storeu_ps(c_row, mask0, acc[i][0]);
+                _mm512_mask_storeu_ps(c_row + 16, mask1, acc[i][1]);
+            }
+        }
+
+        // 64 bytes of k per step with vpdpbusd (u8 x s8 -> int32, four products per lane)
+        // the activations are made unsigned by flipping their sign bit (+128), the driver takes
+        // 128 * b_sums back off
+        __attribute__((target("avx512f,avx512bw,avx512vnni")))
+        void dotTileS8Vnni(const int8_t* const* a_rows, const int8_t* const* b_rows, size_t k,
+                           int32_t sums[S8_MR][Int8Gemm::NR])
+        {
+            __m512i acc[S8_MR][Int8Gemm::NR];
+            for (size_t r = 0; r < S8_MR; ++r)
+            {
+                for (size_t q = 0; q < Int8Gemm::NR; ++q)
+                {
+                    acc[r][q] = _mm512_setzero_si512();
+                }
+            }
+
+            const __m512i sign_bit = _mm512_set1_epi8(static_cast<char>(0x80));
+            for (size_t p = 0; p < k; p += 64)
+            {
+                __m512i b8[Int8Gemm::NR];
+                for (size_t q = 0; q < Int8Gemm::NR; ++q)
+                {
+                    b8[q] = _mm512_loadu_si512(b_rows[q] + p);
+                }
+                for (size_t r = 0; r < S8_MR; ++r)
+                {
+                    const __m512i a8 = _mm512_xor_si512(_mm512_loadu_si512(a_rows[r] + p), sign_bit);
+                    for (size_t q = 0; q < Int8Gemm::NR; ++q)
+                    {
+                        acc[r][q] = _mm512_dpbusd_epi32(acc[r][q], a8, b8[q]);
+                    }
+                }
+            }
+
+            // reduce a row's four accumulators together: interleave and add pairs until every
+            // 128 bit lane holds [sum0 sum1 sum2 sum3] partials, then fold the lanes
+            for (size_t r = 0; r < S8_MR; ++r)
+            {
+                const __m512i s01 = _mm512_add_epi32(_mm512_unpacklo_epi32(acc[r][0], acc[r][1]),
+                                                     _mm512_unpackhi_epi32(acc[r][0], acc[r][1]));
+                const __m512i s23 = _mm512_add_epi32(_mm512_unpacklo_epi32(acc[r][2], acc[r][3]),
+                                                     _mm512_unpackhi_epi32(acc[r][2], acc[r][3]));
+                const __m512i s = _mm512_add_epi32(_mm512_unpacklo_epi64(s01, s23), _mm512_unpackhi_epi64(s01, s23));
+                const __m256i half = _mm256_add_epi32(_mm512_castsi512_si256(s), _mm512_extracti64x4_epi64(s, 1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(sums[r]),
+                                 _mm_add_epi32(_mm256_castsi256_si128(half), _mm256_extracti128_si256(half, 1)));
+            }
+        }
+
+        void gemmS8Vnni(size_t m, size_t n, size_t k,
+                        const int8_t* a, size_t lda, const int8_t* b, size_t ldb, const int32_t* b_sums,
+                        const float* a_scales, const float* b_scales,
+                        float* c, size_t ldc, const GemmEpilogue* epilogue)
+        {
+            Int8Gemm::run<S8_MR>(dotTileS8Vnni, 128, relu, sigmoid, m, n, k, a, lda, b, ldb, b_sums,
+                          a_scales, b_scales, c, ldc, epilogue);
+        }
+
+        // one int4 block (16 bytes, 32 weights) of each column per step, unpacked to two zmm of fp32
+        // weights that every row then reuses
+        template<size_t ROWS>
+        MININN_TARGET void dotTileQ4Rows(const float* const* a_rows, const uint8_t* const* b_rows,
+                                         const float* const* scale_rows, size_t k, size_t group_size,
+                                         float sums[Q4_MR][Int4Gemm::NR])
+        {
+            __m512 acc[ROWS][Int4Gemm::NR][2];
+            for (size_t r = 0; r < ROWS; ++r)
+            {
+                for (size_t q = 0; q < Int4Gemm::NR; ++q)
+                {
+                    acc[r][q][0] = _mm512_setzero_ps();
+                    acc[r][q][1] = _mm512_setzero_ps();
+                }
+            }
+
+            const __m128i low_mask = _mm_set1_epi8(0x0f);
+            const __m128i offset = _mm_set1_epi8(8);
+            for (size_t g = 0, group = 0; g < k; g += group_size, ++group)
+            {
+                __m512 scale[Int4Gemm::NR];
+                for (size_t q = 0; q < Int4Gemm::NR; ++q)
+                {
+                    scale[q] = _mm512_set1_ps(scale_rows[q][group]);
+                }
+
+                for (size_t p = g; p < g + group_size; p += Kernels::INT4_BLOCK)
+                {
+                    for (size_t q = 0; q < Int4Gemm::NR; ++q)
+                    {
+                        const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b_rows[q] + p / 2));
+                        const __m128i lo = _mm_sub_epi8(_mm_and_si128(packed, low_mask), offset);
+                        const __m128i hi = _mm_sub_epi8(_mm_and_si128(_mm_srli_epi16(packed, 4), low_mask), offset);
+                        const __m512 w0 = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(lo)), scale[q]);
+                        const __m512 w1 = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(hi)), scale[q]);
+
+                        for (size_t r = 0; r < ROWS; ++r)
+                        {
+                            const float* x = a_rows[r] + p;
+                            acc[r][q][0] = _mm512_fmadd_ps(_mm512_loadu_ps(x), w0, acc[r][q][0]);
+                            acc[r][q][1] = _mm512_fmadd_ps(_mm512_loadu_ps(x + 16), w1, acc[r][q][1]);
+                        }
+                    }
+                }
+            }
+
+            for (size_t r = 0; r < ROWS; ++r)
+            {
+                for (size_t q = 0; q < Int4Gemm::NR; ++q)
+                {
+                    sums[r][q] = _mm512_reduce_add_ps(_mm512_add_ps(acc[r][q][0], acc[r][q][1]));
+                }
+            }
+        }
+
+        void dotTileQ4(const float* const* a_rows, size_t rows, const uint8_t* const* b_rows,
+                       const float* const* scale_rows, size_t k, size_t group_size, float sums[Q4_MR][Int4Gemm::NR])
+        {
+            switch (rows)
+            {
+                case 1: dotTileQ4Rows<1>(a_rows, b_rows, scale_rows, k, group_size, sums); break;
+                case 2: dotTileQ4Rows<2>(a_rows, b_rows, scale_rows, k, group_size, sums); break;
+                case 3: dotTileQ4Rows<3>(a_rows, b_rows, scale_rows, k, group_size, sums); break;
+                default: dotTileQ4Rows<4>(a_rows, b_rows, scale_rows, k, group_size, sums); break;
+            }
+        }
+
+        void gemmQ4(size_t m, size_t n, size_t k,
+                    const float* a, size_t lda, const uint8_t* b, size_t ldb,
+                    const float* b_scales, size_t group_size,
+                    float* c, size_t ldc, const GemmEpilogue* epilogue)
+        {
+            Int4Gemm::run<Q4_MR>(dotTileQ4, relu, sigmoid, m, n, k, a, lda, b, ldb, b_scales, group_size,
+                                 c, ldc, epilogue);
+        }
+
+        // 16-bit masked loads and stores need avx512bw, so the conversion tails below stay scalar
+
+        MININN_TARGET void fp16ToFp32(const uint16_t* src, float* dst, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                const __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+                _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(h));
+            }
+            for (; i < n; ++i)
+            {
+                dst[i] = HalfFloat::fp16ToFp32(src[i]);
+            }
+        }
+
+        MININN_TARGET void fp32ToFp16(const float* src, uint16_t* dst, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                const __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), h);
+            }
+            for (; i < n; ++i)
+            {
+                dst[i] = HalfFloat::fp32ToFp16(src[i]);
+            }
+        }
+
+        MININN_TARGET void bf16ToFp32(const uint16_t* src, float* dst, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                const __m512i b = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+                _mm512_storeu_si512(dst + i, _mm512_slli_epi32(b, 16));
+            }
+            for (; i < n; ++i)
+            {
+                dst[i] = HalfFloat::bf16ToFp32(src[i]);
+            }
+        }
+
+        MININN_TARGET void fp32ToBf16(const float* src, uint16_t* dst, size_t n)
+        {
+            const __m512i one = _mm512_set1_epi32(1);
+            const __m512i half = _mm512_set1_epi32(0x7fff);
+            const __m512i abs_mask = _mm512_set1_epi32(0x7fffffff);
+            const __m512i inf = _mm512_set1_epi32(0x7f800000);
+            const __m512i quiet_bit = _mm512_set1_epi32(0x00400000);
+
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                // round to nearest even on the dropped half, nan lanes just get their quiet bit set
+                const __m512i bits = _mm512_castps_si512(_mm512_loadu_ps(src + i));
+                const __m512i lsb = _mm512_and_si512(_mm512_srli_epi32(bits, 16), one);
+                const __m512i rounded = _mm512_add_epi32(bits, _mm512_add_epi32(lsb, half));
+                const __mmask16 nan = _mm512_cmpgt_epi32_mask(_mm512_and_si512(bits, abs_mask), inf);
+                const __m512i result = _mm512_mask_or_epi32(rounded, nan, bits, quiet_bit);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                                    _mm512_cvtepi32_epi16(_mm512_srli_epi32(result, 16)));
+            }
+            for (; i < n; ++i)
+            {
+                dst[i] = HalfFloat::fp32ToBf16(src[i]);
+            }
+        }
+
+        KernelTable makeTable()
+        {
+            KernelTable table = {
+                CpuTier::AVX512, "avx512",
+                relu, sigmoid, softmax, axpy, axpyFp16, axpyBf16,
+                MR, NR, gemmMicro,
+                gemmS8Vnni,
+                gemmQ4,
+                fp16ToFp32, fp32ToFp16, bf16ToFp32, fp32ToBf16
+            };
+
+            // plain avx512f has no byte/word ops worth using, every avx512 cpu runs the avx2 kernel
+            if (!Kernels::hasAvx512Vnni())
+            {
+                table.gemm_s8 = avx2KernelTable()->gemm_s8;
+            }
+            return table;
+        }
+    } // namespace
+
+    const KernelTable* avx512KernelTable()
+    {
+        static const KernelTable table = makeTable();
+        return &table;
+    }
+
+} // namespace mininn
+
+#else
+
+namespace mininn
+{
+    const KernelTable* avx512KernelTable()
+    {
+        return nullptr;
+    }
+
+} // namespace mininn
+
+#endif
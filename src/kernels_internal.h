@@ -0,0 +1,263 @@
+#pragma once
+
+// shared between the kernel translation units only, not part of the public headers
+
+#include "kernels.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace mininn
+{
+    // defined in the per-tier translation units, nullptr when not built for x86
+    const KernelTable* sse42KernelTable();
+    const KernelTable* avx2KernelTable();
+    const KernelTable* avx512KernelTable();
+
+    // int8 gemm loops shared by every tier (see KernelTable::gemm_s8)
+    // each tier supplies a dot product kernel for one MR x NR tile of int32 sums over the full k
+    // (MR is the tier's choice, sized to its register file); a tier that adds 128 to the activations
+    // to use u8 x s8 instructions passes a_offset = 128 and the driver takes a_offset * b_sums[j] back off
+    namespace Int8Gemm
+    {
+        constexpr size_t NR = 4;
+
+        template<size_t MR>
+        using DotTile = void (*)(const int8_t* const* a_rows, const int8_t* const* b_rows, size_t k,
+                                 int32_t sums[MR][NR]);
+
+        template<size_t MR>
+        inline void run(DotTile<MR> dot, int32_t a_offset,
+                        void (*relu)(float*, size_t), void (*sigmoid)(float*, size_t),
+                        size_t m, size_t n, size_t k,
+                        const int8_t* a, size_t lda, const int8_t* b, size_t ldb, const int32_t* b_sums,
+                        const float* a_scales, const float* b_scales,
+                        float* c, size_t ldc, const GemmEpilogue* epilogue)
+        {
+            const float* bias = epilogue ? epilogue->bias : nullptr;
+            const Activation activation = epilogue ? epilogue->activation : Activation::NONE;
+
+            for (size_t i = 0; i < m; i += MR)
+            {
+                const size_t rows = std::min(MR, m - i);
+
+                // partial tiles repeat their last row/column and drop the extra sums
+                const int8_t* a_rows[MR];
+                for (size_t r = 0; r < MR; ++r)
+                {
+                    a_rows[r] = a + (i + std::min(r, rows - 1)) * lda;
+                }
+
+                for (size_t j = 0; j < n; j += NR)
+                {
+                    const size_t cols = std::min(NR, n - j);
+                    const int8_t* b_rows[NR];
+                    for (size_t q = 0; q < NR; ++q)
+                    {
+                        b_rows[q] = b + (j + std::min(q, cols - 1)) * ldb;
+                    }
+
+                    int32_t sums[MR][NR];
+                    dot(a_rows, b_rows, k, sums);
+
+                    // requantize: int32 sums back to float, plus the bias
+                    for (size_t r = 0; r < rows; ++r)
+                    {
+                        float* c_row = c + (i + r) * ldc + j;
+                        for (size_t q = 0; q < cols; ++q)
+                        {
+                            const int32_t sum = sums[r][q] - a_offset * b_sums[j + q];
+                            c_row[q] = static_cast<float>(sum) * (a_scales[i + r] * b_scales[j + q]) +
+                                       (bias ? bias[j + q] : 0.0f);
+                        }
+                    }
+                }
+
+                // the rows are still in cache, finish them off with the activation
+                for (size_t r = 0; r < rows; ++r)
+                {
+                    if (activation == Activation::RELU)
+                    {
+                        relu(c + (i + r) * ldc, n);
+                    }
+                    else if (activation == Activation::SIGMOID)
+                    {
+                        sigmoid(c + (i + r) * ldc, n);
+                    }
+                }
+            }
+        }
+    }
+
+    // int4 gemm loop shared by every tier (see KernelTable::gemm_q4)
+    // each tier supplies a kernel for up to MR activation rows against NR columns of weights over the full
+    // k (MR is the tier's choice, sized to its register file): every block of weights is unpacked to fp32
+    // once and reused for all the rows, and the NR columns give the fma chains independent work
+    // partial tiles pass the real row count (gemv must not pay for MR rows) and repeat their last column
+    namespace Int4Gemm
+    {
+        constexpr size_t NR = 2;
+
+        template<size_t MR>
+        using DotTile = void (*)(const float* const* a_rows, size_t rows, const uint8_t* const* b_rows,
+                                 const float* const* scale_rows, size_t k, size_t group_size, float sums[MR][NR]);
+
+        template<size_t MR>
+        inline void run(DotTile<MR> dot,
+                        void (*relu)(float*, size_t), void (*sigmoid)(float*, size_t),
+                        size_t m, size_t n, size_t k,
+                        const float* a, size_t lda, const uint8_t* b, size_t ldb,
+                        const float* b_scales, size_t group_size,
+                        float* c, size_t ldc, const GemmEpilogue* epilogue)
+        {
+            const float* bias = epilogue ? epilogue->bias : nullptr;
+            const Activation activation = epilogue ? epilogue->activation : Activation::NONE;
+            const size_t groups = k / group_size;
+
+            for (size_t i = 0; i < m; i += MR)
+            {
+                const size_t rows = std::min(MR, m - i);
+                const float* a_rows[MR];
+                for (size_t r = 0; r < rows; ++r)
+                {
+                    a_rows[r] = a + (i + r) * lda;
+                }
+
+                for (size_t j = 0; j < n; j += NR)
+                {
+                    const size_t cols = std::min(NR, n - j);
+                    const uint8_t* b_rows[NR];
+                    const float* scale_rows[NR];
+                    for (size_t q = 0; q < NR; ++q)
+                    {
+                        const size_t col = j + std::min(q, cols - 1);
+                        b_rows[q] = b + col * ldb;
+                        scale_rows[q] = b_scales + col * groups;
+                    }
+
+                    float sums[MR][NR];
+                    dot(a_rows, rows, b_rows, scale_rows, k, group_size, sums);
+                    for (size_t r = 0; r < rows; ++r)
+                    {
+                        float* c_row = c + (i + r) * ldc + j;
+                        for (size_t q = 0; q < cols; ++q)
+                        {
+                            c_row[q] = sums[r][q] + (bias ? bias[j + q] : 0.0f);
+                        }
+                    }
+                }
+
+                for (size_t r = 0; r < rows; ++r)
+                {
+                    if (activation == Activation::RELU)
+                    {
+                        relu(c + (i + r) * ldc, n);
+                    }
+                    else if (activation == Activation::SIGMOID)
+                    {
+                        sigmoid(c + (i + r) * ldc, n);
+                    }
+                }
+            }
+        }
+    }
+
+    // cephes style expf: exp(x) = 2^n * exp(r), r = x - n*ln2, exp(r) by a degree 5 polynomial
+    // the split ln2 keeps r accurate, results are within a couple of ulp of std::exp
+    namespace ExpConstants
+    {
+        constexpr float HI = 88.3762626647949f;
+        constexpr float LO = -87.3365447505531f;   // keeps 2^n a normal float
+        constexpr float LOG2E = 1.44269504088896341f;
+        constexpr float LN2_HI = 0.693359375f;
+        constexpr float LN2_LO = -2.12194440e-4f;
+        constexpr float P0 = 1.9875691500e-4f;
+        constexpr float P1 = 1.3981999507e-3f;
+        constexpr float P2 = 8.3334519073e-3f;
+        constexpr float P3 = 4.1665795894e-2f;
+        constexpr float P4 = 1.6666665459e-1f;
+        constexpr float P5 = 5.0000001201e-1f;
+    }
+
+    // one value 16-bit float conversions: the scalar tier and the tails of the simd ones
+    // (bit tricks after F. Giesen's half <-> float routines, results match f16c exactly)
+    namespace HalfFloat
+    {
+        inline uint32_t bitsOf(float f)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &f, sizeof(bits));
+            return bits;
+        }
+
+        inline float fromBits(uint32_t bits)
+        {
+            float f;
+            std::memcpy(&f, &bits, sizeof(f));
+            return f;
+        }
+
+        inline float fp16ToFp32(uint16_t h)
+        {
+            const uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+            const uint32_t exp_mant = h & 0x7fffu;
+            uint32_t bits = (exp_mant << 13) + ((127u - 15u) << 23);   // rebias the exponent
+
+            if (exp_mant >= 0x7c00u)
+            {
+                bits += (128u - 16u) << 23;                             // inf / nan keep an all ones exponent
+                if (exp_mant > 0x7c00u)
+                {
+                    bits |= 0x00400000u;                                // quiet the nan
+                }
+            }
+            else if (exp_mant < 0x0400u)
+            {
+                // subnormal (or zero): let the fpu renormalize it
+                bits = bitsOf(fromBits(bits + (1u << 23)) - fromBits(113u << 23));
+            }
+            return fromBits(bits | sign);
+        }
+
+        inline uint16_t fp32ToFp16(float f)
+        {
+            uint32_t bits = bitsOf(f);
+            const uint32_t sign = (bits >> 16) & 0x8000u;
+            bits &= 0x7fffffffu;
+
+            if (bits > 0x7f800000u)
+            {
+                return static_cast<uint16_t>(sign | 0x7e00u | ((bits >> 13) & 0x3ffu));
+            }
+            if (bits >= (127u + 16u) << 23)
+            {
+                return static_cast<uint16_t>(sign | 0x7c00u);           // too big (or inf)
+            }
+            if (bits < (127u - 14u) << 23)
+            {
+                // result is subnormal: adding 0.5 lines the mantissa up so the fpu does the rounding
+                const float magic = fromBits(((127u - 15u) + (23u - 10u) + 1u) << 23);
+                return static_cast<uint16_t>(sign | (bitsOf(fromBits(bits) + magic) - bitsOf(magic)));
+            }
+            // round to nearest even on the 13 dropped bits, a carry out bumps the exponent (up to inf)
+            bits += ((15u - 127u) << 23) + 0xfffu + ((bits >> 13) & 1u);
+            return static_cast<uint16_t>(sign | (bits >> 13));
+        }
+
+        inline float bf16ToFp32(uint16_t b)
+        {
+            return fromBits(static_cast<uint32_t>(b) << 16);
+        }
+
+        inline uint16_t fp32ToBf16(float f)
+        {
+            const uint32_t bits = bitsOf(f);
+            if ((bits & 0x7fffffffu) > 0x7f800000u)
+            {
+                return static_cast<uint16_t>((bits >> 16) | 0x0040u);
+            }
+            return static_cast<uint16_t>((bits + 0x7fffu + ((bits >> 16) & 1u)) >> 16);
+        }
+    }
+
+} // namespace mininn
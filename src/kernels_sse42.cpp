@@ -0,0 +1,484 @@
+/* kernels_sse42.cpp
+ *
+ * SSE4.2 kernels (4-wide). Every function carries a target attribute instead of
+ * the whole file being built with -msse4.2, so the rest of the binary keeps
+ * running on baseline x86-64 and these are only reached through the registry.
+ */
+
+#include "kernels_internal.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define MININN_TARGET __attribute__((target("sse4.2")))
+
+namespace mininn
+{
+    namespace
+    {
+        constexpr size_t MR = 4;
+        constexpr size_t NR = 8;
+        constexpr size_t S8_MR = 2;    // 8 accumulators + 4 weight rows + 1 activation row
+        constexpr size_t Q4_MR = 2;    // 8 accumulators + 4 weights + 1 activation row
+
+        MININN_TARGET inline __m128 exp4(__m128 x)
+        {
+            using namespace ExpConstants;
+            x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(LO)), _mm_set1_ps(HI));
+
+            __m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(LOG2E)), _mm_set1_ps(0.5f));
+            fx = _mm_floor_ps(fx);
+
+            x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(LN2_HI)));
+            x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(LN2_LO)));
+
+            __m128 y = _mm_set1_ps(P0);
+            y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(P1));
+            y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(P2));
+            y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(P3));
+            y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(P4));
+            y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(P5));
+            y = _mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)), _mm_add_ps(x, _mm_set1_ps(1.0f)));
+
+            // build 2^n directly in the exponent bits
+            __m128i n = _mm_add_epi32(_mm_cvttps_epi32(fx), _mm_set1_epi32(127));
+            return _mm_mul_ps(y, _mm_castsi128_ps(_mm_slli_epi32(n, 23)));
+        }
+
+        MININN_TARGET void relu(float* data, size_t n)
+        {
+            const __m128 zero = _mm_setzero_ps();
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                _mm_storeu_ps(data + i, _mm_max_ps(_mm_loadu_ps(data + i), zero));
+            }
+            for (; i < n; ++i)
+            {
+                data[i] = data[i] < 0.0f ? 0.0f : data[i];
+            }
+        }
+
+        MININN_TARGET inline __m128 sigmoid4(__m128 x)
+        {
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 neg_x = _mm_xor_ps(x, _mm_set1_ps(-0.0f));
+            return _mm_div_ps(one, _mm_add_ps(one, exp4(neg_x)));
+        }
+
+        MININN_TARGET void sigmoid(float* data, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                _mm_storeu_ps(data + i, sigmoid4(_mm_loadu_ps(data + i)));
+            }
+            for (; i < n; ++i)
+            {
+                data[i] = 1.0f / (1.0f + std::exp(-data[i]));
+            }
+        }
+
+        MININN_TARGET void softmax(float* data, size_t n)
+        {
+            size_t i = 0;
+
+            // max
+            __m128 max_vec = _mm_set1_ps(data[0]);
+            for (; i + 4 <= n; i += 4)
+            {
+                max_vec = _mm_max_ps(max_vec, _mm_loadu_ps(data + i));
+            }
+            alignas(16) float lanes[4];
+            _mm_store_ps(lanes, max_vec);
+            float max_val = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+            for (; i < n; ++i)
+            {
+                max_val = std::max(max_val, data[i]);
+            }
+
+            // exp(x - max) and sum
+            const __m128 max_bcast = _mm_set1_ps(max_val);
+            __m128 sum_vec = _mm_setzero_ps();
+            for (i = 0; i + 4 <= n; i += 4)
+            {
+                const __m128 e = exp4(_mm_sub_ps(_mm_loadu_ps(data + i), max_bcast));
+                _mm_storeu_ps(data + i, e);
+                sum_vec = _mm_add_ps(sum_vec, e);
+            }
+            _mm_store_ps(lanes, sum_vec);
+            float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+            for (; i < n; ++i)
+            {
+                data[i] = std::exp(data[i] - max_val);
+                sum += data[i];
+            }
+
+            // normalize
+            const float inverse_sum = 1.0f / sum;
+            const __m128 inverse_vec = _mm_set1_ps(inverse_sum);
+            for (i = 0; i + 4 <= n; i += 4)
+            {
+                _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), inverse_vec));
+            }
+            for (; i < n; ++i)
+            {
+                data[i] *= inverse_sum;
+            }
+        }
+
+        MININN_TARGET void axpy(size_t n, float alpha, const float* x, float* y)
+        {
+            const __m128 a = _mm_set1_ps(alpha);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(a, _mm_loadu_ps(x + i))));
+            }
+            for (; i < n; ++i)
+            {
+                y[i] += alpha * x[i];
+            }
+        }
+
+        // no f16c at this tier, fp16 is widened one value at a time
+        void axpyFp16(size_t n, float alpha, const uint16_t* x, float* y)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                y[i] += alpha * HalfFloat::fp16ToFp32(x[i]);
+            }
+        }
+
+        MININN_TARGET void axpyBf16(size_t n, float alpha, const uint16_t* x, float* y)
+        {
+            const __m128 a = _mm_set1_ps(alpha);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                const __m128i b = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(x + i)));
+                const __m128 xv = _mm_castsi128_ps(_mm_slli_epi32(b, 16));
+                _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(a, xv)));
+            }
+            for (; i < n; ++i)
+            {
+                y[i] += alpha * HalfFloat::bf16ToFp32(x[i]);
+            }
+        }
+
+        MININN_TARGET inline __m128 epilogue4(__m128 x, __m128 bias, Activation activation)
+        {
+            x = _mm_add_ps(x, bias);
+            if (activation == Activation::RELU)
+            {
+                return _mm_max_ps(x, _mm_setzero_ps());
+            }
+            if (activation == Activation::SIGMOID)
+            {
+                return sigmoid4(x);
+            }
+            return x;
+        }
+
+        MININN_TARGET void gemmMicro(size_t kc, const float* a, const float* b,
+                                     float* c, size_t ldc, size_t mr, size_t nr, bool accumulate,
+                                     const GemmEpilogue* epilogue)
+        {
+            __m128 acc[MR][2];
+            for (size_t i = 0; i < MR; ++i)
+            {
+                acc[i][0] = _mm_setzero_ps();
+                acc[i][1] = _mm_setzero_ps();
+            }
+
+            for (size_t p = 0; p < kc; ++p)
+            {
+                const __m128 b0 = _mm_loadu_ps(b + p * NR);
+                const __m128 b1 = _mm_loadu_ps(b + p * NR + 4);
+                for (size_t i = 0; i < MR; ++i)
+                {
+                    const __m128 a_val = _mm_set1_ps(a[p * MR + i]);
+                    acc[i][0] = _mm_add_ps(acc[i][0], _mm_mul_ps(a_val, b0));
+                    acc[i][1] = _mm_add_ps(acc[i][1], _mm_mul_ps(a_val, b1));
+                }
+            }
+
+            // edge tiles go through a zero padded copy so every row is two full vectors
+            const bool full = mr == MR && nr == NR;
+            alignas(16) float tile[MR * NR];
+            alignas(16) float bias_tile[NR];
+            float* out = full ? c : tile;
+            const size_t ld_out = full ? ldc : NR;
+            if (!full)
+            {
+                std::fill(tile, tile + MR * NR, 0.0f);
+                if (accumulate)
+                {
+                    for (size_t i = 0; i < mr; ++i)
+                    {
+                        std::copy(c + i * ldc, c + i * ldc + nr, tile + i * NR);
+                    }
+                }
+            }
+
+            __m128 bias0 = _mm_setzero_ps();
+            __m128 bias1 = _mm_setzero_ps();
+            if (epilogue && epilogue->bias)
+            {
+                const float* bias = epilogue->bias;
+                if (!full)
+                {
+                    std::fill(bias_tile, bias_tile + NR, 0.0f);
+                    std::copy(bias, bias + nr, bias_tile);
+                    bias = bias_tile;
+                }
+                bias0 = _mm_loadu_ps(bias);
+                bias1 = _mm_loadu_ps(bias + 4);
+            }
+
+            for (size_t i = 0; i < mr; ++i)
+            {
+                float* out_row = out + i * ld_out;
+                if (accumulate)
+                {
+                    acc[i][0] = _mm_add_ps(acc[i][0], _mm_loadu_ps(out_row));
+                    acc[i][1] = _mm_add_ps(acc[i][1], _mm_loadu_ps(out_row + 4));
+                }
+                if (epilogue)
+                {
+                    acc[i][0] = epilogue4(acc[i][0], bias0, epilogue->activation);
+                    acc[i][1] = epilogue4(acc[i][1], bias1, epilogue->activation);
+                }
+                _mm_storeu_ps(out_row, acc[i][0]);
+                _mm_storeu_ps(out_row + 4, acc[i][1]);
+            }
+
+            if (!full)
+            {
+                for (size_t i = 0; i < mr; ++i)
+                {
+                    std::copy(tile + i * NR, tile + i * NR + nr, c + i * ldc);
+                }
+            }
+        }
+
+        // 8 bytes of k per step: widen to int16, pmaddwd multiplies and adds neighbouring pairs into int32
+        MININN_TARGET void dotTileS8(const int8_t* const* a_rows, const int8_t* const* b_rows, size_t k,
+                                     int32_t sums[S8_MR][Int8Gemm::NR])
+        {
+            __m128i acc[S8_MR][Int8Gemm::NR];
+            for (size_t r = 0; r < S8_MR; ++r)
+            {
+                for (size_t q = 0; q < Int8Gemm::NR; ++q)
+                {
+                    acc[r][q] = _mm_setzero_si128();
+                }
+            }
+
+            for (size_t p = 0; p < k; p += 8)
+            {
+                __m128i b16[Int8Gemm::NR];
+                for (size_t q = 0; q < Int8Gemm::NR; ++q)
+                {
+                    b16[q] = _mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b_rows[q] + p)));
+                }
+                for (size_t r = 0; r < S8_MR; ++r)
+                {
+                    const __m128i a16 = _mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a_rows[r] + p)));
+                    for (size_t q = 0; q < Int8Gemm::NR; ++q)
+                    {
+                        acc[r][q] = _mm_add_epi32(acc[r][q], _mm_madd_epi16(a16, b16[q]));
+                    }
+                }
+            }
+
+            for (size_t r = 0; r < S8_MR; ++r)
+            {
+                const __m128i sum = _mm_hadd_epi32(_mm_hadd_epi32(acc[r][0], acc[r][1]),
+                                                   _mm_hadd_epi32(acc[r][2], acc[r][3]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(sums[r]), sum);
+            }
+        }
+
+        void gemmS8(size_t m, size_t n, size_t k,
+                    const int8_t* a, size_t lda, const int8_t* b, size_t ldb, const int32_t* b_sums,
+                    const float* a_scales, const float* b_scales,
+                    float* c, size_t ldc, const GemmEpilogue* epilogue)
+        {
+            Int8Gemm::run<S8_MR>(dotTileS8, 0, relu, sigmoid, m, n, k, a, lda, b, ldb, b_sums,
+                          a_scales, b_scales, c, ldc, epilogue);
+        }
+
+        // one int4 block (16 bytes, 32 weights) of each column per step, unpacked half by half to four
+        // xmm of fp32 weights that every row then reuses
+        template<size_t ROWS>
+        MININN_TARGET void dotTileQ4Rows(const float* const* a_rows, const uint8_t* const* b_rows,
+                                         const float* const* scale_rows, size_t k, size_t group_size,
+                                         float sums[Q4_MR][Int4Gemm::NR])
+        {
+            __m128 acc[ROWS][Int4Gemm::NR][2];
+            for (size_t r = 0; r < ROWS; ++r)
+            {
+                for (size_t q = 0; q < Int4Gemm::NR; ++q)
+                {
+                    acc[r][q][0] = _mm_setzero_ps();
+                    acc[r][q][1] = _mm_setzero_ps();
+                }
+            }
+
+            const __m128i low_mask = _mm_set1_epi8(0x0f);
+            const __m128i offset = _mm_set1_epi8(8);
+            for (size_t g = 0, group = 0; g < k; g += group_size, ++group)
+            {
+                for (size_t q = 0; q < Int4Gemm::NR; ++q)
+                {
+                    const __m128 scale = _mm_set1_ps(scale_rows[q][group]);
+                    for (size_t p = g; p < g + group_size; p += Kernels::INT4_BLOCK)
+                    {
+                        const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b_rows[q] + p / 2));
+                        const __m128i halves[2] = {
+                            _mm_sub_epi8(_mm_and_si128(packed, low_mask), offset),
+                            _mm_sub_epi8(_mm_and_si128(_mm_srli_epi16(packed, 4), low_mask), offset)
+                        };
+
+                        for (size_t h = 0; h < 2; ++h)
+                        {
+                            __m128 w[4];
+                            w[0] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi8_epi32(halves[h])), scale);
+                            w[1] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi8_epi32(_mm_srli_si128(halves[h], 4))), scale);
+                            w[2] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi8_epi32(_mm_srli_si128(halves[h], 8))), scale);
+                            w[3] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi8_epi32(_mm_srli_si128(halves[h], 12))), scale);
+
+                            for (size_t r = 0; r < ROWS; ++r)
+                            {
+                                const float* x = a_rows[r] + p + h * 16;
+                                acc[r][q][0] = _mm_add_ps(acc[r][q][0], _mm_mul_ps(_mm_loadu_ps(x), w[0]));
+                                acc[r][q][1] = _mm_add_ps(acc[r][q][1], _mm_mul_ps(_mm_loadu_ps(x + 4), w[1]));
+                                acc[r][q][0] = _mm_add_ps(acc[r][q][0], _mm_mul_ps(_mm_loadu_ps(x + 8), w[2]));
+                                acc[r][q][1] = _mm_add_ps(acc[r][q][1], _mm_mul_ps(_mm_loadu_ps(x + 12), w[3]));
+                            }
+                        }
+                    }
+                }
+            }
+
+            alignas(16) float lanes[4];
+            for (size_t r = 0; r < ROWS; ++r)
+            {
+                for (size_t q = 0; q < Int4Gemm::NR; ++q)
+                {
+                    _mm_store_ps(lanes, _mm_add_ps(acc[r][q][0], acc[r][q][1]));
+                    sums[r][q] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+                }
+            }
+        }
+
+        void dotTileQ4(const float* const* a_rows, size_t rows, const uint8_t* const* b_rows,
+                       const float* const* scale_rows, size_t k, size_t group_size, float sums[Q4_MR][Int4Gemm::NR])
+        {
+            switch (rows)
+            {
+                case 1: dotTileQ4Rows<1>(a_rows, b_rows, scale_rows, k, group_size, sums); break;
+                default: dotTileQ4Rows<2>(a_rows, b_rows, scale_rows, k, group_size, sums); break;
+            }
+        }
+
+        void gemmQ4(size_t m, size_t n, size_t k,
+                    const float* a, size_t lda, const uint8_t* b, size_t ldb,
+                    const float* b_scales, size_t group_size,
+                    float* c, size_t ldc, const GemmEpilogue* epilogue)
+        {
+            Int4Gemm::run<Q4_MR>(dotTileQ4, relu, sigmoid, m, n, k, a, lda, b, ldb, b_scales, group_size,
+                                 c, ldc, epilogue);
+        }
+
+        // no f16c at this tier, fp16 goes through the scalar bit tricks
+
+        void fp16ToFp32(const uint16_t* src, float* dst, size_t n)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                dst[i] = HalfFloat::fp16ToFp32(src[i]);
+            }
+        }
+
+        void fp32ToFp16(const float* src, uint16_t* dst, size_t n)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                dst[i] = HalfFloat::fp32ToFp16(src[i]);
+            }
+        }
+
+        MININN_TARGET void bf16ToFp32(const uint16_t* src, float* dst, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                const __m128i b = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_slli_epi32(b, 16));
+            }
+            for (; i < n; ++i)
+            {
+                dst[i] = HalfFloat::bf16ToFp32(src[i]);
+            }
+        }
+
+        // fp32 bits -> bf16 in the low half of each lane, rounded to nearest even (nan stays nan)
+        MININN_TARGET inline __m128i roundToBf16(__m128 x)
+        {
+            const __m128i bits = _mm_castps_si128(x);
+            const __m128i lsb = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(1));
+            const __m128i rounded = _mm_add_epi32(bits, _mm_add_epi32(lsb, _mm_set1_epi32(0x7fff)));
+            const __m128i abs = _mm_and_si128(bits, _mm_set1_epi32(0x7fffffff));
+            const __m128i nan = _mm_cmpgt_epi32(abs, _mm_set1_epi32(0x7f800000));
+            const __m128i quiet = _mm_or_si128(bits, _mm_set1_epi32(0x00400000));
+            return _mm_srli_epi32(_mm_blendv_epi8(rounded, quiet, nan), 16);
+        }
+
+        MININN_TARGET void fp32ToBf16(const float* src, uint16_t* dst, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                const __m128i lo = roundToBf16(_mm_loadu_ps(src + i));
+                const __m128i hi = roundToBf16(_mm_loadu_ps(src + i + 4));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi32(lo, hi));
+            }
+            for (; i < n; ++i)
+            {
+                dst[i] = HalfFloat::fp32ToBf16(src[i]);
+            }
+        }
+
+        const KernelTable table = {
+            CpuTier::SSE42, "sse4.2",
+            relu, sigmoid, softmax, axpy, axpyFp16, axpyBf16,
+            MR, NR, gemmMicro,
+            gemmS8,
+            gemmQ4,
+            fp16ToFp32, fp32ToFp16, bf16ToFp32, fp32ToBf16
+        };
+    } // namespace
+
+    const KernelTable* sse42KernelTable()
+    {
+        return &table;
+    }
+
+} // namespace mininn
+
+#else
+
+namespace mininn
+{
+    const KernelTable* sse42KernelTable()
+    {
+        return nullptr;
+    }
+
+} // namespace mininn
+
+#endif
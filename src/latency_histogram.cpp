@@ -0,0 +1,184 @@
+/* latency_histogram.cpp
+ *
+ * Log-linear latency histogram. Bucket i < 2 * SUB_BUCKETS holds exactly the
+ * value i (in ns); above that the top SUB_BUCKET_BITS + 1 bits of a value
+ * pick its bucket, so bucket width doubles every SUB_BUCKETS buckets and the
+ * relative error stays constant.
+ */
+
+#include "latency_histogram.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+namespace mininn
+{
+    namespace
+    {
+        void atomicMin(std::atomic<uint64_t>& target, uint64_t value)
+        {
+            uint64_t current = target.load(std::memory_order_relaxed);
+            while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        void atomicMax(std::atomic<uint64_t>& target, uint64_t value)
+        {
+            uint64_t current = target.load(std::memory_order_relaxed);
+            while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        LatencyHistogram::Duration fromNanoseconds(double nanoseconds)
+        {
+            return LatencyHistogram::Duration(nanoseconds / 1e6);
+        }
+    }
+
+    LatencyHistogram::LatencyHistogram()
+    {
+        reset();
+    }
+
+    LatencyHistogram::LatencyHistogram(const LatencyHistogram& other)
+    {
+        reset();
+        merge(other);
+    }
+
+    LatencyHistogram& LatencyHistogram::operator=(const LatencyHistogram& other)
+    {
+        if (this != &other)
+        {
+            reset();
+            merge(other);
+        }
+        return *this;
+    }
+
+    size_t LatencyHistogram::bucketIndex(uint64_t nanoseconds)
+    {
+        if (nanoseconds < 2 * SUB_BUCKETS)
+        {
+            return static_cast<size_t>(nanoseconds);
+        }
+
+        const unsigned magnitude = 63 - static_cast<unsigned>(__builtin_clzll(nanoseconds));
+        const unsigned shift = magnitude - SUB_BUCKET_BITS;
+        return static_cast<size_t>(shift * SUB_BUCKETS + (nanoseconds >> shift));
+    }
+
+    uint64_t LatencyHistogram::bucketLowest(size_t index)
+    {
+        if (index < 2 * SUB_BUCKETS)
+        {
+            return index;
+        }
+
+        const uint64_t shift = index / SUB_BUCKETS - 1;
+        return (index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+    }
+
+    uint64_t LatencyHistogram::bucketWidth(size_t index)
+    {
+        return index < 2 * SUB_BUCKETS ? 1 : uint64_t(1) << (index / SUB_BUCKETS - 1);
+    }
+
+    void LatencyHistogram::record(std::chrono::nanoseconds latency)
+    {
+        const uint64_t value = static_cast<uint64_t>(std::max<std::chrono::nanoseconds::rep>(latency.count(), 0));
+
+        buckets_[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+        atomicMin(min_, value);
+        atomicMax(max_, value);
+    }
+
+    void LatencyHistogram::merge(const LatencyHistogram& other)
+    {
+        for (size_t i = 0; i < NUM_BUCKETS; ++i)
+        {
+            const uint64_t n = other.buckets_[i].load(std::memory_order_relaxed);
+            if (n != 0)
+            {
+                buckets_[i].fetch_add(n, std::memory_order_relaxed);
+            }
+        }
+        count_.fetch_add(other.count_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        sum_.fetch_add(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        atomicMin(min_, other.min_.load(std::memory_order_relaxed));
+        atomicMax(max_, other.max_.load(std::memory_order_relaxed));
+    }
+
+    void LatencyHistogram::reset()
+    {
+        for (auto& bucket : buckets_)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        count_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        min_.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    LatencyHistogram::Duration LatencyHistogram::mean() const
+    {
+        const uint64_t n = count();
+        return n == 0 ? Duration(0) : fromNanoseconds(static_cast<double>(sum_.load(std::memory_order_relaxed)) / n);
+    }
+
+    LatencyHistogram::Duration LatencyHistogram::min() const
+    {
+        return count() == 0 ? Duration(0) : fromNanoseconds(static_cast<double>(min_.load(std::memory_order_relaxed)));
+    }
+
+    LatencyHistogram::Duration LatencyHistogram::max() const
+    {
+        return fromNanoseconds(static_cast<double>(max_.load(std::memory_order_relaxed)));
+    }
+
+    LatencyHistogram::Duration LatencyHistogram::percentile(double p) const
+    {
+        const uint64_t n = count();
+        if (n == 0)
+        {
+            return Duration(0);
+        }
+
+        // rank of the sample we're after, 1 based
+        const double clamped = std::min(std::max(p, 0.0), 100.0);
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped / 100.0 * n)));
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < NUM_BUCKETS; ++i)
+        {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+            {
+                // middle of the bucket, but never outside what was actually recorded
+                const uint64_t value = bucketLowest(i) + (bucketWidth(i) - 1) / 2;
+                const uint64_t lo = min_.load(std::memory_order_relaxed);
+                const uint64_t hi = max_.load(std::memory_order_relaxed);
+                return fromNanoseconds(static_cast<double>(std::min(std::max(value, lo), hi)));
+            }
+        }
+
+        // buckets still catching up with count_ (concurrent record)
+        return max();
+    }
+
+    std::string LatencyHistogram::summary() const
+    {
+        std::ostringstream out;
+        out << "n=" << count() << " mean=" << mean().count() << " p50=" << percentile(50).count()
+            << " p90=" << percentile(90).count() << " p99=" << percentile(99).count()
+            << " p999=" << percentile(99.9).count() << " max=" << max().count() << " ms";
+        return out.str();
+    }
+
+} // namespace mininn
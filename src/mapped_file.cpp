@@ -0,0 +1,82 @@
+/* mapped_file.cpp
+ *
+ * POSIX mmap wrapper used for zero-copy model loading.
+ */
+
+#include "mapped_file.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MININN_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mininn
+{
+    MappedFile::MappedFile(const std::string& filepath)
+    {
+#ifdef MININN_HAVE_MMAP
+        const int fd = ::open(filepath.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to open model file: " + filepath + " (" + std::strerror(errno) + ")");
+        }
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0)
+        {
+            const int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Failed to stat model file: " + filepath + " (" + std::strerror(error) + ")");
+        }
+        if (info.st_size <= 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Model file is empty: " + filepath);
+        }
+
+        // private + read-only: the mapping can never write back to the file, and until something
+        // writes to it (nothing should) its pages stay shared with the page cache
+        const size_t size = static_cast<size_t>(info.st_size);
+        void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        const int error = errno;
+
+        // the mapping keeps its own reference to the file
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            throw std::runtime_error("Failed to map model file: " + filepath + " (" + std::strerror(error) + ")");
+        }
+
+        data_ = static_cast<const uint8_t*>(mapping);
+        size_ = size;
+#else
+        throw std::runtime_error("Memory-mapped loading is not supported on this platform: " + filepath);
+#endif
+    }
+
+    MappedFile::~MappedFile()
+    {
+#ifdef MININN_HAVE_MMAP
+        if (data_)
+        {
+            ::munmap(const_cast<uint8_t*>(data_), size_);
+        }
+#endif
+    }
+
+    bool MappedFile::supported()
+    {
+#ifdef MININN_HAVE_MMAP
+        return true;
+#else
+        return false;
+#endif
+    }
+
+} // namespace mininn
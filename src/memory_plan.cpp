@@ -0,0 +1,132 @@
+/* memory_plan.cpp
+ *
+ * Shape inference and buffer planning for the inference engine. A buffer is
+ * live from the layer that writes it, through any layers that update it in
+ * place, to the layer that reads it. Slots are handed out greedily to buffers
+ * whose lifetimes don't overlap, so the whole forward pass runs out of a
+ * single arena allocated once.
+ */
+
+#include "memory_plan.h"
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+namespace mininn
+{
+    namespace
+    {
+        // slots start on Tensor::ALIGNMENT boundaries (the arena's own) so every intermediate is as aligned
+        // as an owned tensor and no two share a cache line
+        constexpr size_t SLOT_ALIGNMENT = Tensor::ALIGNMENT / sizeof(float);
+
+        size_t elementCount(const std::vector<size_t>& shape)
+        {
+            size_t count = 1;
+            for (size_t dim : shape)
+            {
+                count *= dim;
+            }
+            return count;
+        }
+    }
+
+    MemoryPlan::MemoryPlan(const std::vector<std::unique_ptr<Layer>>& layers, const std::vector<size_t>& input_shape)
+        : input_shape_(input_shape)
+    {
+        if (layers.empty())
+        {
+            throw std::invalid_argument("Cannot plan memory for an empty layer stack");
+        }
+
+        // shape inference
+        shapes_.reserve(layers.size());
+        const std::vector<size_t>* current = &input_shape_;
+        for (size_t i = 0; i < layers.size(); ++i)
+        {
+            try
+            {
+                shapes_.push_back(layers[i]->outputShape(*current));
+            }
+            catch (const std::exception& e)
+            {
+                throw std::invalid_argument("Shape inference failed at layer " + std::to_string(i) + ": " + e.what());
+            }
+            current = &shapes_.back();
+        }
+
+        // the first layer reads the caller's input, which is const, so it never runs in place
+        const size_t num_layers = layers.size();
+        in_place_.resize(num_layers);
+        for (size_t i = 1; i < num_layers; ++i)
+        {
+            in_place_[i] = layers[i]->supportsInPlace();
+        }
+
+        // the last buffer is the caller's output, so it's never planned
+        output_start_ = num_layers - 1;
+        while (output_start_ > 0 && in_place_[output_start_])
+        {
+            --output_start_;
+        }
+
+        // a buffer written at step first and updated in place up to step last is read at
+        // last + 1, so a slot whose tenant was last read before first is free again
+        std::vector<size_t> slot_of(output_start_);
+        std::vector<size_t> slot_last_use;
+        for (size_t first = 0; first < output_start_;)
+        {
+            size_t last = first;
+            while (last + 1 < output_start_ && in_place_[last + 1])
+            {
+                ++last;
+            }
+
+            size_t slot = 0;
+            while (slot < slot_last_use.size() && slot_last_use[slot] >= first)
+            {
+                ++slot;
+            }
+            if (slot == slot_last_use.size())
+            {
+                slot_last_use.push_back(0);
+                slot_sizes_.push_back(0);
+            }
+
+            slot_last_use[slot] = last + 1;
+            for (size_t i = first; i <= last; ++i)
+            {
+                slot_of[i] = slot;
+                slot_sizes_[slot] = std::max(slot_sizes_[slot], elementCount(shapes_[i]));
+            }
+            first = last + 1;
+        }
+
+        std::vector<size_t> slot_offsets(slot_sizes_.size());
+        for (size_t slot = 0; slot < slot_sizes_.size(); ++slot)
+        {
+            slot_offsets[slot] = arena_size_;
+            arena_size_ += (slot_sizes_[slot] + SLOT_ALIGNMENT - 1) / SLOT_ALIGNMENT * SLOT_ALIGNMENT;
+        }
+
+        if (arena_size_ > 0)
+        {
+            const size_t bytes = arena_size_ * sizeof(float);
+            arena_.reset(static_cast<float*>(::operator new[](bytes, std::align_val_t(Tensor::ALIGNMENT))));
+            std::fill(arena_.get(), arena_.get() + arena_size_, 0.0f);
+        }
+
+        intermediates_.reserve(output_start_);
+        for (size_t i = 0; i < output_start_; ++i)
+        {
+            intermediates_.push_back(Tensor::view(arena_.get() + slot_offsets[slot_of[i]], shapes_[i]));
+        }
+    }
+
+    void MemoryPlan::ArenaDelete::operator()(float* arena) const
+    {
+        ::operator delete[](arena, std::align_val_t(Tensor::ALIGNMENT));
+    }
+
+} // namespace mininn
@@ -1,123 +1,785 @@
 /* model_loader.cpp
  * 
  * Implementation of the ModelLoader class for loading neural network models
- * from binary files.
+ * from binary files. The whole file is either read into memory once or
+ * memory-mapped, and then parsed from there; mapped weight tensors are views
+ * into the file itself. Files are written in the v2 format (tables up front,
+ * aligned payloads), v1 files are still read.
  */
 
 #include "model_loader.h"
+#include "mapped_file.h"
+#include "scratch_buffer.h"
+#include "quantization.h"
 #include "tensor_ops.h"
+#include "tracer.h"
+#include "gemm.h"
 #include <fstream>
 #include <stdexcept>
 #include <sstream>
 #include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+#include <deque>
 
 namespace mininn
 {
-    LinearLayer::LinearLayer(const Tensor& weights, const Tensor& bias)
-        : Layer(LayerType::LINEAR), weights_(weights), bias_(bias)
+    static_assert(sizeof(ModelFormat::Header) == 16, "v1/v2 header must be 16 bytes");
+    static_assert(sizeof(ModelFormat::ModelInfo) == 80, "v2 model info must be 80 bytes");
+    static_assert(sizeof(ModelFormat::LayerEntry) == 12, "v2 layer entry must be 12 bytes");
+    static_assert(sizeof(ModelFormat::TensorEntry) == 56, "v2 tensor entry must be 56 bytes");
+
+    namespace
+    {
+        // the stored dtype byte as a DataType, throws for values past the last known type
+        DataType checkedDataType(uint8_t raw)
+        {
+            if (raw > static_cast<uint8_t>(DataType::BFLOAT16))
+            {
+                throw std::runtime_error("Unknown tensor data type: " + std::to_string(raw));
+            }
+            return static_cast<DataType>(raw);
+        }
+
+        // payload size of a tensor, refusing shapes whose element count couldn't fit in limit bytes
+        size_t tensorBytes(DataType dtype, const std::vector<size_t>& shape, size_t limit)
+        {
+            size_t count = 1;
+            for (size_t dim : shape)
+            {
+                if (dim != 0 && count > limit / dim * 2)    // int4 packs two elements per byte
+                {
+                    throw std::runtime_error("Tensor data exceeds file size");
+                }
+                count *= dim;
+            }
+            return Tensor::byteSize(dtype, count);
+        }
+
+        // the layers below compute in fp32, so their float parameters must actually be FLOAT32
+        void requireFloat32(const Tensor& tensor, const char* what)
+        {
+            if (tensor.dtype() != DataType::FLOAT32)
+            {
+                throw std::invalid_argument(std::string(what) + " must be a FLOAT32 tensor, got " +
+                                            dataTypeName(tensor.dtype()));
+            }
+        }
+
+        size_t alignedOffset(size_t offset)
+        {
+            const size_t alignment = ModelFormat::TENSOR_ALIGNMENT;
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+        // shared by the linear layers: validates input against [in_features] or [batch_size, in_features],
+        // makes sure output has the matching shape (reusing it when it does) and returns the batch size
+        size_t prepareLinearOutput(const Tensor& input, Tensor& output, size_t in_features, size_t out_features)
+        {
+            if (input.rank() != 1 && input.rank() != 2)
+            {
+                throw std::invalid_argument("Linear layer input must be 1D or 2D tensor");
+            }
+            if (input.shape().back() != in_features)
+            {
+                throw std::invalid_argument(
+                    "Input features must match weight input dimension: " +
+                    std::to_string(input.shape().back()) + " != " + std::to_string(in_features)
+                );
+            }
+            
+            const size_t batch_size = input.rank() == 1 ? 1 : input.shape()[0];
+            const bool output_fits = input.rank() == 1
+                ? output.rank() == 1 && output.shape()[0] == out_features
+                : output.rank() == 2 && output.shape()[0] == batch_size && output.shape()[1] == out_features;
+            if (!output_fits)
+            {
+                output = input.rank() == 1 ? Tensor({out_features}) : Tensor({batch_size, out_features});
+            }
+            return batch_size;
+        }
+
+        std::vector<size_t> linearOutputShape(const std::vector<size_t>& input_shape, size_t in_features,
+                                              size_t out_features)
+        {
+            // same conventions as forward: [input_features] or [batch_size, input_features]
+            if (input_shape.empty() || input_shape.size() > 2)
+            {
+                throw std::invalid_argument("Linear layer input must be 1D or 2D tensor");
+            }
+            
+            if (input_shape.back() != in_features)
+            {
+                throw std::invalid_argument(
+                    "Input features must match weight input dimension: " +
+                    std::to_string(input_shape.back()) + " != " + std::to_string(in_features)
+                );
+            }
+            
+            std::vector<size_t> output_shape = input_shape;
+            output_shape.back() = out_features;
+            return output_shape;
+        }
+
+        // a multiply-add per weight and row, plus the bias
+        uint64_t linearFlops(const std::vector<size_t>& input_shape, size_t in_features, size_t out_features)
+        {
+            const uint64_t rows = input_shape.size() == 2 ? input_shape[0] : 1;
+            return rows * out_features * (2 * static_cast<uint64_t>(in_features) + 1);
+        }
+
+        uint64_t elementCount(const std::vector<size_t>& shape)
+        {
+            uint64_t count = 1;
+            for (size_t dim : shape)
+            {
+                count *= dim;
+            }
+            return count;
+        }
+
+        // one tensor payload written by saveToFile
+        struct Payload
+        {
+            DataType dtype;
+            std::vector<size_t> shape;
+            const void* data;
+            size_t bytes;
+        };
+
+        Payload tensorPayload(const Tensor& tensor)
+        {
+            return {tensor.dtype(), tensor.shape(), tensor.raw(), tensor.byteSize()};
+        }
+
+        // activation a linear layer's gemm epilogue applies for a fused next layer, false if it can't
+        // softmax needs whole rows, so it only gets the bias in the epilogue and runs in place right after
+        bool fusedActivation(LayerType next, Activation& activation)
+        {
+            switch (next)
+            {
+                case LayerType::RELU:
+                    activation = Activation::RELU;
+                    return true;
+                case LayerType::SIGMOID:
+                    activation = Activation::SIGMOID;
+                    return true;
+                case LayerType::SOFTMAX:
+                    activation = Activation::NONE;
+                    return true;
+                default:
+                    return false;
+            }
+        }
+    }
+
+    // bounds-checked cursor over a model file's bytes
+    class ModelReader
+    {
+    public:
+        // map_tensors: tensor data may be returned as views into data (which must outlive them)
+        ModelReader(const uint8_t* data, size_t size, bool map_tensors)
+            : data_(data), size_(size), map_tensors_(map_tensors) {}
+
+        // next bytes of the file, throws if fewer than that are left
+        const uint8_t* take(size_t bytes)
+        {
+            if (bytes > size_ - offset_)
+            {
+                throw std::runtime_error("Unexpected end of model file");
+            }
+            const uint8_t* current = data_ + offset_;
+            offset_ += bytes;
+            return current;
+        }
+
+        // bytes at an absolute position, without moving the cursor
+        const uint8_t* at(uint64_t offset, uint64_t bytes) const
+        {
+            if (offset > size_ || bytes > size_ - offset)
+            {
+                throw std::runtime_error("Tensor data lies outside the model file");
+            }
+            return data_ + offset;
+        }
+
+        template<typename T>
+        void read(T& value)
+        {
+            std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        }
+
+        // tensor over bytes: a view when mapping and the data is element aligned in the file
+        // (nothing ever writes to a mapped file's tensors, the mapping is read-only), a copy otherwise
+        Tensor makeTensor(const uint8_t* bytes, const std::vector<size_t>& shape, DataType dtype) const
+        {
+            const size_t alignment = dtype == DataType::FLOAT32 ? alignof(float)
+                                   : dtype == DataType::FLOAT16 || dtype == DataType::BFLOAT16 ? alignof(uint16_t)
+                                   : 1;
+            if (map_tensors_ && reinterpret_cast<uintptr_t>(bytes) % alignment == 0)
+            {
+                return Tensor::view(const_cast<uint8_t*>(bytes), shape, dtype);
+            }
+            
+            Tensor tensor(shape, dtype);
+            std::memcpy(tensor.raw(), bytes, tensor.byteSize());
+            return tensor;
+        }
+
+        size_t remaining() const { return size_ - offset_; }
+        bool mapsTensors() const { return map_tensors_; }
+
+    private:
+        const uint8_t* data_;
+        size_t size_;
+        size_t offset_ = 0;
+        bool map_tensors_;
+    };
+
+    LinearLayer::LinearLayer(Tensor weights, Tensor bias)
+        : Layer(LayerType::LINEAR), weights_(std::move(weights)), bias_(std::move(bias))
     {
         // validate dimensions
-        if (weights.rank() != 2)
+        if (weights_.dtype() != DataType::FLOAT32 && weights_.dtype() != DataType::FLOAT16 &&
+            weights_.dtype() != DataType::BFLOAT16)
+        {
+            throw std::invalid_argument(std::string("Linear layer weights must be FLOAT32, FLOAT16 or BFLOAT16, got ") +
+                                        dataTypeName(weights_.dtype()));
+        }
+        requireFloat32(bias_, "Linear layer bias");
+        if (weights_.rank() != 2)
         {
             throw std::invalid_argument("Linear layer weights must be 2D tensor");
         }
-        if (bias.rank() != 1)
+        if (bias_.rank() != 1)
         {
             throw std::invalid_argument("Linear layer bias must be 1D tensor");
         }
-        if (weights.shape()[1] != bias.shape()[0])
+        if (weights_.shape()[1] != bias_.shape()[0])
         {
             throw std::invalid_argument(
                 "Weight output dimension must match bias dimension: " +
-                std::to_string(weights.shape()[1]) + " != " + std::to_string(bias.shape()[0])
+                std::to_string(weights_.shape()[1]) + " != " + std::to_string(bias_.shape()[0])
             );
         }
     }
 
     void LinearLayer::forward(const Tensor& input, Tensor& output)
     {
-        // Linear transformation: output = input * weights + bias
+        forward(input, output, nullptr);
+    }
+
+    void LinearLayer::forward(const Tensor& input, Tensor& output, ThreadPool* pool)
+    {
+        forwardWithEpilogue(input, output, pool, Activation::NONE);
+    }
+
+    bool LinearLayer::canFuse(const Layer& next) const
+    {
+        Activation activation;
+        return fusedActivation(next.getType(), activation);
+    }
+
+    void LinearLayer::forwardFused(const Tensor& input, Tensor& output, Layer& next, ThreadPool* pool)
+    {
+        Activation activation;
+        if (!fusedActivation(next.getType(), activation))
+        {
+            Layer::forwardFused(input, output, next, pool);
+            return;
+        }
+        
+        forwardWithEpilogue(input, output, pool, activation);
+        if (next.getType() == LayerType::SOFTMAX)
+        {
+            // runs while the output is still in cache
+            next.forwardInPlace(output);
+        }
+    }
+
+    void LinearLayer::addParameterBytes(ParameterBytes& bytes) const
+    {
+        bytes.add(weights_);
+        bytes.add(bias_);
+    }
+
+    void LinearLayer::forwardWithEpilogue(const Tensor& input, Tensor& output, ThreadPool* pool,
+                                          Activation activation)
+    {
+        // Linear transformation: output = activation(input * weights + bias)
         // input: [batch_size, input_features] or [input_features]  
         // weights: [input_features, output_features]
         // bias: [output_features]
         // output: [batch_size, output_features] or [output_features]
+        const size_t in_features = weights_.shape()[0];
+        const size_t out_features = weights_.shape()[1];
+        
+        // a single sample is a [1, input_features] row, so both cases are one gemm straight
+        // from the input without copying it into a temporary 2d tensor first
+        const size_t batch_size = prepareLinearOutput(input, output, in_features, out_features);
+        
+        // bias (and the fused activation) are applied to each output tile inside the gemm
+        GemmEpilogue epilogue;
+        epilogue.bias = bias_.data();
+        epilogue.activation = activation;
+        switch (weights_.dtype())
+        {
+            case DataType::FLOAT16:
+                Gemm::sgemmHalf(batch_size, out_features, in_features, input.data(), in_features,
+                                static_cast<const uint16_t*>(weights_.raw()), Gemm::HalfFormat::FP16, out_features,
+                                output.data(), out_features, pool, epilogue);
+                break;
+            case DataType::BFLOAT16:
+                Gemm::sgemmHalf(batch_size, out_features, in_features, input.data(), in_features,
+                                static_cast<const uint16_t*>(weights_.raw()), Gemm::HalfFormat::BF16, out_features,
+                                output.data(), out_features, pool, epilogue);
+                break;
+            default:
+                Gemm::sgemm(batch_size, out_features, in_features, input.data(), in_features,
+                            weights_.data(), out_features, output.data(), out_features, pool, epilogue);
+                break;
+        }
+    }
+
+    std::vector<size_t> LinearLayer::outputShape(const std::vector<size_t>& input_shape) const
+    {
+        return linearOutputShape(input_shape, weights_.shape()[0], weights_.shape()[1]);
+    }
+
+    uint64_t LinearLayer::flops(const std::vector<size_t>& input_shape) const
+    {
+        return linearFlops(input_shape, weights_.shape()[0], weights_.shape()[1]);
+    }
+
+    QuantizedLinearLayer::QuantizedLinearLayer(size_t in_features, size_t out_features, const int8_t* weights,
+                                               Tensor weight_scales, Tensor bias, float input_scale)
+        : Layer(LayerType::LINEAR_INT8)
+        , in_features_(in_features)
+        , out_features_(out_features)
+        , padded_in_((in_features + Kernels::INT8_K_ALIGNMENT - 1) / Kernels::INT8_K_ALIGNMENT * Kernels::INT8_K_ALIGNMENT)
+        , weight_scales_(std::move(weight_scales))
+        , bias_(std::move(bias))
+        , input_scale_(input_scale)
+    {
+        if (in_features == 0 || out_features == 0 || !weights)
+        {
+            throw std::invalid_argument("Quantized linear layer needs non-empty weights");
+        }
+        requireFloat32(weight_scales_, "Quantized linear layer scales");
+        requireFloat32(bias_, "Quantized linear layer bias");
+        if (weight_scales_.shape() != std::vector<size_t>{out_features} || bias_.shape() != std::vector<size_t>{out_features})
+        {
+            throw std::invalid_argument("Quantized linear layer scales and bias must be [" +
+                                        std::to_string(out_features) + "] tensors");
+        }
+        if (!std::isfinite(input_scale) || input_scale < 0.0f)
+        {
+            throw std::invalid_argument("Quantized linear layer input scale must be finite and non-negative");
+        }
         
-        if (input.rank() == 1)
+        // pad every output channel's row with zeros up to the kernels' k alignment
+        weights_.assign(out_features * padded_in_, 0);
+        weight_sums_.assign(out_features, 0);
+        for (size_t j = 0; j < out_features; ++j)
         {
-            // single sample: input [input_features]
-            if (input.shape()[0] != weights_.shape()[0])
+            const int8_t* source = weights + j * in_features;
+            std::copy(source, source + in_features, weights_.data() + j * padded_in_);
+            for (size_t i = 0; i < in_features; ++i)
             {
-                throw std::invalid_argument(
-                    "Input features must match weight input dimension: " +
-                    std::to_string(input.shape()[0]) + " != " + std::to_string(weights_.shape()[0])
-                );
+                weight_sums_[j] += source[i];
             }
-            
-            // reshape input to [1, input_features] for matrix multiplication
-            Tensor input_2d({1, input.shape()[0]});
-            std::memcpy(input_2d.data(), input.data(), input.size() * sizeof(float));
-            
-            // output_temp: [1, output_features]
-            Tensor output_temp;
-            TensorOps::matmul(input_2d, weights_, output_temp);
-            
-            // create output tensor and add bias
-            output = Tensor({weights_.shape()[1]});
-            for (size_t i = 0; i < output.size(); ++i)
+        }
+    }
+
+    std::unique_ptr<QuantizedLinearLayer> QuantizedLinearLayer::quantize(const LinearLayer& layer, float input_scale)
+    {
+        const Tensor weights = layer.weights().to(DataType::FLOAT32);     // half precision layers too
+        const size_t in_features = weights.shape()[0];
+        const size_t out_features = weights.shape()[1];
+        
+        // transpose to one row per output channel, each with its own scale
+        std::vector<float> row(in_features);
+        std::vector<int8_t> quantized(in_features * out_features);
+        Tensor scales({out_features});
+        for (size_t j = 0; j < out_features; ++j)
+        {
+            for (size_t i = 0; i < in_features; ++i)
             {
-                output.data()[i] = output_temp.data()[i] + bias_.data()[i];
+                row[i] = weights.data()[i * out_features + j];
             }
+            scales.data()[j] = Quantization::int8Scale(Quantization::maxAbs(row.data(), in_features));
+            Quantization::quantizeInt8(row.data(), in_features, scales.data()[j], quantized.data() + j * in_features);
+        }
+        
+        return std::make_unique<QuantizedLinearLayer>(in_features, out_features, quantized.data(),
+                                                      std::move(scales), layer.bias(), input_scale);
+    }
+
+    void QuantizedLinearLayer::forward(const Tensor& input, Tensor& output)
+    {
+        forward(input, output, nullptr);
+    }
+
+    void QuantizedLinearLayer::forward(const Tensor& input, Tensor& output, ThreadPool* pool)
+    {
+        forwardWithEpilogue(input, output, pool, Activation::NONE);
+    }
+
+    std::vector<size_t> QuantizedLinearLayer::outputShape(const std::vector<size_t>& input_shape) const
+    {
+        return linearOutputShape(input_shape, in_features_, out_features_);
+    }
+
+    uint64_t QuantizedLinearLayer::flops(const std::vector<size_t>& input_shape) const
+    {
+        return linearFlops(input_shape, in_features_, out_features_);
+    }
+
+    bool QuantizedLinearLayer::canFuse(const Layer& next) const
+    {
+        Activation activation;
+        return fusedActivation(next.getType(), activation);
+    }
+
+    void QuantizedLinearLayer::forwardFused(const Tensor& input, Tensor& output, Layer& next, ThreadPool* pool)
+    {
+        Activation activation;
+        if (!fusedActivation(next.getType(), activation))
+        {
+            Layer::forwardFused(input, output, next, pool);
+            return;
         }
-        else if (input.rank() == 2)
+        
+        forwardWithEpilogue(input, output, pool, activation);
+        if (next.getType() == LayerType::SOFTMAX)
         {
-            // batch processing: input [batch_size, input_features]
-            if (input.shape()[1] != weights_.shape()[0])
+            next.forwardInPlace(output);
+        }
+    }
+
+    void QuantizedLinearLayer::addParameterBytes(ParameterBytes& bytes) const
+    {
+        // the padded rows are copied out of any mapped file, so they're always on the heap
+        bytes.add(DataType::INT8, weights_.size() * sizeof(int8_t), false);
+        bytes.other += weight_sums_.size() * sizeof(int32_t);
+        bytes.add(weight_scales_);
+        bytes.add(bias_);
+    }
+
+    void QuantizedLinearLayer::forwardWithEpilogue(const Tensor& input, Tensor& output, ThreadPool* pool,
+                                                   Activation activation)
+    {
+        const size_t batch_size = prepareLinearOutput(input, output, in_features_, out_features_);
+        
+        // quantized activations live in per-thread scratch that only ever grows, like the gemm pack buffers
+        thread_local ScratchBuffer<int8_t> quantized;
+        thread_local ScratchBuffer<float> row_scales;
+        quantized.reserve(batch_size * padded_in_);
+        row_scales.reserve(batch_size);
+        
+        for (size_t b = 0; b < batch_size; ++b)
+        {
+            const float* row = input.data() + b * in_features_;
+            const float scale = input_scale_ > 0.0f
+                ? input_scale_
+                : Quantization::int8Scale(Quantization::maxAbs(row, in_features_));
+            int8_t* quantized_row = quantized.data() + b * padded_in_;
+            Quantization::quantizeInt8(row, in_features_, scale, quantized_row);
+            std::fill(quantized_row + in_features_, quantized_row + padded_in_, static_cast<int8_t>(0));
+            row_scales.data()[b] = scale;
+        }
+        
+        // the epilogue scales the int32 sums back to float, adds the bias and applies the activation
+        GemmEpilogue epilogue;
+        epilogue.bias = bias_.data();
+        epilogue.activation = activation;
+        Gemm::gemmS8(batch_size, out_features_, padded_in_, quantized.data(), padded_in_,
+                     weights_.data(), padded_in_, weight_sums_.data(), row_scales.data(), weight_scales_.data(),
+                     output.data(), out_features_, pool, epilogue);
+    }
+
+    Int4LinearLayer::Int4LinearLayer(size_t in_features, size_t out_features, size_t group_size, const uint8_t* packed,
+                                     Tensor scales, Tensor bias, bool copy_weights)
+        : Layer(LayerType::LINEAR_INT4)
+        , in_features_(in_features)
+        , out_features_(out_features)
+        , group_size_(group_size)
+        , padded_in_(group_size ? (in_features + group_size - 1) / group_size * group_size : 0)
+        , weights_(packed)
+        , scale_dtype_(scales.dtype())
+        , scales_(std::move(scales))
+        , bias_(std::move(bias))
+    {
+        if (in_features == 0 || out_features == 0 || !packed)
+        {
+            throw std::invalid_argument("Int4 linear layer needs non-empty weights");
+        }
+        // the kernels read fp32 scales, 16-bit ones are widened once
+        if (scale_dtype_ == DataType::FLOAT16 || scale_dtype_ == DataType::BFLOAT16)
+        {
+            scales_ = scales_.to(DataType::FLOAT32);
+        }
+        requireFloat32(scales_, "Int4 linear layer scales");
+        requireFloat32(bias_, "Int4 linear layer bias");
+        if (group_size == 0 || group_size % Kernels::INT4_BLOCK != 0)
+        {
+            throw std::invalid_argument("Int4 group size must be a positive multiple of " +
+                                        std::to_string(Kernels::INT4_BLOCK) + ", got " + std::to_string(group_size));
+        }
+        const size_t groups = padded_in_ / group_size;
+        if (scales_.shape() != std::vector<size_t>{out_features, groups})
+        {
+            throw std::invalid_argument("Int4 linear layer scales must be a [" + std::to_string(out_features) + ", " +
+                                        std::to_string(groups) + "] tensor");
+        }
+        if (bias_.shape() != std::vector<size_t>{out_features})
+        {
+            throw std::invalid_argument("Int4 linear layer bias must be a [" + std::to_string(out_features) + "] tensor");
+        }
+        
+        if (copy_weights)
+        {
+            owned_weights_.assign(packed, packed + out_features * padded_in_ / 2);
+            weights_ = owned_weights_.data();
+        }
+    }
+
+    std::unique_ptr<Int4LinearLayer> Int4LinearLayer::quantize(const LinearLayer& layer, size_t group_size,
+                                                               DataType scale_dtype)
+    {
+        if (group_size == 0 || group_size % Kernels::INT4_BLOCK != 0)
+        {
+            throw std::invalid_argument("Int4 group size must be a positive multiple of " +
+                                        std::to_string(Kernels::INT4_BLOCK) + ", got " + std::to_string(group_size));
+        }
+        if (scale_dtype != DataType::FLOAT32 && scale_dtype != DataType::FLOAT16 && scale_dtype != DataType::BFLOAT16)
+        {
+            throw std::invalid_argument(std::string("Int4 scales can't be stored as ") + dataTypeName(scale_dtype));
+        }
+        
+        const Tensor weights = layer.weights().to(DataType::FLOAT32);     // half precision layers too
+        const size_t in_features = weights.shape()[0];
+        const size_t out_features = weights.shape()[1];
+        const size_t padded_in = (in_features + group_size - 1) / group_size * group_size;
+        const size_t groups = padded_in / group_size;
+        
+        // transpose to one zero padded row per output channel, each group with its own scale
+        std::vector<float> row(padded_in, 0.0f);
+        std::vector<int8_t> quantized(padded_in);
+        std::vector<uint8_t> packed(out_features * padded_in / 2);
+        Tensor scales({out_features, groups});
+        Tensor row_scales({groups});
+        for (size_t j = 0; j < out_features; ++j)
+        {
+            for (size_t i = 0; i < in_features; ++i)
             {
-                throw std::invalid_argument(
-                    "Input features must match weight input dimension: " +
-                    std::to_string(input.shape()[1]) + " != " + std::to_string(weights_.shape()[0])
-                );
+                row[i] = weights.data()[i * out_features + j];
             }
-            
-            // matrix multiplication: [batch_size, input_features] * [input_features, output_features]
-            TensorOps::matmul(input, weights_, output);
-            
-            // add bias to each sample in the batch
-            const size_t batch_size = output.shape()[0];
-            const size_t output_features = output.shape()[1];
-            
-            for (size_t batch = 0; batch < batch_size; ++batch)
+            for (size_t g = 0; g < groups; ++g)
+            {
+                row_scales.data()[g] = Quantization::int4Scale(Quantization::maxAbs(row.data() + g * group_size,
+                                                                                    group_size));
+            }
+            // quantize against the scales as they'll be stored, so rounding them costs no extra error
+            if (scale_dtype != DataType::FLOAT32)
+            {
+                row_scales = row_scales.to(scale_dtype).to(DataType::FLOAT32);
+            }
+            for (size_t g = 0; g < groups; ++g)
             {
-                for (size_t feature = 0; feature < output_features; ++feature)
+                const float scale = row_scales.data()[g];
+                if (!std::isfinite(scale))
                 {
-                    output.at({batch, feature}) += bias_.at({feature});
+                    throw std::invalid_argument(std::string("Int4 weights too large for ") +
+                                                dataTypeName(scale_dtype) + " scales");
                 }
+                scales.data()[j * groups + g] = scale;
+                // a scale that rounded to zero only has weights that round to zero
+                Quantization::quantizeInt4(row.data() + g * group_size, group_size, scale > 0.0f ? scale : 1.0f,
+                                           quantized.data() + g * group_size);
             }
+            Quantization::packInt4(quantized.data(), padded_in, packed.data() + j * padded_in / 2);
         }
-        else
+        
+        return std::make_unique<Int4LinearLayer>(in_features, out_features, group_size, packed.data(),
+                                                 scales.to(scale_dtype), layer.bias());
+    }
+
+    void Int4LinearLayer::forward(const Tensor& input, Tensor& output)
+    {
+        forward(input, output, nullptr);
+    }
+
+    void Int4LinearLayer::forward(const Tensor& input, Tensor& output, ThreadPool* pool)
+    {
+        forwardWithEpilogue(input, output, pool, Activation::NONE);
+    }
+
+    std::vector<size_t> Int4LinearLayer::outputShape(const std::vector<size_t>& input_shape) const
+    {
+        return linearOutputShape(input_shape, in_features_, out_features_);
+    }
+
+    uint64_t Int4LinearLayer::flops(const std::vector<size_t>& input_shape) const
+    {
+        return linearFlops(input_shape, in_features_, out_features_);
+    }
+
+    bool Int4LinearLayer::canFuse(const Layer& next) const
+    {
+        Activation activation;
+        return fusedActivation(next.getType(), activation);
+    }
+
+    void Int4LinearLayer::forwardFused(const Tensor& input, Tensor& output, Layer& next, ThreadPool* pool)
+    {
+        Activation activation;
+        if (!fusedActivation(next.getType(), activation))
         {
-            throw std::invalid_argument("Linear layer input must be 1D or 2D tensor");
+            Layer::forwardFused(input, output, next, pool);
+            return;
+        }
+        
+        forwardWithEpilogue(input, output, pool, activation);
+        if (next.getType() == LayerType::SOFTMAX)
+        {
+            next.forwardInPlace(output);
         }
     }
 
+    void Int4LinearLayer::addParameterBytes(ParameterBytes& bytes) const
+    {
+        bytes.add(DataType::INT4, out_features_ * (padded_in_ / 2), owned_weights_.empty());
+        bytes.add(scales_);
+        bytes.add(bias_);
+    }
+
+    void Int4LinearLayer::forwardWithEpilogue(const Tensor& input, Tensor& output, ThreadPool* pool,
+                                              Activation activation)
+    {
+        const size_t batch_size = prepareLinearOutput(input, output, in_features_, out_features_);
+        
+        // the kernels read whole groups, so inputs that end mid-group get a zero padded copy
+        const float* a = input.data();
+        if (padded_in_ != in_features_)
+        {
+            thread_local ScratchBuffer<float> padded;
+            padded.reserve(batch_size * padded_in_);
+            for (size_t b = 0; b < batch_size; ++b)
+            {
+                const float* row = input.data() + b * in_features_;
+                float* padded_row = padded.data() + b * padded_in_;
+                std::copy(row, row + in_features_, padded_row);
+                std::fill(padded_row + in_features_, padded_row + padded_in_, 0.0f);
+            }
+            a = padded.data();
+        }
+        
+        GemmEpilogue epilogue;
+        epilogue.bias = bias_.data();
+        epilogue.activation = activation;
+        Gemm::gemmQ4(batch_size, out_features_, padded_in_, a, padded_in_, weights_, padded_in_ / 2,
+                     scales_.data(), group_size_, output.data(), out_features_, pool, epilogue);
+    }
+
+    void Layer::forwardFused(const Tensor& input, Tensor& output, Layer& next, ThreadPool* pool)
+    {
+        (void)input;
+        (void)output;
+        (void)pool;
+        throw std::runtime_error("Layer type " + std::to_string(static_cast<int>(type_)) +
+                                 " cannot be fused with layer type " +
+                                 std::to_string(static_cast<int>(next.getType())));
+    }
+
+    void Layer::forwardInPlace(Tensor& tensor)
+    {
+        (void)tensor;
+        throw std::runtime_error("Layer type " + std::to_string(static_cast<int>(type_)) +
+                                 " does not support in-place execution");
+    }
+
+    uint64_t Layer::flops(const std::vector<size_t>& input_shape) const
+    {
+        return elementCount(input_shape);
+    }
+
+    uint64_t Layer::bytesMoved(const std::vector<size_t>& input_shape) const
+    {
+        ParameterBytes parameters;
+        addParameterBytes(parameters);
+        return (elementCount(input_shape) + elementCount(outputShape(input_shape))) * sizeof(float) +
+               parameters.total();
+    }
+
+    const char* layerTypeName(LayerType type)
+    {
+        switch (type)
+        {
+            case LayerType::LINEAR: return "Linear";
+            case LayerType::RELU: return "ReLU";
+            case LayerType::SIGMOID: return "Sigmoid";
+            case LayerType::SOFTMAX: return "Softmax";
+            case LayerType::LINEAR_INT8: return "LinearInt8";
+            case LayerType::LINEAR_INT4: return "LinearInt4";
+        }
+        return "Unknown";
+    }
+
     // Activation layer implementations
+    // forward copies into output (reusing its buffer when the size fits) and runs the in-place op there
     void ReLULayer::forward(const Tensor& input, Tensor& output)
     {
-        // copy input to output then apply ReLU in-place
-        output = input;  // this uses the copy constructor
-        TensorOps::relu(output);
+        output = input;
+        forwardInPlace(output);
+    }
+
+    void ReLULayer::forwardInPlace(Tensor& tensor)
+    {
+        TensorOps::relu(tensor);
     }
 
     void SigmoidLayer::forward(const Tensor& input, Tensor& output)
     {
         output = input;
-        TensorOps::sigmoid(output);
+        forwardInPlace(output);
+    }
+
+    void SigmoidLayer::forwardInPlace(Tensor& tensor)
+    {
+        TensorOps::sigmoid(tensor);
+    }
+
+    uint64_t SigmoidLayer::flops(const std::vector<size_t>& input_shape) const
+    {
+        // 1 / (1 + exp(-x)), counting the exp as one
+        return 4 * elementCount(input_shape);
+    }
+
+    uint64_t SoftmaxLayer::flops(const std::vector<size_t>& input_shape) const
+    {
+        // max, subtract and exp, sum, divide
+        return 5 * elementCount(input_shape);
     }
 
     void SoftmaxLayer::forward(const Tensor& input, Tensor& output)
     {
         output = input;
-        TensorOps::softmax(output);
+        forwardInPlace(output);
+    }
+
+    void SoftmaxLayer::forwardInPlace(Tensor& tensor)
+    {
+        // a 2d input is [batch_size, features] (same convention as LinearLayer) -> normalize per sample
+        if (tensor.rank() == 2)
+        {
+            TensorOps::softmax_rows(tensor);
+        }
+        else
+        {
+            TensorOps::softmax(tensor);
+        }
     }
 
     // Model implementation
@@ -130,60 +792,98 @@ namespace mininn
         layers_.push_back(std::move(layer));
     }
 
-    // ModelLoader implementation
-    std::unique_ptr<Model> ModelLoader::loadFromFile(const std::string& filepath)
+    size_t Model::mappedBytes() const
     {
-        std::ifstream file(filepath, std::ios::binary);
-        if (!file.is_open())
+        return mapped_file_ ? mapped_file_->size() : 0;
+    }
+
+    ParameterBytes Model::parameterBytes() const
+    {
+        ParameterBytes bytes;
+        for (const auto& layer : layers_)
         {
-            throw std::runtime_error("Failed to open model file: " + filepath);
+            layer->addParameterBytes(bytes);
         }
+        return bytes;
+    }
 
-        try
+    // ParameterBytes implementation
+    void ParameterBytes::add(DataType dtype, size_t bytes, bool in_place)
+    {
+        by_type[static_cast<size_t>(dtype)] += bytes;
+        if (in_place)
         {
-            // read + validate header
-            ModelFormat::Header header;
-            readBinary(file, header);
-            validateHeader(header);
+            mapped += bytes;
+        }
+    }
 
-            auto model = std::make_unique<Model>();
+    ParameterBytes& ParameterBytes::operator+=(const ParameterBytes& other)
+    {
+        for (size_t i = 0; i < NUM_DATA_TYPES; ++i)
+        {
+            by_type[i] += other.by_type[i];
+        }
+        this->other += other.other;
+        mapped += other.mapped;
+        return *this;
+    }
+
+    size_t ParameterBytes::total() const
+    {
+        size_t sum = other;
+        for (size_t bytes : by_type)
+        {
+            sum += bytes;
+        }
+        return sum;
+    }
 
-            // load each layer
-            for (uint32_t i = 0; i < header.num_layers; ++i)
+    // ModelLoader implementation
+    std::unique_ptr<Model> ModelLoader::loadFromFile(const std::string& filepath, LoadMode mode, Tracer* tracer)
+    {
+        TraceSpan span(tracer, "load_model", "load");
+        span.setArgs("\"mmap\":%s", mode == LoadMode::MMAP ? "true" : "false");
+        
+        if (mode == LoadMode::MMAP)
+        {
+            std::shared_ptr<const MappedFile> mapped = std::make_shared<MappedFile>(filepath);
+            try
             {
-                auto layer = loadLayer(file);
-                model->addLayer(std::move(layer));
+                ModelReader reader(mapped->data(), mapped->size(), true);
+                auto model = parseModel(reader);
+                model->setMappedFile(std::move(mapped));
+                return model;
             }
+            catch (const std::exception& e)
+            {
+                throw std::runtime_error("Failed to load model from " + filepath + ": " + e.what());
+            }
+        }
 
-            // load input/output shape metadata
-            std::vector<size_t> input_shape, output_shape;
-            
-            // read input shape
-            uint32_t input_rank;
-            readBinary(file, input_rank);
-            input_shape.resize(input_rank);
-            for (uint32_t i = 0; i < input_rank; ++i)
+        std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Failed to open model file: " + filepath);
+        }
+
+        try
+        {
+            // one read for the whole file instead of one per field
+            const std::streamsize file_size = file.tellg();
+            if (file_size < 0)
             {
-                uint32_t dim;
-                readBinary(file, dim);
-                input_shape[i] = dim;
+                throw std::runtime_error("Failed to determine file size");
             }
-            
-            // read output shape  
-            uint32_t output_rank;
-            readBinary(file, output_rank);
-            output_shape.resize(output_rank);
-            for (uint32_t i = 0; i < output_rank; ++i)
+            std::vector<uint8_t> bytes(static_cast<size_t>(file_size));
+            file.seekg(0);
+            file.read(reinterpret_cast<char*>(bytes.data()), file_size);
+            if (!file.good())
             {
-                uint32_t dim;
-                readBinary(file, dim);
-                output_shape[i] = dim;
+                throw std::runtime_error("Failed to read binary data from file");
             }
-            
-            model->setInputShape(input_shape);
-            model->setOutputShape(output_shape);
 
-            return model;
+            ModelReader reader(bytes.data(), bytes.size(), false);
+            return parseModel(reader);
         }
         catch (const std::exception& e)
         {
@@ -191,6 +891,25 @@ namespace mininn
         }
     }
 
+    std::unique_ptr<Model> ModelLoader::parseModel(ModelReader& reader)
+    {
+        // read + validate header
+        ModelFormat::Header header;
+        reader.read(header);
+        validateHeader(header);
+
+        auto model = std::make_unique<Model>();
+        if (header.version_major == ModelFormat::VERSION_MAJOR_V1)
+        {
+            parseV1(reader, header, *model);
+        }
+        else
+        {
+            parseV2(reader, header, *model);
+        }
+        return model;
+    }
+
     void ModelLoader::validateHeader(const ModelFormat::Header& header)
     {
         if (header.magic != ModelFormat::MAGIC_NUMBER)
@@ -198,7 +917,8 @@ namespace mininn
             throw std::runtime_error("Invalid model file format (magic number mismatch)");
         }
         
-        if (header.version_major != ModelFormat::VERSION_MAJOR)
+        if (header.version_major != ModelFormat::VERSION_MAJOR &&
+            header.version_major != ModelFormat::VERSION_MAJOR_V1)
         {
             throw std::runtime_error(
                 "Unsupported model version: " + std::to_string(header.version_major) + 
@@ -217,21 +937,21 @@ namespace mininn
         }
     }
 
-    std::unique_ptr<Layer> ModelLoader::loadLayer(std::ifstream& file)
+    std::unique_ptr<Layer> ModelLoader::createLayer(uint8_t layer_type_raw, std::vector<Tensor>& tensors)
     {
-        uint8_t layer_type_raw;
-        readBinary(file, layer_type_raw);
-        
         LayerType layer_type = static_cast<LayerType>(layer_type_raw);
+        const size_t expected_tensors = layer_type == LayerType::LINEAR ? 2 : 0;
+        if (tensors.size() != expected_tensors)
+        {
+            throw std::runtime_error("Layer type " + std::to_string(layer_type_raw) + " expects " +
+                                     std::to_string(expected_tensors) + " tensors, got " +
+                                     std::to_string(tensors.size()));
+        }
         
         switch (layer_type)
         {
             case LayerType::LINEAR:
-            {
-                Tensor weights = loadTensor(file);
-                Tensor bias = loadTensor(file);
-                return std::make_unique<LinearLayer>(weights, bias);
-            }
+                return std::make_unique<LinearLayer>(std::move(tensors[0]), std::move(tensors[1]));
             
             case LayerType::RELU:
                 return std::make_unique<ReLULayer>();
@@ -247,17 +967,65 @@ namespace mininn
         }
     }
 
-    Tensor ModelLoader::loadTensor(std::ifstream& file)
+    void ModelLoader::parseV1(ModelReader& reader, const ModelFormat::Header& header, Model& model)
+    {
+        // load each layer
+        std::vector<Tensor> tensors;
+        for (uint32_t i = 0; i < header.num_layers; ++i)
+        {
+            uint8_t layer_type_raw;
+            reader.read(layer_type_raw);
+            
+            // only linear layers have parameters: weights then bias
+            tensors.clear();
+            if (static_cast<LayerType>(layer_type_raw) == LayerType::LINEAR)
+            {
+                tensors.push_back(loadTensor(reader));
+                tensors.push_back(loadTensor(reader));
+            }
+            model.addLayer(createLayer(layer_type_raw, tensors));
+        }
+
+        // load input/output shape metadata
+        std::vector<size_t> input_shape, output_shape;
+        
+        // read input shape
+        uint32_t input_rank;
+        reader.read(input_rank);
+        input_shape.resize(input_rank);
+        for (uint32_t i = 0; i < input_rank; ++i)
+        {
+            uint32_t dim;
+            reader.read(dim);
+            input_shape[i] = dim;
+        }
+        
+        // read output shape  
+        uint32_t output_rank;
+        reader.read(output_rank);
+        output_shape.resize(output_rank);
+        for (uint32_t i = 0; i < output_rank; ++i)
+        {
+            uint32_t dim;
+            reader.read(dim);
+            output_shape[i] = dim;
+        }
+        
+        model.setInputShape(input_shape);
+        model.setOutputShape(output_shape);
+    }
+
+    Tensor ModelLoader::loadTensor(ModelReader& reader)
     {
         // Read tensor metadata
         uint8_t dtype_raw;
-        readBinary(file, dtype_raw);
-        DataType dtype = static_cast<DataType>(dtype_raw);
+        reader.read(dtype_raw);
+        const DataType dtype = checkedDataType(dtype_raw);
         
         uint32_t rank;
-        readBinary(file, rank);
+        reader.read(rank);
         
-        if (rank == 0 || rank > 8)  // reasonable(?) bounds
+        if (rank == 0 || rank > ModelFormat::MAX_RANK)
         {
             throw std::runtime_error("Invalid tensor rank: " + std::to_string(rank));
         }
@@ -266,39 +1034,157 @@ namespace mininn
         for (uint32_t i = 0; i < rank; ++i)
         {
             uint32_t dim;
-            readBinary(file, dim);
+            reader.read(dim);
             shape[i] = dim;
         }
         
-        // create tensor and read data
-        Tensor tensor(shape, dtype);
+        // the payload follows the shape directly
+        const size_t byte_length = tensorBytes(dtype, shape, reader.remaining());
+        return reader.makeTensor(reader.take(byte_length), shape, dtype);
+    }
+
+    void ModelLoader::parseV2(ModelReader& reader, const ModelFormat::Header& header, Model& model)
+    {
+        ModelFormat::ModelInfo info;
+        reader.read(info);
+        if (info.input_rank > ModelFormat::MAX_RANK || info.output_rank > ModelFormat::MAX_RANK)
+        {
+            throw std::runtime_error("Invalid model input/output rank");
+        }
+        model.setInputShape(std::vector<size_t>(info.input_shape, info.input_shape + info.input_rank));
+        model.setOutputShape(std::vector<size_t>(info.output_shape, info.output_shape + info.output_rank));
         
-        // for now, we only support FLOAT32 data
-        if (dtype != DataType::FLOAT32)
+        // both tables are read up front, the payloads are then found through their offsets
+        if (info.num_tensors > reader.remaining() / sizeof(ModelFormat::TensorEntry))
         {
-            throw std::runtime_error("Only FLOAT32 tensors are currently supported");
+            throw std::runtime_error("Tensor table exceeds file size");
+        }
+        std::vector<ModelFormat::LayerEntry> layer_entries(header.num_layers);
+        for (auto& entry : layer_entries)
+        {
+            reader.read(entry);
+        }
+        std::vector<ModelFormat::TensorEntry> tensor_entries(info.num_tensors);
+        for (auto& entry : tensor_entries)
+        {
+            reader.read(entry);
         }
         
-        file.read(reinterpret_cast<char*>(tensor.data()), tensor.size() * sizeof(float));
-        if (!file.good())
+        std::vector<Tensor> tensors;
+        for (const auto& entry : layer_entries)
         {
-            throw std::runtime_error("Failed to read tensor data");
+            if (entry.first_tensor > tensor_entries.size() ||
+                entry.num_tensors > tensor_entries.size() - entry.first_tensor)
+            {
+                throw std::runtime_error("Layer refers to tensors outside the tensor table");
+            }
+            
+            const ModelFormat::TensorEntry* entries = tensor_entries.data() + entry.first_tensor;
+            if (static_cast<LayerType>(entry.type) == LayerType::LINEAR_INT8)
+            {
+                model.addLayer(loadQuantizedLinear(reader, entries, entry.num_tensors));
+                continue;
+            }
+            if (static_cast<LayerType>(entry.type) == LayerType::LINEAR_INT4)
+            {
+                model.addLayer(loadInt4Linear(reader, entries, entry.num_tensors));
+                continue;
+            }
+            
+            tensors.clear();
+            for (uint32_t i = 0; i < entry.num_tensors; ++i)
+            {
+                tensors.push_back(loadTensor(reader, entries[i]));
+            }
+            model.addLayer(createLayer(entry.type, tensors));
+        }
+    }
+
+    std::unique_ptr<Layer> ModelLoader::loadQuantizedLinear(ModelReader& reader,
+                                                            const ModelFormat::TensorEntry* entries, uint32_t count)
+    {
+        // int8 weights [out, in], then float weight scales [out], bias [out] and input scale [1]
+        if (count != 4)
+        {
+            throw std::runtime_error("Layer type " + std::to_string(static_cast<int>(LayerType::LINEAR_INT8)) +
+                                     " expects 4 tensors, got " + std::to_string(count));
+        }
+        
+        const ModelFormat::TensorEntry& weights = entries[0];
+        if (static_cast<DataType>(weights.dtype) != DataType::INT8 || weights.rank != 2 ||
+            weights.byte_length != static_cast<uint64_t>(weights.shape[0]) * weights.shape[1])
+        {
+            throw std::runtime_error("Quantized linear weights must be a 2D INT8 tensor");
         }
         
-        return tensor;
+        // the kernels want each row padded along k, so the weights are always copied
+        const int8_t* data = reinterpret_cast<const int8_t*>(reader.at(weights.offset, weights.byte_length));
+        Tensor weight_scales = loadTensor(reader, entries[1]);
+        Tensor bias = loadTensor(reader, entries[2]);
+        Tensor input_scale = loadTensor(reader, entries[3]);
+        if (input_scale.size() != 1)
+        {
+            throw std::runtime_error("Quantized linear input scale must have one element");
+        }
+        return std::make_unique<QuantizedLinearLayer>(weights.shape[1], weights.shape[0], data, std::move(weight_scales),
+                                                      std::move(bias), input_scale.data<float>()[0]);
     }
 
-    // template specializations for binary I/O
-    template<typename T>
-    void ModelLoader::readBinary(std::ifstream& file, T& value)
+    std::unique_ptr<Layer> ModelLoader::loadInt4Linear(ModelReader& reader,
+                                                       const ModelFormat::TensorEntry* entries, uint32_t count)
     {
-        file.read(reinterpret_cast<char*>(&value), sizeof(T));
-        if (!file.good())
+        // int4 weights [out, in] with rows padded to whole groups, then fp32 or 16-bit group scales [out, groups]
+        // and bias [out]
+        if (count != 3)
         {
-            throw std::runtime_error("Failed to read binary data from file");
+            throw std::runtime_error("Layer type " + std::to_string(static_cast<int>(LayerType::LINEAR_INT4)) +
+                                     " expects 3 tensors, got " + std::to_string(count));
         }
+        
+        const ModelFormat::TensorEntry& weights = entries[0];
+        const ModelFormat::TensorEntry& scales_entry = entries[1];
+        if (static_cast<DataType>(weights.dtype) != DataType::INT4 || weights.rank != 2 || weights.shape[0] == 0 ||
+            weights.byte_length % weights.shape[0] != 0)
+        {
+            throw std::runtime_error("Int4 linear weights must be a 2D INT4 tensor");
+        }
+        
+        // the padded row length comes from the payload size, the group size from the number of scales
+        const size_t out_features = weights.shape[0];
+        const size_t in_features = weights.shape[1];
+        const size_t padded_in = static_cast<size_t>(weights.byte_length / out_features) * 2;
+        const size_t groups = scales_entry.rank == 2 ? scales_entry.shape[1] : 0;
+        if (groups == 0 || padded_in % groups != 0 || padded_in < in_features ||
+            padded_in - in_features >= padded_in / groups)
+        {
+            throw std::runtime_error("Int4 linear weights don't match their group scales");
+        }
+        
+        // rows are stored exactly as the kernels read them, so a mapped file is used in place
+        const uint8_t* data = reader.at(weights.offset, weights.byte_length);
+        Tensor scales = loadTensor(reader, scales_entry);
+        Tensor bias = loadTensor(reader, entries[2]);
+        return std::make_unique<Int4LinearLayer>(in_features, out_features, padded_in / groups, data,
+                                                 std::move(scales), std::move(bias), !reader.mapsTensors());
     }
 
+    Tensor ModelLoader::loadTensor(ModelReader& reader, const ModelFormat::TensorEntry& entry)
+    {
+        if (entry.rank == 0 || entry.rank > ModelFormat::MAX_RANK)
+        {
+            throw std::runtime_error("Invalid tensor rank: " + std::to_string(entry.rank));
+        }
+        
+        const DataType dtype = checkedDataType(entry.dtype);
+        const std::vector<size_t> shape(entry.shape, entry.shape + entry.rank);
+        if (entry.byte_length != tensorBytes(dtype, shape, entry.byte_length))
+        {
+            throw std::runtime_error("Tensor byte length doesn't match its shape");
+        }
+        return reader.makeTensor(reader.at(entry.offset, entry.byte_length), shape, dtype);
+    }
+
+    // template specializations for binary I/O
     template<typename T>
     void ModelLoader::writeBinary(std::ofstream& file, const T& value)
     {
@@ -309,34 +1195,118 @@ namespace mininn
         }
     }
 
-    // Helper function to save a tensor
-    void ModelLoader::saveTensor(std::ofstream& file, const Tensor& tensor)
+    void ModelLoader::saveToFile(const Model& model, const std::string& filepath)
     {
-        // Write tensor metadata
-        uint8_t dtype_raw = static_cast<uint8_t>(tensor.dtype());
-        writeBinary(file, dtype_raw);
-        
-        uint32_t rank = static_cast<uint32_t>(tensor.rank());
-        writeBinary(file, rank);
+        // validate before touching the file so a bad model never leaves a partial one behind
+        const auto& layers = model.getLayers();
+        if (layers.empty())
+        {
+            throw std::runtime_error("Cannot save a model with no layers: " + filepath);
+        }
+        const auto& input_shape = model.getInputShape();
+        const auto& output_shape = model.getOutputShape();
+        if (input_shape.size() > ModelFormat::MAX_RANK || output_shape.size() > ModelFormat::MAX_RANK)
+        {
+            throw std::runtime_error("Model input/output rank exceeds " + std::to_string(ModelFormat::MAX_RANK) +
+                                     ": " + filepath);
+        }
         
-        // Write shape
-        const auto& shape = tensor.shape();
-        for (size_t dim : shape)
+        // gather every layer's tensors (see LayerEntry for what each layer type stores)
+        std::vector<ModelFormat::LayerEntry> layer_entries(layers.size());
+        std::vector<Payload> tensors;
+        std::deque<std::vector<int8_t>> unpadded_weights;  // stable addresses while tensors points at them
+        std::deque<float> input_scales;
+        std::deque<Tensor> narrowed_scales;                 // int4 scales back in their stored dtype
+        for (size_t i = 0; i < layers.size(); ++i)
         {
-            uint32_t dim_u32 = static_cast<uint32_t>(dim);
-            writeBinary(file, dim_u32);
+            auto& entry = layer_entries[i];
+            std::memset(&entry, 0, sizeof(entry));
+            entry.type = static_cast<uint8_t>(layers[i]->getType());
+            entry.first_tensor = static_cast<uint32_t>(tensors.size());
+            
+            if (layers[i]->getType() == LayerType::LINEAR)
+            {
+                const auto* linear_layer = dynamic_cast<const LinearLayer*>(layers[i].get());
+                if (!linear_layer)
+                {
+                    throw std::runtime_error("Failed to cast to LinearLayer");
+                }
+                tensors.push_back(tensorPayload(linear_layer->weights_));
+                tensors.push_back(tensorPayload(linear_layer->bias_));
+            }
+            else if (layers[i]->getType() == LayerType::LINEAR_INT8)
+            {
+                const auto* quantized = dynamic_cast<const QuantizedLinearLayer*>(layers[i].get());
+                if (!quantized)
+                {
+                    throw std::runtime_error("Failed to cast to QuantizedLinearLayer");
+                }
+                
+                // the file holds the weights without the in-memory k padding
+                const size_t in = quantized->in_features_;
+                const size_t out = quantized->out_features_;
+                std::vector<int8_t>& weights = unpadded_weights.emplace_back(in * out);
+                for (size_t j = 0; j < out; ++j)
+                {
+                    std::copy(quantized->weightRow(j), quantized->weightRow(j) + in, weights.data() + j * in);
+                }
+                input_scales.push_back(quantized->input_scale_);
+                
+                tensors.push_back({DataType::INT8, {out, in}, weights.data(), weights.size()});
+                tensors.push_back(tensorPayload(quantized->weight_scales_));
+                tensors.push_back(tensorPayload(quantized->bias_));
+                tensors.push_back({DataType::FLOAT32, {1}, &input_scales.back(), sizeof(float)});
+            }
+            else if (layers[i]->getType() == LayerType::LINEAR_INT4)
+            {
+                const auto* int4 = dynamic_cast<const Int4LinearLayer*>(layers[i].get());
+                if (!int4)
+                {
+                    throw std::runtime_error("Failed to cast to Int4LinearLayer");
+                }
+                
+                // written as laid out in memory, padding included
+                tensors.push_back({DataType::INT4, {int4->out_features_, int4->in_features_}, int4->weights_,
+                                   int4->out_features_ * int4->padded_in_ / 2});
+                const Tensor* scales = &int4->scales_;
+                if (int4->scale_dtype_ != DataType::FLOAT32)
+                {
+                    scales = &narrowed_scales.emplace_back(int4->scales_.to(int4->scale_dtype_));
+                }
+                tensors.push_back(tensorPayload(*scales));
+                tensors.push_back(tensorPayload(int4->bias_));
+            }
+            entry.num_tensors = static_cast<uint32_t>(tensors.size()) - entry.first_tensor;
         }
         
-        // Write data
-        file.write(reinterpret_cast<const char*>(tensor.data()), tensor.size() * sizeof(float));
-        if (!file.good())
+        // lay the payloads out after the tables, each on its own aligned offset
+        const size_t tables_end = sizeof(ModelFormat::Header) + sizeof(ModelFormat::ModelInfo) +
+                                  layer_entries.size() * sizeof(ModelFormat::LayerEntry) +
+                                  tensors.size() * sizeof(ModelFormat::TensorEntry);
+        std::vector<ModelFormat::TensorEntry> tensor_entries(tensors.size());
+        size_t offset = tables_end;
+        for (size_t i = 0; i < tensors.size(); ++i)
         {
-            throw std::runtime_error("Failed to write tensor data");
+            const Payload& tensor = tensors[i];
+            if (tensor.shape.empty() || tensor.shape.size() > ModelFormat::MAX_RANK)
+            {
+                throw std::runtime_error("Cannot save tensor of rank " + std::to_string(tensor.shape.size()) + ": " + filepath);
+            }
+            
+            auto& entry = tensor_entries[i];
+            std::memset(&entry, 0, sizeof(entry));
+            offset = alignedOffset(offset);
+            entry.offset = offset;
+            entry.byte_length = tensor.bytes;
+            entry.dtype = static_cast<uint8_t>(tensor.dtype);
+            entry.rank = static_cast<uint8_t>(tensor.shape.size());
+            for (size_t d = 0; d < tensor.shape.size(); ++d)
+            {
+                entry.shape[d] = static_cast<uint32_t>(tensor.shape[d]);
+            }
+            offset += entry.byte_length;
         }
-    }
-
-    void ModelLoader::saveToFile(const Model& model, const std::string& filepath)
-    {
+        
         std::ofstream file(filepath, std::ios::binary);
         if (!file.is_open())
         {
@@ -350,51 +1320,43 @@ namespace mininn
             header.magic = ModelFormat::MAGIC_NUMBER;
             header.version_major = ModelFormat::VERSION_MAJOR;
             header.version_minor = ModelFormat::VERSION_MINOR;
-            header.num_layers = static_cast<uint32_t>(model.getLayers().size());
+            header.num_layers = static_cast<uint32_t>(layers.size());
             header.reserved = 0;
-            
             writeBinary(file, header);
+            
+            // Write model info: tensor count and input/output shapes
+            ModelFormat::ModelInfo info;
+            std::memset(&info, 0, sizeof(info));
+            info.num_tensors = static_cast<uint32_t>(tensors.size());
+            info.input_rank = static_cast<uint32_t>(input_shape.size());
+            info.output_rank = static_cast<uint32_t>(output_shape.size());
+            std::copy(input_shape.begin(), input_shape.end(), info.input_shape);
+            std::copy(output_shape.begin(), output_shape.end(), info.output_shape);
+            writeBinary(file, info);
 
-            // Write layers
-            for (const auto& layer : model.getLayers())
+            // Write the layer and tensor tables
+            for (const auto& entry : layer_entries)
             {
-                // Write layer type
-                uint8_t layer_type = static_cast<uint8_t>(layer->getType());
-                writeBinary(file, layer_type);
-
-                // Write layer-specific data
-                if (layer->getType() == LayerType::LINEAR)
-                {
-                    const auto* linear_layer = dynamic_cast<const LinearLayer*>(layer.get());
-                    if (!linear_layer)
-                    {
-                        throw std::runtime_error("Failed to cast to LinearLayer");
-                    }
-
-                    // Save weights and bias
-                    saveTensor(file, linear_layer->weights_);
-                    saveTensor(file, linear_layer->bias_);
-                }
-                // Other layer types don't have parameters to save
+                writeBinary(file, entry);
             }
-
-            // Write input/output shapes
-            const auto& input_shape = model.getInputShape();
-            uint32_t input_rank = static_cast<uint32_t>(input_shape.size());
-            writeBinary(file, input_rank);
-            for (size_t dim : input_shape)
+            for (const auto& entry : tensor_entries)
             {
-                uint32_t dim_u32 = static_cast<uint32_t>(dim);
-                writeBinary(file, dim_u32);
+                writeBinary(file, entry);
             }
-
-            const auto& output_shape = model.getOutputShape();
-            uint32_t output_rank = static_cast<uint32_t>(output_shape.size());
-            writeBinary(file, output_rank);
-            for (size_t dim : output_shape)
+            
+            // Write the payloads, zero padded up to each one's offset
+            static const char padding[ModelFormat::TENSOR_ALIGNMENT] = {};
+            size_t position = tables_end;
+            for (size_t i = 0; i < tensors.size(); ++i)
             {
-                uint32_t dim_u32 = static_cast<uint32_t>(dim);
-                writeBinary(file, dim_u32);
+                file.write(padding, static_cast<std::streamsize>(tensor_entries[i].offset - position));
+                file.write(static_cast<const char*>(tensors[i].data),
+                           static_cast<std::streamsize>(tensor_entries[i].byte_length));
+                if (!file.good())
+                {
+                    throw std::runtime_error("Failed to write tensor data");
+                }
+                position = tensor_entries[i].offset + tensor_entries[i].byte_length;
             }
         }
         catch (const std::exception& e)
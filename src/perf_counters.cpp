@@ -0,0 +1,210 @@
+/* perf_counters.cpp
+ *
+ * Per-thread hardware performance counters through Linux perf_event_open,
+ * read as one group so a layer's cycles and misses come from the same interval.
+ */
+
+#include "perf_counters.h"
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#define MININN_HAVE_PERF_EVENTS 1
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace mininn
+{
+    namespace
+    {
+#ifdef MININN_HAVE_PERF_EVENTS
+        struct EventConfig
+        {
+            uint32_t type;
+            uint64_t config;
+        };
+
+        // indexed by PerfEvent
+        constexpr EventConfig EVENT_CONFIGS[NUM_PERF_EVENTS] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        };
+
+        int openEvent(const EventConfig& event, int group_fd)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = event.type;
+            attr.config = event.config;
+            attr.exclude_kernel = 1;     // all perf_event_paranoid <= 2 allows for a process's own threads
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            // the leader starts stopped and enables the whole group once it's complete
+            attr.disabled = group_fd < 0 ? 1 : 0;
+            return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+        }
+
+        std::string openError(PerfEvent event, int error)
+        {
+            std::string message = std::string("perf_event_open(") + perfEventName(event) + "): " + std::strerror(error);
+            if (error == EACCES || error == EPERM)
+            {
+                message += " (not permitted: see /proc/sys/kernel/perf_event_paranoid, containers may also block it)";
+            }
+            else if (error == ENOENT || error == ENODEV || error == EOPNOTSUPP)
+            {
+                message += " (no such hardware event, e.g. a VM without a virtual PMU)";
+            }
+            return message;
+        }
+#endif
+    }
+
+    const char* perfEventName(PerfEvent event)
+    {
+        switch (event)
+        {
+            case PerfEvent::CYCLES: return "cycles";
+            case PerfEvent::INSTRUCTIONS: return "instructions";
+            case PerfEvent::L1D_MISSES: return "l1d_misses";
+            case PerfEvent::LLC_MISSES: return "llc_misses";
+            case PerfEvent::BRANCH_MISSES: return "branch_misses";
+        }
+        return "unknown";
+    }
+
+    double PerfCounts::ipc() const
+    {
+        if (!has(PerfEvent::CYCLES) || !has(PerfEvent::INSTRUCTIONS) || get(PerfEvent::CYCLES) == 0)
+        {
+            return 0.0;
+        }
+        return static_cast<double>(get(PerfEvent::INSTRUCTIONS)) / get(PerfEvent::CYCLES);
+    }
+
+    PerfCounts& PerfCounts::operator+=(const PerfCounts& other)
+    {
+        available = empty() ? other.available : (other.empty() ? available : available & other.available);
+        for (size_t i = 0; i < NUM_PERF_EVENTS; ++i)
+        {
+            values[i] = (available & (1u << i)) ? values[i] + other.values[i] : 0;
+        }
+        return *this;
+    }
+
+    PerfCounts PerfCounts::operator-(const PerfCounts& earlier) const
+    {
+        PerfCounts difference;
+        difference.available = available & earlier.available;
+        for (size_t i = 0; i < NUM_PERF_EVENTS; ++i)
+        {
+            // scaled multiplexed counts can step back a little
+            const bool counted = (difference.available & (1u << i)) && values[i] > earlier.values[i];
+            difference.values[i] = counted ? values[i] - earlier.values[i] : 0;
+        }
+        return difference;
+    }
+
+    PerfCounters::PerfCounters()
+    {
+        fds_.fill(-1);
+#ifdef MININN_HAVE_PERF_EVENTS
+        // whichever event opens first leads the group, so one missing event doesn't take the rest with it
+        for (size_t i = 0; i < NUM_PERF_EVENTS; ++i)
+        {
+            fds_[i] = openEvent(EVENT_CONFIGS[i], leader_);
+            if (fds_[i] < 0)
+            {
+                if (error_.empty())
+                {
+                    error_ = openError(static_cast<PerfEvent>(i), errno);
+                }
+                continue;
+            }
+            if (leader_ < 0)
+            {
+                leader_ = fds_[i];
+            }
+            counts_available_ |= 1u << i;
+        }
+
+        if (leader_ >= 0 && ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) != 0)
+        {
+            error_ = std::string("perf_event_open: failed to enable the counters: ") + std::strerror(errno);
+            counts_available_ = 0;
+        }
+#else
+        error_ = "hardware counters need linux perf_event_open";
+#endif
+    }
+
+    PerfCounters::~PerfCounters()
+    {
+#ifdef MININN_HAVE_PERF_EVENTS
+        for (int fd : fds_)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    PerfCounts PerfCounters::read() const
+    {
+        PerfCounts counts;
+#ifdef MININN_HAVE_PERF_EVENTS
+        if (!available())
+        {
+            return counts;
+        }
+
+        // {nr, time_enabled, time_running, values[nr]}, values in the order the events joined the group
+        uint64_t buffer[3 + NUM_PERF_EVENTS];
+        const ssize_t bytes = ::read(leader_, buffer, sizeof(buffer));
+        if (bytes < static_cast<ssize_t>(3 * sizeof(uint64_t)) || buffer[0] > NUM_PERF_EVENTS)
+        {
+            return counts;
+        }
+
+        const uint64_t enabled = buffer[1];
+        const uint64_t running = buffer[2];
+        const double scale = running > 0 && running < enabled ? static_cast<double>(enabled) / running : 1.0;
+        size_t slot = 0;
+        for (size_t i = 0; i < NUM_PERF_EVENTS && slot < buffer[0]; ++i)
+        {
+            if (counts_available_ & (1u << i))
+            {
+                counts.values[i] = static_cast<uint64_t>(buffer[3 + slot++] * scale);
+            }
+        }
+        counts.available = counts_available_;
+#endif
+        return counts;
+    }
+
+    PerfCounters& PerfCounters::forThisThread()
+    {
+        thread_local PerfCounters counters;
+        return counters;
+    }
+
+    bool PerfCounters::supported()
+    {
+#ifdef MININN_HAVE_PERF_EVENTS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+} // namespace mininn
@@ -0,0 +1,236 @@
+/* quantization.cpp
+ *
+ * Post-training quantization. Calibration runs the float model over sample
+ * inputs and records the range reaching every linear layer; conversion turns
+ * each LinearLayer into a QuantizedLinearLayer with per output channel weight
+ * scales and (when calibrated) a static activation scale. Int4 conversion is
+ * weight-only: each LinearLayer becomes an Int4LinearLayer with one scale per
+ * group of weights along the input, and needs no calibration.
+ */
+
+#include "quantization.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+namespace mininn
+{
+    namespace Quantization
+    {
+        namespace
+        {
+            void quantizeSymmetric(const float* x, size_t n, float scale, int limit_value, int8_t* q)
+            {
+                const float inverse_scale = 1.0f / scale;
+                const float limit = static_cast<float>(limit_value);
+                for (size_t i = 0; i < n; ++i)
+                {
+                    // clamp before rounding so out of range (or calibrated-away) values saturate
+                    const float scaled = std::min(std::max(x[i] * inverse_scale, -limit), limit);
+                    q[i] = static_cast<int8_t>(std::lrint(scaled));
+                }
+            }
+
+            // the activation layers carry no parameters, quantized models get fresh ones
+            std::unique_ptr<Layer> copyActivation(const Layer& layer)
+            {
+                switch (layer.getType())
+                {
+                    case LayerType::RELU:
+                        return std::make_unique<ReLULayer>();
+                    case LayerType::SIGMOID:
+                        return std::make_unique<SigmoidLayer>();
+                    case LayerType::SOFTMAX:
+                        return std::make_unique<SoftmaxLayer>();
+                    default:
+                        throw std::invalid_argument("Cannot quantize layer type " +
+                                                    std::to_string(static_cast<int>(layer.getType())));
+                }
+            }
+        }
+
+        float int8Scale(float max_abs)
+        {
+            return max_abs > 0.0f ? max_abs / static_cast<float>(INT8_LIMIT) : 1.0f;
+        }
+
+        void quantizeInt8(const float* x, size_t n, float scale, int8_t* q)
+        {
+            quantizeSymmetric(x, n, scale, INT8_LIMIT, q);
+        }
+
+        float int4Scale(float max_abs)
+        {
+            return max_abs > 0.0f ? max_abs / static_cast<float>(INT4_LIMIT) : 1.0f;
+        }
+
+        void quantizeInt4(const float* x, size_t n, float scale, int8_t* q)
+        {
+            quantizeSymmetric(x, n, scale, INT4_LIMIT, q);
+        }
+
+        void packInt4(const int8_t* q, size_t n, uint8_t* packed)
+        {
+            constexpr size_t HALF = Kernels::INT4_BLOCK / 2;
+            for (size_t block = 0; block < n; block += Kernels::INT4_BLOCK)
+            {
+                for (size_t i = 0; i < HALF; ++i)
+                {
+                    const unsigned low = static_cast<unsigned>(q[block + i] + 8);
+                    const unsigned high = static_cast<unsigned>(q[block + HALF + i] + 8);
+                    packed[block / 2 + i] = static_cast<uint8_t>(low | (high << 4));
+                }
+            }
+        }
+
+        int8_t unpackInt4(const uint8_t* packed, size_t i)
+        {
+            constexpr size_t HALF = Kernels::INT4_BLOCK / 2;
+            const size_t within = i % Kernels::INT4_BLOCK;
+            const uint8_t byte = packed[(i - within) / 2 + within % HALF];
+            const int nibble = within < HALF ? (byte & 0x0f) : (byte >> 4);
+            return static_cast<int8_t>(nibble - 8);
+        }
+
+        float maxAbs(const float* x, size_t n)
+        {
+            float result = 0.0f;
+            for (size_t i = 0; i < n; ++i)
+            {
+                result = std::max(result, std::fabs(x[i]));
+            }
+            return result;
+        }
+
+        std::vector<float> calibrate(const Model& model, const std::vector<Tensor>& samples)
+        {
+            const auto& layers = model.getLayers();
+            std::vector<float> ranges(layers.size(), 0.0f);
+
+            Tensor current;
+            Tensor next;
+            for (const Tensor& sample : samples)
+            {
+                current = sample;
+                for (size_t i = 0; i < layers.size(); ++i)
+                {
+                    ranges[i] = std::max(ranges[i], maxAbs(current.data(), current.size()));
+                    layers[i]->forward(current, next);
+                    std::swap(current, next);
+                }
+            }
+            return ranges;
+        }
+
+        std::unique_ptr<Model> quantizeInt8(const Model& model, const std::vector<Tensor>& calibration_samples)
+        {
+            const std::vector<float> ranges = calibrate(model, calibration_samples);
+            const bool calibrated = !calibration_samples.empty();
+
+            auto quantized = std::make_unique<Model>();
+            const auto& layers = model.getLayers();
+            for (size_t i = 0; i < layers.size(); ++i)
+            {
+                const Layer& layer = *layers[i];
+                if (layer.getType() == LayerType::LINEAR)
+                {
+                    const float input_scale = calibrated ? int8Scale(ranges[i]) : 0.0f;
+                    quantized->addLayer(QuantizedLinearLayer::quantize(
+                        dynamic_cast<const LinearLayer&>(layer), input_scale));
+                }
+                else
+                {
+                    quantized->addLayer(copyActivation(layer));
+                }
+            }
+
+            quantized->setInputShape(model.getInputShape());
+            quantized->setOutputShape(model.getOutputShape());
+            return quantized;
+        }
+
+        std::unique_ptr<Model> quantizeInt4(const Model& model, size_t group_size, DataType scale_dtype)
+        {
+            auto quantized = std::make_unique<Model>();
+            for (const auto& layer : model.getLayers())
+            {
+                if (layer->getType() == LayerType::LINEAR)
+                {
+                    const auto& linear = dynamic_cast<const LinearLayer&>(*layer);
+                    quantized->addLayer(Int4LinearLayer::quantize(linear, group_size, scale_dtype));
+                }
+                else
+                {
+                    quantized->addLayer(copyActivation(*layer));
+                }
+            }
+
+            quantized->setInputShape(model.getInputShape());
+            quantized->setOutputShape(model.getOutputShape());
+            return quantized;
+        }
+
+        std::unique_ptr<Model> convertWeights(const Model& model, DataType dtype)
+        {
+            if (dtype != DataType::FLOAT32 && dtype != DataType::FLOAT16 && dtype != DataType::BFLOAT16)
+            {
+                throw std::invalid_argument(std::string("Linear weights can't be stored as ") + dataTypeName(dtype));
+            }
+
+            auto converted = std::make_unique<Model>();
+            for (const auto& layer : model.getLayers())
+            {
+                if (layer->getType() == LayerType::LINEAR)
+                {
+                    const auto& linear = dynamic_cast<const LinearLayer&>(*layer);
+                    converted->addLayer(std::make_unique<LinearLayer>(linear.weights().to(dtype), linear.bias()));
+                }
+                else
+                {
+                    converted->addLayer(copyActivation(*layer));
+                }
+            }
+
+            converted->setInputShape(model.getInputShape());
+            converted->setOutputShape(model.getOutputShape());
+            return converted;
+        }
+
+        std::vector<Tensor> loadSamples(const std::string& filepath, const std::vector<size_t>& input_shape)
+        {
+            std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+            if (!file.is_open())
+            {
+                throw std::runtime_error("Failed to open calibration file: " + filepath);
+            }
+
+            size_t sample_size = 1;
+            for (size_t dim : input_shape)
+            {
+                sample_size *= dim;
+            }
+            const std::streamsize file_size = file.tellg();
+            const size_t sample_bytes = sample_size * sizeof(float);
+            if (sample_bytes == 0 || file_size <= 0 || static_cast<size_t>(file_size) % sample_bytes != 0)
+            {
+                throw std::runtime_error("Calibration file size isn't a multiple of the model input size: " + filepath);
+            }
+
+            std::vector<Tensor> samples;
+            file.seekg(0);
+            for (size_t i = 0; i < static_cast<size_t>(file_size) / sample_bytes; ++i)
+            {
+                Tensor sample(input_shape);
+                file.read(reinterpret_cast<char*>(sample.data()), static_cast<std::streamsize>(sample_bytes));
+                if (!file.good())
+                {
+                    throw std::runtime_error("Failed to read calibration file: " + filepath);
+                }
+                samples.push_back(std::move(sample));
+            }
+            return samples;
+        }
+    } // namespace Quantization
+
+} // namespace mininn
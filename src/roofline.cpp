@@ -0,0 +1,361 @@
+/* roofline.cpp
+ *
+ * Roofline analysis of a model. The machine's two roofs come from built-in
+ * microbenchmarks run with the active kernel tier (the gemm micro-kernel on
+ * L1 resident panels for compute, a streaming axpy for memory bandwidth);
+ * every layer's flops and compulsory bytes over its measured time place it
+ * under them.
+ */
+
+#include "roofline.h"
+#include "benchmark.h"
+#include "kernels.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+namespace mininn
+{
+    namespace
+    {
+        // micro-kernel panels: kc * (mr + nr) floats stay well inside any L1
+        constexpr size_t PEAK_KC = 128;
+        // micro-kernel calls per timed op, so the op isn't mostly call overhead
+        constexpr size_t PEAK_CALLS = 64;
+        // each of axpy's two arrays, far past any last level cache
+        constexpr size_t STREAM_FLOATS = size_t(8) << 20;
+
+        constexpr size_t WARMUP_RUNS = 5;
+
+        double median(std::vector<double> values)
+        {
+            if (values.empty())
+            {
+                return 0.0;
+            }
+            const size_t middle = values.size() / 2;
+            std::nth_element(values.begin(), values.begin() + middle, values.end());
+            return values[middle];
+        }
+
+        // fn(0) .. fn(size - 1) on as many distinct threads of pool (or fn(0) on the caller), started together
+        // parallelFor makes one chunk per thread but lets a free thread take a second one; every chunk waits at
+        // the start line until all have arrived, so a thread holding one can't pick up another, and none of
+        // them runs while the others haven't started yet
+        void onEveryThread(ThreadPool* pool, const std::function<void(size_t)>& fn)
+        {
+            if (!pool)
+            {
+                fn(0);
+                return;
+            }
+            const size_t threads = pool->size();
+            std::atomic<size_t> arrived(0);
+            pool->parallelFor(threads, 1, [&](size_t begin, size_t end)
+            {
+                for (size_t thread = begin; thread < end; ++thread)
+                {
+                    arrived.fetch_add(1, std::memory_order_acq_rel);
+                    while (arrived.load(std::memory_order_acquire) < threads)
+                    {
+                        std::this_thread::yield();
+                    }
+                    fn(thread);
+                }
+            });
+        }
+
+        double computePeak(ThreadPool* pool, const BenchmarkOptions& options)
+        {
+            const KernelTable& kernels = Kernels::active();
+            const size_t mr = kernels.gemm_mr;
+            const size_t nr = kernels.gemm_nr;
+            const size_t threads = pool ? pool->size() : 1;
+
+            struct Panels
+            {
+                std::vector<float> a, b, c;
+            };
+            std::vector<Panels> panels(threads);
+            for (auto& panel : panels)
+            {
+                // normal values only: denormals would take the slow path
+                panel.a.assign(PEAK_KC * mr, 0.5f);
+                panel.b.assign(PEAK_KC * nr, 0.25f);
+                panel.c.assign(mr * nr, 0.0f);
+            }
+
+            BenchmarkSuite suite(options);
+            suite.run("peak_fp32_fma", threads * PEAK_CALLS * 2 * PEAK_KC * mr * nr, 0, [&]
+            {
+                onEveryThread(pool, [&](size_t thread)
+                {
+                    Panels& panel = panels[thread];
+                    for (size_t call = 0; call < PEAK_CALLS; ++call)
+                    {
+                        kernels.gemm_micro(PEAK_KC, panel.a.data(), panel.b.data(), panel.c.data(), nr, mr, nr,
+                                           true, nullptr);
+                    }
+                });
+            });
+            return suite.results().back().gflops();
+        }
+
+        double bandwidthPeak(ThreadPool* pool, const BenchmarkOptions& options)
+        {
+            const KernelTable& kernels = Kernels::active();
+            const size_t threads = pool ? pool->size() : 1;
+            const size_t per_thread = (STREAM_FLOATS + threads - 1) / threads;
+            std::vector<float> x(STREAM_FLOATS, 0.0f);
+            std::vector<float> y(STREAM_FLOATS, 1.0f);
+
+            // reads x and y, writes y
+            BenchmarkSuite suite(options);
+            suite.run("peak_stream_axpy", 0, 3 * STREAM_FLOATS * sizeof(float), [&]
+            {
+                onEveryThread(pool, [&](size_t thread)
+                {
+                    const size_t begin = std::min(thread * per_thread, STREAM_FLOATS);
+                    const size_t end = std::min(begin + per_thread, STREAM_FLOATS);
+                    kernels.axpy(end - begin, 1.0f, x.data() + begin, y.data() + begin);
+                });
+            });
+            return suite.results().back().gbytesPerSecond();
+        }
+
+        std::vector<Tensor> randomInputs(const std::vector<size_t>& shape, size_t count)
+        {
+            std::mt19937 rng(42);
+            std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+            std::vector<Tensor> inputs;
+            for (size_t i = 0; i < count; ++i)
+            {
+                Tensor input(shape);
+                for (size_t j = 0; j < input.size(); ++j)
+                {
+                    input.data()[j] = uniform(rng);
+                }
+                inputs.push_back(std::move(input));
+            }
+            return inputs;
+        }
+    }
+
+    double MachinePeak::ridgePoint() const
+    {
+        return gbytes_per_second > 0.0 ? gflops / gbytes_per_second : 0.0;
+    }
+
+    double MachinePeak::attainableGflops(double intensity) const
+    {
+        return std::min(gflops, intensity * gbytes_per_second);
+    }
+
+    MachinePeak MachinePeak::measure(ThreadPool* pool, std::chrono::milliseconds min_time)
+    {
+        BenchmarkOptions options;
+        options.warmup_runs = 1;
+        options.repetitions = 5;
+        options.min_time = min_time;
+
+        MachinePeak peak;
+        peak.threads = pool ? pool->size() : 1;
+        peak.gflops = computePeak(pool, options);
+        peak.gbytes_per_second = bandwidthPeak(pool, options);
+        return peak;
+    }
+
+    double LayerRoofline::gflops() const
+    {
+        return time_ms > 0.0 ? flops / (time_ms * 1e6) : 0.0;
+    }
+
+    double LayerRoofline::intensity() const
+    {
+        return bytes > 0 ? static_cast<double>(flops) / bytes : 0.0;
+    }
+
+    uint64_t RooflineReport::totalFlops() const
+    {
+        uint64_t total = 0;
+        for (const auto& layer : layers)
+        {
+            total += layer.flops;
+        }
+        return total;
+    }
+
+    uint64_t RooflineReport::totalBytes() const
+    {
+        uint64_t total = 0;
+        for (const auto& layer : layers)
+        {
+            total += layer.bytes;
+        }
+        return total;
+    }
+
+    double RooflineReport::percentOfPeak(const LayerRoofline& layer) const
+    {
+        return peak.gflops > 0.0 ? 100.0 * layer.gflops() / peak.gflops : 0.0;
+    }
+
+    double RooflineReport::percentOfRoof(const LayerRoofline& layer) const
+    {
+        const double roof = peak.attainableGflops(layer.intensity());
+        return roof > 0.0 ? 100.0 * layer.gflops() / roof : 0.0;
+    }
+
+    void RooflineReport::print(std::ostream& out) const
+    {
+        char line[200];
+        std::string shape;
+        for (size_t i = 0; i < input_shape.size(); ++i)
+        {
+            shape += (i == 0 ? "" : ",") + std::to_string(input_shape[i]);
+        }
+        std::snprintf(line, sizeof(line),
+                      "input [%s], %zu runs; peak %.1f GFLOP/s and %.1f GB/s on %zu thread(s), ridge %.2f flop/byte\n",
+                      shape.c_str(), runs, peak.gflops, peak.gbytes_per_second, peak.threads, peak.ridgePoint());
+        out << line;
+        std::snprintf(line, sizeof(line), "%-5s %-18s %10s %10s %8s %10s %7s %9s %7s %7s  %s\n", "layer", "pass",
+                      "MFLOP", "KB", "flop/B", "time ms", "share", "GFLOP/s", "%peak", "%roof", "bound");
+        out << line;
+
+        double layer_ms = 0.0;
+        for (const auto& layer : layers)
+        {
+            layer_ms += layer.time_ms;
+        }
+        for (const auto& layer : layers)
+        {
+            std::snprintf(line, sizeof(line), "%-5zu %-18s %10.3f %10.1f %8.2f %10.4f %6.1f%% %9.2f %6.1f%% %6.1f%%  %s\n",
+                          layer.index, layer.name.c_str(), layer.flops / 1e6, layer.bytes / 1024.0, layer.intensity(),
+                          layer.time_ms, layer_ms > 0.0 ? 100.0 * layer.time_ms / layer_ms : 0.0, layer.gflops(),
+                          percentOfPeak(layer), percentOfRoof(layer), memoryBound(layer) ? "memory" : "compute");
+            out << line;
+        }
+
+        // the whole call, engine overhead included
+        LayerRoofline total;
+        total.flops = totalFlops();
+        total.bytes = totalBytes();
+        total.time_ms = total_ms;
+        std::snprintf(line, sizeof(line), "%-5s %-18s %10.3f %10.1f %8.2f %10.4f %7s %9.2f %6.1f%% %6.1f%%  %s\n",
+                      "total", "", total.flops / 1e6, total.bytes / 1024.0, total.intensity(), total.time_ms, "",
+                      total.gflops(), percentOfPeak(total), percentOfRoof(total),
+                      memoryBound(total) ? "memory" : "compute");
+        out << line;
+    }
+
+    void RooflineReport::writeJson(std::ostream& out) const
+    {
+        out << "{\n  \"input_shape\": [";
+        for (size_t i = 0; i < input_shape.size(); ++i)
+        {
+            out << (i == 0 ? "" : ", ") << input_shape[i];
+        }
+        out << "], \"runs\": " << runs << ", \"total_ms\": " << total_ms << ", \"total_flops\": " << totalFlops()
+            << ", \"total_bytes\": " << totalBytes() << ",\n  \"peak\": {\"cpu_tier\": \"" << Kernels::active().name
+            << "\", \"threads\": " << peak.threads << ", \"gflops\": " << peak.gflops
+            << ", \"gbytes_per_second\": " << peak.gbytes_per_second << ", \"ridge_point\": " << peak.ridgePoint()
+            << "},\n  \"layers\": [";
+        for (size_t i = 0; i < layers.size(); ++i)
+        {
+            const LayerRoofline& layer = layers[i];
+            out << (i == 0 ? "\n" : ",\n") << "    {\"index\": " << layer.index << ", \"name\": \"" << layer.name
+                << "\", \"flops\": " << layer.flops << ", \"bytes\": " << layer.bytes << ", \"time_ms\": "
+                << layer.time_ms << ", \"gflops\": " << layer.gflops() << ", \"intensity\": " << layer.intensity()
+                << ", \"percent_of_peak\": " << percentOfPeak(layer) << ", \"percent_of_roof\": "
+                << percentOfRoof(layer) << ", \"bound\": \"" << (memoryBound(layer) ? "memory" : "compute") << "\"}";
+        }
+        out << (layers.empty() ? "]\n}\n" : "\n  ]\n}\n");
+    }
+
+    RooflineReport measureRoofline(const InferenceEngine& engine, const MachinePeak& peak, size_t batch_size,
+                                   size_t runs)
+    {
+        const auto& sample_shape = engine.getInputShape();
+        if (runs == 0 || batch_size == 0)
+        {
+            throw std::invalid_argument("Roofline needs at least one run of at least one sample");
+        }
+        if (batch_size > 1 && sample_shape.size() != 1)
+        {
+            throw std::invalid_argument("Roofline batches need a model with flat inputs");
+        }
+
+        RooflineReport report;
+        report.peak = peak;
+        report.runs = runs;
+        report.input_shape = sample_shape;
+        if (batch_size > 1)
+        {
+            report.input_shape = {batch_size, sample_shape[0]};
+        }
+
+        // a clone profiles without touching the caller's engine
+        InferenceEngine profiled = engine.clone();
+        profiled.enableProfiling(true);
+        ExecutionContext context = profiled.createContext();
+        const std::vector<Tensor> inputs = randomInputs(sample_shape, batch_size);
+        Tensor output(profiled.getOutputShape());
+
+        const auto& layers = profiled.getModel()->getLayers();
+        std::vector<std::vector<double>> layer_ms(layers.size());
+        std::vector<double> total_ms;
+        for (size_t run = 0; run < WARMUP_RUNS + runs; ++run)
+        {
+            if (batch_size > 1)
+            {
+                profiled.predictBatch(inputs, context);
+            }
+            else
+            {
+                profiled.predict(inputs[0], output, context);
+            }
+
+            if (run >= WARMUP_RUNS)
+            {
+                const InferenceStats& stats = context.stats();
+                total_ms.push_back(stats.total_time.count());
+                for (size_t i = 0; i < layers.size(); ++i)
+                {
+                    layer_ms[i].push_back(stats.layer_times[i].count());
+                }
+            }
+        }
+        report.total_ms = median(total_ms);
+
+        // one row per pass, fused layers folded into the layer that applies them
+        std::vector<size_t> shape = report.input_shape;
+        for (size_t i = 0; i < layers.size(); ++i)
+        {
+            const std::vector<size_t> output_shape = layers[i]->outputShape(shape);
+            if (profiled.isFused(i))
+            {
+                LayerRoofline& pass = report.layers.back();
+                pass.name += std::string("+") + layerTypeName(layers[i]->getType());
+                pass.flops += layers[i]->flops(shape);
+                pass.time_ms += median(layer_ms[i]);
+            }
+            else
+            {
+                LayerRoofline pass;
+                pass.index = i;
+                pass.name = layerTypeName(layers[i]->getType());
+                pass.flops = layers[i]->flops(shape);
+                pass.bytes = layers[i]->bytesMoved(shape);
+                pass.time_ms = median(layer_ms[i]);
+                report.layers.push_back(std::move(pass));
+            }
+            shape = output_shape;
+        }
+        return report;
+    }
+
+} // namespace mininn
@@ -0,0 +1,50 @@
+/* scratch_buffer.cpp
+ *
+ * Process wide accounting of the per-thread scratch buffers kernels keep
+ * between calls, for memory reports.
+ */
+
+#include "scratch_buffer.h"
+#include <atomic>
+
+namespace mininn
+{
+    namespace ScratchMemory
+    {
+        namespace
+        {
+            std::atomic<size_t> current(0);
+            std::atomic<size_t> peak(0);
+        }
+
+        size_t bytes()
+        {
+            return current.load(std::memory_order_relaxed);
+        }
+
+        size_t peakBytes()
+        {
+            return peak.load(std::memory_order_relaxed);
+        }
+
+        void add(size_t bytes)
+        {
+            if (bytes == 0)
+            {
+                return;
+            }
+
+            const size_t now = current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+            size_t seen = peak.load(std::memory_order_relaxed);
+            while (now > seen && !peak.compare_exchange_weak(seen, now, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        void release(size_t bytes)
+        {
+            current.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+    }
+
+} // namespace mininn
@@ -6,8 +6,12 @@
  */
 
 #include "tensor.h"
+#include "kernels.h"
 #include <numeric>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
 #include <sstream>
 
 namespace mininn 
@@ -15,19 +19,88 @@ namespace mininn
     // using initialize list to set default values
     Tensor::Tensor()
         : shape_{}
+        , strides_{}
         , total_size_(0)
         , dtype_(DataType::FLOAT32)
         , data_(nullptr)
     {
     }
 
+    const char* dataTypeName(DataType dtype)
+    {
+        switch (dtype)
+        {
+            case DataType::FLOAT32: return "float32";
+            case DataType::INT8: return "int8";
+            case DataType::INT4: return "int4";
+            case DataType::FLOAT16: return "float16";
+            case DataType::BFLOAT16: return "bfloat16";
+        }
+        return "unknown";
+    }
+
+    size_t Tensor::byteSize(DataType dtype, size_t count)
+    {
+        switch (dtype)
+        {
+            case DataType::FLOAT32: return count * sizeof(float);
+            case DataType::INT8: return count;
+            case DataType::INT4: return (count + 1) / 2;
+            case DataType::FLOAT16:
+            case DataType::BFLOAT16: return count * sizeof(uint16_t);
+        }
+        throw std::invalid_argument("Unknown tensor data type");
+    }
+
+    void Tensor::AlignedDelete::operator()(uint8_t* bytes) const
+    {
+        ::operator delete[](bytes, std::align_val_t(ALIGNMENT));
+    }
+
+    void Tensor::allocate()
+    {
+        const size_t bytes = byteSize();
+        if (bytes == 0)
+        {
+            storage_.reset();
+            data_ = nullptr;
+            return;
+        }
+        storage_.reset(static_cast<uint8_t*>(::operator new[](bytes, std::align_val_t(ALIGNMENT))));
+        std::memset(storage_.get(), 0, bytes);
+        data_ = storage_.get();
+    }
+
+    Tensor Tensor::view(float* data, const std::vector<size_t>& shape)
+    {
+        return view(data, shape, DataType::FLOAT32);
+    }
+
+    Tensor Tensor::view(void* data, const std::vector<size_t>& shape, DataType dtype)
+    {
+        if (!data)
+        {
+            throw std::invalid_argument("Cannot create a tensor view over null data");
+        }
+        
+        Tensor tensor;
+        tensor.validateShape(shape);
+        tensor.shape_ = shape;
+        tensor.dtype_ = dtype;
+        tensor.total_size_ = tensor.calculateTotalSize();
+        tensor.calculateStrides();
+        tensor.data_ = data;
+        return tensor;
+    }
+
     Tensor::Tensor(const std::vector<size_t>& shape, DataType dtype)
         : shape_(shape)
         , dtype_(dtype)
     {
         validateShape(shape);
         total_size_ = calculateTotalSize();
-        data_ = std::make_unique<float[]>(total_size_);
+        calculateStrides();
+        allocate();
     }
 
     Tensor::Tensor(const std::vector<size_t>& shape, const std::vector<float>& data, DataType dtype)
@@ -36,45 +109,77 @@ namespace mininn
     {
         validateShape(shape);
         total_size_ = calculateTotalSize();
+        calculateStrides();
         
         if (data.size() != total_size_) 
         {
             throw std::invalid_argument("Data size does not match tensor shape");
         }
         
-        data_ = std::make_unique<float[]>(total_size_);
-        std::copy(data.begin(), data.end(), data_.get());
+        // the values are given as floats, anything else is converted on the way in
+        if (dtype_ == DataType::FLOAT32)
+        {
+            allocate();
+            std::copy(data.begin(), data.end(), static_cast<float*>(data_));
+        }
+        else
+        {
+            *this = Tensor::view(const_cast<float*>(data.data()), shape, DataType::FLOAT32).to(dtype);
+        }
     }
 
     Tensor::Tensor(const Tensor& other)
         : shape_(other.shape_)
+        , strides_(other.strides_)
         , total_size_(other.total_size_)
         , dtype_(other.dtype_)
+        , data_(nullptr)
     {
-        data_ = std::make_unique<float[]>(total_size_);
-        std::copy(other.data_.get(), other.data_.get() + total_size_, data_.get());
+        if (other.data_)
+        {
+            allocate();
+            std::memcpy(data_, other.data_, byteSize());
+        }
     }
 
     Tensor& Tensor::operator=(const Tensor& other)
     {
         if (this != &other) 
         {
+            // keep our buffer when it already holds the same kind and number of elements
+            // (and keep writing through views)
+            const bool reuse = data_ && other.data_ && total_size_ == other.total_size_ && dtype_ == other.dtype_;
             shape_ = other.shape_;
+            strides_ = other.strides_;
             total_size_ = other.total_size_;
             dtype_ = other.dtype_;
-            data_ = std::make_unique<float[]>(total_size_);
+            if (!reuse)
+            {
+                storage_.reset();
+                data_ = nullptr;
+                if (other.data_)
+                {
+                    allocate();
+                }
+            }
             // starts copying contents from other's data addresses in memory to this tensor's data addresses
-            std::copy(other.data_.get(), other.data_.get() + total_size_, data_.get());
+            if (other.data_)
+            {
+                std::memcpy(data_, other.data_, byteSize());
+            }
         }
         return *this;
     }
 
     Tensor::Tensor(Tensor&& other) noexcept
         : shape_(std::move(other.shape_))
+        , strides_(std::move(other.strides_))
         , total_size_(other.total_size_)
         , dtype_(other.dtype_)
-        , data_(std::move(other.data_))
+        , storage_(std::move(other.storage_))
+        , data_(other.data_)
     {
+        other.data_ = nullptr;
     }
 
     Tensor& Tensor::operator=(Tensor&& other) noexcept
@@ -82,25 +187,151 @@ namespace mininn
         if (this != &other) 
         {
             shape_ = std::move(other.shape_);
+            strides_ = std::move(other.strides_);
             total_size_ = other.total_size_;
             dtype_ = other.dtype_;
-            data_ = std::move(other.data_);
+            storage_ = std::move(other.storage_);
+            data_ = other.data_;
+            other.data_ = nullptr;
         }
         return *this;
     }
 
+    namespace
+    {
+        // float -> int8 / int4 value casts: round half away from zero, then saturate
+        template<int LO, int HI>
+        int roundSaturate(float value)
+        {
+            if (std::isnan(value))
+            {
+                return 0;
+            }
+            return static_cast<int>(std::lround(std::clamp(value, static_cast<float>(LO), static_cast<float>(HI))));
+        }
+
+        // converts count elements starting at element first (even for INT4) to float
+        void toFloat(const void* src, DataType dtype, size_t first, size_t count, float* dst)
+        {
+            const KernelTable& kernels = Kernels::active();
+            switch (dtype)
+            {
+                case DataType::FLOAT32:
+                    std::memcpy(dst, static_cast<const float*>(src) + first, count * sizeof(float));
+                    break;
+                case DataType::FLOAT16:
+                    kernels.fp16_to_fp32(static_cast<const uint16_t*>(src) + first, dst, count);
+                    break;
+                case DataType::BFLOAT16:
+                    kernels.bf16_to_fp32(static_cast<const uint16_t*>(src) + first, dst, count);
+                    break;
+                case DataType::INT8:
+                {
+                    const int8_t* values = static_cast<const int8_t*>(src) + first;
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        dst[i] = static_cast<float>(values[i]);
+                    }
+                    break;
+                }
+                case DataType::INT4:
+                {
+                    const uint8_t* bytes = static_cast<const uint8_t*>(src) + first / 2;
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        const uint8_t nibble = (i % 2 == 0 ? bytes[i / 2] : bytes[i / 2] >> 4) & 0x0f;
+                        dst[i] = static_cast<float>(static_cast<int>(nibble ^ 0x08) - 8);   // sign extend
+                    }
+                    break;
+                }
+            }
+        }
+
+        void fromFloat(const float* src, size_t count, void* dst, DataType dtype, size_t first)
+        {
+            const KernelTable& kernels = Kernels::active();
+            switch (dtype)
+            {
+                case DataType::FLOAT32:
+                    std::memcpy(static_cast<float*>(dst) + first, src, count * sizeof(float));
+                    break;
+                case DataType::FLOAT16:
+                    kernels.fp32_to_fp16(src, static_cast<uint16_t*>(dst) + first, count);
+                    break;
+                case DataType::BFLOAT16:
+                    kernels.fp32_to_bf16(src, static_cast<uint16_t*>(dst) + first, count);
+                    break;
+                case DataType::INT8:
+                {
+                    int8_t* values = static_cast<int8_t*>(dst) + first;
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        values[i] = static_cast<int8_t>(roundSaturate<-128, 127>(src[i]));
+                    }
+                    break;
+                }
+                case DataType::INT4:
+                {
+                    uint8_t* bytes = static_cast<uint8_t*>(dst) + first / 2;
+                    for (size_t i = 0; i < count; i += 2)
+                    {
+                        const int lo = roundSaturate<-8, 7>(src[i]);
+                        const int hi = i + 1 < count ? roundSaturate<-8, 7>(src[i + 1]) : 0;
+                        bytes[i / 2] = static_cast<uint8_t>((lo & 0x0f) | ((hi & 0x0f) << 4));
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    Tensor Tensor::to(DataType dtype) const
+    {
+        if (dtype == dtype_)
+        {
+            return *this;
+        }
+        if (!data_)
+        {
+            throw std::invalid_argument("Cannot convert an empty tensor");
+        }
+        
+        Tensor result(shape_, dtype);
+        if (dtype_ == DataType::FLOAT32)
+        {
+            fromFloat(static_cast<const float*>(data_), total_size_, result.data_, dtype, 0);
+        }
+        else if (dtype == DataType::FLOAT32)
+        {
+            toFloat(data_, dtype_, 0, total_size_, static_cast<float*>(result.data_));
+        }
+        else
+        {
+            // everything else goes through float, a chunk at a time so the staging stays in l1
+            constexpr size_t CHUNK = 1024;    // even, so int4 chunks start on a byte
+            float staging[CHUNK];
+            for (size_t first = 0; first < total_size_; first += CHUNK)
+            {
+                const size_t count = std::min(CHUNK, total_size_ - first);
+                toFloat(data_, dtype_, first, count, staging);
+                fromFloat(staging, count, result.data_, dtype, first);
+            }
+        }
+        return result;
+    }
+
     // can modify returned value
     float& Tensor::at(const std::vector<size_t>& indices)
     {
         size_t idx = calculateIndex(indices);
-        return data_[idx];
+        return data<float>()[idx];
     }
 
     // cannot modify returned value
     const float& Tensor::at(const std::vector<size_t>& indices) const
     {
         size_t idx = calculateIndex(indices);
-        return data_[idx];
+        return data<float>()[idx];
     }
 
     void Tensor::reshape(const std::vector<size_t>& new_shape)
@@ -114,6 +345,7 @@ namespace mininn
         }
         
         shape_ = new_shape;
+        calculateStrides();
     }
 
     // validate every dimension is not zero and shape is not empty
@@ -148,12 +380,9 @@ namespace mininn
         }
         
         size_t index = 0;
-        size_t multiplier = 1;
-        // cast to int to exit loop
-        for (int i = static_cast<int>(indices.size()) - 1; i >= 0; --i)
+        for (size_t i = 0; i < indices.size(); ++i)
         {
-            index += indices[i] * multiplier;
-            multiplier *= shape_[i];
+            index += indices[i] * strides_[i];
         }
         
         return index;
@@ -166,6 +395,19 @@ namespace mininn
                               1ULL, std::multiplies<size_t>());
     }
 
+    // row-major strides -> last dimension is contiguous
+    void Tensor::calculateStrides()
+    {
+        strides_.resize(shape_.size());
+        size_t stride = 1;
+        // cast to int to exit loop
+        for (int i = static_cast<int>(shape_.size()) - 1; i >= 0; --i)
+        {
+            strides_[i] = stride;
+            stride *= shape_[i];
+        }
+    }
+
     Tensor& Tensor::operator+=(const Tensor& other)
     {
         if (shape_ != other.shape_)
@@ -173,9 +415,11 @@ namespace mininn
             throw std::invalid_argument("Tensor shapes must match for addition");
         }
         
+        float* lhs = data<float>();
+        const float* rhs = other.data<float>();
         for (size_t i = 0; i < total_size_; ++i)
         {
-            data_[i] += other.data_[i];
+            lhs[i] += rhs[i];
         }
         return *this;
     }
@@ -187,9 +431,11 @@ namespace mininn
             throw std::invalid_argument("Tensor shapes must match for subtraction");
         }
         
+        float* lhs = data<float>();
+        const float* rhs = other.data<float>();
         for (size_t i = 0; i < total_size_; ++i)
         {
-            data_[i] -= other.data_[i];
+            lhs[i] -= rhs[i];
         }
         return *this;
     }
@@ -201,9 +447,11 @@ namespace mininn
             throw std::invalid_argument("Tensor shapes must match for element-wise multiplication");
         }
         
+        float* lhs = data<float>();
+        const float* rhs = other.data<float>();
         for (size_t i = 0; i < total_size_; ++i)
         {
-            data_[i] *= other.data_[i];
+            lhs[i] *= rhs[i];
         }
         return *this;
     }
@@ -215,13 +463,15 @@ namespace mininn
             throw std::invalid_argument("Tensor shapes must match for element-wise division");
         }
         
+        float* lhs = data<float>();
+        const float* rhs = other.data<float>();
         for (size_t i = 0; i < total_size_; ++i)
         {
-            if (other.data_[i] == 0.0f)
+            if (rhs[i] == 0.0f)
             {
                 throw std::invalid_argument("Division by zero");
             }
-            data_[i] /= other.data_[i];
+            lhs[i] /= rhs[i];
         }
         return *this;
     }
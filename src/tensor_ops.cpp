@@ -4,38 +4,60 @@
  */
 
 #include "tensor_ops.h"
+#include "gemm.h"
+#include "kernels.h"
 #include <stdexcept>
 #include <string>
 #include <cmath>
 
 namespace mininn
 {
-    void TensorOps::matmul(const Tensor& tensor1, const Tensor& tensor2, Tensor& result)
+    namespace
     {
         // tensor1 dimensions are m x n and tensor2 dimensions are n x p -> result dimensions are m x p
-        if (tensor1.rank() != 2 || tensor2.rank() != 2)
+        // result is only reallocated when it can't already hold that
+        void prepareMatmul(const Tensor& tensor1, const Tensor& tensor2, Tensor& result)
         {
-            throw std::invalid_argument("Matrix multiplication requires 2D tensors");
-        }
+            if (tensor1.rank() != 2 || tensor2.rank() != 2)
+            {
+                throw std::invalid_argument("Matrix multiplication requires 2D tensors");
+            }
 
-        const std::vector<size_t> shape1 = tensor1.shape();  // m x n
-        const std::vector<size_t> shape2 = tensor2.shape();  // n x p
+            const std::vector<size_t>& shape1 = tensor1.shape();  // m x n
+            const std::vector<size_t>& shape2 = tensor2.shape();  // n x p
 
-        if (shape1[1] != shape2[0])
-        {
-            throw std::invalid_argument(
-                "Inner dimensions must match for matrix multiplication: " +
-                std::to_string(shape1[1]) + " != " + std::to_string(shape2[0])
-            );
+            if (shape1[1] != shape2[0])
+            {
+                throw std::invalid_argument(
+                    "Inner dimensions must match for matrix multiplication: " +
+                    std::to_string(shape1[1]) + " != " + std::to_string(shape2[0])
+                );
+            }
+
+            if (result.rank() != 2 || result.shape()[0] != shape1[0] || result.shape()[1] != shape2[1])
+            {
+                result = Tensor({shape1[0], shape2[1]});
+            }
         }
+    }
 
-        const size_t m = shape1[0];
-        const size_t n = shape1[1];
-        const size_t p = shape2[1];
+    void TensorOps::matmul(const Tensor& tensor1, const Tensor& tensor2, Tensor& result, ThreadPool* pool)
+    {
+        prepareMatmul(tensor1, tensor2, result);
 
-        // create result tensor with correct dimensions
-        result = Tensor({m, p});
+        const size_t m = tensor1.shape()[0];
+        const size_t n = tensor1.shape()[1];
+        const size_t p = tensor2.shape()[1];
+        Gemm::sgemm(m, p, n, tensor1.data(), n, tensor2.data(), p, result.data(), p, pool);
+    }
+
+    void TensorOps::matmul_reference(const Tensor& tensor1, const Tensor& tensor2, Tensor& result)
+    {
+        prepareMatmul(tensor1, tensor2, result);
 
+        const size_t m = tensor1.shape()[0];
+        const size_t n = tensor1.shape()[1];
+        const size_t p = tensor2.shape()[1];
         for (size_t i = 0; i < m; ++i)
         {
             for (size_t j = 0; j < p; ++j)
@@ -43,35 +65,22 @@ namespace mininn
                 float sum = 0.0f;
                 for (size_t k = 0; k < n; ++k)
                 {
-                    sum += tensor1.at({i, k}) * tensor2.at({k, j});
+                    sum += tensor1(i, k) * tensor2(k, j);
                 }
-                result.at({i, j}) = sum;
+                result(i, j) = sum;
             }
         }
     }
 
-    // void TensorOps::matmul_optimized(const Tensor& tensor1, const Tensor& tensor2, Tensor& result)
-    // {
-    //     // TODO: implement optimized matrix multiplication (cache friendly version)
-    // }
-
+    // activations go through the kernel registry so they run on the best available simd tier
     void TensorOps::relu(Tensor& tensor)
     {
-        for (size_t i = 0; i < tensor.size(); ++i)
-        {
-            if (tensor.data()[i] < 0.0f)
-            {
-                tensor.data()[i] = 0.0f;
-            }
-        }
+        Kernels::active().relu(tensor.data(), tensor.size());
     }
 
     void TensorOps::sigmoid(Tensor& tensor)
     {
-        for (size_t i = 0; i < tensor.size(); ++i)
-        {
-            tensor.data()[i] = 1.0f / (1.0f + std::exp(-tensor.data()[i]));
-        }
+        Kernels::active().sigmoid(tensor.data(), tensor.size());
     }
 
     void TensorOps::softmax(Tensor& tensor)
@@ -81,25 +90,22 @@ namespace mininn
             throw std::invalid_argument("Cannot compute Softmax on empty tensor");
         }
 
-        // find max val to prevent overflow
-        float max_val = tensor.data()[0];
-        for (size_t i = 1; i < tensor.size(); ++i)
-        {
-            max_val = std::max(max_val, tensor.data()[i]);
-        }
+        Kernels::active().softmax(tensor.data(), tensor.size());
+    }
 
-        // exp(x - max_val) for each element then sum
-        float sum = 0.0f;
-        for (size_t i = 0; i < tensor.size(); ++i)
+    void TensorOps::softmax_rows(Tensor& tensor)
+    {
+        if (tensor.size() == 0)
         {
-            tensor.data()[i] = std::exp(tensor.data()[i] - max_val);
-            sum += tensor.data()[i];
+            throw std::invalid_argument("Cannot compute Softmax on empty tensor");
         }
 
-        const float inverse_sum = 1.0f / sum;
-        for (size_t i = 0; i < tensor.size(); ++i)
+        const size_t row_size = tensor.shape().back();
+        const size_t rows = tensor.size() / row_size;
+        const KernelTable& kernels = Kernels::active();
+        for (size_t row = 0; row < rows; ++row)
         {
-            tensor.data()[i] *= inverse_sum;
+            kernels.softmax(tensor.data() + row * row_size, row_size);
         }
     }
 } // namespace mininn
\ No newline at end of file
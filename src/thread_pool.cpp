@@ -0,0 +1,256 @@
+/* thread_pool.cpp
+ *
+ * Implementation of the work-stealing ThreadPool used for batch partitioning
+ * and for splitting large GEMMs across cores.
+ */
+
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace mininn
+{
+    namespace
+    {
+        // which pool (and which of its deques) the current thread belongs to
+        thread_local const ThreadPool* current_pool = nullptr;
+        thread_local size_t current_index = SIZE_MAX;
+
+        void pinToCore(std::thread& thread, size_t core)
+        {
+#ifdef __linux__
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(core % ThreadPool::hardwareThreads(), &cpus);
+            // best effort: containers may forbid changing affinity
+            pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpus);
+#else
+            (void)thread;
+            (void)core;
+#endif
+        }
+    }
+
+    ThreadPool::ThreadPool(size_t num_threads, bool pin_threads)
+        : pending_(0), next_queue_(0), stopping_(false)
+    {
+        if (num_threads == 0)
+        {
+            num_threads = hardwareThreads();
+        }
+
+        const size_t num_workers = num_threads - 1;
+        queues_.reserve(num_workers);
+        for (size_t i = 0; i < num_workers; ++i)
+        {
+            queues_.push_back(std::make_unique<WorkQueue>());
+        }
+
+        workers_.reserve(num_workers);
+        for (size_t i = 0; i < num_workers; ++i)
+        {
+            workers_.emplace_back([this, i] { workerLoop(i); });
+            if (pin_threads)
+            {
+                // core 0 is left to the calling thread
+                pinToCore(workers_.back(), i + 1);
+            }
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+
+        for (auto& worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    size_t ThreadPool::hardwareThreads()
+    {
+        const unsigned int count = std::thread::hardware_concurrency();
+        return count == 0 ? 1 : count;
+    }
+
+    void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        // a few chunks per thread so stealing can even out uneven work
+        grain = std::max<size_t>(grain, 1);
+        const size_t max_chunks = size() * 4;
+        const size_t num_chunks = std::min((count + grain - 1) / grain, max_chunks);
+
+        if (num_chunks <= 1 || workers_.empty())
+        {
+            fn(0, count);
+            return;
+        }
+
+        const size_t chunk_size = (count + num_chunks - 1) / num_chunks;
+
+        std::atomic<size_t> remaining(0);
+        std::exception_ptr error;
+        std::mutex error_mutex;
+
+        auto run_chunk = [&](size_t begin)
+        {
+            try
+            {
+                fn(begin, std::min(begin + chunk_size, count));
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+            remaining.fetch_sub(1, std::memory_order_acq_rel);
+        };
+
+        // chunk 0 stays on the calling thread, the rest go to the deques
+        for (size_t begin = chunk_size; begin < count; begin += chunk_size)
+        {
+            remaining.fetch_add(1, std::memory_order_relaxed);
+            submit([&run_chunk, begin] { run_chunk(begin); });
+        }
+
+        remaining.fetch_add(1, std::memory_order_relaxed);
+        run_chunk(0);
+
+        // help with queued work (ours or anyone's) instead of blocking
+        while (remaining.load(std::memory_order_acquire) > 0)
+        {
+            if (!runPendingTask())
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    void ThreadPool::submit(Task task)
+    {
+        size_t target = currentQueue();
+        if (target == SIZE_MAX)
+        {
+            target = next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+        }
+
+        {
+            // count the task before any worker can take it (and decrement), so pending_ never wraps below
+            // zero; under the sleep mutex so a worker can't miss the wakeup
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            pending_.fetch_add(1, std::memory_order_release);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+            queues_[target]->tasks.push_back(std::move(task));
+        }
+        wake_.notify_one();
+    }
+
+    void ThreadPool::workerLoop(size_t index)
+    {
+        current_pool = this;
+        current_index = index;
+
+        while (true)
+        {
+            Task task;
+            if (tryPop(index, task) || trySteal(index, task))
+            {
+                pending_.fetch_sub(1, std::memory_order_acq_rel);
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            wake_.wait(lock, [this] { return stopping_ || pending_.load(std::memory_order_acquire) > 0; });
+            if (stopping_ && pending_.load(std::memory_order_acquire) == 0)
+            {
+                return;
+            }
+        }
+    }
+
+    bool ThreadPool::tryPop(size_t index, Task& task)
+    {
+        WorkQueue& queue = *queues_[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+        {
+            return false;
+        }
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool ThreadPool::trySteal(size_t thief, Task& task)
+    {
+        const size_t num_queues = queues_.size();
+        const size_t start = thief == SIZE_MAX ? 0 : thief + 1;
+
+        for (size_t offset = 0; offset < num_queues; ++offset)
+        {
+            const size_t victim = (start + offset) % num_queues;
+            if (victim == thief)
+            {
+                continue;
+            }
+
+            WorkQueue& queue = *queues_[victim];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty())
+            {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ThreadPool::runPendingTask()
+    {
+        const size_t self = currentQueue();
+
+        Task task;
+        if ((self != SIZE_MAX && tryPop(self, task)) || trySteal(self, task))
+        {
+            pending_.fetch_sub(1, std::memory_order_acq_rel);
+            task();
+            return true;
+        }
+        return false;
+    }
+
+    size_t ThreadPool::currentQueue() const
+    {
+        return current_pool == this ? current_index : SIZE_MAX;
+    }
+
+} // namespace mininn
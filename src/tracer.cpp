@@ -0,0 +1,167 @@
+/* tracer.cpp
+ *
+ * Ring buffer of complete trace events and their Chrome trace-event JSON
+ * form. Slot i % capacity holds event i; its sequence number says which
+ * event that is, so the writer can put the kept events back in order.
+ */
+
+#include "tracer.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace mininn
+{
+    namespace
+    {
+        std::atomic<uint32_t> next_thread_id(1);
+
+        int64_t nanosecondsBetween(Tracer::Clock::time_point from, Tracer::Clock::time_point to)
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+        }
+
+        // chrome wants microseconds, keep the nanoseconds as decimals
+        void writeMicroseconds(std::ostream& out, int64_t nanoseconds)
+        {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.3f", static_cast<double>(nanoseconds) / 1000.0);
+            out << buffer;
+        }
+    }
+
+    Tracer::Tracer(size_t capacity)
+        : capacity_(capacity), next_(0), epoch_(Clock::now())
+    {
+        if (capacity_ == 0)
+        {
+            throw std::invalid_argument("Tracer capacity must be positive");
+        }
+        events_.reset(new Event[capacity_]);
+    }
+
+    uint32_t Tracer::currentThreadId()
+    {
+        thread_local const uint32_t id = next_thread_id.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    void Tracer::record(const char* name, const char* category, Clock::time_point start, Clock::time_point end,
+                        const char* args)
+    {
+        record(name, category, start, end, args, currentThreadId());
+    }
+
+    void Tracer::record(const char* name, const char* category, Clock::time_point start, Clock::time_point end,
+                        const char* args, uint32_t thread_id)
+    {
+        const uint64_t index = next_.fetch_add(1, std::memory_order_relaxed);
+        Event& event = events_[index % capacity_];
+
+        event.name = name;
+        event.category = category;
+        // work that started before the tracer did (e.g. a request queued earlier) is clipped to its start
+        event.start_ns = std::max<int64_t>(nanosecondsBetween(epoch_, start), 0);
+        event.duration_ns = std::max<int64_t>(nanosecondsBetween(epoch_, end) - event.start_ns, 0);
+        event.thread_id = thread_id;
+        const size_t args_length = args ? std::strlen(args) : 0;
+        if (args_length < ARGS_SIZE)
+        {
+            std::memcpy(event.args, args ? args : "", args_length + 1);
+        }
+        else
+        {
+            event.args[0] = '\0';
+        }
+        event.sequence.store(index + 1, std::memory_order_release);
+    }
+
+    size_t Tracer::size() const
+    {
+        return static_cast<size_t>(std::min<uint64_t>(next_.load(std::memory_order_relaxed), capacity_));
+    }
+
+    size_t Tracer::dropped() const
+    {
+        const uint64_t recorded = next_.load(std::memory_order_relaxed);
+        return recorded > capacity_ ? static_cast<size_t>(recorded - capacity_) : 0;
+    }
+
+    void Tracer::clear()
+    {
+        for (size_t i = 0; i < capacity_; ++i)
+        {
+            events_[i].sequence.store(0, std::memory_order_relaxed);
+        }
+        next_.store(0, std::memory_order_relaxed);
+    }
+
+    void Tracer::writeJson(std::ostream& out) const
+    {
+        // oldest kept event first
+        std::vector<const Event*> ordered;
+        ordered.reserve(size());
+        for (size_t i = 0; i < capacity_; ++i)
+        {
+            if (events_[i].sequence.load(std::memory_order_acquire) != 0)
+            {
+                ordered.push_back(&events_[i]);
+            }
+        }
+        std::sort(ordered.begin(), ordered.end(), [](const Event* a, const Event* b)
+        {
+            return a->sequence.load(std::memory_order_relaxed) < b->sequence.load(std::memory_order_relaxed);
+        });
+
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        for (size_t i = 0; i < ordered.size(); ++i)
+        {
+            const Event& event = *ordered[i];
+            out << (i == 0 ? "\n" : ",\n")
+                << "{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread_id << ",\"ts\":";
+            writeMicroseconds(out, event.start_ns);
+            out << ",\"dur\":";
+            writeMicroseconds(out, event.duration_ns);
+            out << ",\"args\":{" << event.args << "}}";
+        }
+        out << "\n]}\n";
+    }
+
+    void Tracer::saveJson(const std::string& filepath) const
+    {
+        std::ofstream file(filepath);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Failed to open file for writing: " + filepath);
+        }
+
+        writeJson(file);
+        if (!file.good())
+        {
+            throw std::runtime_error("Failed to write trace to: " + filepath);
+        }
+    }
+
+    void TraceSpan::setArgs(const char* format, ...)
+    {
+        if (!tracer_)
+        {
+            return;
+        }
+
+        va_list list;
+        va_start(list, format);
+        const int length = std::vsnprintf(args_, sizeof(args_), format, list);
+        va_end(list);
+        if (length < 0 || static_cast<size_t>(length) >= sizeof(args_))
+        {
+            args_[0] = '\0';
+        }
+    }
+
+} // namespace mininn
@@ -0,0 +1,204 @@
+/* benchmark_test.cpp
+ *
+ * Tests for the micro-benchmark runner: repetition statistics, calibration,
+ * filtering, the JSON it writes and reads back, and baseline comparison.
+ */
+
+#include <gtest/gtest.h>
+#include "benchmark.h"
+#include <cmath>
+#include <sstream>
+
+using namespace mininn;
+
+TEST(BenchmarkTest, Statistics)
+{
+    BenchmarkResult result;
+    EXPECT_EQ(result.median(), 0.0);
+    EXPECT_EQ(result.gflops(), 0.0);
+
+    result.samples = {40.0, 10.0, 30.0, 20.0};
+    result.flops_per_op = 100;
+    result.bytes_per_op = 50;
+    EXPECT_DOUBLE_EQ(result.median(), 25.0);
+    EXPECT_DOUBLE_EQ(result.mean(), 25.0);
+    EXPECT_DOUBLE_EQ(result.min(), 10.0);
+    EXPECT_DOUBLE_EQ(result.max(), 40.0);
+    EXPECT_NEAR(result.stddev(), std::sqrt(500.0 / 3.0), 1e-9);
+    EXPECT_DOUBLE_EQ(result.gflops(), 4.0);            // 100 flops in 25 ns
+    EXPECT_DOUBLE_EQ(result.gbytesPerSecond(), 2.0);
+
+    result.samples.push_back(1000.0);
+    EXPECT_DOUBLE_EQ(result.median(), 30.0);
+}
+
+TEST(BenchmarkTest, RunsRepetitionsOfCalibratedBatches)
+{
+    BenchmarkOptions options;
+    options.repetitions = 4;
+    options.warmup_runs = 1;
+    options.min_time = std::chrono::milliseconds(1);
+    BenchmarkSuite suite(options);
+
+    size_t calls = 0;
+    volatile double sink = 0.0;
+    EXPECT_TRUE(suite.run("spin", 64, 0, [&]
+    {
+        ++calls;
+        for (int i = 0; i < 64; ++i)
+        {
+            sink = sink + 1.0;
+        }
+    }));
+
+    ASSERT_EQ(suite.results().size(), 1U);
+    const BenchmarkResult& result = suite.results()[0];
+    EXPECT_EQ(result.name, "spin");
+    EXPECT_EQ(result.samples.size(), 4U);
+    EXPECT_GT(result.iterations, 1U);
+    EXPECT_GE(calls, (options.repetitions + options.warmup_runs) * result.iterations);
+    for (double sample : result.samples)
+    {
+        EXPECT_GT(sample, 0.0);
+    }
+    EXPECT_GT(result.gflops(), 0.0);
+
+    EXPECT_THROW(BenchmarkSuite(BenchmarkOptions{0, 0, std::chrono::milliseconds(1), ""}), std::invalid_argument);
+}
+
+TEST(BenchmarkTest, FilterAndJson)
+{
+    BenchmarkOptions options;
+    options.repetitions = 2;
+    options.min_time = std::chrono::milliseconds(0);
+    options.filter = "relu";
+    BenchmarkSuite suite(options);
+
+    bool ran = false;
+    EXPECT_FALSE(suite.run("matmul/64", 1, 1, [&] { ran = true; }));
+    EXPECT_FALSE(ran);
+    EXPECT_TRUE(suite.run("relu/\"1K\"", 1, 8, [] {}));
+
+    std::ostringstream out;
+    suite.writeJson(out);
+    const std::string json = out.str();
+    EXPECT_NE(json.find("\"repetitions\": 2"), std::string::npos);
+    EXPECT_NE(json.find("{\"name\": \"relu/\\\"1K\\\"\", \"iterations\": "), std::string::npos);
+    EXPECT_NE(json.find("\"bytes_per_op\": 8"), std::string::npos);
+    EXPECT_NE(json.find("\"ns_per_op\": {\"median\": "), std::string::npos);
+    EXPECT_EQ(json.find("matmul"), std::string::npos);
+}
+
+TEST(BenchmarkTest, MedianConfidenceInterval)
+{
+    BenchmarkResult result;
+    for (int i = 10; i >= 1; --i)
+    {
+        result.samples.push_back(i);
+    }
+
+    // floor(5 - 1.96 * sqrt(10) / 2) -> 0 based index 1, and mirrored from the top index 8
+    EXPECT_DOUBLE_EQ(result.medianLow(), 2.0);
+    EXPECT_DOUBLE_EQ(result.medianHigh(), 9.0);
+    EXPECT_LE(result.medianLow(), result.median());
+    EXPECT_GE(result.medianHigh(), result.median());
+
+    result.samples = {7.0};
+    EXPECT_DOUBLE_EQ(result.medianLow(), 7.0);
+    EXPECT_DOUBLE_EQ(result.medianHigh(), 7.0);
+}
+
+TEST(BenchmarkTest, JsonRoundTrip)
+{
+    BenchmarkOptions options;
+    options.repetitions = 5;
+    options.min_time = std::chrono::milliseconds(0);
+    options.filter = "a/,c/";
+    BenchmarkSuite suite(options);
+    EXPECT_TRUE(suite.run("a/1", 10, 20, [] {}));
+    EXPECT_FALSE(suite.run("b/1", 10, 20, [] {}));
+    EXPECT_TRUE(suite.run("c/\"q\"", 0, 0, [] {}));
+
+    std::stringstream json;
+    suite.writeJson(json);
+    const std::vector<BenchmarkResult> read = BenchmarkSuite::readJson(json);
+
+    ASSERT_EQ(read.size(), 2U);
+    EXPECT_EQ(read[0].name, "a/1");
+    EXPECT_EQ(read[0].flops_per_op, 10U);
+    EXPECT_EQ(read[0].bytes_per_op, 20U);
+    EXPECT_EQ(read[0].iterations, suite.results()[0].iterations);
+    ASSERT_EQ(read[0].samples.size(), 5U);
+    EXPECT_NEAR(read[0].median(), suite.results()[0].median(), 1e-5 * suite.results()[0].median());
+    EXPECT_EQ(read[1].name, "c/\"q\"");
+
+    // a bare median is enough for a hand written baseline
+    std::istringstream minimal("{\"benchmarks\": [{\"name\": \"x\", \"ns_per_op\": {\"median\": 12.5}}], \"ok\": true}");
+    const std::vector<BenchmarkResult> bare = BenchmarkSuite::readJson(minimal);
+    ASSERT_EQ(bare.size(), 1U);
+    EXPECT_DOUBLE_EQ(bare[0].median(), 12.5);
+
+    for (const char* bad : {"", "{\"benchmarks\": [", "{\"benchmarks\": 3}", "{\"benchmarks\": [{\"name\": \"x\"}]}",
+                            "{\"benchmarks\": []} x"})
+    {
+        std::istringstream in(bad);
+        EXPECT_THROW(BenchmarkSuite::readJson(in), std::runtime_error) << bad;
+    }
+    EXPECT_THROW(BenchmarkSuite::loadJson("does_not_exist.json"), std::runtime_error);
+}
+
+TEST(BenchmarkTest, ComparisonNeedsThresholdAndSeparation)
+{
+    auto make = [](const std::string& name, std::vector<double> samples)
+    {
+        BenchmarkResult result;
+        result.name = name;
+        result.samples = std::move(samples);
+        return result;
+    };
+
+    const std::vector<BenchmarkResult> baseline = {
+        make("steady", {100, 101, 99, 100, 102, 98, 100}),
+        make("slower", {100, 101, 99, 100, 102, 98, 100}),
+        make("faster", {100, 101, 99, 100, 102, 98, 100}),
+        make("noisy", {100, 60, 140, 100, 180, 90, 110}),
+        make("gone", {1}),
+    };
+    const std::vector<BenchmarkResult> current = {
+        make("steady", {104, 105, 103, 104, 106, 102, 104}),    // +4%, under the threshold
+        make("slower", {130, 131, 129, 130, 132, 128, 130}),
+        make("faster", {70, 71, 69, 70, 72, 68, 70}),
+        make("noisy", {130, 70, 160, 120, 200, 100, 125}),      // +20% median, intervals overlap
+        make("added", {5}),
+    };
+
+    const auto comparisons = compareBenchmarks(baseline, current, 0.1);
+    ASSERT_EQ(comparisons.size(), 5U);
+    EXPECT_EQ(comparisons[0].verdict, BenchmarkComparison::Verdict::UNCHANGED);
+    EXPECT_NEAR(comparisons[0].change, 0.04, 1e-12);
+    EXPECT_EQ(comparisons[1].verdict, BenchmarkComparison::Verdict::REGRESSED);
+    EXPECT_DOUBLE_EQ(comparisons[1].baseline_ns, 100.0);
+    EXPECT_DOUBLE_EQ(comparisons[1].current_ns, 130.0);
+    EXPECT_EQ(comparisons[2].verdict, BenchmarkComparison::Verdict::IMPROVED);
+    EXPECT_EQ(comparisons[3].verdict, BenchmarkComparison::Verdict::NOISY);
+    EXPECT_EQ(comparisons[4].verdict, BenchmarkComparison::Verdict::NEW);
+    EXPECT_STREQ(verdictName(comparisons[1].verdict), "REGRESSED");
+
+    // a looser threshold lets the slowdown through
+    EXPECT_EQ(compareBenchmarks(baseline, current, 0.5)[1].verdict, BenchmarkComparison::Verdict::UNCHANGED);
+    EXPECT_THROW(compareBenchmarks(baseline, current, -0.1), std::invalid_argument);
+
+    // the baseline's interval of 1..10 ends at 9, so a run whose interval starts at 9.5 is apart from it
+    std::vector<double> one_to_ten;
+    for (int i = 1; i <= 10; ++i)
+    {
+        one_to_ten.push_back(i);
+    }
+    const auto just_apart = compareBenchmarks({make("edge", one_to_ten)},
+                                              {make("edge", {9.25, 9.5, 10, 11, 12, 13, 14, 15, 16, 17})}, 0.1);
+    EXPECT_EQ(just_apart[0].verdict, BenchmarkComparison::Verdict::REGRESSED);
+
+    std::ostringstream table;
+    printComparison(table, comparisons);
+    EXPECT_NE(table.str().find("+30.0%  REGRESSED"), std::string::npos);
+}
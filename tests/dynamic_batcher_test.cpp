@@ -0,0 +1,235 @@
+/* dynamic_batcher_test.cpp
+ *
+ * Tests for the lock-free MPMC queue and the DynamicBatcher built on it:
+ * coalescing, result scattering, callbacks and shutdown.
+ */
+
+#include <gtest/gtest.h>
+#include "dynamic_batcher.h"
+#include "mpmc_queue.h"
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace mininn;
+
+TEST(MpmcQueueTest, FifoAndCapacity)
+{
+    MpmcQueue<int> queue(5);
+    EXPECT_EQ(queue.capacity(), 8U);
+    EXPECT_TRUE(queue.empty());
+
+    for (int i = 0; i < 8; ++i)
+    {
+        EXPECT_TRUE(queue.tryPush(int(i)));
+    }
+    EXPECT_FALSE(queue.tryPush(8));
+
+    int value = -1;
+    for (int i = 0; i < 8; ++i)
+    {
+        ASSERT_TRUE(queue.tryPop(value));
+        EXPECT_EQ(value, i);
+    }
+    EXPECT_FALSE(queue.tryPop(value));
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(MpmcQueueTest, ConcurrentProducersAndConsumers)
+{
+    // small queue so producers keep lapping the consumers
+    MpmcQueue<size_t> queue(16);
+    const size_t num_producers = 3;
+    const size_t per_producer = 20000;
+
+    std::atomic<size_t> sum(0);
+    std::atomic<size_t> popped(0);
+    std::vector<std::thread> threads;
+
+    for (size_t p = 0; p < num_producers; ++p)
+    {
+        threads.emplace_back([&, p]()
+        {
+            for (size_t i = 0; i < per_producer; ++i)
+            {
+                size_t value = p * per_producer + i + 1;
+                while (!queue.tryPush(std::move(value)))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (size_t c = 0; c < 2; ++c)
+    {
+        threads.emplace_back([&]()
+        {
+            size_t value;
+            while (popped.load() < num_producers * per_producer)
+            {
+                if (queue.tryPop(value))
+                {
+                    sum.fetch_add(value);
+                    popped.fetch_add(1);
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    const size_t n = num_producers * per_producer;
+    EXPECT_EQ(popped.load(), n);
+    EXPECT_EQ(sum.load(), n * (n + 1) / 2);
+}
+
+class DynamicBatcherTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        std::vector<float> weights(IN * OUT), bias(OUT);
+        for (size_t i = 0; i < weights.size(); ++i) weights[i] = static_cast<float>((i * 7) % 11) / 11.0f - 0.5f;
+        for (size_t i = 0; i < bias.size(); ++i) bias[i] = 0.1f * static_cast<float>(i);
+
+        auto model = std::make_unique<Model>();
+        model->addLayer(std::make_unique<LinearLayer>(Tensor({IN, OUT}, weights), Tensor({OUT}, bias)));
+        model->addLayer(std::make_unique<ReLULayer>());
+        model->setInputShape({IN});
+        model->setOutputShape({OUT});
+        engine_ = std::make_unique<InferenceEngine>(std::move(model));
+    }
+
+    Tensor makeInput(size_t seed) const
+    {
+        std::vector<float> values(IN);
+        for (size_t i = 0; i < IN; ++i)
+        {
+            values[i] = static_cast<float>((seed * 31 + i * 17) % 29) / 29.0f - 0.3f;
+        }
+        return Tensor({IN}, values);
+    }
+
+    static constexpr size_t IN = 32;
+    static constexpr size_t OUT = 8;
+    std::unique_ptr<InferenceEngine> engine_;
+};
+
+TEST_F(DynamicBatcherTest, CoalescesRequestsAndScattersResults)
+{
+    BatchingOptions options;
+    options.max_batch_size = 16;
+    options.max_wait = std::chrono::milliseconds(50);   // long enough that full batches form first
+    DynamicBatcher batcher(*engine_, options);
+
+    const size_t num_requests = 64;
+    std::vector<std::future<Tensor>> futures;
+    for (size_t r = 0; r < num_requests; ++r)
+    {
+        futures.push_back(batcher.submit(makeInput(r)));
+    }
+
+    for (size_t r = 0; r < num_requests; ++r)
+    {
+        Tensor output = futures[r].get();
+        Tensor expected = engine_->predict(makeInput(r));
+        ASSERT_EQ(output.shape(), expected.shape());
+        for (size_t i = 0; i < OUT; ++i)
+        {
+            EXPECT_NEAR(output.data()[i], expected.data()[i], 1e-5f);
+        }
+    }
+
+    EXPECT_EQ(batcher.getNumRequests(), num_requests);
+    EXPECT_GE(batcher.getNumBatches(), num_requests / options.max_batch_size);
+    EXPECT_LT(batcher.getNumBatches(), num_requests);
+}
+
+TEST_F(DynamicBatcherTest, ConcurrentSubmittersWithCallbacks)
+{
+    BatchingOptions options;
+    options.max_batch_size = 8;
+    options.max_wait = std::chrono::microseconds(200);
+    options.queue_capacity = 4;   // submitters have to wait for room
+    DynamicBatcher batcher(*engine_, options);
+
+    const size_t num_threads = 4;
+    const size_t per_thread = 50;
+    std::atomic<size_t> answered(0);
+    std::atomic<size_t> mismatches(0);
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            ExecutionContext context;
+            for (size_t r = 0; r < per_thread; ++r)
+            {
+                const size_t seed = t * per_thread + r;
+                Tensor expected = engine_->predict(makeInput(seed), context);
+                batcher.submit(makeInput(seed), [&, expected](Tensor output, std::exception_ptr error)
+                {
+                    if (error || output.shape() != expected.shape() ||
+                        std::abs(output.data()[0] - expected.data()[0]) > 1e-5f)
+                    {
+                        mismatches.fetch_add(1);
+                    }
+                    answered.fetch_add(1);
+                });
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    while (answered.load() < num_threads * per_thread)
+    {
+        std::this_thread::yield();
+    }
+    EXPECT_EQ(mismatches.load(), 0U);
+    EXPECT_EQ(batcher.getNumRequests(), num_threads * per_thread);
+}
+
+TEST_F(DynamicBatcherTest, DestructorFinishesPendingRequests)
+{
+    std::vector<std::future<Tensor>> futures;
+    {
+        BatchingOptions options;
+        options.max_wait = std::chrono::seconds(10);   // only shutdown can flush a partial batch this soon
+        DynamicBatcher batcher(*engine_, options);
+        for (size_t r = 0; r < 5; ++r)
+        {
+            futures.push_back(batcher.submit(makeInput(r)));
+        }
+    }
+
+    for (auto& future : futures)
+    {
+        ASSERT_EQ(future.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+        EXPECT_EQ(future.get().shape(), std::vector<size_t>({OUT}));
+    }
+}
+
+TEST_F(DynamicBatcherTest, RejectsBadInputs)
+{
+    DynamicBatcher batcher(*engine_);
+
+    EXPECT_THROW(batcher.submit(Tensor({IN + 1})), std::invalid_argument);
+    EXPECT_THROW(batcher.submit(Tensor({IN}, DataType::INT8)), std::invalid_argument);
+    EXPECT_THROW(batcher.submit(makeInput(0), DynamicBatcher::Callback()), std::invalid_argument);
+
+    BatchingOptions options;
+    options.max_batch_size = 0;
+    EXPECT_THROW(DynamicBatcher(*engine_, options), std::invalid_argument);
+}
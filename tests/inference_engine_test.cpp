@@ -7,10 +7,43 @@
 #include <gtest/gtest.h>
 #include "inference_engine.h"
 #include "model_loader.h"
+#include "scratch_buffer.h"
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
 #include <memory>
+#include <new>
+#include <thread>
 
 using namespace mininn;
 
+// count every heap allocation in the test binary so steady-state inference can be checked for zero
+// (kept out of line so gcc doesn't pair the inlined free with operator new and warn)
+namespace
+{
+    std::atomic<size_t> g_allocations(0);
+}
+
+__attribute__((noinline)) void* operator new(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
 class InferenceEngineTest : public ::testing::Test 
 {
 protected:
@@ -114,6 +147,412 @@ TEST_F(InferenceEngineTest, BatchInference)
     }
 }
 
+TEST_F(InferenceEngineTest, BatchMatchesSingleSamplePredict) 
+{
+    // wider model so the batch actually goes through the blocked gemm path
+    const size_t in_features = 37;
+    const size_t hidden = 23;
+    const size_t out_features = 5;
+    
+    std::vector<float> w1(in_features * hidden), b1(hidden), w2(hidden * out_features), b2(out_features);
+    for (size_t i = 0; i < w1.size(); ++i) w1[i] = static_cast<float>((i * 7) % 11) / 11.0f - 0.5f;
+    for (size_t i = 0; i < b1.size(); ++i) b1[i] = static_cast<float>(i % 3) * 0.1f;
+    for (size_t i = 0; i < w2.size(); ++i) w2[i] = static_cast<float>((i * 5) % 13) / 13.0f - 0.5f;
+    for (size_t i = 0; i < b2.size(); ++i) b2[i] = -0.1f * static_cast<float>(i);
+    
+    auto test_model = std::make_unique<Model>();
+    test_model->addLayer(std::make_unique<LinearLayer>(Tensor({in_features, hidden}, w1), Tensor({hidden}, b1)));
+    test_model->addLayer(std::make_unique<ReLULayer>());
+    test_model->addLayer(std::make_unique<LinearLayer>(Tensor({hidden, out_features}, w2), Tensor({out_features}, b2)));
+    test_model->addLayer(std::make_unique<SoftmaxLayer>());
+    test_model->setInputShape({in_features});
+    test_model->setOutputShape({out_features});
+    
+    InferenceEngine engine(std::move(test_model));
+    
+    std::vector<Tensor> inputs;
+    for (size_t b = 0; b < 19; ++b)
+    {
+        std::vector<float> values(in_features);
+        for (size_t i = 0; i < in_features; ++i)
+        {
+            values[i] = static_cast<float>((b * 31 + i * 17) % 29) / 29.0f - 0.3f;
+        }
+        inputs.emplace_back(std::vector<size_t>{in_features}, values);
+    }
+    
+    std::vector<Tensor> outputs = engine.predictBatch(inputs);
+    ASSERT_EQ(outputs.size(), inputs.size());
+    
+    for (size_t b = 0; b < inputs.size(); ++b)
+    {
+        Tensor expected = engine.predict(inputs[b]);
+        ASSERT_EQ(outputs[b].shape(), expected.shape());
+        
+        // softmax must normalize each sample on its own, not across the batch
+        float sum = 0.0f;
+        for (size_t i = 0; i < out_features; ++i)
+        {
+            EXPECT_NEAR(outputs[b].data()[i], expected.data()[i], 1e-5f);
+            sum += outputs[b].data()[i];
+        }
+        EXPECT_NEAR(sum, 1.0f, 1e-5f);
+    }
+}
+
+TEST_F(InferenceEngineTest, MultiThreadedBatchMatchesSingleThreaded) 
+{
+    const size_t in_features = 64;
+    const size_t hidden = 48;
+    const size_t out_features = 10;
+    
+    auto make_model = [&]()
+    {
+        std::vector<float> w1(in_features * hidden), b1(hidden), w2(hidden * out_features), b2(out_features);
+        for (size_t i = 0; i < w1.size(); ++i) w1[i] = static_cast<float>((i * 7) % 11) / 11.0f - 0.5f;
+        for (size_t i = 0; i < b1.size(); ++i) b1[i] = static_cast<float>(i % 3) * 0.1f;
+        for (size_t i = 0; i < w2.size(); ++i) w2[i] = static_cast<float>((i * 5) % 13) / 13.0f - 0.5f;
+        for (size_t i = 0; i < b2.size(); ++i) b2[i] = -0.1f * static_cast<float>(i);
+        
+        auto test_model = std::make_unique<Model>();
+        test_model->addLayer(std::make_unique<LinearLayer>(Tensor({in_features, hidden}, w1), Tensor({hidden}, b1)));
+        test_model->addLayer(std::make_unique<ReLULayer>());
+        test_model->addLayer(std::make_unique<LinearLayer>(Tensor({hidden, out_features}, w2), Tensor({out_features}, b2)));
+        test_model->addLayer(std::make_unique<SoftmaxLayer>());
+        test_model->setInputShape({in_features});
+        test_model->setOutputShape({out_features});
+        return test_model;
+    };
+    
+    InferenceEngine serial_engine(make_model());
+    InferenceEngine threaded_engine(make_model());
+    threaded_engine.setNumThreads(4);
+    threaded_engine.enableProfiling(true);
+    EXPECT_EQ(threaded_engine.getNumThreads(), 4u);
+    
+    // large enough to be split into row slices, then small enough to go through the threaded gemm
+    for (size_t batch_size : {131u, 5u})
+    {
+        std::vector<Tensor> inputs;
+        for (size_t b = 0; b < batch_size; ++b)
+        {
+            std::vector<float> values(in_features);
+            for (size_t i = 0; i < in_features; ++i)
+            {
+                values[i] = static_cast<float>((b * 31 + i * 17) % 29) / 29.0f - 0.3f;
+            }
+            inputs.emplace_back(std::vector<size_t>{in_features}, values);
+        }
+        
+        std::vector<Tensor> expected = serial_engine.predictBatch(inputs);
+        std::vector<Tensor> actual = threaded_engine.predictBatch(inputs);
+        ASSERT_EQ(actual.size(), expected.size());
+        
+        for (size_t b = 0; b < batch_size; ++b)
+        {
+            ASSERT_EQ(actual[b].shape(), expected[b].shape());
+            for (size_t i = 0; i < out_features; ++i)
+            {
+                EXPECT_NEAR(actual[b].data()[i], expected[b].data()[i], 1e-5f);
+            }
+        }
+        
+        EXPECT_EQ(threaded_engine.getLastInferenceStats().layer_times.size(), 4u);
+    }
+    
+    // a pool can be shared, and setting one thread drops it
+    auto shared_pool = std::make_shared<ThreadPool>(2);
+    serial_engine.setThreadPool(shared_pool);
+    EXPECT_EQ(serial_engine.getNumThreads(), 2u);
+    threaded_engine.setNumThreads(1);
+    EXPECT_EQ(threaded_engine.getNumThreads(), 1u);
+}
+
+TEST_F(InferenceEngineTest, SteadyStatePredictDoesNotAllocate) 
+{
+    InferenceEngine engine(std::move(model_));
+    
+    Tensor input({2}, {1.0f, -2.0f});
+    Tensor output(engine.getOutputShape());
+    
+    // first call warms up thread local gemm buffers and the kernel table
+    engine.predict(input, output);
+    Tensor expected = engine.predict(input);
+    
+    for (bool profiling : {false, true})
+    {
+        engine.enableProfiling(profiling);
+        engine.predict(input, output);
+        
+        const size_t before = g_allocations.load();
+        for (int i = 0; i < 10; ++i)
+        {
+            engine.predict(input, output);
+        }
+        EXPECT_EQ(g_allocations.load() - before, 0U) << "profiling=" << profiling;
+    }
+    
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        EXPECT_FLOAT_EQ(output.data()[i], expected.data()[i]);
+    }
+    
+    // after clearBuffers the plan is rebuilt on demand
+    engine.clearBuffers();
+    engine.predict(input, output);
+    EXPECT_FLOAT_EQ(output.data()[0], expected.data()[0]);
+}
+
+TEST_F(InferenceEngineTest, ConcurrentPredictWithContexts) 
+{
+    const size_t in_features = 96;
+    const size_t hidden = 64;
+    const size_t out_features = 10;
+    
+    std::vector<float> w1(in_features * hidden), b1(hidden), w2(hidden * out_features), b2(out_features);
+    for (size_t i = 0; i < w1.size(); ++i) w1[i] = static_cast<float>((i * 7) % 11) / 11.0f - 0.5f;
+    for (size_t i = 0; i < b1.size(); ++i) b1[i] = static_cast<float>(i % 3) * 0.1f;
+    for (size_t i = 0; i < w2.size(); ++i) w2[i] = static_cast<float>((i * 5) % 13) / 13.0f - 0.5f;
+    for (size_t i = 0; i < b2.size(); ++i) b2[i] = -0.1f * static_cast<float>(i);
+    
+    auto test_model = std::make_unique<Model>();
+    test_model->addLayer(std::make_unique<LinearLayer>(Tensor({in_features, hidden}, w1), Tensor({hidden}, b1)));
+    test_model->addLayer(std::make_unique<ReLULayer>());
+    test_model->addLayer(std::make_unique<LinearLayer>(Tensor({hidden, out_features}, w2), Tensor({out_features}, b2)));
+    test_model->addLayer(std::make_unique<SoftmaxLayer>());
+    test_model->setInputShape({in_features});
+    test_model->setOutputShape({out_features});
+    
+    InferenceEngine engine(std::move(test_model));
+    engine.enableProfiling(true);
+    
+    const size_t num_inputs = 24;
+    std::vector<Tensor> inputs;
+    std::vector<Tensor> expected;
+    for (size_t s = 0; s < num_inputs; ++s)
+    {
+        std::vector<float> values(in_features);
+        for (size_t i = 0; i < in_features; ++i)
+        {
+            values[i] = static_cast<float>((s * 31 + i * 17) % 29) / 29.0f - 0.3f;
+        }
+        inputs.emplace_back(std::vector<size_t>{in_features}, values);
+        expected.push_back(engine.predict(inputs.back()));
+    }
+    
+    // every thread brings its own context and shares the engine (and its weights); the last one also
+    // runs batches, and a second round shares a pool that the gemms inside the layers use as well
+    const size_t num_threads = 4;
+    for (bool with_pool : {false, true})
+    {
+        if (with_pool)
+        {
+            engine.setNumThreads(2);
+        }
+        
+        std::vector<ExecutionContext> contexts;
+        for (size_t t = 0; t < num_threads; ++t)
+        {
+            contexts.push_back(engine.createContext());
+        }
+        
+        std::atomic<size_t> mismatches(0);
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < num_threads; ++t)
+        {
+            threads.emplace_back([&, t]()
+            {
+                auto check = [&](const Tensor& actual, const Tensor& reference)
+                {
+                    for (size_t i = 0; i < out_features; ++i)
+                    {
+                        if (std::abs(actual.data()[i] - reference.data()[i]) > 1e-5f)
+                        {
+                            mismatches.fetch_add(1);
+                        }
+                    }
+                };
+                
+                Tensor output(engine.getOutputShape());
+                for (size_t round = 0; round < 50; ++round)
+                {
+                    if (t + 1 == num_threads && round % 10 == 0)
+                    {
+                        std::vector<Tensor> outputs = engine.predictBatch(inputs, contexts[t]);
+                        for (size_t s = 0; s < num_inputs; ++s)
+                        {
+                            check(outputs[s], expected[s]);
+                        }
+                    }
+                    else
+                    {
+                        const size_t s = (t * 7 + round) % num_inputs;
+                        engine.predict(inputs[s], output, contexts[t]);
+                        check(output, expected[s]);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        
+        EXPECT_EQ(mismatches.load(), 0U) << "with_pool=" << with_pool;
+        for (const auto& context : contexts)
+        {
+            EXPECT_EQ(context.stats().layer_times.size(), 4U);
+            EXPECT_GT(context.stats().total_time.count(), 0.0);
+        }
+    }
+    
+    // a context moved to another engine re-plans for that engine's model
+    InferenceEngine other(std::move(model_));
+    ExecutionContext context = engine.createContext();
+    Tensor other_output = other.predict(Tensor({2}, {1.0f, 2.0f}), context);
+    EXPECT_NEAR(other_output.data()[0], 9.1f, 1e-5);
+    engine.predict(inputs[0], other_output, context);
+    EXPECT_EQ(other_output.shape(), std::vector<size_t>({out_features}));
+}
+
+TEST_F(InferenceEngineTest, CloneSharesWeights) 
+{
+    const Tensor* weights = &static_cast<const LinearLayer&>(*model_->getLayers()[0]).weights();
+    
+    auto engine = std::make_unique<InferenceEngine>(std::move(model_));
+    engine->setNumThreads(2);
+    engine->enableFusion(false);
+    
+    InferenceEngine clone = engine->clone();
+    EXPECT_EQ(clone.getModel(), engine->getModel());
+    EXPECT_EQ(&static_cast<const LinearLayer&>(*clone.getModel()->getLayers()[0]).weights(), weights);
+    EXPECT_EQ(clone.getNumThreads(), 2U);
+    EXPECT_EQ(clone.getNumFusedLayers(), 0U);
+    
+    // own stats: profiling the clone leaves the original's untouched
+    clone.enableProfiling(true);
+    Tensor input({2}, {1.0f, 2.0f});
+    Tensor expected = engine->predict(input);
+    Tensor output = clone.predict(input);
+    EXPECT_EQ(clone.getLastInferenceStats().layer_times.size(), 2U);
+    EXPECT_TRUE(engine->getLastInferenceStats().layer_times.empty());
+    
+    // the model outlives the engine it was loaded for
+    engine.reset();
+    EXPECT_EQ(clone.getModel().use_count(), 1);
+    clone.predict(input, output);
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        EXPECT_FLOAT_EQ(output.data()[i], expected.data()[i]);
+    }
+}
+
+TEST_F(InferenceEngineTest, InconsistentOutputShapeRejected) 
+{
+    // the layers produce 3 features, the model claims 4
+    model_->setOutputShape({4});
+    EXPECT_THROW(InferenceEngine engine(std::move(model_)), std::invalid_argument);
+}
+
+TEST_F(InferenceEngineTest, FusedMatchesUnfused) 
+{
+    const size_t in_features = 20;
+    const size_t hidden = 33;
+    const size_t out_features = 7;
+    
+    // one of each fusable activation
+    auto make_model = [&]()
+    {
+        std::vector<float> w1(in_features * hidden), b1(hidden), w2(hidden * hidden), b2(hidden);
+        std::vector<float> w3(hidden * out_features), b3(out_features);
+        for (size_t i = 0; i < w1.size(); ++i) w1[i] = static_cast<float>((i * 7) % 11) / 11.0f - 0.5f;
+        for (size_t i = 0; i < b1.size(); ++i) b1[i] = static_cast<float>(i % 3) * 0.1f - 0.1f;
+        for (size_t i = 0; i < w2.size(); ++i) w2[i] = static_cast<float>((i * 3) % 7) / 7.0f - 0.5f;
+        for (size_t i = 0; i < b2.size(); ++i) b2[i] = 0.05f * static_cast<float>(i % 5);
+        for (size_t i = 0; i < w3.size(); ++i) w3[i] = static_cast<float>((i * 5) % 13) / 13.0f - 0.5f;
+        for (size_t i = 0; i < b3.size(); ++i) b3[i] = -0.1f * static_cast<float>(i);
+        
+        auto test_model = std::make_unique<Model>();
+        test_model->addLayer(std::make_unique<LinearLayer>(Tensor({in_features, hidden}, w1), Tensor({hidden}, b1)));
+        test_model->addLayer(std::make_unique<ReLULayer>());
+        test_model->addLayer(std::make_unique<LinearLayer>(Tensor({hidden, hidden}, w2), Tensor({hidden}, b2)));
+        test_model->addLayer(std::make_unique<SigmoidLayer>());
+        test_model->addLayer(std::make_unique<LinearLayer>(Tensor({hidden, out_features}, w3), Tensor({out_features}, b3)));
+        test_model->addLayer(std::make_unique<SoftmaxLayer>());
+        test_model->setInputShape({in_features});
+        test_model->setOutputShape({out_features});
+        return test_model;
+    };
+    
+    InferenceEngine fused_engine(make_model());
+    InferenceEngine unfused_engine(make_model());
+    unfused_engine.enableFusion(false);
+    EXPECT_EQ(fused_engine.getNumFusedLayers(), 3u);
+    EXPECT_EQ(unfused_engine.getNumFusedLayers(), 0u);
+    EXPECT_EQ(fused_engine.getNumLayers(), 6u);
+    
+    std::vector<Tensor> inputs;
+    for (size_t b = 0; b < 9; ++b)
+    {
+        std::vector<float> values(in_features);
+        for (size_t i = 0; i < in_features; ++i)
+        {
+            values[i] = static_cast<float>((b * 31 + i * 17) % 29) / 29.0f - 0.4f;
+        }
+        inputs.emplace_back(std::vector<size_t>{in_features}, values);
+    }
+    
+    for (const Tensor& input : inputs)
+    {
+        Tensor expected = unfused_engine.predict(input);
+        Tensor actual = fused_engine.predict(input);
+        for (size_t i = 0; i < out_features; ++i)
+        {
+            EXPECT_NEAR(actual.data()[i], expected.data()[i], 1e-6f);
+        }
+    }
+    
+    std::vector<Tensor> expected = unfused_engine.predictBatch(inputs);
+    std::vector<Tensor> actual = fused_engine.predictBatch(inputs);
+    for (size_t b = 0; b < inputs.size(); ++b)
+    {
+        for (size_t i = 0; i < out_features; ++i)
+        {
+            EXPECT_NEAR(actual[b].data()[i], expected[b].data()[i], 1e-6f);
+        }
+    }
+    
+    // a fused activation still shows up in the per-layer profile
+    fused_engine.enableProfiling(true);
+    fused_engine.predict(inputs[0]);
+    EXPECT_EQ(fused_engine.getLastInferenceStats().layer_times.size(), 6u);
+}
+
+TEST_F(InferenceEngineTest, BatchInputValidation) 
+{
+    InferenceEngine engine(std::move(model_));
+    
+    std::vector<Tensor> inputs = {
+        Tensor({2}, {1.0f, 2.0f}),
+        Tensor({3}, {1.0f, 2.0f, 3.0f})  // wrong size
+    };
+    
+    EXPECT_THROW(engine.predictBatch(inputs), std::invalid_argument);
+}
+
+TEST_F(InferenceEngineTest, BatchProfiling) 
+{
+    InferenceEngine engine(std::move(model_));
+    engine.enableProfiling(true);
+    
+    std::vector<Tensor> inputs(4, Tensor({2}, {1.0f, 2.0f}));
+    engine.predictBatch(inputs);
+    
+    const auto& stats = engine.getLastInferenceStats();
+    EXPECT_GT(stats.total_time.count(), 0.0);
+    EXPECT_EQ(stats.layer_times.size(), 2U);
+}
+
 TEST_F(InferenceEngineTest, EmptyBatchRejection) 
 {
     InferenceEngine engine(std::move(model_));
@@ -178,6 +617,89 @@ TEST_F(InferenceEngineTest, ProfilingEnabled)
 }
 
 // Test buffer management
+TEST_F(InferenceEngineTest, LatencyHistograms) 
+{
+    InferenceEngine engine(std::move(model_));
+    Tensor input({2}, {1.0f, 2.0f});
+    
+    // nothing is recorded without profiling
+    engine.predict(input);
+    EXPECT_EQ(engine.getLastInferenceStats().latency.count(), 0U);
+    
+    engine.enableProfiling(true);
+    for (int i = 0; i < 20; ++i)
+    {
+        engine.predict(input);
+    }
+    engine.predictBatch({input, input, input});
+    
+    const InferenceStats& stats = engine.getLastInferenceStats();
+    EXPECT_EQ(stats.latency.count(), 21U);
+    ASSERT_EQ(stats.layer_latency.size(), 2U);
+    EXPECT_EQ(stats.layer_latency[0].count(), 21U);
+    EXPECT_LE(stats.latency.percentile(50).count(), stats.latency.percentile(99).count());
+    EXPECT_LE(stats.latency.percentile(99).count(), stats.latency.max().count());
+    
+    // other contexts keep their own histograms, which merge into one report
+    ExecutionContext context = engine.createContext();
+    engine.predict(input, context);
+    InferenceStats total = context.stats();
+    total.mergeLatency(stats);
+    EXPECT_EQ(total.latency.count(), 22U);
+    EXPECT_EQ(total.layer_latency[1].count(), 22U);
+    
+    engine.resetLatencyStats();
+    EXPECT_EQ(engine.getLastInferenceStats().latency.count(), 0U);
+    EXPECT_EQ(engine.getLastInferenceStats().layer_latency[0].count(), 0U);
+}
+
+TEST_F(InferenceEngineTest, MemoryReport) 
+{
+    // a second linear layer, so the relu output needs an intermediate buffer
+    model_->addLayer(std::make_unique<LinearLayer>(Tensor({3, 2}, {1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f}),
+                                                   Tensor({2}, {0.0f, 0.5f})));
+    model_->setOutputShape({2});
+    InferenceEngine engine(std::move(model_));
+    
+    // 2x3 + 3x2 weights and 3 + 2 biases, nothing mapped
+    MemoryReport report = engine.memoryReport();
+    EXPECT_EQ(report.parameters.by_type[static_cast<size_t>(DataType::FLOAT32)], 17 * sizeof(float));
+    EXPECT_EQ(report.parameters.total(), 17 * sizeof(float));
+    EXPECT_EQ(report.mapped_file_bytes, 0U);
+    EXPECT_GE(report.activation_bytes, 3 * sizeof(float));
+    EXPECT_EQ(report.transient_peak_bytes, 0U);
+    EXPECT_NE(report.toString().find("float32 68"), std::string::npos);
+    
+    // a batch of 4 stages 4 x (2 + 2) floats and plans a batch arena
+    engine.enableProfiling(true);
+    Tensor input({2}, {1.0f, 2.0f});
+    engine.predictBatch({input, input, input, input});
+    report = engine.memoryReport();
+    EXPECT_EQ(report.transient_peak_bytes, 4 * 4 * sizeof(float));
+    EXPECT_GE(report.scratch_peak_bytes, report.scratch_bytes);
+    
+    // kernel scratch counts while its thread holds it
+    {
+        ScratchBuffer<float> scratch;
+        scratch.reserve(1000);
+        EXPECT_GE(engine.memoryReport().scratch_bytes, report.scratch_bytes + 1000 * sizeof(float));
+        EXPECT_GE(ScratchMemory::peakBytes(), 1000 * sizeof(float));
+    }
+    EXPECT_EQ(engine.memoryReport().scratch_bytes, report.scratch_bytes);
+    EXPECT_EQ(report.totalBytes(), report.parameters.heap() + report.activation_bytes +
+                                   report.transient_peak_bytes + report.scratch_bytes);
+    
+    const InferenceStats& stats = engine.getLastInferenceStats();
+    EXPECT_EQ(stats.memory.activation_bytes, report.activation_bytes);
+    EXPECT_EQ(stats.memory_usage_bytes, stats.memory.totalBytes());
+    
+    // a fresh context has planned only its single sample arena
+    ExecutionContext context = engine.createContext();
+    MemoryReport fresh = engine.memoryReport(context);
+    EXPECT_LT(fresh.activation_bytes, report.activation_bytes);
+    EXPECT_EQ(fresh.transient_peak_bytes, 0U);
+}
+
 TEST_F(InferenceEngineTest, BufferManagement) 
 {
     InferenceEngine engine(std::move(model_));
@@ -0,0 +1,567 @@
+/* kernels_test.cpp
+ *
+ * Tests for runtime cpu dispatch: every simd tier this machine supports must
+ * agree with the scalar reference kernels.
+ */
+
+#include <gtest/gtest.h>
+#include "kernels.h"
+#include "gemm.h"
+#include "thread_pool.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace mininn;
+
+class KernelsTest : public ::testing::Test
+{
+protected:
+    // all tiers the current cpu can run, scalar first
+    std::vector<const KernelTable*> supportedTables() const
+    {
+        std::vector<const KernelTable*> tables;
+        for (CpuTier tier : {CpuTier::SCALAR, CpuTier::SSE42, CpuTier::AVX2, CpuTier::AVX512})
+        {
+            if (const KernelTable* table = Kernels::forTier(tier))
+            {
+                tables.push_back(table);
+            }
+        }
+        return tables;
+    }
+
+    // deterministic values in [-range, range]
+    std::vector<float> makeData(size_t n, float range) const
+    {
+        std::vector<float> data(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            data[i] = (static_cast<float>((i * 53 + 11) % 97) / 48.0f - 1.0f) * range;
+        }
+        return data;
+    }
+
+    // sizes that hit full vectors and every tail length
+    const std::vector<size_t> sizes_ = {1, 3, 4, 7, 8, 15, 16, 17, 33, 100, 1000};
+};
+
+TEST_F(KernelsTest, DetectionIsConsistent)
+{
+    const CpuTier detected = Kernels::detectCpuTier();
+
+    // the detected tier and everything below it must have kernels
+    ASSERT_NE(Kernels::forTier(detected), nullptr);
+    ASSERT_NE(Kernels::forTier(CpuTier::SCALAR), nullptr);
+    EXPECT_EQ(Kernels::forTier(detected)->tier, detected);
+
+    // the active table never exceeds what the cpu supports
+    EXPECT_LE(Kernels::active().tier, detected);
+}
+
+TEST_F(KernelsTest, TierNames)
+{
+    CpuTier tier;
+    EXPECT_TRUE(Kernels::parseTier("avx2", tier));
+    EXPECT_EQ(tier, CpuTier::AVX2);
+    EXPECT_TRUE(Kernels::parseTier("sse4.2", tier));
+    EXPECT_EQ(tier, CpuTier::SSE42);
+    EXPECT_FALSE(Kernels::parseTier("neon", tier));
+    EXPECT_STREQ(Kernels::tierName(CpuTier::AVX512), "avx512");
+}
+
+TEST_F(KernelsTest, SetActiveTier)
+{
+    const CpuTier original = Kernels::active().tier;
+
+    Kernels::setActiveTier(CpuTier::SCALAR);
+    EXPECT_EQ(Kernels::active().tier, CpuTier::SCALAR);
+
+    Kernels::setActiveTier(original);
+    EXPECT_EQ(Kernels::active().tier, original);
+}
+
+TEST_F(KernelsTest, ReluMatchesScalar)
+{
+    for (const KernelTable* table : supportedTables())
+    {
+        for (size_t n : sizes_)
+        {
+            std::vector<float> expected = makeData(n, 5.0f);
+            std::vector<float> actual = expected;
+
+            Kernels::forTier(CpuTier::SCALAR)->relu(expected.data(), n);
+            table->relu(actual.data(), n);
+
+            EXPECT_EQ(actual, expected) << table->name << " n=" << n;
+        }
+    }
+}
+
+TEST_F(KernelsTest, SigmoidMatchesScalar)
+{
+    for (const KernelTable* table : supportedTables())
+    {
+        for (size_t n : sizes_)
+        {
+            std::vector<float> expected = makeData(n, 30.0f);
+            std::vector<float> actual = expected;
+
+            Kernels::forTier(CpuTier::SCALAR)->sigmoid(expected.data(), n);
+            table->sigmoid(actual.data(), n);
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                ASSERT_NEAR(actual[i], expected[i], 1e-6f) << table->name << " n=" << n << " i=" << i;
+            }
+        }
+    }
+}
+
+TEST_F(KernelsTest, SigmoidExtremeInputs)
+{
+    for (const KernelTable* table : supportedTables())
+    {
+        std::vector<float> data(16, 0.0f);
+        data[0] = 200.0f;
+        data[1] = -200.0f;
+        data[2] = 88.0f;
+        data[3] = -88.0f;
+
+        table->sigmoid(data.data(), data.size());
+
+        EXPECT_FLOAT_EQ(data[0], 1.0f) << table->name;
+        EXPECT_NEAR(data[1], 0.0f, 1e-30f) << table->name;
+        EXPECT_FALSE(std::isnan(data[2])) << table->name;
+        EXPECT_FALSE(std::isnan(data[3])) << table->name;
+        EXPECT_FLOAT_EQ(data[4], 0.5f) << table->name;
+    }
+}
+
+TEST_F(KernelsTest, SoftmaxMatchesScalar)
+{
+    for (const KernelTable* table : supportedTables())
+    {
+        for (size_t n : sizes_)
+        {
+            std::vector<float> expected = makeData(n, 20.0f);
+            std::vector<float> actual = expected;
+
+            Kernels::forTier(CpuTier::SCALAR)->softmax(expected.data(), n);
+            table->softmax(actual.data(), n);
+
+            float sum = 0.0f;
+            for (size_t i = 0; i < n; ++i)
+            {
+                ASSERT_NEAR(actual[i], expected[i], 1e-6f) << table->name << " n=" << n << " i=" << i;
+                sum += actual[i];
+            }
+            EXPECT_NEAR(sum, 1.0f, 1e-5f) << table->name << " n=" << n;
+        }
+    }
+}
+
+TEST_F(KernelsTest, AxpyMatchesScalar)
+{
+    for (const KernelTable* table : supportedTables())
+    {
+        for (size_t n : sizes_)
+        {
+            const std::vector<float> x = makeData(n, 2.0f);
+            std::vector<float> expected = makeData(n, 1.0f);
+            std::vector<float> actual = expected;
+
+            Kernels::forTier(CpuTier::SCALAR)->axpy(n, 0.75f, x.data(), expected.data());
+            table->axpy(n, 0.75f, x.data(), actual.data());
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                ASSERT_NEAR(actual[i], expected[i], 1e-6f) << table->name << " n=" << n;
+            }
+        }
+    }
+}
+
+TEST_F(KernelsTest, AxpyHalfMatchesScalar)
+{
+    const KernelTable& scalar = *Kernels::forTier(CpuTier::SCALAR);
+
+    for (size_t n : sizes_)
+    {
+        const std::vector<float> values = makeData(n, 3.0f);
+        std::vector<uint16_t> fp16(n), bf16(n);
+        scalar.fp32_to_fp16(values.data(), fp16.data(), n);
+        scalar.fp32_to_bf16(values.data(), bf16.data(), n);
+        const std::vector<float> y0 = makeData(n, 1.0f);
+
+        std::vector<float> expected_fp16 = y0, expected_bf16 = y0;
+        scalar.axpy_fp16(n, 0.75f, fp16.data(), expected_fp16.data());
+        scalar.axpy_bf16(n, 0.75f, bf16.data(), expected_bf16.data());
+
+        for (const KernelTable* table : supportedTables())
+        {
+            std::vector<float> actual_fp16 = y0, actual_bf16 = y0;
+            table->axpy_fp16(n, 0.75f, fp16.data(), actual_fp16.data());
+            table->axpy_bf16(n, 0.75f, bf16.data(), actual_bf16.data());
+            for (size_t i = 0; i < n; ++i)
+            {
+                ASSERT_NEAR(actual_fp16[i], expected_fp16[i], 1e-5f) << table->name << " n=" << n;
+                ASSERT_NEAR(actual_bf16[i], expected_bf16[i], 1e-5f) << table->name << " n=" << n;
+            }
+        }
+    }
+}
+
+TEST_F(KernelsTest, GemmHalfMatchesWidenedWeights)
+{
+    const CpuTier original = Kernels::active().tier;
+    ThreadPool pool(2);
+
+    const size_t k = 300, n = 45;
+    const std::vector<float> b = makeData(k * n, 1.0f);
+    const std::vector<float> bias = makeData(n, 2.0f);
+    GemmEpilogue epilogue;
+    epilogue.bias = bias.data();
+    epilogue.activation = Activation::RELU;
+
+    for (Gemm::HalfFormat format : {Gemm::HalfFormat::FP16, Gemm::HalfFormat::BF16})
+    {
+        // the reference multiplies by the same rounded weights, widened up front
+        const KernelTable& scalar = *Kernels::forTier(CpuTier::SCALAR);
+        std::vector<uint16_t> half(k * n);
+        std::vector<float> widened(k * n);
+        if (format == Gemm::HalfFormat::FP16)
+        {
+            scalar.fp32_to_fp16(b.data(), half.data(), k * n);
+            scalar.fp16_to_fp32(half.data(), widened.data(), k * n);
+        }
+        else
+        {
+            scalar.fp32_to_bf16(b.data(), half.data(), k * n);
+            scalar.bf16_to_fp32(half.data(), widened.data(), k * n);
+        }
+
+        // short m takes the axpy path, 37 the packed one, and the pool splits columns
+        for (size_t m : {1u, 2u, 37u})
+        {
+            const std::vector<float> a = makeData(m * k, 1.0f);
+            std::vector<float> expected(m * n);
+            Kernels::setActiveTier(CpuTier::SCALAR);
+            Gemm::sgemm(m, n, k, a.data(), k, widened.data(), n, expected.data(), n, nullptr, epilogue);
+
+            for (const KernelTable* table : supportedTables())
+            {
+                Kernels::setActiveTier(table->tier);
+                for (ThreadPool* p : {static_cast<ThreadPool*>(nullptr), &pool})
+                {
+                    std::vector<float> actual(m * n, -1.0f);
+                    Gemm::sgemmHalf(m, n, k, a.data(), k, half.data(), format, n, actual.data(), n, p, epilogue);
+                    for (size_t i = 0; i < m * n; ++i)
+                    {
+                        ASSERT_NEAR(actual[i], expected[i], 1e-3f) << table->name << " m=" << m << " i=" << i;
+                    }
+                }
+            }
+        }
+    }
+
+    Kernels::setActiveTier(original);
+}
+
+TEST_F(KernelsTest, GemmMatchesScalarOnEveryTier)
+{
+    const CpuTier original = Kernels::active().tier;
+
+    const size_t m = 37, k = 300, n = 45;
+    const std::vector<float> a = makeData(m * k, 1.0f);
+    const std::vector<float> b = makeData(k * n, 1.0f);
+
+    std::vector<float> expected(m * n);
+    Kernels::setActiveTier(CpuTier::SCALAR);
+    Gemm::sgemm(m, n, k, a.data(), k, b.data(), n, expected.data(), n);
+
+    for (const KernelTable* table : supportedTables())
+    {
+        Kernels::setActiveTier(table->tier);
+
+        std::vector<float> actual(m * n, -1.0f);
+        Gemm::sgemm(m, n, k, a.data(), k, b.data(), n, actual.data(), n);
+
+        for (size_t i = 0; i < m * n; ++i)
+        {
+            ASSERT_NEAR(actual[i], expected[i], 1e-3f) << table->name << " i=" << i;
+        }
+    }
+
+    Kernels::setActiveTier(original);
+}
+
+TEST_F(KernelsTest, GemmEpilogueMatchesSeparatePasses)
+{
+    const CpuTier original = Kernels::active().tier;
+
+    // small m takes the axpy path, the rest go through the micro-kernels with ragged tiles
+    for (size_t m : {1u, 2u, 37u})
+    {
+        const size_t k = 300, n = 45;
+        const std::vector<float> a = makeData(m * k, 1.0f);
+        const std::vector<float> b = makeData(k * n, 1.0f);
+        const std::vector<float> bias = makeData(n, 2.0f);
+
+        for (Activation activation : {Activation::NONE, Activation::RELU, Activation::SIGMOID})
+        {
+            // reference: plain scalar gemm, then bias and activation as separate passes
+            Kernels::setActiveTier(CpuTier::SCALAR);
+            const KernelTable& scalar = Kernels::active();
+            std::vector<float> expected(m * n);
+            Gemm::sgemm(m, n, k, a.data(), k, b.data(), n, expected.data(), n);
+            for (size_t i = 0; i < m; ++i)
+            {
+                float* row = expected.data() + i * n;
+                scalar.axpy(n, 1.0f, bias.data(), row);
+                if (activation == Activation::RELU) scalar.relu(row, n);
+                if (activation == Activation::SIGMOID) scalar.sigmoid(row, n);
+            }
+
+            GemmEpilogue epilogue;
+            epilogue.bias = bias.data();
+            epilogue.activation = activation;
+
+            for (const KernelTable* table : supportedTables())
+            {
+                Kernels::setActiveTier(table->tier);
+
+                std::vector<float> actual(m * n, -1.0f);
+                Gemm::sgemm(m, n, k, a.data(), k, b.data(), n, actual.data(), n, nullptr, epilogue);
+
+                for (size_t i = 0; i < m * n; ++i)
+                {
+                    ASSERT_NEAR(actual[i], expected[i], 1e-3f)
+                        << table->name << " m=" << m << " activation=" << static_cast<int>(activation) << " i=" << i;
+                }
+            }
+        }
+    }
+
+    Kernels::setActiveTier(original);
+}
+
+TEST_F(KernelsTest, GemmS8MatchesScalarOnEveryTier)
+{
+    const size_t n = 37, k = 2 * Kernels::INT8_K_ALIGNMENT;
+
+    std::vector<int8_t> b(n * k);
+    std::vector<int32_t> b_sums(n, 0);
+    for (size_t j = 0; j < n; ++j)
+    {
+        for (size_t p = 0; p < k; ++p)
+        {
+            // full range, including -127 and 127
+            b[j * k + p] = static_cast<int8_t>(static_cast<int>((j * 131 + p * 29) % 255) - 127);
+            b_sums[j] += b[j * k + p];
+        }
+    }
+    const std::vector<float> b_scales = makeData(n, 0.02f);
+    const std::vector<float> bias = makeData(n, 1.0f);
+
+    // odd row counts leave partial register tiles
+    for (size_t m : {1u, 3u, 8u})
+    {
+        std::vector<int8_t> a(m * k);
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            a[i] = static_cast<int8_t>(static_cast<int>((i * 97 + 13) % 255) - 127);
+        }
+        std::vector<float> a_scales(m);
+        for (size_t i = 0; i < m; ++i)
+        {
+            a_scales[i] = 0.01f * static_cast<float>(i + 1);
+        }
+
+        for (Activation activation : {Activation::NONE, Activation::RELU, Activation::SIGMOID})
+        {
+            GemmEpilogue epilogue;
+            epilogue.bias = bias.data();
+            epilogue.activation = activation;
+
+            // int32 reference
+            std::vector<float> expected(m * n);
+            for (size_t i = 0; i < m; ++i)
+            {
+                for (size_t j = 0; j < n; ++j)
+                {
+                    int32_t sum = 0;
+                    for (size_t p = 0; p < k; ++p)
+                    {
+                        sum += a[i * k + p] * b[j * k + p];
+                    }
+                    float value = static_cast<float>(sum) * (a_scales[i] * b_scales[j]) + bias[j];
+                    if (activation == Activation::RELU) value = std::max(value, 0.0f);
+                    if (activation == Activation::SIGMOID) value = 1.0f / (1.0f + std::exp(-value));
+                    expected[i * n + j] = value;
+                }
+            }
+
+            for (const KernelTable* table : supportedTables())
+            {
+                std::vector<float> actual(m * n, -1.0f);
+                table->gemm_s8(m, n, k, a.data(), k, b.data(), k, b_sums.data(), a_scales.data(), b_scales.data(),
+                               actual.data(), n, &epilogue);
+
+                for (size_t i = 0; i < m * n; ++i)
+                {
+                    ASSERT_NEAR(actual[i], expected[i], 1e-5f * std::max(1.0f, std::fabs(expected[i])))
+                        << table->name << " m=" << m << " activation=" << static_cast<int>(activation) << " i=" << i;
+                }
+            }
+        }
+    }
+}
+
+TEST_F(KernelsTest, GemmQ4MatchesReferenceOnEveryTier)
+{
+    const size_t n = 37, k = 4 * Kernels::INT4_BLOCK, group_size = 2 * Kernels::INT4_BLOCK;
+    const size_t groups = k / group_size, half = Kernels::INT4_BLOCK / 2;
+
+    // every nibble value, packed as described at Kernels::INT4_BLOCK
+    std::vector<uint8_t> b(n * k / 2);
+    for (size_t i = 0; i < b.size(); ++i)
+    {
+        b[i] = static_cast<uint8_t>((i * 37 + 5) % 256);
+    }
+    const std::vector<float> b_scales = makeData(n * groups, 0.1f);
+    const std::vector<float> bias = makeData(n, 1.0f);
+
+    // odd row counts leave partial register tiles
+    for (size_t m : {1u, 3u, 9u})
+    {
+        const std::vector<float> a = makeData(m * k, 1.0f);
+
+        for (Activation activation : {Activation::NONE, Activation::RELU, Activation::SIGMOID})
+        {
+            GemmEpilogue epilogue;
+            epilogue.bias = bias.data();
+            epilogue.activation = activation;
+
+            std::vector<float> expected(m * n);
+            for (size_t i = 0; i < m; ++i)
+            {
+                for (size_t j = 0; j < n; ++j)
+                {
+                    double sum = 0.0;
+                    for (size_t p = 0; p < k; ++p)
+                    {
+                        const size_t block = p / Kernels::INT4_BLOCK, within = p % Kernels::INT4_BLOCK;
+                        const uint8_t byte = b[j * k / 2 + block * half + within % half];
+                        const int q = (within < half ? (byte & 0x0f) : (byte >> 4)) - 8;
+                        sum += static_cast<double>(a[i * k + p]) * q * b_scales[j * groups + p / group_size];
+                    }
+                    float value = static_cast<float>(sum) + bias[j];
+                    if (activation == Activation::RELU) value = std::max(value, 0.0f);
+                    if (activation == Activation::SIGMOID) value = 1.0f / (1.0f + std::exp(-value));
+                    expected[i * n + j] = value;
+                }
+            }
+
+            for (const KernelTable* table : supportedTables())
+            {
+                std::vector<float> actual(m * n, -1.0f);
+                table->gemm_q4(m, n, k, a.data(), k, b.data(), k / 2, b_scales.data(), group_size,
+                               actual.data(), n, &epilogue);
+
+                for (size_t i = 0; i < m * n; ++i)
+                {
+                    ASSERT_NEAR(actual[i], expected[i], 1e-4f * std::max(1.0f, std::fabs(expected[i])))
+                        << table->name << " m=" << m << " activation=" << static_cast<int>(activation) << " i=" << i;
+                }
+            }
+        }
+    }
+}
+
+TEST_F(KernelsTest, HalfConversionsKnownValues)
+{
+    const KernelTable& scalar = *Kernels::forTier(CpuTier::SCALAR);
+    auto toFp16 = [&](float value) { uint16_t h; scalar.fp32_to_fp16(&value, &h, 1); return h; };
+    auto toBf16 = [&](float value) { uint16_t b; scalar.fp32_to_bf16(&value, &b, 1); return b; };
+    auto fromBits = [](uint32_t bits) { float f; std::memcpy(&f, &bits, sizeof(f)); return f; };
+
+    EXPECT_EQ(toFp16(1.0f), 0x3c00);
+    EXPECT_EQ(toFp16(-2.5f), 0xc100);
+    EXPECT_EQ(toFp16(65504.0f), 0x7bff);                   // largest finite
+    EXPECT_EQ(toFp16(65520.0f), 0x7c00);                   // rounds up to inf
+    EXPECT_EQ(toFp16(std::ldexp(1.0f, -24)), 0x0001);      // smallest subnormal
+    EXPECT_EQ(toFp16(std::ldexp(1.0f, -25)), 0x0000);      // tie, rounds to even
+    EXPECT_EQ(toFp16(1.0f + std::ldexp(1.0f, -11)), 0x3c00);                          // tie, even
+    EXPECT_EQ(toFp16(1.0f + 3.0f * std::ldexp(1.0f, -11)), 0x3c02);                   // tie, odd -> up
+    EXPECT_EQ(toFp16(-INFINITY), 0xfc00);
+    EXPECT_EQ(toFp16(NAN) & 0x7e00, 0x7e00);
+
+    EXPECT_EQ(toBf16(1.0f), 0x3f80);
+    EXPECT_EQ(toBf16(fromBits(0x3f808000)), 0x3f80);       // tie, even
+    EXPECT_EQ(toBf16(fromBits(0x3f818000)), 0x3f82);       // tie, odd -> up
+    EXPECT_EQ(toBf16(fromBits(0x7f7fffff)), 0x7f80);       // largest float rounds to inf
+    EXPECT_EQ(toBf16(fromBits(0x7f800001)) & 0x7fc0, 0x7fc0);   // signalling nan comes back quiet
+
+    const uint16_t subnormal = 0x0001;
+    float value;
+    scalar.fp16_to_fp32(&subnormal, &value, 1);
+    EXPECT_EQ(value, std::ldexp(1.0f, -24));
+}
+
+TEST_F(KernelsTest, HalfConversionsMatchScalarOnEveryTier)
+{
+    const KernelTable& scalar = *Kernels::forTier(CpuTier::SCALAR);
+
+    // every 16-bit pattern, then fp32 patterns spread over the whole range (nan and inf included)
+    std::vector<uint16_t> halves(1u << 16);
+    for (size_t i = 0; i < halves.size(); ++i)
+    {
+        halves[i] = static_cast<uint16_t>(i);
+    }
+    std::vector<float> floats(1u << 16);
+    uint32_t state = 12345;
+    for (size_t i = 0; i < floats.size(); ++i)
+    {
+        state = state * 1664525u + 1013904223u;
+        std::memcpy(&floats[i], &state, sizeof(state));
+    }
+    const std::vector<float> ordinary = makeData(floats.size(), 100.0f);
+    floats.insert(floats.end(), ordinary.begin(), ordinary.end());
+
+    std::vector<float> expected_fp16_wide(halves.size()), expected_bf16_wide(halves.size());
+    std::vector<uint16_t> expected_fp16(floats.size()), expected_bf16(floats.size());
+    scalar.fp16_to_fp32(halves.data(), expected_fp16_wide.data(), halves.size());
+    scalar.bf16_to_fp32(halves.data(), expected_bf16_wide.data(), halves.size());
+    scalar.fp32_to_fp16(floats.data(), expected_fp16.data(), floats.size());
+    scalar.fp32_to_bf16(floats.data(), expected_bf16.data(), floats.size());
+
+    for (const KernelTable* table : supportedTables())
+    {
+        // the full arrays, then short runs for every tail length
+        std::vector<size_t> lengths = sizes_;
+        lengths.push_back(halves.size());
+        for (size_t n : lengths)
+        {
+            std::vector<float> wide(n);
+            std::vector<uint16_t> narrow(n);
+
+            table->fp16_to_fp32(halves.data(), wide.data(), n);
+            ASSERT_EQ(std::memcmp(wide.data(), expected_fp16_wide.data(), n * sizeof(float)), 0) << table->name << " n=" << n;
+            table->bf16_to_fp32(halves.data(), wide.data(), n);
+            ASSERT_EQ(std::memcmp(wide.data(), expected_bf16_wide.data(), n * sizeof(float)), 0) << table->name << " n=" << n;
+
+            table->fp32_to_fp16(floats.data(), narrow.data(), n);
+            ASSERT_EQ(std::memcmp(narrow.data(), expected_fp16.data(), n * sizeof(uint16_t)), 0) << table->name << " n=" << n;
+            table->fp32_to_bf16(floats.data(), narrow.data(), n);
+            ASSERT_EQ(std::memcmp(narrow.data(), expected_bf16.data(), n * sizeof(uint16_t)), 0) << table->name << " n=" << n;
+        }
+
+        // the fp32 side has twice as many patterns
+        std::vector<uint16_t> narrow(floats.size());
+        table->fp32_to_fp16(floats.data(), narrow.data(), floats.size());
+        EXPECT_EQ(narrow, expected_fp16) << table->name;
+        table->fp32_to_bf16(floats.data(), narrow.data(), floats.size());
+        EXPECT_EQ(narrow, expected_bf16) << table->name;
+    }
+}
@@ -0,0 +1,106 @@
+/* latency_histogram_test.cpp
+ *
+ * Tests for LatencyHistogram: bucket layout, percentile accuracy, merging,
+ * and recording from several threads at once.
+ */
+
+#include <gtest/gtest.h>
+#include "latency_histogram.h"
+#include <thread>
+#include <vector>
+
+using namespace mininn;
+using std::chrono::nanoseconds;
+
+TEST(LatencyHistogramTest, BucketsCoverEveryValue)
+{
+    // every bucket starts right after the previous one ends, and each value maps back into its bucket
+    for (size_t i = 1; i < LatencyHistogram::NUM_BUCKETS; ++i)
+    {
+        ASSERT_EQ(LatencyHistogram::bucketLowest(i),
+                  LatencyHistogram::bucketLowest(i - 1) + LatencyHistogram::bucketWidth(i - 1)) << i;
+    }
+    for (uint64_t value : {uint64_t(0), uint64_t(63), uint64_t(64), uint64_t(1000), uint64_t(123456789),
+                           uint64_t(1) << 40, ~uint64_t(0)})
+    {
+        const size_t index = LatencyHistogram::bucketIndex(value);
+        ASSERT_LT(index, LatencyHistogram::NUM_BUCKETS);
+        EXPECT_LE(LatencyHistogram::bucketLowest(index), value);
+        EXPECT_LE(value - LatencyHistogram::bucketLowest(index), LatencyHistogram::bucketWidth(index) - 1);
+    }
+}
+
+TEST(LatencyHistogramTest, PercentilesWithinBucketPrecision)
+{
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.percentile(50).count(), 0.0);
+
+    // 1 us .. 10 ms, uniform
+    for (uint64_t i = 1; i <= 10000; ++i)
+    {
+        histogram.record(nanoseconds(i * 1000));
+    }
+
+    EXPECT_EQ(histogram.count(), 10000U);
+    EXPECT_NEAR(histogram.mean().count(), 5.0005, 1e-9);
+    EXPECT_DOUBLE_EQ(histogram.min().count(), 0.001);
+    EXPECT_DOUBLE_EQ(histogram.max().count(), 10.0);
+
+    for (double p : {50.0, 90.0, 99.0, 99.9})
+    {
+        const double expected = p / 10.0;   // ms
+        EXPECT_NEAR(histogram.percentile(p).count(), expected, expected * 0.02) << "p" << p;
+    }
+    EXPECT_DOUBLE_EQ(histogram.percentile(100).count(), 10.0);
+    EXPECT_DOUBLE_EQ(histogram.percentile(0).count(), 0.001);
+    EXPECT_NE(histogram.summary().find("n=10000"), std::string::npos);
+}
+
+TEST(LatencyHistogramTest, MergeCopyAndReset)
+{
+    LatencyHistogram fast;
+    LatencyHistogram slow;
+    for (int i = 0; i < 90; ++i) fast.record(nanoseconds(1000));
+    for (int i = 0; i < 10; ++i) slow.record(std::chrono::duration<double, std::milli>(5.0));
+
+    LatencyHistogram all(fast);
+    all.merge(slow);
+    EXPECT_EQ(fast.count(), 90U);
+    EXPECT_EQ(all.count(), 100U);
+    EXPECT_NEAR(all.percentile(50).count(), 0.001, 0.001 * 0.02);
+    EXPECT_NEAR(all.percentile(95).count(), 5.0, 5.0 * 0.02);
+    EXPECT_DOUBLE_EQ(all.max().count(), 5.0);
+
+    all.reset();
+    EXPECT_EQ(all.count(), 0U);
+    EXPECT_EQ(all.max().count(), 0.0);
+    all = slow;
+    EXPECT_EQ(all.count(), 10U);
+}
+
+TEST(LatencyHistogramTest, ConcurrentRecording)
+{
+    LatencyHistogram histogram;
+    const size_t num_threads = 4;
+    const uint64_t per_thread = 25000;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            for (uint64_t i = 0; i < per_thread; ++i)
+            {
+                histogram.record(nanoseconds(100 + t));
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(histogram.count(), num_threads * per_thread);
+    EXPECT_DOUBLE_EQ(histogram.min().count(), 100e-6);
+    EXPECT_DOUBLE_EQ(histogram.max().count(), 103e-6);
+}
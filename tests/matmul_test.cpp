@@ -118,4 +118,100 @@ TEST(MatmulTest, ZeroValues)
     EXPECT_FLOAT_EQ(result.at({0, 1}), 3.0f);  // 0*0 + 1*3
     EXPECT_FLOAT_EQ(result.at({1, 0}), 2.0f);  // 2*1 + 0*0
     EXPECT_FLOAT_EQ(result.at({1, 1}), 0.0f);  // 2*0 + 0*3
-}
\ No newline at end of file
+}
+// blocked gemm against the reference triple loop
+namespace
+{
+    Tensor makeMatrix(size_t rows, size_t cols, float seed)
+    {
+        std::vector<float> values(rows * cols);
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            // deterministic values in [-1, 1] so sums stay well conditioned
+            values[i] = static_cast<float>((i * 37 + static_cast<size_t>(seed * 101)) % 200) / 100.0f - 1.0f;
+        }
+        return Tensor({rows, cols}, values);
+    }
+
+    void expectMatchesReference(size_t m, size_t n, size_t p)
+    {
+        Tensor a = makeMatrix(m, n, 1.0f);
+        Tensor b = makeMatrix(n, p, 2.0f);
+        Tensor expected;
+        Tensor actual;
+
+        TensorOps::matmul_reference(a, b, expected);
+        TensorOps::matmul(a, b, actual);
+
+        ASSERT_EQ(actual.shape(), expected.shape());
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            ASSERT_NEAR(actual.data()[i], expected.data()[i], 1e-3f)
+                << "mismatch at " << i << " for " << m << "x" << n << "x" << p;
+        }
+    }
+}
+
+TEST(MatmulTest, ReferenceBasicMatrixMultiplication)
+{
+    Tensor a({2, 3}, {1.0f, 2.0f, 3.0f,
+                      4.0f, 5.0f, 6.0f});
+    Tensor b({3, 2}, {7.0f, 8.0f,
+                      9.0f, 10.0f,
+                      11.0f, 12.0f});
+    Tensor result;
+
+    TensorOps::matmul_reference(a, b, result);
+
+    EXPECT_EQ(result.shape(), std::vector<size_t>({2, 2}));
+    EXPECT_FLOAT_EQ(result.at({0, 0}), 58.0f);
+    EXPECT_FLOAT_EQ(result.at({0, 1}), 64.0f);
+    EXPECT_FLOAT_EQ(result.at({1, 0}), 139.0f);
+    EXPECT_FLOAT_EQ(result.at({1, 1}), 154.0f);
+}
+
+TEST(MatmulTest, GemmMatchesReferenceOnEdgeTiles)
+{
+    // shapes that aren't multiples of the register tile or cache blocks
+    expectMatchesReference(1, 1, 1);
+    expectMatchesReference(3, 5, 7);
+    expectMatchesReference(4, 8, 8);
+    expectMatchesReference(5, 9, 17);
+    expectMatchesReference(13, 31, 29);
+}
+
+TEST(MatmulTest, GemmMatchesReferenceAcrossCacheBlocks)
+{
+    // crosses KC (256), MC (96) and NC (1024) boundaries
+    expectMatchesReference(130, 300, 40);
+    expectMatchesReference(6, 20, 1030);
+}
+
+TEST(MatmulTest, GemmGemvShape)
+{
+    // single sample through a 784 -> 128 layer
+    expectMatchesReference(1, 784, 128);
+    expectMatchesReference(2, 33, 9);
+}
+
+TEST(MatmulTest, GemmReusesResultBuffer)
+{
+    Tensor a = makeMatrix(8, 16, 1.0f);
+    Tensor b = makeMatrix(16, 12, 2.0f);
+    Tensor result({8, 12});
+    const float* original_ptr = result.data();
+
+    TensorOps::matmul(a, b, result);
+
+    EXPECT_EQ(result.data(), original_ptr);
+}
+
+TEST(MatmulTest, ReferenceDimensionMismatchError)
+{
+    Tensor a({2, 3});
+    Tensor b({2, 2});
+    Tensor result;
+
+    EXPECT_THROW(TensorOps::matmul_reference(a, b, result), std::invalid_argument);
+    EXPECT_THROW(TensorOps::matmul_reference(Tensor({2, 3, 4}), b, result), std::invalid_argument);
+}
@@ -0,0 +1,118 @@
+/* memory_plan_test.cpp
+ *
+ * Tests for shape inference and the liveness based buffer plan.
+ */
+
+#include <gtest/gtest.h>
+#include "memory_plan.h"
+#include "model_loader.h"
+#include <cstdint>
+#include <memory>
+
+using namespace mininn;
+
+class MemoryPlanTest : public ::testing::Test
+{
+protected:
+    std::unique_ptr<Layer> linear(size_t in_features, size_t out_features) const
+    {
+        return std::make_unique<LinearLayer>(Tensor({in_features, out_features}), Tensor({out_features}));
+    }
+};
+
+TEST_F(MemoryPlanTest, ShapeInference)
+{
+    std::vector<std::unique_ptr<Layer>> layers;
+    layers.push_back(linear(8, 32));
+    layers.push_back(std::make_unique<ReLULayer>());
+    layers.push_back(linear(32, 4));
+    layers.push_back(std::make_unique<SoftmaxLayer>());
+
+    MemoryPlan single(layers, {8});
+    EXPECT_EQ(single.layerOutputShape(0), std::vector<size_t>({32}));
+    EXPECT_EQ(single.layerOutputShape(2), std::vector<size_t>({4}));
+    EXPECT_EQ(single.outputShape(), std::vector<size_t>({4}));
+
+    MemoryPlan batch(layers, {5, 8});
+    EXPECT_EQ(batch.layerOutputShape(1), std::vector<size_t>({5, 32}));
+    EXPECT_EQ(batch.outputShape(), std::vector<size_t>({5, 4}));
+}
+
+TEST_F(MemoryPlanTest, ChainPingPongsBetweenTwoBuffers)
+{
+    std::vector<std::unique_ptr<Layer>> layers;
+    layers.push_back(linear(8, 100));
+    layers.push_back(linear(100, 20));
+    layers.push_back(linear(20, 30));
+    layers.push_back(linear(30, 3));
+
+    MemoryPlan plan(layers, {8});
+    EXPECT_EQ(plan.numBuffers(), 2U);
+    EXPECT_FALSE(plan.writesOutput(2));
+    EXPECT_TRUE(plan.writesOutput(3));
+
+    // consecutive outputs never share memory, every other one does
+    EXPECT_TRUE(plan.intermediate(0).isView());
+    EXPECT_NE(plan.intermediate(0).data(), plan.intermediate(1).data());
+    EXPECT_EQ(plan.intermediate(0).data(), plan.intermediate(2).data());
+    EXPECT_EQ(plan.intermediate(2).shape(), std::vector<size_t>({30}));
+
+    // every slot starts on a Tensor::ALIGNMENT boundary in memory, not just within the arena
+    for (size_t i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(plan.intermediate(i).data()) % Tensor::ALIGNMENT, 0U);
+    }
+
+    // each slot holds its largest tenant: max(100, 30) and 20 floats
+    EXPECT_GE(plan.arenaBytes(), 120 * sizeof(float));
+    EXPECT_LT(plan.arenaBytes(), 200 * sizeof(float));
+}
+
+TEST_F(MemoryPlanTest, ActivationsRunInPlace)
+{
+    std::vector<std::unique_ptr<Layer>> layers;
+    layers.push_back(std::make_unique<ReLULayer>());  // first layer can't overwrite the caller's input
+    layers.push_back(linear(8, 100));
+    layers.push_back(std::make_unique<ReLULayer>());
+    layers.push_back(linear(100, 20));
+    layers.push_back(std::make_unique<SigmoidLayer>());
+    layers.push_back(linear(20, 3));
+    layers.push_back(std::make_unique<SoftmaxLayer>());
+
+    MemoryPlan plan(layers, {8});
+    EXPECT_FALSE(plan.inPlace(0));
+    EXPECT_TRUE(plan.inPlace(2));
+    EXPECT_TRUE(plan.inPlace(6));
+
+    // an in-place layer shares its input's buffer
+    EXPECT_EQ(plan.intermediate(1).data(), plan.intermediate(2).data());
+    EXPECT_EQ(plan.intermediate(3).data(), plan.intermediate(4).data());
+    EXPECT_NE(plan.intermediate(2).data(), plan.intermediate(3).data());
+
+    // the final linear and the softmax after it both work on the caller's output
+    EXPECT_FALSE(plan.writesOutput(4));
+    EXPECT_TRUE(plan.writesOutput(5));
+    EXPECT_TRUE(plan.writesOutput(6));
+    EXPECT_EQ(plan.numBuffers(), 2U);
+}
+
+TEST_F(MemoryPlanTest, SingleLayerNeedsNoArena)
+{
+    std::vector<std::unique_ptr<Layer>> layers;
+    layers.push_back(linear(4, 2));
+
+    MemoryPlan plan(layers, {4});
+    EXPECT_EQ(plan.numBuffers(), 0U);
+    EXPECT_EQ(plan.arenaBytes(), 0U);
+    EXPECT_EQ(plan.outputShape(), std::vector<size_t>({2}));
+}
+
+TEST_F(MemoryPlanTest, ShapeErrors)
+{
+    std::vector<std::unique_ptr<Layer>> layers;
+    layers.push_back(linear(8, 16));
+    layers.push_back(linear(10, 4));  // doesn't take 16 features
+
+    EXPECT_THROW(MemoryPlan(layers, {8}), std::invalid_argument);
+    EXPECT_THROW(MemoryPlan({}, {8}), std::invalid_argument);
+}
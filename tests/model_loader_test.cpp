@@ -7,7 +7,10 @@
 #include <gtest/gtest.h>
 #include "model_loader.h"
 #include "inference_engine.h"
+#include "mapped_file.h"
+#include <cstring>
 #include <fstream>
+#include <iterator>
 #include <vector>
 
 using namespace mininn;
@@ -32,10 +35,10 @@ protected:
     {
         std::ofstream file(test_file_path_, std::ios::binary);
         
-        // write header
+        // write header (v1 layout: layers, tensors and shapes inline, in order)
         ModelFormat::Header header;
         header.magic = ModelFormat::MAGIC_NUMBER;
-        header.version_major = ModelFormat::VERSION_MAJOR;
+        header.version_major = ModelFormat::VERSION_MAJOR_V1;
         header.version_minor = ModelFormat::VERSION_MINOR;
         header.num_layers = 2;  // linear + ReLU
         header.reserved = 0;
@@ -190,6 +193,158 @@ TEST_F(ModelLoaderTest, ValidModelFileCheck)
     // Note: Wed need to create a valid file to test this properly
 }
 
+TEST_F(ModelLoaderTest, MemoryMappedLoadMatchesCopy) 
+{
+    if (!MappedFile::supported())
+    {
+        GTEST_SKIP() << "no mmap on this platform";
+    }
+    
+    createSimpleModelFile();
+    auto copied = ModelLoader::loadFromFile(test_file_path_);
+    auto mapped = ModelLoader::loadFromFile(test_file_path_, LoadMode::MMAP);
+    EXPECT_FALSE(copied->isMapped());
+    EXPECT_TRUE(mapped->isMapped());
+    ASSERT_EQ(mapped->getLayers().size(), 2U);
+    EXPECT_EQ(mapped->getInputShape(), copied->getInputShape());
+    
+    // the mapping outlives the file's directory entry
+    std::remove(test_file_path_.c_str());
+    
+    InferenceEngine copied_engine(std::move(copied));
+    InferenceEngine mapped_engine(std::move(mapped));
+    Tensor input({2}, {1.0f, -0.5f});
+    Tensor expected = copied_engine.predict(input);
+    Tensor actual = mapped_engine.predict(input);
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        EXPECT_FLOAT_EQ(actual.data()[i], expected.data()[i]);
+    }
+}
+
+TEST_F(ModelLoaderTest, MemoryMappedLoadErrors) 
+{
+    EXPECT_THROW(ModelLoader::loadFromFile("/nonexistent/model.minn", LoadMode::MMAP), std::runtime_error);
+    
+    createInvalidMagicFile();
+    EXPECT_THROW(ModelLoader::loadFromFile(test_file_path_, LoadMode::MMAP), std::runtime_error);
+    
+    // a file cut off in the middle of a tensor
+    createSimpleModelFile();
+    std::ifstream in(test_file_path_, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream out(test_file_path_, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), 40);
+    out.close();
+    EXPECT_THROW(ModelLoader::loadFromFile(test_file_path_, LoadMode::MMAP), std::runtime_error);
+    EXPECT_THROW(ModelLoader::loadFromFile(test_file_path_), std::runtime_error);
+}
+
+TEST_F(ModelLoaderTest, SaveAndLoadV2) 
+{
+    auto model = std::make_unique<Model>();
+    std::vector<float> weights(5 * 7);
+    for (size_t i = 0; i < weights.size(); ++i)
+    {
+        weights[i] = static_cast<float>(i) * 0.25f - 3.0f;
+    }
+    model->addLayer(std::make_unique<LinearLayer>(Tensor({5, 7}, weights), Tensor({7}, std::vector<float>(7, 0.5f))));
+    model->addLayer(std::make_unique<ReLULayer>());
+    model->addLayer(std::make_unique<LinearLayer>(Tensor({7, 3}), Tensor({3}, {1.0f, 2.0f, 3.0f})));
+    model->addLayer(std::make_unique<SoftmaxLayer>());
+    model->setInputShape({5});
+    model->setOutputShape({3});
+    ModelLoader::saveToFile(*model, test_file_path_);
+    
+    // the header says v2 and every payload sits on an aligned offset behind the tables
+    std::ifstream in(test_file_path_, std::ios::binary);
+    ModelFormat::Header header;
+    ModelFormat::ModelInfo info;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    in.read(reinterpret_cast<char*>(&info), sizeof(info));
+    EXPECT_EQ(header.version_major, ModelFormat::VERSION_MAJOR);
+    EXPECT_EQ(header.num_layers, 4U);
+    EXPECT_EQ(info.num_tensors, 4U);
+    in.seekg(static_cast<std::streamoff>(header.num_layers * sizeof(ModelFormat::LayerEntry)), std::ios::cur);
+    for (uint32_t i = 0; i < info.num_tensors; ++i)
+    {
+        ModelFormat::TensorEntry entry;
+        in.read(reinterpret_cast<char*>(&entry), sizeof(entry));
+        EXPECT_EQ(entry.offset % ModelFormat::TENSOR_ALIGNMENT, 0U);
+    }
+    in.close();
+    
+    for (LoadMode mode : {LoadMode::COPY, LoadMode::MMAP})
+    {
+        auto loaded = ModelLoader::loadFromFile(test_file_path_, mode);
+        ASSERT_EQ(loaded->getLayers().size(), 4U);
+        EXPECT_EQ(loaded->getInputShape(), std::vector<size_t>({5}));
+        EXPECT_EQ(loaded->getOutputShape(), std::vector<size_t>({3}));
+        EXPECT_EQ(loaded->getLayers()[3]->getType(), LayerType::SOFTMAX);
+        
+        const auto* linear = dynamic_cast<const LinearLayer*>(loaded->getLayers()[0].get());
+        ASSERT_NE(linear, nullptr);
+        ASSERT_EQ(linear->weights().shape(), std::vector<size_t>({5, 7}));
+        for (size_t i = 0; i < weights.size(); ++i)
+        {
+            EXPECT_EQ(linear->weights().data()[i], weights[i]);
+        }
+        EXPECT_EQ(linear->bias().data()[6], 0.5f);
+        
+        // mapped v2 weights are used straight from the file
+        if (mode == LoadMode::MMAP && MappedFile::supported())
+        {
+            EXPECT_TRUE(linear->weights().isView());
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(linear->weights().data()) % ModelFormat::TENSOR_ALIGNMENT, 0U);
+        }
+        else
+        {
+            EXPECT_FALSE(linear->weights().isView());
+        }
+    }
+}
+
+TEST_F(ModelLoaderTest, CorruptV2Rejected) 
+{
+    auto model = std::make_unique<Model>();
+    model->addLayer(std::make_unique<LinearLayer>(Tensor({2, 3}), Tensor({3})));
+    model->setInputShape({2});
+    model->setOutputShape({3});
+    ModelLoader::saveToFile(*model, test_file_path_);
+    
+    std::ifstream in(test_file_path_, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    
+    auto write_and_expect_failure = [&](const std::vector<char>& contents)
+    {
+        std::ofstream out(test_file_path_, std::ios::binary | std::ios::trunc);
+        out.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        out.close();
+        EXPECT_THROW(ModelLoader::loadFromFile(test_file_path_), std::runtime_error);
+        EXPECT_THROW(ModelLoader::loadFromFile(test_file_path_, LoadMode::MMAP), std::runtime_error);
+    };
+    
+    // payload cut off
+    write_and_expect_failure(std::vector<char>(bytes.begin(), bytes.end() - 4));
+    
+    // bias payload pointed past the end of the file
+    const size_t bias_entry = sizeof(ModelFormat::Header) + sizeof(ModelFormat::ModelInfo) +
+                              sizeof(ModelFormat::LayerEntry) + sizeof(ModelFormat::TensorEntry);
+    std::vector<char> bad_offset = bytes;
+    const uint64_t offset = bytes.size();
+    std::memcpy(bad_offset.data() + bias_entry, &offset, sizeof(offset));
+    write_and_expect_failure(bad_offset);
+    
+    // layer claiming tensors the table doesn't have
+    std::vector<char> bad_layer = bytes;
+    const uint32_t num_tensors = 3;
+    std::memcpy(bad_layer.data() + sizeof(ModelFormat::Header) + sizeof(ModelFormat::ModelInfo) + 8,
+                &num_tensors, sizeof(num_tensors));
+    write_and_expect_failure(bad_layer);
+}
+
 TEST_F(ModelLoaderTest, SaveToFileNotImplemented) 
 {
     Model model;
@@ -241,3 +396,71 @@ TEST_F(ModelLoaderTest, ActivationLayerForward)
     sigmoid.forward(input2, output2);
     EXPECT_NEAR(output2.data()[0], 0.5f, 1e-5);
 }
+
+TEST_F(ModelLoaderTest, ActivationLayerForwardInPlace) 
+{
+    ReLULayer relu;
+    SigmoidLayer sigmoid;
+    SoftmaxLayer softmax;
+    EXPECT_TRUE(relu.supportsInPlace());
+    EXPECT_TRUE(sigmoid.supportsInPlace());
+    EXPECT_TRUE(softmax.supportsInPlace());
+    
+    // the tensor is updated where it is, no new buffer
+    Tensor tensor({3}, {-1.0f, 0.0f, 2.0f});
+    const float* buffer = tensor.data();
+    relu.forwardInPlace(tensor);
+    EXPECT_EQ(tensor.data(), buffer);
+    EXPECT_EQ(tensor.data()[0], 0.0f);
+    EXPECT_EQ(tensor.data()[2], 2.0f);
+    
+    // in place and out of place agree
+    Tensor logits({2, 3}, {1.0f, 2.0f, 3.0f, -1.0f, 0.0f, 1.0f});
+    Tensor expected;
+    softmax.forward(logits, expected);
+    softmax.forwardInPlace(logits);
+    for (size_t i = 0; i < logits.size(); ++i)
+    {
+        EXPECT_FLOAT_EQ(logits.data()[i], expected.data()[i]);
+    }
+    
+    // linear layers change the shape, so they can't
+    LinearLayer linear(Tensor({3, 2}), Tensor({2}));
+    EXPECT_FALSE(linear.supportsInPlace());
+    EXPECT_THROW(linear.forwardInPlace(tensor), std::runtime_error);
+}
+
+TEST_F(ModelLoaderTest, LinearLayerFusion) 
+{
+    LinearLayer linear(Tensor({3, 2}, {1.0f, -1.0f, 2.0f, 0.5f, -3.0f, 1.0f}), Tensor({2}, {0.5f, -0.5f}));
+    ReLULayer relu;
+    SigmoidLayer sigmoid;
+    SoftmaxLayer softmax;
+    LinearLayer other(Tensor({2, 2}), Tensor({2}));
+    EXPECT_TRUE(linear.canFuse(relu));
+    EXPECT_TRUE(linear.canFuse(sigmoid));
+    EXPECT_TRUE(linear.canFuse(softmax));
+    EXPECT_FALSE(linear.canFuse(other));
+    EXPECT_FALSE(relu.canFuse(sigmoid));
+    
+    // fused and separate layers agree
+    Tensor input({2, 3}, {1.0f, 2.0f, 3.0f, -1.0f, 0.5f, 0.0f});
+    for (Layer* next : std::vector<Layer*>{&relu, &sigmoid, &softmax})
+    {
+        Tensor expected;
+        linear.forward(input, expected);
+        next->forwardInPlace(expected);
+        
+        Tensor actual;
+        linear.forwardFused(input, actual, *next, nullptr);
+        ASSERT_EQ(actual.shape(), expected.shape());
+        for (size_t i = 0; i < actual.size(); ++i)
+        {
+            EXPECT_NEAR(actual.data()[i], expected.data()[i], 1e-6f);
+        }
+    }
+    
+    Tensor output;
+    EXPECT_THROW(linear.forwardFused(input, output, other, nullptr), std::runtime_error);
+    EXPECT_THROW(relu.forwardFused(input, output, sigmoid, nullptr), std::runtime_error);
+}
@@ -0,0 +1,155 @@
+/* perf_counters_test.cpp
+ *
+ * Tests for the hardware counters: count arithmetic, graceful fallback where
+ * perf_event_open isn't permitted, and the per-layer counts the engine collects.
+ */
+
+#include <gtest/gtest.h>
+#include "inference_engine.h"
+#include "perf_counters.h"
+#include <vector>
+
+using namespace mininn;
+
+namespace
+{
+    PerfCounts makeCounts(uint64_t cycles, uint64_t instructions, uint64_t llc_misses, uint32_t available)
+    {
+        PerfCounts counts;
+        counts.values[static_cast<size_t>(PerfEvent::CYCLES)] = cycles;
+        counts.values[static_cast<size_t>(PerfEvent::INSTRUCTIONS)] = instructions;
+        counts.values[static_cast<size_t>(PerfEvent::LLC_MISSES)] = llc_misses;
+        counts.available = available;
+        return counts;
+    }
+
+    // linear -> relu -> linear -> softmax, relu and softmax fuse into the linears
+    std::shared_ptr<const Model> makeModel()
+    {
+        const size_t in = 16, hidden = 8, out = 4;
+        std::vector<float> w1(in * hidden, 0.05f), b1(hidden, 0.1f), w2(hidden * out, -0.1f), b2(out, 0.0f);
+        auto model = std::make_unique<Model>();
+        model->addLayer(std::make_unique<LinearLayer>(Tensor({in, hidden}, w1), Tensor({hidden}, b1)));
+        model->addLayer(std::make_unique<ReLULayer>());
+        model->addLayer(std::make_unique<LinearLayer>(Tensor({hidden, out}, w2), Tensor({out}, b2)));
+        model->addLayer(std::make_unique<SoftmaxLayer>());
+        model->setInputShape({in});
+        model->setOutputShape({out});
+        return model;
+    }
+}
+
+TEST(PerfCountersTest, CountArithmetic)
+{
+    const uint32_t all = (1u << NUM_PERF_EVENTS) - 1;
+    const uint32_t no_llc = all & ~(1u << static_cast<size_t>(PerfEvent::LLC_MISSES));
+
+    PerfCounts empty;
+    EXPECT_TRUE(empty.empty());
+    EXPECT_EQ(empty.ipc(), 0.0);
+
+    const PerfCounts before = makeCounts(1000, 1500, 10, all);
+    const PerfCounts after = makeCounts(3000, 5500, 30, all);
+    const PerfCounts delta = after - before;
+    EXPECT_EQ(delta.get(PerfEvent::CYCLES), 2000U);
+    EXPECT_DOUBLE_EQ(delta.ipc(), 2.0);
+    EXPECT_EQ(delta.memoryBytes(), 20 * PerfCounts::CACHE_LINE_BYTES);
+
+    // an empty total takes the first counts' events, after that only events both have stay
+    PerfCounts total;
+    total += delta;
+    EXPECT_EQ(total.available, all);
+    total += makeCounts(100, 100, 5, no_llc);
+    EXPECT_FALSE(total.has(PerfEvent::LLC_MISSES));
+    EXPECT_EQ(total.get(PerfEvent::LLC_MISSES), 0U);
+    EXPECT_EQ(total.get(PerfEvent::INSTRUCTIONS), 4100U);
+
+    // ipc needs both cycles and instructions
+    EXPECT_EQ(makeCounts(100, 200, 0, 1u << static_cast<size_t>(PerfEvent::INSTRUCTIONS)).ipc(), 0.0);
+
+    LayerCounters layer;
+    layer.counts = delta;
+    EXPECT_EQ(layer.bytesPerFlop(), 0.0);
+    layer.flops = 640;
+    EXPECT_DOUBLE_EQ(layer.bytesPerFlop(), 2.0);
+    layer.counts.available = no_llc;
+    EXPECT_EQ(layer.bytesPerFlop(), 0.0);
+
+    EXPECT_STREQ(perfEventName(PerfEvent::BRANCH_MISSES), "branch_misses");
+}
+
+TEST(PerfCountersTest, OpensOrSaysWhyNot)
+{
+    PerfCounters counters;
+    if (!counters.available())
+    {
+        // containers and VMs without a PMU: nothing counted, but a reason
+        EXPECT_FALSE(counters.error().empty());
+        EXPECT_TRUE(counters.read().empty());
+        return;
+    }
+
+    const PerfCounts start = counters.read();
+    volatile double sink = 0.0;
+    for (int i = 0; i < 100000; ++i)
+    {
+        sink = sink + i;
+    }
+    const PerfCounts work = counters.read() - start;
+    if (work.has(PerfEvent::INSTRUCTIONS))
+    {
+        EXPECT_GT(work.get(PerfEvent::INSTRUCTIONS), 100000U);
+    }
+    if (work.has(PerfEvent::CYCLES))
+    {
+        EXPECT_GT(work.get(PerfEvent::CYCLES), 0U);
+    }
+}
+
+TEST(PerfCountersTest, EngineCountsEveryLayer)
+{
+    InferenceEngine engine(makeModel());
+    const bool available = PerfCounters::forThisThread().available();
+
+    // profiling alone doesn't touch the counters
+    engine.enableProfiling(true);
+    engine.predict(Tensor({16}, std::vector<float>(16, 1.0f)));
+    EXPECT_TRUE(engine.getLastInferenceStats().layer_counters.empty());
+    EXPECT_FALSE(engine.getLastInferenceStats().counters_available);
+
+    engine.enableHardwareCounters(true);
+    engine.predict(Tensor({16}, std::vector<float>(16, 1.0f)));
+    const InferenceStats& stats = engine.getLastInferenceStats();
+    EXPECT_EQ(stats.counters_available, available);
+    ASSERT_EQ(stats.layer_counters.size(), 4U);
+
+    // the fused relu and softmax count under their linears: 8 * (2 * 16 + 1) + 8 and 4 * (2 * 8 + 1) + 5 * 4
+    EXPECT_EQ(stats.layer_counters[0].flops, 272U);
+    EXPECT_EQ(stats.layer_counters[1].flops, 0U);
+    EXPECT_EQ(stats.layer_counters[2].flops, 88U);
+    EXPECT_TRUE(stats.layer_counters[1].counts.empty());
+    if (available)
+    {
+        EXPECT_FALSE(stats.layer_counters[0].counts.empty());
+        EXPECT_FALSE(stats.counters.empty());
+    }
+    else
+    {
+        EXPECT_TRUE(stats.counters.empty());
+        EXPECT_EQ(stats.layer_counters[0].ipc(), 0.0);
+    }
+
+    // batch slices on pool threads add up to the work of the whole batch
+    InferenceEngine threaded = engine.clone();
+    threaded.setNumThreads(2);
+    std::vector<Tensor> inputs(64, Tensor({16}, std::vector<float>(16, 0.5f)));
+    threaded.predictBatch(inputs);
+    const InferenceStats& batch_stats = threaded.getLastInferenceStats();
+    ASSERT_EQ(batch_stats.layer_counters.size(), 4U);
+    EXPECT_EQ(batch_stats.layer_counters[0].flops, 64U * 272U);
+    EXPECT_EQ(batch_stats.layer_counters[2].flops, 64U * 88U);
+
+    engine.enableHardwareCounters(false);
+    engine.predict(Tensor({16}, std::vector<float>(16, 1.0f)));
+    EXPECT_TRUE(engine.getLastInferenceStats().layer_counters.empty());
+}
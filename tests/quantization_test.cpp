@@ -0,0 +1,489 @@
+/* quantization_test.cpp
+ *
+ * Tests for int8 and int4 post-training quantization: the quantizers themselves,
+ * the quantized linear layers against their float originals, and quantized
+ * models end to end. Also covers fp16 / bf16 weight conversion.
+ */
+
+#include <gtest/gtest.h>
+#include "quantization.h"
+#include "inference_engine.h"
+#include "model_loader.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+
+using namespace mininn;
+
+class QuantizationTest : public ::testing::Test
+{
+protected:
+    void TearDown() override
+    {
+        std::remove(model_path_.c_str());
+        std::remove(samples_path_.c_str());
+    }
+
+    // deterministic values in [-range, range]
+    std::vector<float> makeData(size_t n, float range, size_t seed = 0) const
+    {
+        std::vector<float> data(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            data[i] = (static_cast<float>((i * 53 + seed * 17 + 11) % 97) / 48.0f - 1.0f) * range;
+        }
+        return data;
+    }
+
+    std::unique_ptr<LinearLayer> linear(size_t in_features, size_t out_features, size_t seed) const
+    {
+        return std::make_unique<LinearLayer>(Tensor({in_features, out_features}, makeData(in_features * out_features, 0.5f, seed)),
+                                             Tensor({out_features}, makeData(out_features, 0.1f, seed + 1)));
+    }
+
+    // Linear(24 -> 70) -> ReLU -> Linear(70 -> 5) -> Softmax
+    std::unique_ptr<Model> makeModel() const
+    {
+        auto model = std::make_unique<Model>();
+        model->addLayer(linear(24, 70, 1));
+        model->addLayer(std::make_unique<ReLULayer>());
+        model->addLayer(linear(70, 5, 2));
+        model->addLayer(std::make_unique<SoftmaxLayer>());
+        model->setInputShape({24});
+        model->setOutputShape({5});
+        return model;
+    }
+
+    std::vector<Tensor> makeSamples(size_t count) const
+    {
+        std::vector<Tensor> samples;
+        for (size_t i = 0; i < count; ++i)
+        {
+            samples.emplace_back(std::vector<size_t>{24}, makeData(24, 1.0f, i));
+        }
+        return samples;
+    }
+
+    std::string model_path_ = "/tmp/quantization_test.minn";
+    std::string samples_path_ = "/tmp/quantization_test_samples.f32";
+};
+
+TEST_F(QuantizationTest, Int8RoundTrip)
+{
+    EXPECT_FLOAT_EQ(Quantization::int8Scale(0.0f), 1.0f);
+
+    const std::vector<float> x = {-2.0f, -0.7f, 0.0f, 0.3f, 1.99f, 2.0f};
+    const float scale = Quantization::int8Scale(Quantization::maxAbs(x.data(), x.size()));
+    EXPECT_FLOAT_EQ(scale, 2.0f / 127.0f);
+
+    std::vector<int8_t> q(x.size());
+    Quantization::quantizeInt8(x.data(), x.size(), scale, q.data());
+    EXPECT_EQ(q.front(), -127);
+    EXPECT_EQ(q.back(), 127);
+    for (size_t i = 0; i < x.size(); ++i)
+    {
+        EXPECT_LE(std::fabs(q[i] * scale - x[i]), scale * 0.5f + 1e-6f);
+    }
+
+    // values past the calibrated range saturate
+    const float outside[2] = {-10.0f, 10.0f};
+    Quantization::quantizeInt8(outside, 2, scale, q.data());
+    EXPECT_EQ(q[0], -127);
+    EXPECT_EQ(q[1], 127);
+}
+
+TEST_F(QuantizationTest, QuantizedLinearMatchesFloat)
+{
+    auto layer = linear(70, 33, 3);
+    const Tensor batch({5, 70}, makeData(5 * 70, 1.0f, 4));
+
+    Tensor expected;
+    layer->forward(batch, expected);
+
+    // per row scales at run time, and a static scale from the batch's range
+    const float static_scale = Quantization::int8Scale(Quantization::maxAbs(batch.data(), batch.size()));
+    for (float input_scale : {0.0f, static_scale})
+    {
+        auto quantized = QuantizedLinearLayer::quantize(*layer, input_scale);
+        EXPECT_EQ(quantized->getType(), LayerType::LINEAR_INT8);
+        EXPECT_EQ(quantized->outputShape({5, 70}), std::vector<size_t>({5, 33}));
+
+        Tensor actual;
+        quantized->forward(batch, actual);
+        ASSERT_EQ(actual.shape(), expected.shape());
+        for (size_t i = 0; i < actual.size(); ++i)
+        {
+            EXPECT_NEAR(actual.data()[i], expected.data()[i], 0.05f) << "input_scale=" << input_scale << " i=" << i;
+        }
+
+        // a single sample is the same as a one row batch
+        Tensor row({70}, std::vector<float>(batch.data(), batch.data() + 70));
+        Tensor single;
+        quantized->forward(row, single);
+        for (size_t j = 0; j < 33; ++j)
+        {
+            EXPECT_FLOAT_EQ(single.data()[j], actual.data()[j]);
+        }
+
+        // the fused relu matches relu applied afterwards
+        ReLULayer relu;
+        Tensor fused;
+        quantized->forwardFused(batch, fused, relu, nullptr);
+        relu.forwardInPlace(actual);
+        for (size_t i = 0; i < actual.size(); ++i)
+        {
+            EXPECT_FLOAT_EQ(fused.data()[i], actual.data()[i]);
+        }
+    }
+
+    EXPECT_THROW(QuantizedLinearLayer::quantize(*layer, -1.0f), std::invalid_argument);
+}
+
+TEST_F(QuantizationTest, CalibratedModelMatchesFloat)
+{
+    auto model = makeModel();
+    const std::vector<Tensor> samples = makeSamples(16);
+
+    // ranges are recorded at every layer's input
+    const std::vector<float> ranges = Quantization::calibrate(*model, samples);
+    ASSERT_EQ(ranges.size(), 4U);
+    EXPECT_FLOAT_EQ(ranges[0], 1.0f);
+    EXPECT_GT(ranges[2], 0.0f);
+
+    auto quantized = Quantization::quantizeInt8(*model, samples);
+    ASSERT_EQ(quantized->getLayers().size(), 4U);
+    EXPECT_EQ(quantized->getLayers()[0]->getType(), LayerType::LINEAR_INT8);
+    EXPECT_EQ(quantized->getLayers()[1]->getType(), LayerType::RELU);
+    const auto* first = dynamic_cast<const QuantizedLinearLayer*>(quantized->getLayers()[0].get());
+    ASSERT_NE(first, nullptr);
+    EXPECT_FLOAT_EQ(first->inputScale(), Quantization::int8Scale(1.0f));
+
+    InferenceEngine float_engine(std::move(model));
+    InferenceEngine int8_engine(std::move(quantized));
+    EXPECT_EQ(int8_engine.getNumFusedLayers(), 2U);
+
+    for (const Tensor& sample : samples)
+    {
+        Tensor expected = float_engine.predict(sample);
+        Tensor actual = int8_engine.predict(sample);
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            EXPECT_NEAR(actual.data()[i], expected.data()[i], 0.02f);
+        }
+    }
+
+    std::vector<Tensor> expected = float_engine.predictBatch(samples);
+    std::vector<Tensor> actual = int8_engine.predictBatch(samples);
+    for (size_t b = 0; b < samples.size(); ++b)
+    {
+        for (size_t i = 0; i < 5; ++i)
+        {
+            EXPECT_NEAR(actual[b].data()[i], expected[b].data()[i], 0.02f);
+        }
+    }
+}
+
+TEST_F(QuantizationTest, SaveAndLoadInt8Model)
+{
+    auto quantized = Quantization::quantizeInt8(*makeModel(), makeSamples(4));
+    ModelLoader::saveToFile(*quantized, model_path_);
+
+    // a quarter of the float weight bytes, plus a little for the scales
+    std::ifstream file(model_path_, std::ios::binary | std::ios::ate);
+    ModelLoader::saveToFile(*makeModel(), model_path_ + ".fp32");
+    std::ifstream float_file(model_path_ + ".fp32", std::ios::binary | std::ios::ate);
+    EXPECT_LT(static_cast<double>(file.tellg()), 0.5 * static_cast<double>(float_file.tellg()));
+    std::remove((model_path_ + ".fp32").c_str());
+
+    InferenceEngine original(std::move(quantized));
+    const Tensor input({24}, makeData(24, 1.0f, 7));
+    Tensor expected = original.predict(input);
+
+    for (LoadMode mode : {LoadMode::COPY, LoadMode::MMAP})
+    {
+        auto loaded = ModelLoader::loadFromFile(model_path_, mode);
+        ASSERT_EQ(loaded->getLayers()[2]->getType(), LayerType::LINEAR_INT8);
+
+        InferenceEngine engine(std::move(loaded));
+        Tensor actual = engine.predict(input);
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            EXPECT_FLOAT_EQ(actual.data()[i], expected.data()[i]);
+        }
+    }
+}
+
+TEST_F(QuantizationTest, Int4PackRoundTrip)
+{
+    EXPECT_FLOAT_EQ(Quantization::int4Scale(0.0f), 1.0f);
+    EXPECT_FLOAT_EQ(Quantization::int4Scale(3.5f), 0.5f);
+
+    const std::vector<float> x = makeData(2 * Kernels::INT4_BLOCK, 3.5f);
+    std::vector<int8_t> q(x.size());
+    Quantization::quantizeInt4(x.data(), x.size(), 0.5f, q.data());
+    for (size_t i = 0; i < x.size(); ++i)
+    {
+        EXPECT_GE(q[i], -7);
+        EXPECT_LE(q[i], 7);
+        EXPECT_LE(std::fabs(q[i] * 0.5f - x[i]), 0.25f + 1e-6f);
+    }
+
+    std::vector<uint8_t> packed(x.size() / 2);
+    Quantization::packInt4(q.data(), q.size(), packed.data());
+    for (size_t i = 0; i < q.size(); ++i)
+    {
+        EXPECT_EQ(Quantization::unpackInt4(packed.data(), i), q[i]) << "i=" << i;
+    }
+
+    // first half of a block in the low nibbles, second half in the high ones
+    EXPECT_EQ(packed[0] & 0x0f, q[0] + 8);
+    EXPECT_EQ(packed[0] >> 4, q[Kernels::INT4_BLOCK / 2] + 8);
+}
+
+TEST_F(QuantizationTest, Int4LinearMatchesFloat)
+{
+    // 70 inputs end mid-group, so the rows are padded and the inputs copied
+    auto layer = linear(70, 33, 3);
+    const Tensor batch({6, 70}, makeData(6 * 70, 1.0f, 4));
+
+    Tensor expected;
+    layer->forward(batch, expected);
+
+    for (size_t group_size : {32u, 64u, 128u})
+    {
+        auto quantized = Int4LinearLayer::quantize(*layer, group_size);
+        EXPECT_EQ(quantized->getType(), LayerType::LINEAR_INT4);
+        EXPECT_EQ(quantized->paddedInFeatures() % group_size, 0U);
+        EXPECT_EQ(quantized->scales().shape(), std::vector<size_t>({33, quantized->paddedInFeatures() / group_size}));
+        EXPECT_EQ(quantized->outputShape({6, 70}), std::vector<size_t>({6, 33}));
+
+        Tensor actual;
+        quantized->forward(batch, actual);
+        ASSERT_EQ(actual.shape(), expected.shape());
+        for (size_t i = 0; i < actual.size(); ++i)
+        {
+            EXPECT_NEAR(actual.data()[i], expected.data()[i], 0.5f) << "group_size=" << group_size << " i=" << i;
+        }
+
+        // a single sample is the same as a one row batch
+        Tensor row({70}, std::vector<float>(batch.data(), batch.data() + 70));
+        Tensor single;
+        quantized->forward(row, single);
+        for (size_t j = 0; j < 33; ++j)
+        {
+            EXPECT_NEAR(single.data()[j], actual.data()[j], 1e-5f);
+        }
+
+        // the fused relu matches relu applied afterwards
+        ReLULayer relu;
+        Tensor fused;
+        quantized->forwardFused(batch, fused, relu, nullptr);
+        relu.forwardInPlace(actual);
+        for (size_t i = 0; i < actual.size(); ++i)
+        {
+            EXPECT_FLOAT_EQ(fused.data()[i], actual.data()[i]);
+        }
+    }
+
+    EXPECT_THROW(Int4LinearLayer::quantize(*layer, 0), std::invalid_argument);
+    EXPECT_THROW(Int4LinearLayer::quantize(*layer, 48), std::invalid_argument);
+}
+
+TEST_F(QuantizationTest, SaveAndLoadInt4Model)
+{
+    auto quantized = Quantization::quantizeInt4(*makeModel(), 32);
+    ASSERT_EQ(quantized->getLayers().size(), 4U);
+    EXPECT_EQ(quantized->getLayers()[0]->getType(), LayerType::LINEAR_INT4);
+    EXPECT_EQ(quantized->getLayers()[3]->getType(), LayerType::SOFTMAX);
+    ModelLoader::saveToFile(*quantized, model_path_);
+
+    InferenceEngine float_engine(makeModel());
+    InferenceEngine original(std::move(quantized));
+    EXPECT_EQ(original.getNumFusedLayers(), 2U);
+    const Tensor input({24}, makeData(24, 1.0f, 7));
+    Tensor expected = original.predict(input);
+    Tensor reference = float_engine.predict(input);
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        EXPECT_NEAR(expected.data()[i], reference.data()[i], 0.1f);
+    }
+
+    for (LoadMode mode : {LoadMode::COPY, LoadMode::MMAP})
+    {
+        auto loaded = ModelLoader::loadFromFile(model_path_, mode);
+        const auto* first = dynamic_cast<const Int4LinearLayer*>(loaded->getLayers()[0].get());
+        ASSERT_NE(first, nullptr);
+        EXPECT_EQ(first->groupSize(), 32U);
+        EXPECT_EQ(first->inFeatures(), 24U);
+
+        InferenceEngine engine(std::move(loaded));
+        Tensor actual = engine.predict(input);
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            EXPECT_FLOAT_EQ(actual.data()[i], expected.data()[i]);
+        }
+    }
+}
+
+TEST_F(QuantizationTest, Int4HalfPrecisionScales)
+{
+    InferenceEngine float_engine(makeModel());
+    const Tensor input({24}, makeData(24, 1.0f, 7));
+    const Tensor reference = float_engine.predict(input);
+
+    ModelLoader::saveToFile(*Quantization::quantizeInt4(*makeModel(), 32), model_path_);
+    const auto fp32_scales_bytes = std::ifstream(model_path_, std::ios::binary | std::ios::ate).tellg();
+
+    for (DataType dtype : {DataType::FLOAT16, DataType::BFLOAT16})
+    {
+        auto quantized = Quantization::quantizeInt4(*makeModel(), 32, dtype);
+        const auto* first = dynamic_cast<const Int4LinearLayer*>(quantized->getLayers()[0].get());
+        ASSERT_NE(first, nullptr);
+        EXPECT_EQ(first->scaleType(), dtype);
+
+        // the kernels get fp32 scales, each exactly what the 16-bit type holds
+        const Tensor& scales = first->scales();
+        ASSERT_EQ(scales.dtype(), DataType::FLOAT32);
+        const Tensor rounded = scales.to(dtype).to(DataType::FLOAT32);
+        for (size_t i = 0; i < scales.size(); ++i)
+        {
+            EXPECT_EQ(scales.data()[i], rounded.data()[i]) << dataTypeName(dtype) << " i=" << i;
+        }
+        ModelLoader::saveToFile(*quantized, model_path_);
+        EXPECT_LT(std::ifstream(model_path_, std::ios::binary | std::ios::ate).tellg(), fp32_scales_bytes);
+
+        InferenceEngine original(std::move(quantized));
+        const Tensor expected = original.predict(input);
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            EXPECT_NEAR(expected.data()[i], reference.data()[i], 0.1f) << dataTypeName(dtype);
+        }
+
+        // stored in their own dtype, widened again on load
+        for (LoadMode mode : {LoadMode::COPY, LoadMode::MMAP})
+        {
+            auto loaded = ModelLoader::loadFromFile(model_path_, mode);
+            const auto* layer = dynamic_cast<const Int4LinearLayer*>(loaded->getLayers()[0].get());
+            ASSERT_NE(layer, nullptr);
+            EXPECT_EQ(layer->scaleType(), dtype);
+            EXPECT_EQ(layer->scales().dtype(), DataType::FLOAT32);
+
+            InferenceEngine engine(std::move(loaded));
+            const Tensor actual = engine.predict(input);
+            for (size_t i = 0; i < expected.size(); ++i)
+            {
+                EXPECT_FLOAT_EQ(actual.data()[i], expected.data()[i]);
+            }
+        }
+    }
+
+    // weights whose scale overflows fp16, and scales that aren't float at all
+    auto huge = std::make_unique<LinearLayer>(Tensor({32, 1}, std::vector<float>(32, 1e6f)), Tensor({1}));
+    EXPECT_THROW(Int4LinearLayer::quantize(*huge, 32, DataType::FLOAT16), std::invalid_argument);
+    EXPECT_NO_THROW(Int4LinearLayer::quantize(*huge, 32, DataType::BFLOAT16));
+    EXPECT_THROW(Int4LinearLayer::quantize(*linear(32, 2, 1), 32, DataType::INT8), std::invalid_argument);
+}
+
+TEST_F(QuantizationTest, ParameterBytesByType)
+{
+    auto model = makeModel();
+    const size_t biases = (70 + 5) * sizeof(float);
+    ParameterBytes fp32 = model->parameterBytes();
+    EXPECT_EQ(fp32.by_type[static_cast<size_t>(DataType::FLOAT32)], (24 * 70 + 70 * 5) * sizeof(float) + biases);
+    EXPECT_EQ(fp32.total(), fp32.by_type[static_cast<size_t>(DataType::FLOAT32)]);
+    EXPECT_EQ(fp32.mapped, 0U);
+
+    ParameterBytes fp16 = Quantization::convertWeights(*model, DataType::FLOAT16)->parameterBytes();
+    EXPECT_EQ(fp16.by_type[static_cast<size_t>(DataType::FLOAT16)], (24 * 70 + 70 * 5) * 2);
+    EXPECT_EQ(fp16.by_type[static_cast<size_t>(DataType::FLOAT32)], biases);
+
+    // int8 rows are padded, and each output channel keeps a weight sum and a scale
+    const size_t align = Kernels::INT8_K_ALIGNMENT;
+    const size_t padded_24 = (24 + align - 1) / align * align;
+    const size_t padded_70 = (70 + align - 1) / align * align;
+    ParameterBytes int8 = Quantization::quantizeInt8(*model, {})->parameterBytes();
+    EXPECT_EQ(int8.by_type[static_cast<size_t>(DataType::INT8)], 70 * padded_24 + 5 * padded_70);
+    EXPECT_EQ(int8.other, (70 + 5) * sizeof(int32_t));
+    EXPECT_EQ(int8.by_type[static_cast<size_t>(DataType::FLOAT32)], 2 * biases);
+
+    // int4 in groups of 32: 24 -> 32 and 70 -> 96 inputs, one scale per group
+    auto int4_model = Quantization::quantizeInt4(*model, 32);
+    ParameterBytes int4 = int4_model->parameterBytes();
+    EXPECT_EQ(int4.by_type[static_cast<size_t>(DataType::INT4)], 70 * 32 / 2 + 5 * 96 / 2);
+    EXPECT_EQ(int4.by_type[static_cast<size_t>(DataType::FLOAT32)], (70 * 1 + 5 * 3) * sizeof(float) + biases);
+
+    // mapped weights are read in place, so they don't count against the heap
+    ModelLoader::saveToFile(*int4_model, model_path_);
+    auto mapped = ModelLoader::loadFromFile(model_path_, LoadMode::MMAP);
+    ParameterBytes in_place = mapped->parameterBytes();
+    EXPECT_EQ(in_place.total(), int4.total());
+    EXPECT_EQ(in_place.mapped, in_place.total());
+    EXPECT_EQ(in_place.heap(), 0U);
+    EXPECT_EQ(mapped->mappedBytes(), static_cast<size_t>(std::ifstream(model_path_, std::ios::binary | std::ios::ate).tellg()));
+}
+
+TEST_F(QuantizationTest, HalfPrecisionWeights)
+{
+    InferenceEngine float_engine(makeModel());
+    const Tensor input({24}, makeData(24, 1.0f, 7));
+    const Tensor reference = float_engine.predict(input);
+
+    for (DataType dtype : {DataType::FLOAT16, DataType::BFLOAT16})
+    {
+        auto converted = Quantization::convertWeights(*makeModel(), dtype);
+        const auto* first = dynamic_cast<const LinearLayer*>(converted->getLayers()[0].get());
+        ASSERT_NE(first, nullptr);
+        EXPECT_EQ(first->weights().dtype(), dtype);
+        EXPECT_EQ(first->bias().dtype(), DataType::FLOAT32);
+        ModelLoader::saveToFile(*converted, model_path_);
+
+        // same fusion as the float model, outputs within the rounding of the weights
+        InferenceEngine original(std::move(converted));
+        EXPECT_EQ(original.getNumFusedLayers(), 2U);
+        const Tensor expected = original.predict(input);
+        const float tolerance = dtype == DataType::FLOAT16 ? 1e-3f : 1e-2f;
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            EXPECT_NEAR(expected.data()[i], reference.data()[i], tolerance) << dataTypeName(dtype);
+        }
+
+        for (LoadMode mode : {LoadMode::COPY, LoadMode::MMAP})
+        {
+            auto loaded = ModelLoader::loadFromFile(model_path_, mode);
+            const auto* layer = dynamic_cast<const LinearLayer*>(loaded->getLayers()[0].get());
+            ASSERT_NE(layer, nullptr);
+            EXPECT_EQ(layer->weights().dtype(), dtype);
+            EXPECT_EQ(layer->weights().isView(), mode == LoadMode::MMAP);
+
+            InferenceEngine engine(std::move(loaded));
+            const Tensor actual = engine.predict(input);
+            for (size_t i = 0; i < expected.size(); ++i)
+            {
+                EXPECT_FLOAT_EQ(actual.data()[i], expected.data()[i]);
+            }
+        }
+    }
+
+    // quantizing a half precision model starts from its widened weights
+    auto int8 = Quantization::quantizeInt8(*Quantization::convertWeights(*makeModel(), DataType::FLOAT16), {});
+    EXPECT_EQ(int8->getLayers()[0]->getType(), LayerType::LINEAR_INT8);
+
+    EXPECT_THROW(Quantization::convertWeights(*makeModel(), DataType::INT8), std::invalid_argument);
+}
+
+TEST_F(QuantizationTest, LoadSamples)
+{
+    const std::vector<float> values = makeData(3 * 24, 1.0f);
+    std::ofstream out(samples_path_, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(float)));
+    out.close();
+
+    std::vector<Tensor> samples = Quantization::loadSamples(samples_path_, {24});
+    ASSERT_EQ(samples.size(), 3U);
+    EXPECT_EQ(samples[2].shape(), std::vector<size_t>({24}));
+    EXPECT_FLOAT_EQ(samples[1].data()[0], values[24]);
+
+    EXPECT_THROW(Quantization::loadSamples(samples_path_, {25}), std::runtime_error);
+    EXPECT_THROW(Quantization::loadSamples("/nonexistent/samples.f32", {24}), std::runtime_error);
+}
@@ -0,0 +1,142 @@
+/* roofline_test.cpp
+ *
+ * Tests for the roofline report: the bytes layers say they move, the roof
+ * arithmetic, the peak microbenchmarks, and the per-pass rows made from a
+ * profiled model.
+ */
+
+#include <gtest/gtest.h>
+#include "roofline.h"
+#include <sstream>
+#include <vector>
+
+using namespace mininn;
+
+namespace
+{
+    // linear -> relu -> linear -> softmax, relu and softmax fuse into the linears
+    std::shared_ptr<const Model> makeModel()
+    {
+        const size_t in = 16, hidden = 8, out = 4;
+        std::vector<float> w1(in * hidden, 0.05f), b1(hidden, 0.1f), w2(hidden * out, -0.1f), b2(out, 0.0f);
+        auto model = std::make_unique<Model>();
+        model->addLayer(std::make_unique<LinearLayer>(Tensor({in, hidden}, w1), Tensor({hidden}, b1)));
+        model->addLayer(std::make_unique<ReLULayer>());
+        model->addLayer(std::make_unique<LinearLayer>(Tensor({hidden, out}, w2), Tensor({out}, b2)));
+        model->addLayer(std::make_unique<SoftmaxLayer>());
+        model->setInputShape({in});
+        model->setOutputShape({out});
+        return model;
+    }
+}
+
+TEST(RooflineTest, LayersCountCompulsoryBytes)
+{
+    auto model = makeModel();
+    const auto& layers = model->getLayers();
+
+    // input 16 + output 8 floats, 16 * 8 weights and 8 biases
+    EXPECT_EQ(layers[0]->bytesMoved({16}), (16 + 8 + 128 + 8) * sizeof(float));
+    EXPECT_EQ(layers[0]->bytesMoved({4, 16}), (64 + 32 + 128 + 8) * sizeof(float));
+    // activations read and write their tensor and have no parameters
+    EXPECT_EQ(layers[1]->bytesMoved({4, 8}), 2 * 32 * sizeof(float));
+}
+
+TEST(RooflineTest, RoofArithmetic)
+{
+    MachinePeak peak;
+    EXPECT_EQ(peak.ridgePoint(), 0.0);
+
+    peak.gflops = 100.0;
+    peak.gbytes_per_second = 20.0;
+    EXPECT_DOUBLE_EQ(peak.ridgePoint(), 5.0);
+    EXPECT_DOUBLE_EQ(peak.attainableGflops(1.0), 20.0);
+    EXPECT_DOUBLE_EQ(peak.attainableGflops(50.0), 100.0);
+
+    RooflineReport report;
+    report.peak = peak;
+    LayerRoofline layer;
+    layer.flops = 2000000;
+    layer.bytes = 1000000;
+    layer.time_ms = 0.1;                              // 20 GFLOP/s at 2 flop/byte, under a 40 GFLOP/s roof
+    EXPECT_DOUBLE_EQ(layer.gflops(), 20.0);
+    EXPECT_DOUBLE_EQ(layer.intensity(), 2.0);
+    EXPECT_DOUBLE_EQ(report.percentOfPeak(layer), 20.0);
+    EXPECT_DOUBLE_EQ(report.percentOfRoof(layer), 50.0);
+    EXPECT_TRUE(report.memoryBound(layer));
+
+    layer.bytes = 0;
+    EXPECT_EQ(layer.intensity(), 0.0);
+}
+
+TEST(RooflineTest, MeasuresMachinePeak)
+{
+    const MachinePeak peak = MachinePeak::measure(nullptr, std::chrono::milliseconds(1));
+    EXPECT_GT(peak.gflops, 0.0);
+    EXPECT_GT(peak.gbytes_per_second, 0.0);
+    EXPECT_EQ(peak.threads, 1U);
+
+    // one copy of each microbenchmark per pool thread, all started together
+    ThreadPool pool(3);
+    const MachinePeak pooled = MachinePeak::measure(&pool, std::chrono::milliseconds(1));
+    EXPECT_GT(pooled.gflops, 0.0);
+    EXPECT_GT(pooled.gbytes_per_second, 0.0);
+    EXPECT_EQ(pooled.threads, 3U);
+}
+
+TEST(RooflineTest, ReportsEveryPass)
+{
+    InferenceEngine engine(makeModel());
+    MachinePeak peak;
+    peak.gflops = 100.0;
+    peak.gbytes_per_second = 10.0;
+
+    const RooflineReport report = measureRoofline(engine, peak, 1, 20);
+    EXPECT_EQ(report.runs, 20U);
+    EXPECT_EQ(report.input_shape, std::vector<size_t>({16}));
+    ASSERT_EQ(report.layers.size(), 2U);
+    EXPECT_EQ(report.layers[0].index, 0U);
+    EXPECT_EQ(report.layers[0].name, "Linear+ReLU");
+    EXPECT_EQ(report.layers[0].flops, 272U);
+    EXPECT_EQ(report.layers[0].bytes, engine.getModel()->getLayers()[0]->bytesMoved({16}));
+    EXPECT_EQ(report.layers[1].index, 2U);
+    EXPECT_EQ(report.layers[1].name, "Linear+Softmax");
+    EXPECT_EQ(report.layers[1].flops, 88U);
+    EXPECT_EQ(report.totalFlops(), 360U);
+    EXPECT_GT(report.total_ms, 0.0);
+    for (const auto& layer : report.layers)
+    {
+        EXPECT_GE(layer.time_ms, 0.0);
+        EXPECT_LE(layer.time_ms, report.total_ms);
+    }
+
+    // profiled on a clone, the engine itself still doesn't profile
+    engine.predict(Tensor({16}, std::vector<float>(16, 1.0f)));
+    EXPECT_TRUE(engine.getLastInferenceStats().layer_times.empty());
+
+    std::ostringstream table;
+    report.print(table);
+    EXPECT_NE(table.str().find("Linear+Softmax"), std::string::npos);
+    EXPECT_NE(table.str().find("total"), std::string::npos);
+
+    std::ostringstream json;
+    report.writeJson(json);
+    EXPECT_NE(json.str().find("\"name\": \"Linear+ReLU\", \"flops\": 272"), std::string::npos);
+    EXPECT_NE(json.str().find("\"ridge_point\": 10"), std::string::npos);
+
+    // unfused, every layer is its own pass
+    engine.enableFusion(false);
+    EXPECT_EQ(measureRoofline(engine, peak, 1, 2).layers.size(), 4U);
+}
+
+TEST(RooflineTest, BatchesScaleTheWork)
+{
+    InferenceEngine engine(makeModel());
+    const RooflineReport report = measureRoofline(engine, MachinePeak(), 8, 5);
+    EXPECT_EQ(report.input_shape, std::vector<size_t>({8, 16}));
+    ASSERT_EQ(report.layers.size(), 2U);
+    EXPECT_EQ(report.layers[0].flops, 8U * 272U);
+
+    EXPECT_THROW(measureRoofline(engine, MachinePeak(), 0, 5), std::invalid_argument);
+    EXPECT_THROW(measureRoofline(engine, MachinePeak(), 1, 0), std::invalid_argument);
+}
@@ -236,3 +236,25 @@ TEST_F(SoftmaxTest, VeryLargeNegativeValues)
     EXPECT_TRUE(checkProbabilityRange(tensor));
     EXPECT_TRUE(checkProbabilitySum(tensor));
 }
+
+TEST_F(SoftmaxTest, RowWiseSoftmax)
+{
+    // each row of a [batch, features] tensor is its own distribution
+    Tensor tensor({2, 3}, {1.0f, 2.0f, 3.0f,
+                           1.0f, 2.0f, 3.0f});
+    Tensor single({3}, {1.0f, 2.0f, 3.0f});
+    
+    TensorOps::softmax_rows(tensor);
+    TensorOps::softmax(single);
+    
+    for (size_t row = 0; row < 2; ++row)
+    {
+        float sum = 0.0f;
+        for (size_t col = 0; col < 3; ++col)
+        {
+            EXPECT_NEAR(tensor.at({row, col}), single.at({col}), 1e-6f);
+            sum += tensor.at({row, col});
+        }
+        EXPECT_NEAR(sum, 1.0f, 1e-6f);
+    }
+}
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 #include "tensor.h"
+#include <cmath>
+#include <cstdint>
 #include <vector>
 #include <stdexcept>
 
@@ -181,6 +183,240 @@ TEST_F(TensorTest, WrongRankAccess)
     EXPECT_THROW(t.at({0, 0, 0}), std::invalid_argument); // too many indices
 }
 
+// testing allocation free indexing
+TEST_F(TensorTest, Strides) 
+{
+    Tensor t(shape3d);
+    EXPECT_EQ(t.strides(), std::vector<size_t>({12, 4, 1}));
+    
+    t.reshape({4, 6});
+    EXPECT_EQ(t.strides(), std::vector<size_t>({6, 1}));
+}
+
+TEST_F(TensorTest, VariadicElementAccess) 
+{
+    Tensor t(shape2d, data_2x3);
+    EXPECT_FLOAT_EQ(t.at(0, 0), 1.0f);
+    EXPECT_FLOAT_EQ(t.at(0, 2), 3.0f);
+    EXPECT_FLOAT_EQ(t.at(1, 2), 6.0f);
+    
+    t.at(1, 1) = 42.0f;
+    EXPECT_FLOAT_EQ(t.at({1, 1}), 42.0f);
+    
+    const Tensor& ct = t;
+    EXPECT_FLOAT_EQ(ct.at(1, 0), 4.0f);
+}
+
+TEST_F(TensorTest, VariadicAccessErrors) 
+{
+    Tensor t(shape2d);
+    EXPECT_THROW(t.at(2, 0), std::out_of_range);
+    EXPECT_THROW(t.at(0, 3), std::out_of_range);
+    EXPECT_THROW(t.at(0), std::invalid_argument);
+    EXPECT_THROW(t.at(0, 0, 0), std::invalid_argument);
+}
+
+TEST_F(TensorTest, FastElementAccess) 
+{
+    Tensor t(shape3d);
+    for (size_t i = 0; i < t.size(); ++i)
+    {
+        t.data()[i] = static_cast<float>(i);
+    }
+    
+    // t(i, j, k) must agree with the checked accessors
+    EXPECT_FLOAT_EQ(t(1, 2, 3), t.at({1, 2, 3}));
+    EXPECT_FLOAT_EQ(t(0, 1, 0), 4.0f);
+    
+    t(1, 0, 0) = -1.0f;
+    EXPECT_FLOAT_EQ(t.data()[12], -1.0f);
+}
+
+#ifndef NDEBUG
+TEST_F(TensorTest, FastAccessCheckedInDebug) 
+{
+    Tensor t(shape2d);
+    EXPECT_THROW(t(2, 0), std::out_of_range);
+    EXPECT_THROW(t(0), std::invalid_argument);
+}
+#endif
+
+// testing non-owning views
+TEST_F(TensorTest, View) 
+{
+    std::vector<float> memory(data_2x3);
+    Tensor view = Tensor::view(memory.data(), shape2d);
+    
+    EXPECT_TRUE(view.isView());
+    EXPECT_EQ(view.data(), memory.data());
+    EXPECT_FLOAT_EQ(view(1, 2), 6.0f);
+    
+    // writes land in the viewed memory
+    view(0, 0) = 10.0f;
+    EXPECT_FLOAT_EQ(memory[0], 10.0f);
+    
+    // copies own their data
+    Tensor copy(view);
+    EXPECT_FALSE(copy.isView());
+    EXPECT_NE(copy.data(), memory.data());
+    
+    EXPECT_THROW(Tensor::view(nullptr, shape2d), std::invalid_argument);
+}
+
+TEST_F(TensorTest, CopyAssignmentReusesBuffer) 
+{
+    Tensor source(shape2d, data_2x3);
+    
+    // same element count -> same buffer, new shape
+    Tensor target({3, 2});
+    const float* buffer = target.data();
+    target = source;
+    EXPECT_EQ(target.data(), buffer);
+    EXPECT_EQ(target.shape(), shape2d);
+    EXPECT_FLOAT_EQ(target(1, 2), 6.0f);
+    
+    // assigning into a view writes through it
+    std::vector<float> memory(6, 0.0f);
+    Tensor view = Tensor::view(memory.data(), {6});
+    view = source;
+    EXPECT_TRUE(view.isView());
+    EXPECT_FLOAT_EQ(memory[5], 6.0f);
+    
+    // a different size needs new storage
+    Tensor small({2});
+    small = source;
+    EXPECT_FALSE(small.isView());
+    EXPECT_EQ(small.size(), 6U);
+}
+
+// testing dtype aware storage
+TEST_F(TensorTest, ByteSizes) 
+{
+    EXPECT_EQ(Tensor::byteSize(DataType::FLOAT32, 5), 20U);
+    EXPECT_EQ(Tensor::byteSize(DataType::FLOAT16, 5), 10U);
+    EXPECT_EQ(Tensor::byteSize(DataType::BFLOAT16, 5), 10U);
+    EXPECT_EQ(Tensor::byteSize(DataType::INT8, 5), 5U);
+    EXPECT_EQ(Tensor::byteSize(DataType::INT4, 5), 3U);
+    
+    Tensor t(shape3d, DataType::FLOAT16);
+    EXPECT_EQ(t.size(), 24U);
+    EXPECT_EQ(t.byteSize(), 48U);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(t.raw()) % Tensor::ALIGNMENT, 0U);
+}
+
+TEST_F(TensorTest, TypedAccess) 
+{
+    Tensor bytes(shape2d, DataType::INT8);
+    bytes.data<int8_t>()[5] = -7;
+    EXPECT_EQ(static_cast<const int8_t*>(bytes.raw())[5], -7);
+    EXPECT_EQ(bytes.data<int8_t>()[0], 0);     // zero initialized
+    
+    // asking for the wrong element type throws
+    EXPECT_THROW(bytes.data<float>(), std::invalid_argument);
+    EXPECT_THROW(bytes.data<Float16>(), std::invalid_argument);
+    EXPECT_THROW(bytes.at(0, 0), std::invalid_argument);
+    
+    Tensor halves(shape2d, DataType::BFLOAT16);
+    EXPECT_NO_THROW(halves.data<BFloat16>());
+    EXPECT_THROW(halves.data<Float16>(), std::invalid_argument);
+    
+    // arithmetic is float only
+    Tensor other(shape2d, DataType::INT8);
+    EXPECT_THROW(bytes += other, std::invalid_argument);
+}
+
+TEST_F(TensorTest, HalfConversionRoundTrip) 
+{
+    const Tensor source(shape2d, {1.0f, -2.5f, 0.0f, 65504.0f, 1e-3f, 3.14159f});
+    
+    const Tensor half = source.to(DataType::FLOAT16);
+    EXPECT_EQ(half.dtype(), DataType::FLOAT16);
+    EXPECT_EQ(half.shape(), shape2d);
+    EXPECT_EQ(half.data<Float16>()[0].bits, 0x3c00);
+    EXPECT_EQ(half.data<Float16>()[1].bits, 0xc100);
+    
+    const Tensor back = half.to(DataType::FLOAT32);
+    for (size_t i = 0; i < source.size(); ++i)
+    {
+        EXPECT_NEAR(back.data()[i], source.data()[i], std::abs(source.data()[i]) * 1e-3f);
+    }
+    
+    const Tensor brain = source.to(DataType::BFLOAT16);
+    EXPECT_EQ(brain.data<BFloat16>()[0].bits, 0x3f80);
+    const Tensor brain_back = brain.to(DataType::FLOAT32);
+    for (size_t i = 0; i < source.size(); ++i)
+    {
+        EXPECT_NEAR(brain_back.data()[i], source.data()[i], std::abs(source.data()[i]) * 1e-2f);
+    }
+    
+    // fp16 -> bf16 goes through float
+    const Tensor cross = half.to(DataType::BFLOAT16).to(DataType::FLOAT32);
+    EXPECT_FLOAT_EQ(cross.data()[1], -2.5f);
+}
+
+TEST_F(TensorTest, IntegerConversions) 
+{
+    const Tensor source({7}, {0.4f, -0.6f, 3.5f, 200.0f, -200.0f, 7.2f, -9.0f});
+    
+    const Tensor bytes = source.to(DataType::INT8);
+    const int8_t* q8 = bytes.data<int8_t>();
+    EXPECT_EQ(q8[0], 0);
+    EXPECT_EQ(q8[1], -1);
+    EXPECT_EQ(q8[2], 4);
+    EXPECT_EQ(q8[3], 127);      // saturates
+    EXPECT_EQ(q8[4], -128);
+    
+    // int4 packs two per byte, an odd count leaves the last high nibble empty
+    const Tensor nibbles = source.to(DataType::INT4);
+    EXPECT_EQ(nibbles.byteSize(), 4U);
+    const Tensor unpacked = nibbles.to(DataType::FLOAT32);
+    const std::vector<float> expected = {0.0f, -1.0f, 4.0f, 7.0f, -8.0f, 7.0f, -8.0f};
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        EXPECT_FLOAT_EQ(unpacked.data()[i], expected[i]) << i;
+    }
+    EXPECT_EQ(nibbles.data<uint8_t>()[0], 0xf0);   // 0 low, -1 high
+    
+    // a non-float dtype given float data converts it on the way in
+    const Tensor direct({7}, {0.4f, -0.6f, 3.5f, 200.0f, -200.0f, 7.2f, -9.0f}, DataType::INT8);
+    EXPECT_EQ(direct.data<int8_t>()[3], 127);
+    
+    // the default constructed tensor has nothing to convert
+    EXPECT_THROW(Tensor().to(DataType::FLOAT16), std::invalid_argument);
+}
+
+TEST_F(TensorTest, TypedViewsAndCopies) 
+{
+    std::vector<uint16_t> memory = {0x3c00, 0x4000, 0x4200, 0x4400};
+    Tensor view = Tensor::view(memory.data(), {2, 2}, DataType::FLOAT16);
+    EXPECT_TRUE(view.isView());
+    EXPECT_FLOAT_EQ(view.to(DataType::FLOAT32).at(1, 1), 4.0f);
+    
+    // copies keep the dtype and own their bytes
+    Tensor copy(view);
+    EXPECT_FALSE(copy.isView());
+    EXPECT_EQ(copy.dtype(), DataType::FLOAT16);
+    EXPECT_EQ(copy.data<Float16>()[2].bits, 0x4200);
+    
+    // assigning another dtype takes its type, size and bytes into a buffer of its own
+    Tensor floats({2, 2});
+    floats = copy;
+    EXPECT_EQ(floats.dtype(), DataType::FLOAT16);
+    EXPECT_EQ(floats.byteSize(), 4 * sizeof(Float16));
+    for (size_t i = 0; i < 4; ++i)
+    {
+        EXPECT_EQ(floats.data<Float16>()[i].bits, memory[i]);
+    }
+    floats.data<Float16>()[0].bits = 0x4800;
+    EXPECT_EQ(copy.data<Float16>()[0].bits, 0x3c00);
+    
+    // same dtype and size writes through the view
+    copy.data<Float16>()[3].bits = 0x4500;
+    view = copy;
+    EXPECT_TRUE(view.isView());
+    EXPECT_EQ(memory[3], 0x4500);
+}
+
 // Test reshaping
 TEST_F(TensorTest, ValidReshape) 
 {
@@ -0,0 +1,133 @@
+/* thread_pool_test.cpp
+ *
+ * Tests for the work-stealing ThreadPool and the multi-threaded gemm built on it.
+ */
+
+#include <gtest/gtest.h>
+#include "thread_pool.h"
+#include "gemm.h"
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace mininn;
+
+TEST(ThreadPoolTest, Size)
+{
+    ThreadPool pool(4);
+    EXPECT_EQ(pool.size(), 4u);
+
+    ThreadPool single(1);
+    EXPECT_EQ(single.size(), 1u);
+
+    ThreadPool hardware;
+    EXPECT_EQ(hardware.size(), ThreadPool::hardwareThreads());
+}
+
+TEST(ThreadPoolTest, ParallelForCoversRangeOnce)
+{
+    ThreadPool pool(4);
+
+    for (size_t count : {0u, 1u, 7u, 100u, 1001u})
+    {
+        std::vector<std::atomic<int>> hits(count);
+        pool.parallelFor(count, 3, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                hits[i].fetch_add(1);
+            }
+        });
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            ASSERT_EQ(hits[i].load(), 1) << "count=" << count << " i=" << i;
+        }
+    }
+}
+
+TEST(ThreadPoolTest, SingleThreadRunsInline)
+{
+    ThreadPool pool(1);
+
+    size_t calls = 0;
+    pool.parallelFor(50, 1, [&](size_t begin, size_t end)
+    {
+        ++calls;
+        EXPECT_EQ(begin, 0u);
+        EXPECT_EQ(end, 50u);
+    });
+    EXPECT_EQ(calls, 1u);
+}
+
+TEST(ThreadPoolTest, NestedParallelFor)
+{
+    // inner loops run on pool threads that are themselves waiting on the outer loop
+    ThreadPool pool(3);
+    std::atomic<size_t> total(0);
+
+    pool.parallelFor(8, 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            pool.parallelFor(100, 10, [&](size_t inner_begin, size_t inner_end)
+            {
+                total.fetch_add(inner_end - inner_begin);
+            });
+        }
+    });
+
+    EXPECT_EQ(total.load(), 800u);
+}
+
+TEST(ThreadPoolTest, ExceptionsReachCaller)
+{
+    ThreadPool pool(4);
+    std::atomic<size_t> finished(0);
+
+    EXPECT_THROW(pool.parallelFor(64, 1, [&](size_t begin, size_t)
+    {
+        if (begin == 32)
+        {
+            throw std::runtime_error("chunk failed");
+        }
+        finished.fetch_add(1);
+    }), std::runtime_error);
+
+    // the pool is still usable afterwards
+    std::atomic<size_t> count(0);
+    pool.parallelFor(10, 1, [&](size_t begin, size_t end) { count.fetch_add(end - begin); });
+    EXPECT_EQ(count.load(), 10u);
+}
+
+TEST(ThreadPoolTest, PinnedPoolRuns)
+{
+    ThreadPool pool(2, true);
+    std::atomic<size_t> count(0);
+    pool.parallelFor(100, 1, [&](size_t begin, size_t end) { count.fetch_add(end - begin); });
+    EXPECT_EQ(count.load(), 100u);
+}
+
+TEST(ThreadPoolTest, ParallelGemmMatchesSerial)
+{
+    ThreadPool pool(4);
+
+    // tall (row split), short and wide (column split), and gemv shapes
+    const std::vector<std::vector<size_t>> shapes = {{200, 70, 90}, {5, 600, 300}, {1, 2000, 300}};
+    for (const auto& shape : shapes)
+    {
+        const size_t m = shape[0], n = shape[1], k = shape[2];
+        std::vector<float> a(m * k), b(k * n);
+        for (size_t i = 0; i < a.size(); ++i) a[i] = static_cast<float>((i * 13) % 17) / 17.0f - 0.5f;
+        for (size_t i = 0; i < b.size(); ++i) b[i] = static_cast<float>((i * 7) % 19) / 19.0f - 0.5f;
+
+        std::vector<float> expected(m * n), actual(m * n, -1.0f);
+        Gemm::sgemm(m, n, k, a.data(), k, b.data(), n, expected.data(), n);
+        Gemm::sgemm(m, n, k, a.data(), k, b.data(), n, actual.data(), n, &pool);
+
+        for (size_t i = 0; i < m * n; ++i)
+        {
+            ASSERT_NEAR(actual[i], expected[i], 1e-4f) << "m=" << m << " n=" << n << " i=" << i;
+        }
+    }
+}
@@ -0,0 +1,360 @@
+/* tracer_test.cpp
+ *
+ * Tests for the Tracer: the Chrome trace JSON it writes, ring buffer
+ * wraparound, and the spans the engine, the loader and the batcher record.
+ */
+
+#include <gtest/gtest.h>
+#include "dynamic_batcher.h"
+#include "inference_engine.h"
+#include "tracer.h"
+#include <cctype>
+#include <cstdio>
+#include <future>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace mininn;
+
+namespace
+{
+    std::string toJson(const Tracer& tracer)
+    {
+        std::ostringstream out;
+        tracer.writeJson(out);
+        return out.str();
+    }
+
+    size_t countOf(const std::string& text, const std::string& needle)
+    {
+        size_t count = 0;
+        for (size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1))
+        {
+            ++count;
+        }
+        return count;
+    }
+
+    // minimal JSON grammar check: one value at pos, skipping whitespace around it
+    bool parseValue(const std::string& text, size_t& pos);
+
+    void skipSpace(const std::string& text, size_t& pos)
+    {
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+        {
+            ++pos;
+        }
+    }
+
+    bool parseString(const std::string& text, size_t& pos)
+    {
+        if (pos >= text.size() || text[pos] != '"')
+        {
+            return false;
+        }
+        for (++pos; pos < text.size(); ++pos)
+        {
+            if (text[pos] == '\\')
+            {
+                ++pos;
+            }
+            else if (text[pos] == '"')
+            {
+                ++pos;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // object or array, members are "key": value for objects and plain values for arrays
+    bool parseContainer(const std::string& text, size_t& pos, char close, bool keyed)
+    {
+        ++pos;
+        skipSpace(text, pos);
+        if (pos < text.size() && text[pos] == close)
+        {
+            ++pos;
+            return true;
+        }
+        while (true)
+        {
+            skipSpace(text, pos);
+            if (keyed)
+            {
+                if (!parseString(text, pos))
+                {
+                    return false;
+                }
+                skipSpace(text, pos);
+                if (pos >= text.size() || text[pos++] != ':')
+                {
+                    return false;
+                }
+            }
+            if (!parseValue(text, pos))
+            {
+                return false;
+            }
+            if (pos >= text.size())
+            {
+                return false;
+            }
+            const char next = text[pos++];
+            if (next == close)
+            {
+                return true;
+            }
+            if (next != ',')
+            {
+                return false;
+            }
+        }
+    }
+
+    bool parseValue(const std::string& text, size_t& pos)
+    {
+        skipSpace(text, pos);
+        if (pos >= text.size())
+        {
+            return false;
+        }
+        bool parsed = false;
+        if (text[pos] == '{')
+        {
+            parsed = parseContainer(text, pos, '}', true);
+        }
+        else if (text[pos] == '[')
+        {
+            parsed = parseContainer(text, pos, ']', false);
+        }
+        else if (text[pos] == '"')
+        {
+            parsed = parseString(text, pos);
+        }
+        else
+        {
+            // numbers, true, false and null
+            const size_t start = pos;
+            while (pos < text.size() && (std::isalnum(static_cast<unsigned char>(text[pos])) ||
+                                         text[pos] == '-' || text[pos] == '+' || text[pos] == '.'))
+            {
+                ++pos;
+            }
+            parsed = pos > start;
+        }
+        skipSpace(text, pos);
+        return parsed;
+    }
+
+    bool isValidJson(const std::string& text)
+    {
+        size_t pos = 0;
+        return parseValue(text, pos) && pos == text.size();
+    }
+
+    // linear -> relu -> linear -> softmax, relu and softmax fuse into the linears
+    std::shared_ptr<const Model> makeModel()
+    {
+        const size_t in = 16, hidden = 8, out = 4;
+        std::vector<float> w1(in * hidden), b1(hidden, 0.1f), w2(hidden * out), b2(out, 0.0f);
+        for (size_t i = 0; i < w1.size(); ++i) w1[i] = static_cast<float>(i % 7) / 7.0f - 0.4f;
+        for (size_t i = 0; i < w2.size(); ++i) w2[i] = static_cast<float>(i % 5) / 5.0f - 0.3f;
+
+        auto model = std::make_unique<Model>();
+        model->addLayer(std::make_unique<LinearLayer>(Tensor({in, hidden}, w1), Tensor({hidden}, b1)));
+        model->addLayer(std::make_unique<ReLULayer>());
+        model->addLayer(std::make_unique<LinearLayer>(Tensor({hidden, out}, w2), Tensor({out}, b2)));
+        model->addLayer(std::make_unique<SoftmaxLayer>());
+        model->setInputShape({in});
+        model->setOutputShape({out});
+        return model;
+    }
+}
+
+TEST(TracerTest, WritesCompleteEvents)
+{
+    Tracer tracer(8);
+    const auto start = Tracer::Clock::now();
+    tracer.record("work", "test", start, start + std::chrono::microseconds(1500), "\"n\":3");
+    tracer.record("idle", "test", start, start);
+
+    EXPECT_EQ(tracer.size(), 2U);
+    EXPECT_EQ(tracer.dropped(), 0U);
+
+    const std::string json = toJson(tracer);
+    EXPECT_EQ(json.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0), 0U);
+    EXPECT_NE(json.find("\"name\":\"work\",\"cat\":\"test\",\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(json.find("\"dur\":1500.000,\"args\":{\"n\":3}"), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"idle\""), std::string::npos);
+    EXPECT_NE(json.find("\"tid\":" + std::to_string(Tracer::currentThreadId())), std::string::npos);
+    EXPECT_LT(json.find("\"work\""), json.find("\"idle\""));
+
+    tracer.clear();
+    EXPECT_EQ(tracer.size(), 0U);
+    EXPECT_EQ(toJson(tracer), "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n]}\n");
+    EXPECT_THROW(Tracer(0), std::invalid_argument);
+}
+
+TEST(TracerTest, RingKeepsNewestEvents)
+{
+    static const char* names[] = {"e0", "e1", "e2", "e3", "e4", "e5", "e6", "e7", "e8", "e9"};
+    Tracer tracer(4);
+    for (const char* name : names)
+    {
+        TraceSpan span(&tracer, name, "test");
+    }
+
+    EXPECT_EQ(tracer.size(), 4U);
+    EXPECT_EQ(tracer.dropped(), 6U);
+
+    // the last four, oldest first
+    const std::string json = toJson(tracer);
+    EXPECT_EQ(json.find("\"e5\""), std::string::npos);
+    size_t previous = 0;
+    for (size_t i = 6; i < 10; ++i)
+    {
+        const size_t pos = json.find(std::string("\"") + names[i] + "\"");
+        ASSERT_NE(pos, std::string::npos) << names[i];
+        EXPECT_GT(pos, previous);
+        previous = pos;
+    }
+}
+
+TEST(TracerTest, ThreadsGetTheirOwnTracks)
+{
+    Tracer tracer(64);
+    std::vector<uint32_t> ids(3);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < ids.size(); ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            ids[t] = Tracer::currentThreadId();
+            for (int i = 0; i < 10; ++i)
+            {
+                TraceSpan span(&tracer, "work", "test");
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(tracer.size(), 30U);
+    EXPECT_NE(ids[0], ids[1]);
+    EXPECT_NE(ids[1], ids[2]);
+    const std::string json = toJson(tracer);
+    for (uint32_t id : ids)
+    {
+        EXPECT_EQ(countOf(json, "\"tid\":" + std::to_string(id) + ","), 10U);
+    }
+}
+
+TEST(TracerTest, OversizedArgsAreDropped)
+{
+    Tracer tracer(8);
+    const auto start = Tracer::Clock::now();
+    const std::string fits(Tracer::ARGS_SIZE - 16, 'x');
+    const std::string too_long(Tracer::ARGS_SIZE, 'y');
+
+    // cut off anywhere, args this long would end inside the string
+    tracer.record("long", "test", start, start, ("\"s\":\"" + too_long + "\"").c_str());
+    tracer.record("fits", "test", start, start, ("\"s\":\"" + fits + "\"").c_str());
+    {
+        TraceSpan span(&tracer, "span", "test");
+        span.setArgs("\"n\":%d,\"s\":\"%s\"", 1, too_long.c_str());
+    }
+
+    const std::string json = toJson(tracer);
+    EXPECT_TRUE(isValidJson(json)) << json;
+    EXPECT_EQ(json.find("yyyy"), std::string::npos);
+    EXPECT_NE(json.find("\"args\":{\"s\":\"" + fits + "\"}"), std::string::npos);
+    EXPECT_EQ(countOf(json, "\"args\":{}"), 2U);
+}
+
+TEST(TracerTest, NullTracerRecordsNothing)
+{
+    TraceSpan span(nullptr, "work", "test");
+    EXPECT_FALSE(span.active());
+    span.setArgs("\"n\":%d", 1);
+}
+
+TEST(TracerTest, EngineTracesLayers)
+{
+    InferenceEngine engine(makeModel());
+    auto tracer = std::make_shared<Tracer>();
+    engine.setTracer(tracer);
+    EXPECT_EQ(engine.getTracer(), tracer);
+
+    Tensor input({16});
+    engine.predict(input);
+
+    // the fused relu and softmax are part of the linear spans
+    std::string json = toJson(*tracer);
+    EXPECT_EQ(countOf(json, "\"name\":\"predict\""), 1U);
+    EXPECT_EQ(countOf(json, "\"name\":\"Linear\""), 2U);
+    EXPECT_EQ(countOf(json, "\"name\":\"ReLU\""), 0U);
+    EXPECT_NE(json.find("\"layer\":0,\"in\":\"[16]\",\"out\":\"[8]\",\"flops\":272,\"fused\":\"ReLU\""),
+              std::string::npos);
+    EXPECT_NE(json.find("\"layer\":2,\"in\":\"[8]\",\"out\":\"[4]\",\"flops\":88,\"fused\":\"Softmax\""),
+              std::string::npos);
+
+    // unfused, every layer gets its own span; a new batch size plans its buffers first
+    tracer->clear();
+    engine.enableFusion(false);
+    engine.predictBatch(std::vector<Tensor>(3, input));
+    json = toJson(*tracer);
+    EXPECT_NE(json.find("\"name\":\"predict_batch\",\"cat\":\"engine\""), std::string::npos);
+    EXPECT_NE(json.find("\"args\":{\"batch_size\":3}"), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"plan\""), std::string::npos);
+    EXPECT_NE(json.find("\"in\":\"[3,16]\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"ReLU\",\"cat\":\"layer\""), std::string::npos);
+    EXPECT_NE(json.find("\"layer\":3,\"in\":\"[3,4]\",\"out\":\"[3,4]\",\"flops\":60"), std::string::npos);
+
+    // clones trace into the same tracer, and without one nothing is recorded
+    tracer->clear();
+    InferenceEngine copy = engine.clone();
+    copy.predict(input);
+    EXPECT_GT(tracer->size(), 0U);
+
+    tracer->clear();
+    engine.setTracer(nullptr);
+    engine.predict(input);
+    EXPECT_EQ(tracer->size(), 0U);
+}
+
+TEST(TracerTest, LoaderAndBatcherSpans)
+{
+    const std::string path = "tracer_test_model.minn";
+    ModelLoader::saveToFile(*makeModel(), path);
+
+    auto tracer = std::make_shared<Tracer>();
+    auto engine = createInferenceEngine(path, LoadMode::COPY, tracer);
+    std::remove(path.c_str());
+    EXPECT_EQ(engine->getTracer(), tracer);
+    EXPECT_NE(toJson(*tracer).find("\"name\":\"load_model\",\"cat\":\"load\""), std::string::npos);
+
+    tracer->clear();
+    {
+        DynamicBatcher batcher(*engine);
+        std::vector<std::future<Tensor>> results;
+        for (int i = 0; i < 4; ++i)
+        {
+            results.push_back(batcher.submit(Tensor({16})));
+        }
+        for (auto& result : results)
+        {
+            result.get();
+        }
+    }
+
+    // every request waited on the submitting thread's track
+    const std::string json = toJson(*tracer);
+    EXPECT_EQ(countOf(json, "\"name\":\"queue_wait\",\"cat\":\"batcher\",\"ph\":\"X\",\"pid\":1,\"tid\":" +
+                            std::to_string(Tracer::currentThreadId()) + ","), 4U);
+    EXPECT_GE(countOf(json, "\"name\":\"batch\""), 1U);
+    EXPECT_GE(countOf(json, "\"name\":\"predict_batch\""), 1U);
+}
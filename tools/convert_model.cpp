@@ -0,0 +1,150 @@
+/* convert_model.cpp
+ *
+ * Offline model conversion. Rewrites a float .minn model with int8 linear
+ * layers (per output channel weight scales), calibrating the activation
+ * scales on sample inputs when given, with int4 weight-only linear layers
+ * (one scale per group of weights, fp32 or 16-bit), or with linear weights
+ * stored as fp16 / bf16 (half the size, still computed in fp32).
+ *
+ * Usage: convert_model --int8 [--calibration samples.f32] input.minn output.minn
+ *        convert_model --int4 [--group-size N] [--fp16|--bf16] input.minn output.minn
+ *        convert_model --fp16|--bf16 input.minn output.minn
+ *   samples.f32 holds raw float32 inputs back to back (native byte order);
+ *   without it activations are scaled per row at run time.
+ *   N is a multiple of 32 (default 32); larger groups mean fewer scales.
+ *   With --int4, --fp16 / --bf16 store the group scales in that type.
+ */
+
+#include "model_loader.h"
+#include "quantization.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace mininn;
+
+namespace
+{
+    void printUsage(const char* program)
+    {
+        std::cerr << "Usage: " << program << " --int8 [--calibration samples.f32] input.minn output.minn\n"
+                  << "       " << program << " --int4 [--group-size N] [--fp16|--bf16] input.minn output.minn\n"
+                  << "       " << program << " --fp16|--bf16 input.minn output.minn\n";
+    }
+
+    long long fileSize(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        return file.is_open() ? static_cast<long long>(file.tellg()) : -1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool int8 = false;
+    bool int4 = false;
+    DataType half = DataType::FLOAT32;    // FLOAT16 / BFLOAT16 when converting weights (or int4 scales)
+    size_t group_size = Quantization::DEFAULT_INT4_GROUP_SIZE;
+    std::string calibration_path;
+    std::string paths[2];
+    size_t num_paths = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--int8") == 0)
+        {
+            int8 = true;
+        }
+        else if (std::strcmp(argv[i], "--int4") == 0)
+        {
+            int4 = true;
+        }
+        else if (std::strcmp(argv[i], "--fp16") == 0)
+        {
+            half = DataType::FLOAT16;
+        }
+        else if (std::strcmp(argv[i], "--bf16") == 0)
+        {
+            half = DataType::BFLOAT16;
+        }
+        else if (std::strcmp(argv[i], "--group-size") == 0 && i + 1 < argc)
+        {
+            group_size = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--calibration") == 0 && i + 1 < argc)
+        {
+            calibration_path = argv[++i];
+        }
+        else if (argv[i][0] != '-' && num_paths < 2)
+        {
+            paths[num_paths++] = argv[i];
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    const int modes = int8 + int4 + (half != DataType::FLOAT32 && !int4);
+    if (modes != 1 || num_paths != 2 || (!int8 && !calibration_path.empty()))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        auto model = ModelLoader::loadFromFile(paths[0]);
+
+        if (half != DataType::FLOAT32 && !int4)
+        {
+            auto converted = Quantization::convertWeights(*model, half);
+            ModelLoader::saveToFile(*converted, paths[1]);
+
+            std::cout << "Converted " << paths[0] << " (" << fileSize(paths[0]) << " bytes) -> "
+                      << paths[1] << " (" << fileSize(paths[1]) << " bytes), " << dataTypeName(half)
+                      << " linear weights\n";
+            return 0;
+        }
+
+        if (int4)
+        {
+            auto quantized = Quantization::quantizeInt4(*model, group_size, half);
+            ModelLoader::saveToFile(*quantized, paths[1]);
+
+            std::cout << "Quantized " << paths[0] << " (" << fileSize(paths[0]) << " bytes) -> "
+                      << paths[1] << " (" << fileSize(paths[1]) << " bytes), int4 weights in groups of "
+                      << group_size;
+            if (half != DataType::FLOAT32)
+            {
+                std::cout << ", " << dataTypeName(half) << " scales";
+            }
+            std::cout << "\n";
+            return 0;
+        }
+
+        std::vector<Tensor> samples;
+        if (!calibration_path.empty())
+        {
+            samples = Quantization::loadSamples(calibration_path, model->getInputShape());
+        }
+
+        auto quantized = Quantization::quantizeInt8(*model, samples);
+        ModelLoader::saveToFile(*quantized, paths[1]);
+
+        std::cout << "Quantized " << paths[0] << " (" << fileSize(paths[0]) << " bytes) -> "
+                  << paths[1] << " (" << fileSize(paths[1]) << " bytes), "
+                  << (samples.empty() ? std::string("dynamic activation scales")
+                                      : std::to_string(samples.size()) + " calibration samples")
+                  << "\n";
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}